@@ -0,0 +1,145 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "histogram.h"
+
+static int
+bucket_of(uint64_t v)
+{
+    int msb = 0, shift;
+
+    if (v < HISTOGRAM_SUB)
+	return (int) v;
+    while ((v >> msb) > 1)
+	++msb;
+    shift = msb - HISTOGRAM_SUB_BITS;
+    return (shift + 1) * HISTOGRAM_SUB + (int) ((v >> shift) - HISTOGRAM_SUB);
+}
+
+/* Smallest value counted in bucket b. */
+static uint64_t
+bucket_low(int b)
+{
+    int shift;
+
+    if (b < HISTOGRAM_SUB)
+	return b;
+    shift = b / HISTOGRAM_SUB - 1;
+    return (uint64_t) (HISTOGRAM_SUB + b % HISTOGRAM_SUB) << shift;
+}
+
+struct histogram *
+histogram_new(void)
+{
+    struct histogram *h;
+
+    h = (struct histogram *) malloc(sizeof(struct histogram));
+    if (h != NULL)
+	histogram_reset(h);
+    return h;
+}
+
+void
+histogram_free(struct histogram *h)
+{
+    free(h);
+}
+
+void
+histogram_reset(struct histogram *h)
+{
+    memset(h, 0, sizeof(struct histogram));
+}
+
+void
+histogram_add(struct histogram *h, uint64_t value)
+{
+    if (h->count == 0 || value < h->min)
+	h->min = value;
+    if (value > h->max)
+	h->max = value;
+    ++h->count;
+    h->sum += value;
+    ++h->buckets[bucket_of(value)];
+}
+
+void
+histogram_merge(struct histogram *dst, const struct histogram *src)
+{
+    int i;
+
+    if (src->count == 0)
+	return;
+    if (dst->count == 0 || src->min < dst->min)
+	dst->min = src->min;
+    if (src->max > dst->max)
+	dst->max = src->max;
+    dst->count += src->count;
+    dst->sum += src->sum;
+    for (i = 0; i < HISTOGRAM_BUCKETS; ++i)
+	dst->buckets[i] += src->buckets[i];
+}
+
+double
+histogram_mean(const struct histogram *h)
+{
+    if (h->count == 0)
+	return 0.0;
+    return h->sum / h->count;
+}
+
+uint64_t
+histogram_quantile(const struct histogram *h, double q)
+{
+    uint64_t rank, seen = 0, v;
+    int i;
+
+    if (h->count == 0)
+	return 0;
+    if (q <= 0.0)
+	return h->min;
+    if (q >= 1.0)
+	return h->max;
+    rank = (uint64_t) (q * h->count);
+    if (rank < 1)
+	rank = 1;
+    for (i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+	seen += h->buckets[i];
+	if (seen >= rank)
+	    break;
+    }
+    /* Report the bucket's upper end, within the range actually seen. */
+    v = i + 1 < HISTOGRAM_BUCKETS ? bucket_low(i + 1) - 1 : h->max;
+    if (v > h->max)
+	v = h->max;
+    if (v < h->min)
+	v = h->min;
+    return v;
+}
@@ -0,0 +1,64 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __HISTOGRAM_H
+#define __HISTOGRAM_H
+
+#include <stdint.h>
+
+/*
+** A log-linear histogram of unsigned values (e.g. latencies in
+** microseconds).  Values below HISTOGRAM_SUB are counted exactly; above
+** that, each power of two is split into HISTOGRAM_SUB buckets, so a
+** bucket is never wider than 1/HISTOGRAM_SUB of its values.
+*/
+enum {
+    HISTOGRAM_SUB_BITS = 4,
+    HISTOGRAM_SUB = 1 << HISTOGRAM_SUB_BITS,
+    HISTOGRAM_BUCKETS = (64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB
+};
+
+struct histogram
+{
+    uint64_t count;
+    uint64_t min, max;
+    double sum;
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+};
+
+struct histogram *histogram_new(void);
+void histogram_free(struct histogram *h);
+void histogram_reset(struct histogram *h);
+void histogram_add(struct histogram *h, uint64_t value);
+void histogram_merge(struct histogram *dst, const struct histogram *src);
+
+/* Mean of the values added, 0 if there are none. */
+double histogram_mean(const struct histogram *h);
+
+/* Value at or below which the fraction q (0..1) of the values lie. */
+uint64_t histogram_quantile(const struct histogram *h, double q);
+
+#endif /* __HISTOGRAM_H */
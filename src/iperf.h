@@ -46,6 +46,7 @@
 #include "timer.h"
 #include "queue.h"
 #include "cjson.h"
+#include "histogram.h"
 
 typedef uint64_t iperf_size_t;
 
@@ -79,6 +80,35 @@ struct iperf_interval_results
     TAILQ_ENTRY(iperf_interval_results) irlistentries;
     void     *custom_data;
     int rtt;
+
+    /* for --rr, latencies in usec */
+    iperf_size_t interval_transactions;
+    double    latency_mean;
+    uint64_t  latency_p50;
+    uint64_t  latency_p99;
+    uint64_t  latency_max;
+
+    /* for --verify, blocks checked and found corrupted */
+    iperf_size_t interval_verified;
+    iperf_size_t interval_corrupted;
+
+    /* for --udp-timestamps, one-way delays in nsec */
+    iperf_size_t owd_count;
+    double    owd_mean;
+    uint64_t  owd_min;
+    uint64_t  owd_p50;
+    uint64_t  owd_p99;
+    uint64_t  owd_max;
+
+    /* for UDP, anomalies other than loss, and the first one seen */
+    iperf_size_t interval_duplicates;
+    iperf_size_t interval_late;
+    int       seq_event;		/* there was one */
+    uint64_t  event_pcount;		/* ... this datagram, */
+    uint64_t  event_highest;		/* ... arriving after this one */
+
+    /* for UDP receivers, datagrams the socket dropped for want of buffer */
+    iperf_size_t interval_socket_drops;
 };
 
 struct iperf_stream_result
@@ -100,6 +130,7 @@ struct iperf_stream_result
     struct timeval start_time;
     struct timeval end_time;
     struct timeval start_time_fixed;
+    iperf_size_t bytes_sent_fixed;	/* bytes_sent at start_time_fixed, for pacing */
     TAILQ_HEAD(irlisthead, iperf_interval_results) interval_results;
     void     *data;
 };
@@ -141,9 +172,24 @@ struct iperf_stream
     struct iperf_stream_result *result;	/* structure pointer to result */
     Timer     *send_timer;
     int       green_light;
+    int       paused;		/* not sending, see "parallel" parameter changes */
+    int       sender;		/* this stream sends; differs between streams with --bidir */
     int       buffer_fd;	/* data to send, file descriptor */
     char      *buffer;		/* data to send, mmapped */
+    int       buffer_size;	/* size of the mmapped buffer */
+    int       buffer_shared;	/* buffer is the test's read-only payload */
     int       diskfile_fd;	/* file to send, file descriptor */
+    struct iperf_diskfile *diskfile;	/* -F read-ahead/write-behind, NULL otherwise */
+    struct iperf_rr_stream *rr;	/* --rr state, NULL otherwise */
+    struct iperf_profile_stream *profile;	/* --profile state, NULL otherwise */
+    int       send_size;	/* size of the next send if nonzero, else blksize */
+    struct iperf_size_mix_stream *size_mix;	/* --size-mix counts, NULL otherwise */
+    struct iperf_verify_stream *verify;	/* --verify counts, NULL otherwise */
+    struct iperf_timestamp_stream *timestamp;	/* --udp-timestamps state, NULL otherwise */
+    struct iperf_seq_stream *seq;	/* UDP sequence tracking, NULL for TCP */
+    struct iperf_drops_stream *drops;	/* UDP kernel drop counts, NULL for TCP */
+    int       incoming_cpu;	/* --busy-poll: CPU its packets were processed on */
+    struct iperf_packet_stream *packet;	/* --af-packet TX ring, NULL otherwise */
 
     /*
      * for udp measurements - This can be a structure outside stream, and
@@ -198,6 +244,271 @@ struct xbind_entry {
     TAILQ_ENTRY(xbind_entry) link;
 };
 
+#define MAX_CAPACITY_TRIALS 64
+
+struct iperf_capacity_trial {
+    uint64_t  rate;			/* offered load, bits/sec over all streams */
+    double    throughput;		/* received, bits/sec */
+    int       packets;
+    int       lost;
+    double    jitter;
+    int       pass;
+};
+
+struct iperf_capacity_search {
+    double    max_loss;			/* acceptable loss, percent */
+    uint64_t  low, high;		/* per-stream rates known to pass, to fail */
+    int       settle;			/* intervals to skip before measuring */
+    int       converged;
+    int       ntrials;
+    struct iperf_capacity_trial trials[MAX_CAPACITY_TRIALS];
+};
+
+#define RR_HEADER_LEN 12	/* send time and id of a request, echoed in its response */
+
+/* One short-lived connection of --crr. */
+struct iperf_rr_conn {
+    int       fd;			/* -1 when free */
+    int       connected;
+    int       pos;			/* bytes read of the request or response */
+    int       sent;			/* bytes written of the cookie and request, or the response */
+    struct iperf_stream *sp;		/* server: the stream being answered, NULL while reading */
+    struct timeval start;		/* connect() (client) */
+    char      head[COOKIE_SIZE + RR_HEADER_LEN];	/* cookie and request header */
+    SLIST_ENTRY(iperf_rr_conn) conns;
+};
+
+struct iperf_rr {
+    int       request_size;
+    int       response_size;
+    int       outstanding;		/* transactions in flight per stream */
+    int       crr;			/* a new connection for each transaction */
+    struct histogram *interval;		/* latencies of all streams, this interval */
+    struct histogram *total;		/* ... and over the test, less omitted intervals */
+    SLIST_HEAD(rrconnlisthead, iperf_rr_conn) conns;	/* accepted --crr connections (server) */
+};
+
+struct iperf_rr_stream {
+    char     *message;			/* request (client) or response (server) to send */
+    int       rx_pos;			/* bytes read of the incoming message */
+    char      rx_header[RR_HEADER_LEN];	/* ... and its header */
+    int       tx_len;			/* size of the message being sent, 0 if none */
+    int       tx_pos;			/* ... and bytes of it written so far */
+    char     *tx_headers;		/* server: headers of the requests still to answer, */
+    int       tx_first, tx_queued;	/* ... a ring of `outstanding` */
+    int       inflight;
+    uint32_t  next_id;
+    struct timeval last_progress;	/* last response or first request (UDP loss) */
+    iperf_size_t interval_transactions;
+    iperf_size_t transactions;
+    iperf_size_t lost;			/* UDP requests given up on */
+    struct histogram *interval;		/* latencies this interval */
+    struct histogram *latency;		/* ... and over the test */
+    struct iperf_rr_conn *conns;	/* --crr connections in flight (client) */
+};
+
+#define PROFILE_POISSON 1
+#define PROFILE_ONOFF 2
+#define PROFILE_TRACE 3
+
+struct iperf_profile {
+    int       type;
+    char     *spec;			/* as given on the command line */
+    double    on, off;			/* PROFILE_ONOFF periods, seconds */
+    int       ntrace;			/* PROFILE_TRACE packets, ... */
+    double   *trace_time;		/* ... when to send them, seconds into the trace, ... */
+    int      *trace_size;		/* ... their sizes, ... */
+    double    trace_period;		/* ... and when the trace starts over */
+};
+
+struct iperf_profile_stream {
+    struct timeval start;
+    double    next;			/* when the next send is due, seconds from start */
+    int       trace_pos;
+    int       trace_pass;
+    Timer    *timer;			/* wakes the stream up at `next` */
+    iperf_size_t sends;
+    double    late_total;		/* seconds the sends were behind schedule */
+    double    late_max;
+};
+
+#define MAX_SIZE_MIX 16		/* datagram size classes */
+#define MIN_SIZE_MIX_SIZE 16	/* room for the UDP header with 64-bit counters */
+#define SIZE_MIX_TABLE 4096	/* about this many sizes are drawn up front */
+
+struct iperf_size_mix {
+    char     *spec;			/* as given on the command line */
+    int       nclasses;
+    int       size[MAX_SIZE_MIX];
+    int       weight[MAX_SIZE_MIX];
+    int       cycle;			/* length of table, a multiple of the total weight */
+    int      *table;			/* size of datagram n is table[(n - 1) % cycle] ... */
+    unsigned char *class_of;		/* ... and its class class_of[(n - 1) % cycle] */
+};
+
+struct iperf_size_mix_stream {
+    iperf_size_t count[MAX_SIZE_MIX];	/* datagrams sent or received, per class */
+    iperf_size_t peer[MAX_SIZE_MIX];	/* (sender) datagrams the receiver got */
+};
+
+/* The payload every sending stream sends from (see iperf_payload.h). */
+struct iperf_payload {
+    char     *buffer;
+    int       fd;
+    int       size;
+};
+
+/* --payload: what the payload looks like to a compressor. */
+#define PAYLOAD_RANDOM 0	/* incompressible, the default */
+#define PAYLOAD_ZEROS 1
+#define PAYLOAD_PATTERN 2	/* a short random block, repeated */
+#define PAYLOAD_TEXT 3		/* words and sentences */
+#define PAYLOAD_RATIO 4		/* compresses about ratio to one */
+
+struct iperf_payload_mode {
+    char     *spec;		/* as given on the command line */
+    int       type;		/* PAYLOAD_* */
+    double    ratio;		/* for PAYLOAD_RATIO */
+};
+
+/* --verify: both sides derive the payload from the seed. */
+struct iperf_verify {
+    uint32_t  seed;
+    int       period;		/* the pattern repeats every period bytes */
+};
+
+struct iperf_verify_stream {
+    iperf_size_t pos;		/* bytes through the pattern so far */
+    iperf_size_t blocks;	/* receiver: periods checked */
+    iperf_size_t corrupted;	/* ... that did not match */
+    iperf_size_t interval_blocks;
+    iperf_size_t interval_corrupted;
+    iperf_size_t bad_block;	/* 1 + the last corrupted block, 0 if none */
+    iperf_size_t bytes;		/* bytes checked */
+    double    seconds;		/* ... and the time it took */
+};
+
+/* --udp-timestamps: one-way delays in nsec, and where arrivals were stamped. */
+struct iperf_timestamp_stream {
+    struct histogram *interval;
+    struct histogram *total;
+    int64_t   prev_transit;
+    int       have_prev;
+    iperf_size_t negative;	/* datagrams that arrived before they were sent */
+    int       source;		/* best stamp seen: user, kernel, NIC */
+    /* the receiver's summary (the sender gets it in the results) */
+    iperf_size_t count;
+    double    mean;
+    uint64_t  min, p50, p99, max;
+};
+
+/* UDP sequence tracking, see iperf_seq.h. */
+#define SEQ_WINDOW 1024			/* a multiple of 64 */
+#define SEQ_WORDS (SEQ_WINDOW / 64)
+#define SEQ_BURST_BUCKETS 8		/* 1, 2, 3-4, ... 65 and up */
+
+struct iperf_seq_stream {
+    uint64_t  received[SEQ_WORDS];	/* a bit per number in the window */
+    uint64_t  advanced[SEQ_WORDS];	/* ... set if it was the highest yet on arrival */
+    uint64_t  arrival[SEQ_WINDOW];	/* when each arrived, counted in datagrams */
+    uint64_t  next;			/* the highest number yet, + 1 */
+    uint64_t  settled;			/* numbers below this have left the window */
+    uint64_t  arrivals;
+    uint64_t  run;			/* the loss burst being settled */
+    int       finished;			/* the rest of the window has been settled */
+    struct histogram *extent;
+    /* the counts (the sender gets the receiver's in the results) */
+    iperf_size_t lost;
+    iperf_size_t bursts;
+    iperf_size_t burst_max;
+    iperf_size_t burst_lengths[SEQ_BURST_BUCKETS];
+    iperf_size_t reordered;
+    iperf_size_t duplicates;
+    iperf_size_t late;			/* behind the window: can't tell */
+    double    extent_mean;
+    uint64_t  extent_p99, extent_max;
+    double    displacement_mean;
+    uint64_t  displacement_max;
+    double    displacement_sum;
+    /* this interval's, see iperf_seq_stats() */
+    iperf_size_t interval_duplicates;
+    iperf_size_t interval_late;
+    int       event;
+    uint64_t  event_pcount, event_highest;
+};
+
+#define AFFINITY_AUTO -2		/* -A auto, see iperf_placement.h */
+
+/* UDP kernel drop accounting, see iperf_drops.h. */
+struct iperf_drops {
+    char      ifname[32];		/* the receiving interface, "" if unknown */
+    int       have_snmp;		/* /proc/net/snmp could be read */
+    int       have_nic;			/* ... and the interface's statistics */
+    uint64_t  snmp_start, snmp_last;	/* UDP RcvbufErrors, v4 and v6 */
+    uint64_t  nic_start, nic_last;	/* the interface's receive drops */
+    uint64_t  interval_snmp, interval_nic;
+};
+
+struct iperf_drops_stream {
+    uint32_t  overflows;		/* SO_RXQ_OVFL: the socket's drops so far */
+    uint32_t  interval_start;		/* ... when the interval started */
+    int       rcvbuf;			/* SO_RCVBUF, as the kernel has it */
+    /* the receiver's totals (the sender gets them in the results) */
+    iperf_size_t total;
+    int       have_snmp, have_nic;
+    uint64_t  snmp, nic;
+    char      ifname[32];
+};
+
+#define DEFAULT_DISKFILE_DEPTH 8	/* -F buffers in flight per stream */
+#define MAX_DISKFILE_DEPTH 1024
+
+#define MAX_FLOWS 1000000	/* beyond that, file descriptors run out anyway */
+#define FLOWS_EVENTS 1024	/* epoll events handled per pass */
+
+/* How evenly the bytes spread over the flows, one side's view. */
+struct iperf_flows_summary {
+    int       valid;
+    iperf_size_t bytes_min;
+    iperf_size_t bytes_max;
+    double    bytes_mean;
+    double    fairness;			/* Jain's index: 1 is perfectly even */
+    int       idle;			/* flows that carried nothing */
+    iperf_size_t packets;		/* (UDP receiver) datagrams received ... */
+    iperf_size_t lost;			/* ... and missing */
+};
+
+/*
+ * --flows: connections on top of the -P streams, with no iperf_stream
+ * of their own.  Flow i counts towards stream i % -P and sends from its
+ * buffer; the per-flow state is kept an array per field.
+ */
+struct iperf_flows {
+    int       nflows;
+    int       sample;			/* --flows-sample: report every n-th flow */
+    int       nopen;			/* flows connected so far */
+    int       epfd;			/* all the flows, itself in the select() read set */
+    unsigned  turn;			/* (sender) flows sent from: the next pass starts there */
+    int       udp_fd;			/* (UDP receiver) the socket every flow arrives on */
+    int       nstreams;
+    struct iperf_stream **streams;	/* the -P streams, by index */
+    struct timeval start_time;
+    struct timeval end_time;
+    int      *fd;
+    uint32_t *seq;			/* UDP: datagrams sent, or the highest number received */
+    uint32_t *packets;			/* UDP: datagrams received */
+    iperf_size_t *bytes;
+    struct iperf_flows_summary peer;	/* (sender) the receiver's summary */
+};
+
+struct iperf_schedule_entry {
+    struct iperf_test *test;
+    double    at;			/* seconds into the test */
+    char     *spec;			/* parameter changes, "name=value,..." */
+    Timer    *timer;
+    TAILQ_ENTRY(iperf_schedule_entry) link;
+};
+
 struct iperf_test
 {
     char      role;                             /* 'c' lient or 's' erver */
@@ -209,11 +520,15 @@ struct iperf_test
     char     *tmp_template;
     char     *bind_address;                     /* first -B option */
     TAILQ_HEAD(xbind_addrhead, xbind_entry) xbind_addrs; /* all -X opts */
+    TAILQ_HEAD(schedulehead, iperf_schedule_entry) schedule; /* all --schedule opts */
     int       bind_port;                        /* --cport option */
     int       server_port;
     int       omit;                             /* duration of omit period (-O flag) */
     int       duration;                         /* total duration of test (-t flag) */
     char     *diskfile_name;			/* -F option */
+    int       diskfile_depth;			/* --file-depth, 0 for the default */
+    int       diskfile_direct;			/* --file-direct */
+    int       diskfile_fsync;			/* --file-fsync, 0 at the end only */
     int       affinity, server_affinity;	/* -A option */
 #if defined(HAVE_CPUSET_SETAFFINITY)
     cpuset_t cpumask;
@@ -234,12 +549,23 @@ struct iperf_test
     int       one_off;                          /* -1 option */
     int       no_delay;                         /* -N option */
     int       reverse;                          /* -R option */
+    int       bidirectional;                    /* --bidir */
     int	      verbose;                          /* -V option - verbose mode */
     int	      json_output;                      /* -J option - JSON output */
     int	      zerocopy;                         /* -Z option - use sendfile */
     int       debug;				/* -d option - enable debug */
     int	      get_server_output;		/* --get-server-output */
     int	      udp_counters_64bit;		/* --use-64-bit-udp-counters */
+    int	      udp_timestamps;			/* --udp-timestamps, UDP_TIMESTAMPS_* */
+    char     *unix_path;			/* --unix=path: the data sockets' file, NULL for the default name */
+    int	      busy_poll;			/* --busy-poll usec, 0 if off */
+    int	      af_packet;			/* --af-packet */
+    struct iperf_ktls *ktls;			/* --ktls, NULL otherwise */
+    struct iperf_capture *capture;		/* --capture, NULL otherwise */
+    iperf_size_t busy_polls;			/* --busy-poll: main loop polls */
+    iperf_size_t busy_polls_empty;		/* ... that found nothing to do */
+    struct timeval busy_poll_last;		/* ... when the last one found work */
+    double    busy_poll_gap_sum, busy_poll_gap_max;	/* ... seconds between those */
     int       forceflush; /* --forceflush - flushing output at every interval */
 
     int	      multisend;
@@ -288,6 +614,23 @@ struct iperf_test
     cJSON *json_connected;
     cJSON *json_intervals;
     cJSON *json_end;
+    cJSON *json_events;			/* parameter changes not yet reported */
+
+    struct iperf_capacity_search *capacity_search; /* --capacity-search */
+    struct iperf_rr *rr;		/* --rr */
+    struct iperf_profile *profile;	/* --profile */
+    struct iperf_size_mix *size_mix;	/* --size-mix */
+    struct iperf_flows *flows;		/* --flows */
+    struct iperf_payload *payload;	/* shared by the sending streams */
+    struct iperf_payload_mode *payload_mode;	/* --payload, NULL for random */
+    struct iperf_verify *verify;	/* --verify */
+    struct iperf_drops *drops;		/* UDP receivers' host-wide drop counts */
+    struct iperf_placement *placement;	/* -A auto, once placed */
+    int       align_intervals;		/* end intervals on multiples of the interval */
+    struct timeval interval_base;	/* ... counted from here (zero: the epoch) */
+    struct timeval interval_boundary;	/* the boundary the last interval ended on */
+    struct timeval label_base;		/* interval times count from here (zero: each stream's start) */
+    double    start_at;			/* --start-at, seconds since the epoch */
 
     /* Server output (use on client side only) */
     char *server_output_text;
@@ -318,6 +661,7 @@ struct iperf_test
 #define MIN_INTERVAL 0.1
 #define MAX_INTERVAL 60.0
 #define MAX_TIME 86400
+#define MAX_START_DELAY 3600
 #define MAX_BURST 1000
 #define MAX_MSS (9 * 1024)
 #define MAX_STREAMS 128
@@ -39,6 +39,7 @@
 #include <assert.h>
 #include <fcntl.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -66,6 +67,7 @@
 #include "iperf_api.h"
 #include "iperf_udp.h"
 #include "iperf_tcp.h"
+#include "iperf_unix.h"
 #if defined(HAVE_SCTP)
 #include "iperf_sctp.h"
 #endif /* HAVE_SCTP */
@@ -76,6 +78,20 @@
 #include "tcp_window_size.h"
 #include "iperf_util.h"
 #include "iperf_locale.h"
+#include "iperf_rr.h"
+#include "iperf_profile.h"
+#include "iperf_size_mix.h"
+#include "iperf_flows.h"
+#include "iperf_payload.h"
+#include "iperf_verify.h"
+#include "iperf_diskfile.h"
+#include "iperf_timestamp.h"
+#include "iperf_seq.h"
+#include "iperf_drops.h"
+#include "iperf_placement.h"
+#include "iperf_busy_poll.h"
+#include "iperf_packet.h"
+#include "iperf_ktls.h"
 #include "version.h"
 
 /* Forwards. */
@@ -83,11 +99,14 @@ static int send_parameters(struct iperf_test *test);
 static int get_parameters(struct iperf_test *test);
 static int send_results(struct iperf_test *test);
 static int get_results(struct iperf_test *test);
-static int diskfile_send(struct iperf_stream *sp);
-static int diskfile_recv(struct iperf_stream *sp);
 static int JSON_write(int fd, cJSON *json);
 static void print_interval_results(struct iperf_test *test, struct iperf_stream *sp, cJSON *json_interval_streams);
 static cJSON *JSON_read(int fd);
+static cJSON *parse_param_change(const char *spec);
+static void capacity_search_step(struct iperf_test *test);
+static cJSON *capacity_search_json(struct iperf_test *test);
+static void capacity_search_from_json(struct iperf_test *test, cJSON *j);
+static void print_capacity_search(struct iperf_test *test);
 
 
 /*************************** Print usage functions ****************************/
@@ -353,7 +372,7 @@ iperf_set_test_num_streams(struct iperf_test *ipt, int num_streams)
 static void
 check_sender_has_retransmits(struct iperf_test *ipt)
 {
-    if (ipt->sender && ipt->protocol->id == Ptcp && has_tcpinfo_retransmits())
+    if ((ipt->sender || ipt->bidirectional) && ipt->protocol->id == Ptcp && has_tcpinfo_retransmits())
 	ipt->sender_has_retransmits = 1;
     else
 	ipt->sender_has_retransmits = 0;
@@ -375,6 +394,8 @@ iperf_set_test_role(struct iperf_test *ipt, char role)
 void
 iperf_set_test_server_hostname(struct iperf_test *ipt, char *server_hostname)
 {
+    if (ipt->server_hostname)
+	free(ipt->server_hostname);
     ipt->server_hostname = strdup(server_hostname);
 }
 
@@ -489,7 +510,21 @@ void
 iperf_on_test_start(struct iperf_test *test)
 {
     if (test->json_output) {
-	cJSON_AddItemToObject(test->json_start, "test_start", iperf_json_printf("protocol: %s  num_streams: %d  blksize: %d  omit: %d  duration: %d  bytes: %d  blocks: %d  reverse: %d", test->protocol->name, (int64_t) test->num_streams, (int64_t) test->settings->blksize, (int64_t) test->omit, (int64_t) test->duration, (int64_t) test->settings->bytes, (int64_t) test->settings->blocks, test->reverse?(int64_t)1:(int64_t)0));
+	cJSON_AddItemToObject(test->json_start, "test_start", iperf_json_printf("protocol: %s  num_streams: %d  blksize: %d  omit: %d  duration: %d  bytes: %d  blocks: %d  reverse: %d  bidir: %d", test->protocol->name, (int64_t) test->num_streams, (int64_t) test->settings->blksize, (int64_t) test->omit, (int64_t) test->duration, (int64_t) test->settings->bytes, (int64_t) test->settings->blocks, test->reverse?(int64_t)1:(int64_t)0, test->bidirectional?(int64_t)1:(int64_t)0));
+	if (test->rr)
+	    cJSON_AddItemToObject(test->json_start, "rr", iperf_json_printf("request_size: %d  response_size: %d  outstanding: %d  crr: %b", (int64_t) test->rr->request_size, (int64_t) test->rr->response_size, (int64_t) test->rr->outstanding, test->rr->crr));
+	if (test->profile)
+	    cJSON_AddStringToObject(test->json_start, "profile", test->profile->spec);
+	if (test->size_mix)
+	    cJSON_AddStringToObject(test->json_start, "size_mix", test->size_mix->spec);
+	if (test->flows)
+	    cJSON_AddIntToObject(test->json_start, "flows", test->flows->nflows);
+	if (test->verify)
+	    cJSON_AddIntToObject(test->json_start, "verify_seed", test->verify->seed);
+	if (test->payload_mode)
+	    cJSON_AddStringToObject(test->json_start, "payload", test->payload_mode->spec);
+	if (test->udp_timestamps)
+	    cJSON_AddStringToObject(test->json_start, "udp_timestamps", test->udp_timestamps == UDP_TIMESTAMPS_HW ? "hw" : "sw");
     } else {
 	if (test->verbose) {
 	    if (test->settings->bytes)
@@ -548,6 +583,20 @@ iperf_on_connect(struct iperf_test *test)
 	    iprintf(test, report_connecting, test->server_hostname, test->server_port);
 	    if (test->reverse)
 		iprintf(test, report_reverse, test->server_hostname);
+	    else if (test->bidirectional)
+		iprintf(test, report_bidir, test->server_hostname);
+	    if (test->rr)
+		iprintf(test, test->rr->crr ? report_crr : report_rr, test->rr->request_size, test->rr->response_size, test->rr->outstanding);
+	    if (test->profile)
+		iprintf(test, report_profile, test->profile->spec);
+	    if (test->flows)
+		iprintf(test, report_flows, test->flows->nflows);
+	    if (test->verify)
+		iprintf(test, report_verify, test->verify->seed);
+	    if (test->payload_mode)
+		iprintf(test, report_payload, test->payload_mode->spec);
+	    if (test->udp_timestamps)
+		iprintf(test, report_udp_timestamps, test->udp_timestamps == UDP_TIMESTAMPS_HW ? "NIC where it can" : "kernel");
 	}
     } else {
         len = sizeof(sa);
@@ -638,6 +687,9 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
         {"zerocopy", no_argument, NULL, 'Z'},
         {"omit", required_argument, NULL, 'O'},
         {"file", required_argument, NULL, 'F'},
+	{"file-depth", required_argument, NULL, OPT_FILE_DEPTH},
+	{"file-direct", no_argument, NULL, OPT_FILE_DIRECT},
+	{"file-fsync", required_argument, NULL, OPT_FILE_FSYNC},
 #if defined(HAVE_CPU_AFFINITY)
         {"affinity", required_argument, NULL, 'A'},
 #endif /* HAVE_CPU_AFFINITY */
@@ -651,11 +703,32 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
         {"nstreams", required_argument, NULL, OPT_NUMSTREAMS},
         {"xbind", required_argument, NULL, 'X'},
 #endif
+	{"unix", optional_argument, NULL, OPT_UNIX},
+	{"unix-seqpacket", optional_argument, NULL, OPT_UNIX_SEQPACKET},
 	{"pidfile", required_argument, NULL, 'I'},
 	{"logfile", required_argument, NULL, OPT_LOGFILE},
 	{"forceflush", no_argument, NULL, OPT_FORCEFLUSH},
 	{"get-server-output", no_argument, NULL, OPT_GET_SERVER_OUTPUT},
+	{"schedule", required_argument, NULL, OPT_SCHEDULE},
+	{"capacity-search", required_argument, NULL, OPT_CAPACITY_SEARCH},
+	{"start-at", required_argument, NULL, OPT_START_AT},
+	{"align-intervals", no_argument, NULL, OPT_ALIGN_INTERVALS},
+	{"bidir", no_argument, NULL, OPT_BIDIRECTIONAL},
+	{"rr", required_argument, NULL, OPT_RR},
+	{"rr-outstanding", required_argument, NULL, OPT_RR_OUTSTANDING},
+	{"crr", no_argument, NULL, OPT_CRR},
+	{"profile", required_argument, NULL, OPT_PROFILE},
+	{"size-mix", required_argument, NULL, OPT_SIZE_MIX},
+	{"flows", required_argument, NULL, OPT_FLOWS},
+	{"flows-sample", required_argument, NULL, OPT_FLOWS_SAMPLE},
+	{"verify", no_argument, NULL, OPT_VERIFY},
+	{"payload", required_argument, NULL, OPT_PAYLOAD},
 	{"udp-counters-64bit", no_argument, NULL, OPT_UDP_COUNTERS_64BIT},
+	{"udp-timestamps", optional_argument, NULL, OPT_UDP_TIMESTAMPS},
+	{"busy-poll", optional_argument, NULL, OPT_BUSY_POLL},
+	{"af-packet", no_argument, NULL, OPT_AF_PACKET},
+	{"ktls", no_argument, NULL, OPT_KTLS},
+	{"capture", required_argument, NULL, OPT_CAPTURE},
         {"debug", no_argument, NULL, 'd'},
         {"help", no_argument, NULL, 'h'},
         {NULL, 0, NULL, 0}
@@ -669,6 +742,14 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
 #endif /* HAVE_CPU_AFFINITY */
     char* slash;
     struct xbind_entry *xbe;
+    struct iperf_schedule_entry *se;
+    cJSON *j_change;
+    double max_loss;
+    struct timeval now;
+    int rr_request = 0, rr_response = 0, rr_outstanding = 1, crr = 0;
+    char *profile = NULL, *size_mix = NULL;
+    int flows = 0, flows_sample = 0, verify = 0, ktls = 0;
+    uint32_t seed;
 
     blksize = 0;
     server_flag = client_flag = rate_flag = duration_flag = 0;
@@ -735,6 +816,19 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
                 return -1;
 #endif /* HAVE_SCTP */
             break;
+	    case OPT_UNIX:
+	    case OPT_UNIX_SEQPACKET:
+		set_protocol(test, flag == OPT_UNIX ? Punix : Punixseq);
+		if (optarg != NULL) {
+		    if (optarg[0] == '\0' || strlen(optarg) >= sizeof(((struct sockaddr_un *) 0)->sun_path)) {
+			i_errno = IEUNIX;
+			return -1;
+		    }
+		    free(test->unix_path);
+		    test->unix_path = strdup(optarg);
+		}
+		client_flag = 1;
+		break;
 
             case OPT_NUMSTREAMS:
 #if defined(linux) || defined(__FreeBSD__)
@@ -883,21 +977,46 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
             case 'F':
                 test->diskfile_name = optarg;
                 break;
+	    case OPT_FILE_DEPTH:
+		test->diskfile_depth = atoi(optarg);
+		if (test->diskfile_depth < 1 || test->diskfile_depth > MAX_DISKFILE_DEPTH) {
+		    i_errno = IEDISKFILE;
+		    return -1;
+		}
+		break;
+	    case OPT_FILE_DIRECT:
+		test->diskfile_direct = 1;
+		break;
+	    case OPT_FILE_FSYNC:
+		test->diskfile_fsync = atoi(optarg);
+		if (test->diskfile_fsync < 1) {
+		    i_errno = IEDISKFILE;
+		    return -1;
+		}
+		break;
             case 'A':
 #if defined(HAVE_CPU_AFFINITY)
-                test->affinity = strtol(optarg, &endptr, 0);
-                if (endptr == optarg || 
-		    test->affinity < 0 || test->affinity > 1024) {
-                    i_errno = IEAFFINITY;
-                    return -1;
-                }
 		comma = strchr(optarg, ',');
-		if (comma != NULL) {
-		    test->server_affinity = atoi(comma+1);
-		    if (test->server_affinity < 0 || test->server_affinity > 1024) {
+		if (strncmp(optarg, "auto", 4) == 0 && (optarg[4] == '\0' || optarg + 4 == comma))
+		    test->affinity = AFFINITY_AUTO;
+		else {
+		    test->affinity = strtol(optarg, &endptr, 0);
+		    if (endptr == optarg ||
+			test->affinity < 0 || test->affinity > 1024) {
 			i_errno = IEAFFINITY;
 			return -1;
 		    }
+		}
+		if (comma != NULL) {
+		    if (strcmp(comma+1, "auto") == 0)
+			test->server_affinity = AFFINITY_AUTO;
+		    else {
+			test->server_affinity = atoi(comma+1);
+			if (test->server_affinity < 0 || test->server_affinity > 1024) {
+			    i_errno = IEAFFINITY;
+			    return -1;
+			}
+		    }
 		    client_flag = 1;
 		}
 #else /* HAVE_CPU_AFFINITY */
@@ -938,6 +1057,167 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
 	    case OPT_UDP_COUNTERS_64BIT:
 		test->udp_counters_64bit = 1;
 		break;
+	    case OPT_UDP_TIMESTAMPS:
+		if (optarg == NULL)
+		    test->udp_timestamps = UDP_TIMESTAMPS_SW;
+		else if (strcmp(optarg, "hw") == 0)
+		    test->udp_timestamps = UDP_TIMESTAMPS_HW;
+		else {
+		    i_errno = IEUDPTIMESTAMPS;
+		    return -1;
+		}
+		client_flag = 1;
+		break;
+	    case OPT_CAPTURE:
+		iperf_capture_free(test->capture);
+		if ((test->capture = iperf_capture_new(optarg)) == NULL) {
+		    i_errno = IECAPTURE;
+		    return -1;
+		}
+		server_flag = 1;
+		break;
+	    case OPT_KTLS:
+		ktls = 1;
+		client_flag = 1;
+		break;
+	    case OPT_AF_PACKET:
+		test->af_packet = 1;
+		client_flag = 1;
+		break;
+	    case OPT_BUSY_POLL:
+		test->busy_poll = optarg == NULL ? BUSY_POLL_DEFAULT : atoi(optarg);
+		if (test->busy_poll < 1 || test->busy_poll > 1000000) {
+		    i_errno = IEBUSYPOLL;
+		    return -1;
+		}
+		client_flag = 1;
+		break;
+	    case OPT_SCHEDULE:
+		se = (struct iperf_schedule_entry *) malloc(sizeof(struct iperf_schedule_entry));
+		if (!se) {
+		    i_errno = IEPARAMCHANGE;
+		    return -1;
+		}
+		memset(se, 0, sizeof(*se));
+		se->test = test;
+		se->at = strtod(optarg, &endptr);
+		if (endptr == optarg || *endptr != ':' || se->at <= 0 ||
+		    (j_change = parse_param_change(endptr + 1)) == NULL) {
+		    free(se);
+		    i_errno = IEPARAMCHANGE;
+		    return -1;
+		}
+		cJSON_Delete(j_change);
+		se->spec = strdup(endptr + 1);
+		TAILQ_INSERT_TAIL(&test->schedule, se, link);
+		client_flag = 1;
+		break;
+	    case OPT_CAPACITY_SEARCH:
+		max_loss = strtod(optarg, &endptr);
+		if (endptr == optarg || max_loss < 0 || max_loss >= 100) {
+		    i_errno = IECAPACITYSEARCH;
+		    return -1;
+		}
+		if (test->capacity_search == NULL)
+		    test->capacity_search = (struct iperf_capacity_search *) malloc(sizeof(struct iperf_capacity_search));
+		if (test->capacity_search == NULL) {
+		    i_errno = IECAPACITYSEARCH;
+		    return -1;
+		}
+		memset(test->capacity_search, 0, sizeof(struct iperf_capacity_search));
+		test->capacity_search->max_loss = max_loss;
+		client_flag = 1;
+		break;
+	    case OPT_START_AT:
+		test->start_at = strtod(optarg, &endptr);
+		gettimeofday(&now, NULL);
+		if (optarg[0] == '+')
+		    test->start_at += timeval_to_double(&now);
+		if (endptr == optarg || *endptr != '\0' || test->start_at <= timeval_to_double(&now)) {
+		    i_errno = IESTARTAT;
+		    return -1;
+		}
+		if (test->start_at > timeval_to_double(&now) + MAX_START_DELAY) {
+		    i_errno = IESTARTATFAR;
+		    return -1;
+		}
+		/* Intervals count from the start time. */
+		test->align_intervals = 1;
+		test->interval_base.tv_sec = (time_t) test->start_at;
+		test->interval_base.tv_usec = (test->start_at - test->interval_base.tv_sec) * SEC_TO_US;
+		client_flag = 1;
+		break;
+	    case OPT_BIDIRECTIONAL:
+		test->bidirectional = 1;
+		client_flag = 1;
+		break;
+	    case OPT_RR:
+		slash = strchr(optarg, '/');
+		if (slash) {
+		    *slash = '\0';
+		    ++slash;
+		    rr_response = unit_atoi(slash);
+		}
+		rr_request = unit_atoi(optarg);
+		if (!slash)
+		    rr_response = rr_request;
+		if (rr_request < RR_HEADER_LEN || rr_response < RR_HEADER_LEN) {
+		    i_errno = IEREQRESP;
+		    return -1;
+		}
+		client_flag = 1;
+		break;
+	    case OPT_RR_OUTSTANDING:
+		rr_outstanding = atoi(optarg);
+		if (rr_outstanding < 1) {
+		    i_errno = IEREQRESP;
+		    return -1;
+		}
+		client_flag = 1;
+		break;
+	    case OPT_CRR:
+		crr = 1;
+		client_flag = 1;
+		break;
+	    case OPT_PROFILE:
+		profile = optarg;
+		client_flag = 1;
+		break;
+	    case OPT_SIZE_MIX:
+		size_mix = optarg;
+		client_flag = 1;
+		break;
+	    case OPT_FLOWS:
+		flows = atoi(optarg);
+		if (flows < 1 || flows > MAX_FLOWS) {
+		    i_errno = IEFLOWS;
+		    return -1;
+		}
+		client_flag = 1;
+		break;
+	    case OPT_FLOWS_SAMPLE:
+		flows_sample = atoi(optarg);
+		if (flows_sample < 1) {
+		    i_errno = IEFLOWS;
+		    return -1;
+		}
+		client_flag = 1;
+		break;
+	    case OPT_VERIFY:
+		verify = 1;
+		client_flag = 1;
+		break;
+	    case OPT_PAYLOAD:
+		iperf_payload_mode_free(test->payload_mode);
+		if ((test->payload_mode = iperf_payload_mode_new(optarg)) == NULL)
+		    return -1;
+		client_flag = 1;
+		break;
+	    case OPT_ALIGN_INTERVALS:
+		if (!test->start_at)
+		    test->align_intervals = 1;
+		client_flag = 1;
+		break;
             case 'h':
             default:
                 usage_long();
@@ -968,6 +1248,11 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
         i_errno = IEBIND;
         return -1;
     }
+    /* --size-mix sets the sizes: an -l would be lost without a word. */
+    if (size_mix && blksize != 0) {
+	i_errno = IESIZEMIX;
+	return -1;
+    }
     if (blksize == 0) {
 	if (test->protocol->id == Pudp)
 	    blksize = DEFAULT_UDP_BLKSIZE;
@@ -990,6 +1275,136 @@ iperf_parse_arguments(struct iperf_test *test, int argc, char **argv)
     if (!rate_flag)
 	test->settings->rate = test->protocol->id == Pudp ? UDP_RATE : 0;
 
+    if (test->capacity_search != NULL &&
+	(test->protocol->id != Pudp || test->settings->rate == 0 || test->stats_interval == 0)) {
+	i_errno = IECAPACITYSEARCH;
+	return -1;
+    }
+    /*
+     * Each trial takes two intervals.  Without -t the search decides when
+     * the test ends, and the time a full trial table takes is the limit;
+     * a -t is a limit of its own, which may cut the search short.
+     */
+    if (test->capacity_search != NULL && !duration_flag)
+	test->duration = (int) ((2 * MAX_CAPACITY_TRIALS + 1) * test->stats_interval) + 1;
+
+    if (test->bidirectional &&
+	(test->reverse || test->diskfile_name || test->capacity_search)) {
+	i_errno = IEBIDIR;
+	return -1;
+    }
+
+    if (crr) {
+	if (test->protocol->id != Ptcp) {
+	    i_errno = IECRR;
+	    return -1;
+	}
+	if (!rr_request)
+	    rr_request = rr_response = DEFAULT_CRR_SIZE;
+    }
+
+    if (rr_request) {
+	if (test->reverse || test->bidirectional || test->diskfile_name || test->capacity_search) {
+	    i_errno = IEREQRESP;
+	    return -1;
+	}
+	test->rr = iperf_rr_new(rr_request, rr_response, rr_outstanding, crr);
+	if (test->rr == NULL) {
+	    i_errno = IENEWTEST;
+	    return -1;
+	}
+    }
+
+    if (profile) {
+	if (test->rr || test->diskfile_name || test->capacity_search) {
+	    i_errno = IEPROFILE;
+	    return -1;
+	}
+	if ((test->profile = iperf_profile_new(profile)) == NULL)
+	    return -1;
+	/* Only the client has the trace. */
+	if ((test->profile->type == PROFILE_POISSON && test->settings->rate == 0) ||
+	    (test->profile->type == PROFILE_TRACE && (test->reverse || test->bidirectional))) {
+	    i_errno = IEPROFILE;
+	    return -1;
+	}
+    }
+
+    if (size_mix) {
+	if (test->protocol->id != Pudp || test->rr ||
+	    (test->profile && test->profile->type == PROFILE_TRACE)) {
+	    i_errno = IESIZEMIX;
+	    return -1;
+	}
+	if ((test->size_mix = iperf_size_mix_new(size_mix)) == NULL)
+	    return -1;
+	/* Big enough buffers for every size, on both sides. */
+	test->settings->blksize = iperf_size_mix_max(test->size_mix);
+    }
+
+    if (flows_sample && !flows) {
+	i_errno = IEFLOWS;
+	return -1;
+    }
+    if (flows) {
+	/* UDP flows have no handshake, so the server can't send on them. */
+	if (test->bidirectional || test->rr || test->profile || test->size_mix || test->diskfile_name ||
+	    (test->protocol->id != Ptcp && test->protocol->id != Pudp) ||
+	    (test->protocol->id == Pudp && test->reverse)) {
+	    i_errno = IEFLOWS;
+	    return -1;
+	}
+	if ((test->flows = iperf_flows_new(flows, flows_sample)) == NULL)
+	    return -1;
+    }
+
+    if ((test->diskfile_depth || test->diskfile_direct || test->diskfile_fsync) && !test->diskfile_name) {
+	i_errno = IEDISKFILE;
+	return -1;
+    }
+
+    /* --rr messages carry no payload worth shaping. */
+    if (test->payload_mode && (test->diskfile_name || test->rr)) {
+	i_errno = IEPAYLOAD;
+	return -1;
+    }
+
+    if (test->udp_timestamps) {
+	if (test->protocol->id != Pudp) {
+	    i_errno = IEUDPTIMESTAMPS;
+	    return -1;
+	}
+	/* Nanoseconds don't fit the 32-bit header's layout. */
+	test->udp_counters_64bit = 1;
+    }
+
+    if (ktls) {
+	/* --crr connections come and go too fast to set up, --flows too many. */
+	if (test->protocol->id != Ptcp || test->flows || (test->rr && test->rr->crr)) {
+	    i_errno = IEKTLS;
+	    return -1;
+	}
+	if ((test->ktls = iperf_ktls_new(NULL)) == NULL)
+	    return -1;
+    }
+
+    if (test->af_packet &&
+	(test->protocol->id != Pudp || test->diskfile_name || test->rr || test->flows)) {
+	i_errno = IEAFPACKET;
+	return -1;
+    }
+
+    if (verify) {
+	/* Each of these sends something other than the payload. */
+	if (test->diskfile_name || test->zerocopy || test->rr || test->flows) {
+	    i_errno = IEVERIFY;
+	    return -1;
+	}
+	seed = (uint32_t) time(NULL) ^ (uint32_t) getpid();
+	if ((test->verify = iperf_verify_new(seed ? seed : 1)) == NULL)
+	    return -1;
+    }
+
     if ((test->settings->bytes != 0 || test->settings->blocks != 0) && ! duration_flag)
         test->duration = 0;
 
@@ -1039,10 +1454,16 @@ iperf_check_throttle(struct iperf_stream *sp, struct timeval *nowP)
     if (sp->test->done)
         return;
     seconds = timeval_diff(&sp->result->start_time_fixed, nowP);
-    bits_per_second = sp->result->bytes_sent * 8 / seconds;
-    if (bits_per_second < sp->test->settings->rate) {
+    if (seconds > 0)
+	bits_per_second = (sp->result->bytes_sent - sp->result->bytes_sent_fixed) * 8 / seconds;
+    else
+	bits_per_second = 0;
+    if (!sp->paused &&
+	(sp->test->settings->rate == 0 || bits_per_second < sp->test->settings->rate)) {
         sp->green_light = 1;
         FD_SET(sp->socket, &sp->test->write_set);
+	if (sp->test->flows)
+	    FD_SET(sp->test->flows->epfd, &sp->test->read_set);
     } else {
         sp->green_light = 0;
         FD_CLR(sp->socket, &sp->test->write_set);
@@ -1056,8 +1477,10 @@ iperf_send(struct iperf_test *test, fd_set *write_setP)
     register struct iperf_stream *sp;
     struct timeval now;
 
-    /* Can we do multisend mode? */
-    if (test->settings->burst != 0)
+    /* Can we do multisend mode?  A profile holds streams back itself. */
+    if (test->profile != NULL)
+        multisend = test->multisend;
+    else if (test->settings->burst != 0)
         multisend = test->settings->burst;
     else if (test->settings->rate == 0)
         multisend = test->multisend;
@@ -1069,7 +1492,7 @@ iperf_send(struct iperf_test *test, fd_set *write_setP)
 	    gettimeofday(&now, NULL);
 	streams_active = 0;
 	SLIST_FOREACH(sp, &test->streams, streams) {
-	    if (sp->green_light &&
+	    if (sp->sender && sp->green_light &&
 	        (write_setP == NULL || FD_ISSET(sp->socket, write_setP))) {
 		if ((r = sp->snd(sp)) < 0) {
 		    if (r == NET_SOFTERROR)
@@ -1080,7 +1503,9 @@ iperf_send(struct iperf_test *test, fd_set *write_setP)
 		streams_active = 1;
 		test->bytes_sent += r;
 		++test->blocks_sent;
-		if (test->settings->rate != 0 && test->settings->burst == 0)
+		if (test->profile != NULL)
+		    iperf_profile_sent(sp, r);
+		else if (test->settings->rate != 0 && test->settings->burst == 0)
 		    iperf_check_throttle(sp, &now);
 		if (multisend > 1 && test->settings->bytes != 0 && test->bytes_sent >= test->settings->bytes)
 		    break;
@@ -1091,10 +1516,17 @@ iperf_send(struct iperf_test *test, fd_set *write_setP)
 	if (!streams_active)
 	    break;
     }
-    if (test->settings->burst != 0) {
+    if (test->af_packet)
+	SLIST_FOREACH(sp, &test->streams, streams)
+	    if (sp->packet != NULL && iperf_packet_flush(sp) < 0) {
+		i_errno = IESTREAMWRITE;
+		return -1;
+	    }
+    if (test->settings->burst != 0 && test->profile == NULL) {
 	gettimeofday(&now, NULL);
 	SLIST_FOREACH(sp, &test->streams, streams)
-	    iperf_check_throttle(sp, &now);
+	    if (sp->sender)
+		iperf_check_throttle(sp, &now);
     }
     if (write_setP != NULL)
 	SLIST_FOREACH(sp, &test->streams, streams)
@@ -1111,13 +1543,16 @@ iperf_recv(struct iperf_test *test, fd_set *read_setP)
     struct iperf_stream *sp;
 
     SLIST_FOREACH(sp, &test->streams, streams) {
-	if (FD_ISSET(sp->socket, read_setP)) {
+	if (!sp->sender && FD_ISSET(sp->socket, read_setP)) {
 	    if ((r = sp->rcv(sp)) < 0) {
 		i_errno = IESTREAMREAD;
 		return r;
 	    }
-	    test->bytes_sent += r;
-	    ++test->blocks_sent;
+	    /* -n and -k count what is sent; in reverse mode that arrives here. */
+	    if (!test->bidirectional) {
+		test->bytes_sent += r;
+		++test->blocks_sent;
+	    }
 	    FD_CLR(sp->socket, read_setP);
 	}
     }
@@ -1136,6 +1571,10 @@ iperf_init_test(struct iperf_test *test)
             return -1;
     }
 
+    /* Before the clock starts: this times the cipher. */
+    if (test->ktls)
+	iperf_ktls_start(test);
+
     /* Init each stream. */
     if (gettimeofday(&now, NULL) < 0) {
 	i_errno = IEINITTEST;
@@ -1145,6 +1584,15 @@ iperf_init_test(struct iperf_test *test)
 	sp->result->start_time = sp->result->start_time_fixed = now;
     }
 
+    /* The capacity search starts at the -b rate, and skips the first interval. */
+    if (test->capacity_search != NULL) {
+	test->capacity_search->low = 0;
+	test->capacity_search->high = test->settings->rate;
+	test->capacity_search->settle = 1;
+	test->capacity_search->converged = 0;
+	test->capacity_search->ntrials = 0;
+    }
+
     if (test->on_test_start)
         test->on_test_start(test);
 
@@ -1175,8 +1623,13 @@ iperf_create_send_timers(struct iperf_test * test)
 	return -1;
     }
     SLIST_FOREACH(sp, &test->streams, streams) {
+	if (!sp->sender)
+	    continue;
         sp->green_light = 1;
-	if (test->settings->rate != 0) {
+	if (test->profile != NULL) {
+	    if (iperf_profile_start(sp) < 0)
+		return -1;
+	} else if (test->settings->rate != 0) {
 	    cd.p = sp;
 	    sp->send_timer = tmr_create((struct timeval*) 0, send_timer_proc, cd, 100000L, 1);
 	    /* (Repeat every tenth second - arbitrary often value.) */
@@ -1189,6 +1642,490 @@ iperf_create_send_timers(struct iperf_test * test)
     return 0;
 }
 
+/*************************************************************/
+
+/* Parse a parameter change of the form "name=value[,name=value...]".
+** The names are the ones used in the parameter exchange: bandwidth,
+** parallel, len and burst.  Returns a JSON object holding the new
+** values, or NULL with i_errno set.
+*/
+static cJSON *
+parse_param_change(const char *spec)
+{
+    cJSON *j;
+    char *copy, *tok, *eq, *saveptr;
+    int64_t value;
+    int ok;
+
+    j = cJSON_CreateObject();
+    if (j == NULL) {
+	i_errno = IEPARAMCHANGE;
+	return NULL;
+    }
+    copy = strdup(spec);
+    if (copy == NULL) {
+	cJSON_Delete(j);
+	i_errno = IEPARAMCHANGE;
+	return NULL;
+    }
+    ok = 1;
+    for (tok = strtok_r(copy, ",", &saveptr); ok && tok != NULL; tok = strtok_r(NULL, ",", &saveptr)) {
+	eq = strchr(tok, '=');
+	if (eq == NULL || eq[1] == '\0') {
+	    ok = 0;
+	    break;
+	}
+	*eq++ = '\0';
+	if (strcmp(tok, "bandwidth") == 0)
+	    value = unit_atof_rate(eq);
+	else if (strcmp(tok, "len") == 0)
+	    value = unit_atoi(eq);
+	else if (strcmp(tok, "parallel") == 0)
+	    value = atoi(eq);
+	else if (strcmp(tok, "burst") == 0)
+	    value = atoi(eq);
+	else {
+	    ok = 0;
+	    break;
+	}
+	if (value < 0 || cJSON_GetObjectItem(j, tok) != NULL)
+	    ok = 0;
+	else
+	    cJSON_AddIntToObject(j, tok, value);
+    }
+    free(copy);
+    if (!ok || j->child == NULL) {
+	cJSON_Delete(j);
+	i_errno = IEPARAMCHANGE;
+	return NULL;
+    }
+    return j;
+}
+
+static void
+log_param_change(struct iperf_test *test, cJSON *j, struct timeval *nowP)
+{
+    struct iperf_stream *sp;
+    cJSON *j_p;
+    cJSON *json_event;
+    char nbuf[UNIT_LEN];
+    char changes[200];
+    int n;
+    double t = 0.;
+
+    sp = SLIST_FIRST(&test->streams);
+    if (sp != NULL)
+	t = timeval_diff(&sp->result->start_time, nowP);
+
+    if (test->json_output) {
+	/* Held until the next interval report, see iperf_print_intermediate(). */
+	if (test->json_events == NULL)
+	    test->json_events = cJSON_CreateArray();
+	json_event = cJSON_CreateObject();
+	if (test->json_events == NULL || json_event == NULL)
+	    return;
+	cJSON_AddFloatToObject(json_event, "time", t);
+	for (j_p = j->child; j_p != NULL; j_p = j_p->next)
+	    cJSON_AddIntToObject(json_event, j_p->string, j_p->valueint);
+	cJSON_AddItemToArray(test->json_events, json_event);
+    } else {
+	changes[0] = '\0';
+	n = 0;
+	for (j_p = j->child; j_p != NULL && n < sizeof(changes); j_p = j_p->next) {
+	    if (strcmp(j_p->string, "end") == 0)
+		n += snprintf(changes + n, sizeof(changes) - n, "%send of test", n ? ", " : "");
+	    else if (strcmp(j_p->string, "bandwidth") == 0) {
+		unit_snprintf(nbuf, UNIT_LEN, (double) j_p->valueint / 8, test->settings->unit_format);
+		n += snprintf(changes + n, sizeof(changes) - n, "%s%s %ss/sec", n ? ", " : "", j_p->string, nbuf);
+	    } else
+		n += snprintf(changes + n, sizeof(changes) - n, "%s%s %d", n ? ", " : "", j_p->string, (int) j_p->valueint);
+	}
+	iprintf(test, report_param_change, t, changes);
+	if (test->logfile || test->forceflush)
+	    iflush(test);
+    }
+}
+
+/* Apply a parameter change to this side of the test.  Both sides do
+** this; only the sending side's streams change what they are doing.
+** Besides the user-settable parameters, "end" (sent when a capacity
+** search is finished) ends the test early.
+*/
+static int
+apply_param_change(struct iperf_test *test, cJSON *j)
+{
+    cJSON *j_bandwidth, *j_parallel, *j_len, *j_burst;
+    struct iperf_stream *sp;
+    struct timeval now;
+    TimerClientData cd;
+    int i, min_len;
+
+    j_bandwidth = cJSON_GetObjectItem(j, "bandwidth");
+    j_parallel = cJSON_GetObjectItem(j, "parallel");
+    j_len = cJSON_GetObjectItem(j, "len");
+    j_burst = cJSON_GetObjectItem(j, "burst");
+
+    /* Check everything before changing anything.  A --profile sets its
+    ** own schedule. */
+    if (test->profile != NULL &&
+	(j_bandwidth != NULL || j_parallel != NULL || j_len != NULL || j_burst != NULL)) {
+	i_errno = IEPARAMCHANGE;
+	return -1;
+    }
+    if (j_parallel != NULL &&
+	(j_parallel->valueint < 1 || j_parallel->valueint > test->num_streams)) {
+	i_errno = IEPARAMCHANGE;
+	return -1;
+    }
+    if (j_len != NULL) {
+	/* Only as large as the buffers the streams were created with, and
+	** not with --bidir, whose receiving streams share the setting, or
+	** --rr or --size-mix, whose message sizes are fixed, or --verify,
+	** whose pattern is. */
+	if (test->bidirectional || test->rr || test->size_mix || test->verify) {
+	    i_errno = IEPARAMCHANGE;
+	    return -1;
+	}
+	if (test->protocol->id == Pudp)
+	    min_len = test->udp_counters_64bit ? 16 : 12;
+	else
+	    min_len = 1;
+	sp = SLIST_FIRST(&test->streams);
+	if (sp == NULL || j_len->valueint < min_len || j_len->valueint > sp->buffer_size) {
+	    i_errno = IEPARAMCHANGE;
+	    return -1;
+	}
+    }
+    if (j_burst != NULL && j_burst->valueint > MAX_BURST) {
+	i_errno = IEPARAMCHANGE;
+	return -1;
+    }
+
+    if (j_bandwidth != NULL)
+	test->settings->rate = j_bandwidth->valueint;
+    if (j_burst != NULL)
+	test->settings->burst = j_burst->valueint;
+    /* Receivers keep reading with the length they started with. */
+    if (j_len != NULL && test->sender)
+	test->settings->blksize = j_len->valueint;
+
+    gettimeofday(&now, NULL);
+    i = 0;
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (!sp->sender)
+	    continue;
+	/* The first "parallel" streams send, the rest pause. */
+	if (j_parallel != NULL)
+	    sp->paused = ++i > j_parallel->valueint;
+	/* Restart pacing from here, so the new values take effect at once. */
+	sp->result->start_time_fixed = now;
+	sp->result->bytes_sent_fixed = sp->result->bytes_sent;
+	if (test->settings->rate != 0 && sp->send_timer == NULL) {
+	    cd.p = sp;
+	    sp->send_timer = tmr_create((struct timeval*) 0, send_timer_proc, cd, 100000L, 1);
+	    if (sp->send_timer == NULL) {
+		i_errno = IEINITTEST;
+		return -1;
+	    }
+	}
+	iperf_check_throttle(sp, &now);
+    }
+
+    log_param_change(test, j, &now);
+
+    if (cJSON_GetObjectItem(j, "end") != NULL && test->role == 'c')
+	test->done = 1;
+    return 0;
+}
+
+static int
+send_param_change(struct iperf_test *test, cJSON *j)
+{
+    signed char state = PARAM_CHANGE;
+
+    /* Not iperf_set_send_state(): our own state doesn't change. */
+    if (Nwrite(test->ctrl_sck, (char*) &state, sizeof(state), Ptcp) < 0 ||
+	JSON_write(test->ctrl_sck, j) < 0) {
+	i_errno = IESENDPARAMCHANGE;
+	return -1;
+    }
+    return 0;
+}
+
+static int
+change_parameters(struct iperf_test *test, cJSON *j)
+{
+    if (test->state != TEST_RUNNING || test->done) {
+	i_errno = IEPARAMCHANGE;
+	return -1;
+    }
+    if (apply_param_change(test, j) < 0)
+	return -1;
+    return send_param_change(test, j);
+}
+
+int
+iperf_change_parameters(struct iperf_test *test, const char *spec)
+{
+    cJSON *j;
+    int r;
+
+    j = parse_param_change(spec);
+    if (j == NULL)
+	return -1;
+    r = change_parameters(test, j);
+    cJSON_Delete(j);
+    return r;
+}
+
+/* Called by the control message handlers after reading PARAM_CHANGE. */
+int
+iperf_handle_param_change(struct iperf_test *test)
+{
+    cJSON *j;
+    int r;
+
+    j = JSON_read(test->ctrl_sck);
+    if (j == NULL) {
+	i_errno = IERECVPARAMCHANGE;
+	return -1;
+    }
+    if (test->debug) {
+	printf("param_change:\n%s\n", cJSON_Print(j));
+    }
+    r = apply_param_change(test, j);
+    cJSON_Delete(j);
+    return r;
+}
+
+static void
+schedule_timer_proc(TimerClientData client_data, struct timeval *nowP)
+{
+    struct iperf_schedule_entry *se = client_data.p;
+
+    se->timer = NULL;
+    if (se->test->done)
+	return;
+    if (iperf_change_parameters(se->test, se->spec) < 0)
+	iperf_err(se->test, "scheduled parameter change failed: %s", iperf_strerror(i_errno));
+}
+
+int
+iperf_create_schedule_timers(struct iperf_test *test)
+{
+    struct timeval now;
+    struct iperf_schedule_entry *se;
+    TimerClientData cd;
+
+    if (gettimeofday(&now, NULL) < 0) {
+	i_errno = IEINITTEST;
+	return -1;
+    }
+    TAILQ_FOREACH(se, &test->schedule, link) {
+	cd.p = se;
+	se->timer = tmr_create(&now, schedule_timer_proc, cd, se->at * SEC_TO_US, 0);
+	if (se->timer == NULL) {
+	    i_errno = IEINITTEST;
+	    return -1;
+	}
+    }
+    return 0;
+}
+
+/* Back "now" up to the last interval boundary, a multiple of the
+** interval since test->interval_base (the epoch if that is unset), so
+** that interval timers created from the result fire on the boundaries.
+*/
+void
+iperf_align_interval(struct iperf_test *test, struct timeval *nowP, struct timeval *alignedP)
+{
+    int64_t interval_us, since_us;
+
+    *alignedP = *nowP;
+    interval_us = test->stats_interval * SEC_TO_US;
+    if (!test->align_intervals || interval_us <= 0)
+	return;
+    since_us = (int64_t) (nowP->tv_sec - test->interval_base.tv_sec) * SEC_TO_US +
+	(nowP->tv_usec - test->interval_base.tv_usec);
+    if (since_us < 0)
+	return;
+    since_us %= interval_us;
+    alignedP->tv_sec -= since_us / SEC_TO_US;
+    alignedP->tv_usec -= since_us % SEC_TO_US;
+    if (alignedP->tv_usec < 0) {
+	alignedP->tv_usec += SEC_TO_US;
+	--alignedP->tv_sec;
+    }
+}
+
+/* Seconds into the test that tv is, as interval reports label it. */
+double
+iperf_interval_time(struct iperf_stream *sp, struct timeval *tv)
+{
+    struct iperf_test *test = sp->test;
+
+    if (test->label_base.tv_sec != 0)
+	return timeval_diff(&test->label_base, tv);
+    return timeval_diff(&sp->result->start_time, tv);
+}
+
+/* Hold off until the --start-at time, if there is one. */
+int
+iperf_wait_start(struct iperf_test *test)
+{
+    if (test->start_at && delay_until(test->start_at) < 0) {
+	i_errno = IEINITTEST;
+	return -1;
+    }
+    return 0;
+}
+
+/* Capacity search.  The receiving side runs a binary search over the
+** per-stream sending rate, between 0 and the -b rate: after each
+** measured interval it judges the loss against the limit and sends
+** the sender the next rate to try, skipping the interval in which the
+** change takes effect.  When the bracket is within 1% (or the trial
+** table is full) it settles on the best passing rate and ends the test.
+*/
+static void
+capacity_search_step(struct iperf_test *test)
+{
+    struct iperf_capacity_search *cs = test->capacity_search;
+    struct iperf_capacity_trial *ct;
+    struct iperf_stream *sp;
+    struct iperf_interval_results *irp;
+    iperf_size_t bytes = 0;
+    double duration = 0.0, jitter = 0.0;
+    int packets = 0, lost = 0, n = 0;
+    uint64_t rate;
+    cJSON *j;
+
+    if (test->done || test->omitting || cs->converged || cs->ntrials == MAX_CAPACITY_TRIALS)
+	return;
+    if (cs->settle > 0) {
+	--cs->settle;
+	return;
+    }
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	irp = TAILQ_LAST(&sp->result->interval_results, irlisthead);
+	if (irp == NULL)
+	    continue;
+	bytes += irp->bytes_transferred;
+	packets += irp->interval_packet_count;
+	lost += irp->interval_cnt_error;
+	jitter += irp->jitter;
+	duration = irp->interval_duration;
+	++n;
+    }
+    if (n == 0 || duration <= 0.0)
+	return;
+
+    ct = &cs->trials[cs->ntrials++];
+    ct->rate = test->settings->rate * test->num_streams;
+    ct->throughput = bytes * 8 / duration;
+    ct->packets = packets;
+    ct->lost = lost;
+    ct->jitter = jitter / n;
+    ct->pass = packets > 0 && 100.0 * lost / packets <= cs->max_loss;
+    if (ct->pass)
+	cs->low = test->settings->rate;
+    else
+	cs->high = test->settings->rate;
+
+    j = cJSON_CreateObject();
+    if (j == NULL)
+	return;
+    cs->converged = (cs->high - cs->low) * 100 <= cs->high;
+    if (cs->converged || cs->ntrials == MAX_CAPACITY_TRIALS) {
+	if (cs->low > 0)
+	    cJSON_AddIntToObject(j, "bandwidth", cs->low);
+	cJSON_AddTrueToObject(j, "end");
+    } else {
+	rate = (cs->low + cs->high) / 2;
+	cJSON_AddIntToObject(j, "bandwidth", rate);
+	cs->settle = 1;
+    }
+    if (change_parameters(test, j) < 0)
+	iperf_err(test, "capacity search: %s", iperf_strerror(i_errno));
+    cJSON_Delete(j);
+}
+
+static cJSON *
+capacity_search_json(struct iperf_test *test)
+{
+    struct iperf_capacity_search *cs = test->capacity_search;
+    struct iperf_capacity_trial *ct;
+    cJSON *j, *j_trials, *j_trial;
+    int i;
+
+    j = cJSON_CreateObject();
+    if (j == NULL)
+	return NULL;
+    cJSON_AddFloatToObject(j, "max_loss_percent", cs->max_loss);
+    cJSON_AddIntToObject(j, "capacity_bits_per_second", cs->low * test->num_streams);
+    cJSON_AddIntToObject(j, "failed_bits_per_second", cs->high * test->num_streams);
+    cJSON_AddItemToObject(j, "converged", cJSON_CreateBool(cs->converged));
+    j_trials = cJSON_CreateArray();
+    if (j_trials == NULL)
+	return j;
+    cJSON_AddItemToObject(j, "trials", j_trials);
+    for (i = 0; i < cs->ntrials; ++i) {
+	ct = &cs->trials[i];
+	j_trial = cJSON_CreateObject();
+	if (j_trial == NULL)
+	    break;
+	cJSON_AddIntToObject(j_trial, "offered_bits_per_second", ct->rate);
+	cJSON_AddFloatToObject(j_trial, "received_bits_per_second", ct->throughput);
+	cJSON_AddFloatToObject(j_trial, "jitter_ms", ct->jitter * 1000.0);
+	cJSON_AddIntToObject(j_trial, "lost_packets", ct->lost);
+	cJSON_AddIntToObject(j_trial, "packets", ct->packets);
+	cJSON_AddItemToObject(j_trial, "pass", cJSON_CreateBool(ct->pass));
+	cJSON_AddItemToArray(j_trials, j_trial);
+    }
+    return j;
+}
+
+static void
+capacity_search_from_json(struct iperf_test *test, cJSON *j)
+{
+    struct iperf_capacity_search *cs = test->capacity_search;
+    struct iperf_capacity_trial *ct;
+    cJSON *j_p, *j_trials, *j_trial;
+    int i, n;
+
+    if ((j_p = cJSON_GetObjectItem(j, "capacity_bits_per_second")) != NULL && test->num_streams > 0)
+	cs->low = j_p->valuefloat / test->num_streams;
+    if ((j_p = cJSON_GetObjectItem(j, "failed_bits_per_second")) != NULL && test->num_streams > 0)
+	cs->high = j_p->valuefloat / test->num_streams;
+    if ((j_p = cJSON_GetObjectItem(j, "converged")) != NULL)
+	cs->converged = (j_p->type == cJSON_True);
+    j_trials = cJSON_GetObjectItem(j, "trials");
+    if (j_trials == NULL)
+	return;
+    n = cJSON_GetArraySize(j_trials);
+    if (n > MAX_CAPACITY_TRIALS)
+	n = MAX_CAPACITY_TRIALS;
+    for (i = 0; i < n; ++i) {
+	j_trial = cJSON_GetArrayItem(j_trials, i);
+	ct = &cs->trials[cs->ntrials];
+	memset(ct, 0, sizeof(*ct));
+	if ((j_p = cJSON_GetObjectItem(j_trial, "offered_bits_per_second")) != NULL)
+	    ct->rate = j_p->valuefloat;
+	if ((j_p = cJSON_GetObjectItem(j_trial, "received_bits_per_second")) != NULL)
+	    ct->throughput = j_p->valuefloat;
+	if ((j_p = cJSON_GetObjectItem(j_trial, "jitter_ms")) != NULL)
+	    ct->jitter = j_p->valuefloat / 1000.0;
+	if ((j_p = cJSON_GetObjectItem(j_trial, "lost_packets")) != NULL)
+	    ct->lost = j_p->valueint;
+	if ((j_p = cJSON_GetObjectItem(j_trial, "packets")) != NULL)
+	    ct->packets = j_p->valueint;
+	if ((j_p = cJSON_GetObjectItem(j_trial, "pass")) != NULL)
+	    ct->pass = (j_p->type == cJSON_True);
+	++cs->ntrials;
+    }
+}
+
 /**
  * iperf_exchange_parameters - handles the param_Exchange part for client
  *
@@ -1207,10 +2144,8 @@ iperf_exchange_parameters(struct iperf_test *test)
 
     } else {
 
-        if (get_parameters(test) < 0)
-            return -1;
-
-        if ((s = test->protocol->listen(test)) < 0) {
+        /* Tell the client about parameters it sent that we refuse, too. */
+        if (get_parameters(test) < 0 || (s = test->protocol->listen(test)) < 0) {
 	    if (iperf_set_send_state(test, SERVER_ERROR) != 0)
                 return -1;
             err = htonl(i_errno);
@@ -1225,6 +2160,8 @@ iperf_exchange_parameters(struct iperf_test *test)
             }
             return -1;
         }
+        if (test->flows && iperf_flows_listen(test, s) < 0)
+            return -1;
         FD_SET(s, &test->read_set);
         test->max_fd = (s > test->max_fd) ? s : test->max_fd;
         test->prot_listener = s;
@@ -1280,6 +2217,12 @@ send_parameters(struct iperf_test *test)
 	    cJSON_AddTrueToObject(j, "udp");
         else if (test->protocol->id == Psctp)
             cJSON_AddTrueToObject(j, "sctp");
+	else if (test->protocol->id == Punix)
+	    cJSON_AddTrueToObject(j, "unix");
+	else if (test->protocol->id == Punixseq)
+	    cJSON_AddTrueToObject(j, "unix_seqpacket");
+	if (test->unix_path)
+	    cJSON_AddStringToObject(j, "unix_path", test->unix_path);
 	cJSON_AddIntToObject(j, "omit", test->omit);
 	if (test->server_affinity != -1)
 	    cJSON_AddIntToObject(j, "server_affinity", test->server_affinity);
@@ -1296,6 +2239,36 @@ send_parameters(struct iperf_test *test)
 	cJSON_AddIntToObject(j, "parallel", test->num_streams);
 	if (test->reverse)
 	    cJSON_AddTrueToObject(j, "reverse");
+	if (test->bidirectional)
+	    cJSON_AddTrueToObject(j, "bidirectional");
+	/* The server sends with it too, and splices into its -F file. */
+	if (test->zerocopy)
+	    cJSON_AddTrueToObject(j, "zerocopy");
+	if (test->rr) {
+	    cJSON_AddIntToObject(j, "rr_request", test->rr->request_size);
+	    cJSON_AddIntToObject(j, "rr_response", test->rr->response_size);
+	    cJSON_AddIntToObject(j, "rr_outstanding", test->rr->outstanding);
+	    if (test->rr->crr)
+		cJSON_AddTrueToObject(j, "crr");
+	}
+	if (test->profile && (test->reverse || test->bidirectional))
+	    cJSON_AddStringToObject(j, "profile", test->profile->spec);
+	if (test->size_mix)
+	    cJSON_AddStringToObject(j, "size_mix", test->size_mix->spec);
+	if (test->flows)
+	    cJSON_AddIntToObject(j, "flows", test->flows->nflows);
+	if (test->verify)
+	    cJSON_AddIntToObject(j, "verify", test->verify->seed);
+	if (test->payload_mode)
+	    cJSON_AddStringToObject(j, "payload", test->payload_mode->spec);
+	if (test->udp_timestamps)
+	    cJSON_AddIntToObject(j, "udp_timestamps", test->udp_timestamps);
+	if (test->busy_poll)
+	    cJSON_AddIntToObject(j, "busy_poll", test->busy_poll);
+	if (test->af_packet)
+	    cJSON_AddTrueToObject(j, "af_packet");
+	if (test->ktls)
+	    cJSON_AddStringToObject(j, "ktls", iperf_ktls_secret(test->ktls));
 	if (test->settings->socket_bufsize)
 	    cJSON_AddIntToObject(j, "window", test->settings->socket_bufsize);
 	if (test->settings->blksize)
@@ -1316,6 +2289,13 @@ send_parameters(struct iperf_test *test)
 	    cJSON_AddIntToObject(j, "get_server_output", iperf_get_test_get_server_output(test));
 	if (test->udp_counters_64bit)
 	    cJSON_AddIntToObject(j, "udp_counters_64bit", iperf_get_test_udp_counters_64bit(test));
+	if (test->capacity_search)
+	    cJSON_AddFloatToObject(j, "capacity_search", test->capacity_search->max_loss);
+	/* In microseconds: cJSON prints floats with only 6 digits. */
+	if (test->start_at)
+	    cJSON_AddIntToObject(j, "start_at_usec", (int64_t) (test->start_at * SEC_TO_US));
+	else if (test->align_intervals)
+	    cJSON_AddTrueToObject(j, "align_intervals");
 
 	cJSON_AddStringToObject(j, "client_version", IPERF_VERSION);
 
@@ -1339,7 +2319,8 @@ get_parameters(struct iperf_test *test)
 {
     int r = 0;
     cJSON *j;
-    cJSON *j_p;
+    cJSON *j_p, *j_p2, *j_p3;
+    struct timeval now;
 
     j = JSON_read(test->ctrl_sck);
     if (j == NULL) {
@@ -1356,6 +2337,17 @@ get_parameters(struct iperf_test *test)
 	    set_protocol(test, Pudp);
         if ((j_p = cJSON_GetObjectItem(j, "sctp")) != NULL)
             set_protocol(test, Psctp);
+	if ((j_p = cJSON_GetObjectItem(j, "unix")) != NULL)
+	    set_protocol(test, Punix);
+	if ((j_p = cJSON_GetObjectItem(j, "unix_seqpacket")) != NULL)
+	    set_protocol(test, Punixseq);
+	if ((j_p = cJSON_GetObjectItem(j, "unix_path")) != NULL) {
+	    if (j_p->type != cJSON_String || j_p->valuestring[0] == '\0' || strlen(j_p->valuestring) >= sizeof(((struct sockaddr_un *) 0)->sun_path)) {
+		i_errno = IEUNIX;
+		r = -1;
+	    } else
+		test->unix_path = strdup(j_p->valuestring);
+	}
 	if ((j_p = cJSON_GetObjectItem(j, "omit")) != NULL)
 	    test->omit = j_p->valueint;
 	if ((j_p = cJSON_GetObjectItem(j, "server_affinity")) != NULL)
@@ -1374,6 +2366,59 @@ get_parameters(struct iperf_test *test)
 	    test->num_streams = j_p->valueint;
 	if ((j_p = cJSON_GetObjectItem(j, "reverse")) != NULL)
 	    iperf_set_test_reverse(test, 1);
+	if ((j_p = cJSON_GetObjectItem(j, "bidirectional")) != NULL)
+	    test->bidirectional = 1;
+	if ((j_p = cJSON_GetObjectItem(j, "zerocopy")) != NULL)
+	    iperf_set_test_zerocopy(test, 1);
+	if ((j_p = cJSON_GetObjectItem(j, "rr_request")) != NULL) {
+	    j_p2 = cJSON_GetObjectItem(j, "rr_response");
+	    j_p3 = cJSON_GetObjectItem(j, "rr_outstanding");
+	    if (j_p2 == NULL || j_p3 == NULL || j_p->valueint < RR_HEADER_LEN || j_p2->valueint < RR_HEADER_LEN || j_p3->valueint < 1) {
+		i_errno = IEREQRESP;
+		r = -1;
+	    } else if ((test->rr = iperf_rr_new(j_p->valueint, j_p2->valueint, j_p3->valueint, cJSON_GetObjectItem(j, "crr") != NULL)) == NULL) {
+		i_errno = IENEWTEST;
+		r = -1;
+	    }
+	}
+	if ((j_p = cJSON_GetObjectItem(j, "profile")) != NULL) {
+	    if (strncmp(j_p->valuestring, "trace:", 6) == 0) {
+		i_errno = IEPROFILE;
+		r = -1;
+	    } else if ((test->profile = iperf_profile_new(j_p->valuestring)) == NULL)
+		r = -1;
+	}
+	if ((j_p = cJSON_GetObjectItem(j, "size_mix")) != NULL &&
+	    (test->size_mix = iperf_size_mix_new(j_p->valuestring)) == NULL)
+	    r = -1;
+	if ((j_p = cJSON_GetObjectItem(j, "flows")) != NULL &&
+	    (test->flows = iperf_flows_new(j_p->valueint, 0)) == NULL)
+	    r = -1;
+	if ((j_p = cJSON_GetObjectItem(j, "verify")) != NULL &&
+	    (test->verify = iperf_verify_new((uint32_t) j_p->valueint)) == NULL)
+	    r = -1;
+	if ((j_p = cJSON_GetObjectItem(j, "payload")) != NULL) {
+	    if (test->rr) {
+		i_errno = IEPAYLOAD;
+		r = -1;
+	    } else if ((test->payload_mode = iperf_payload_mode_new(j_p->valuestring)) == NULL)
+		r = -1;
+	}
+	if ((j_p = cJSON_GetObjectItem(j, "udp_timestamps")) != NULL) {
+	    /* A mode from a newer client: don't guess at its layout. */
+	    if (j_p->valueint != UDP_TIMESTAMPS_SW && j_p->valueint != UDP_TIMESTAMPS_HW) {
+		i_errno = IEUDPTIMESTAMPS;
+		r = -1;
+	    } else
+		test->udp_timestamps = j_p->valueint;
+	}
+	if ((j_p = cJSON_GetObjectItem(j, "busy_poll")) != NULL)
+	    test->busy_poll = j_p->valueint;
+	if (cJSON_GetObjectItem(j, "af_packet") != NULL)
+	    test->af_packet = 1;
+	if ((j_p = cJSON_GetObjectItem(j, "ktls")) != NULL &&
+	    (j_p->type != cJSON_String || (test->ktls = iperf_ktls_new(j_p->valuestring)) == NULL))
+	    r = -1;
 	if ((j_p = cJSON_GetObjectItem(j, "window")) != NULL)
 	    test->settings->socket_bufsize = j_p->valueint;
 	if ((j_p = cJSON_GetObjectItem(j, "len")) != NULL)
@@ -1394,7 +2439,31 @@ get_parameters(struct iperf_test *test)
 	    iperf_set_test_get_server_output(test, 1);
 	if ((j_p = cJSON_GetObjectItem(j, "udp_counters_64bit")) != NULL)
 	    iperf_set_test_udp_counters_64bit(test, 1);
-	if (test->sender && test->protocol->id == Ptcp && has_tcpinfo_retransmits())
+	if ((j_p = cJSON_GetObjectItem(j, "start_at_usec")) != NULL) {
+	    test->start_at = j_p->valueint / (double) SEC_TO_US;
+	    /* The server waits for it, busy with nothing else: keep it near. */
+	    gettimeofday(&now, NULL);
+	    if (test->start_at > timeval_to_double(&now) + MAX_START_DELAY) {
+		i_errno = IESTARTATFAR;
+		r = -1;
+	    }
+	    test->align_intervals = 1;
+	    test->interval_base.tv_sec = (time_t) test->start_at;
+	    test->interval_base.tv_usec = (test->start_at - test->interval_base.tv_sec) * SEC_TO_US;
+	}
+	if ((j_p = cJSON_GetObjectItem(j, "align_intervals")) != NULL)
+	    test->align_intervals = 1;
+	if ((j_p = cJSON_GetObjectItem(j, "capacity_search")) != NULL) {
+	    test->capacity_search = (struct iperf_capacity_search *) malloc(sizeof(struct iperf_capacity_search));
+	    if (test->capacity_search == NULL) {
+		i_errno = IERECVPARAMS;
+		r = -1;
+	    } else {
+		memset(test->capacity_search, 0, sizeof(struct iperf_capacity_search));
+		test->capacity_search->max_loss = j_p->valuefloat;
+	    }
+	}
+	if ((test->sender || test->bidirectional) && test->protocol->id == Ptcp && has_tcpinfo_retransmits())
 	    test->sender_has_retransmits = 1;
 	cJSON_Delete(j);
     }
@@ -1423,11 +2492,13 @@ send_results(struct iperf_test *test)
 	cJSON_AddFloatToObject(j, "cpu_util_total", test->cpu_util[0]);
 	cJSON_AddFloatToObject(j, "cpu_util_user", test->cpu_util[1]);
 	cJSON_AddFloatToObject(j, "cpu_util_system", test->cpu_util[2]);
-	if ( ! test->sender )
+	if ( ! test->sender && ! test->bidirectional )
 	    sender_has_retransmits = -1;
 	else
 	    sender_has_retransmits = test->sender_has_retransmits;
 	cJSON_AddIntToObject(j, "sender_has_retransmits", sender_has_retransmits);
+	if (test->ktls)
+	    cJSON_AddFloatToObject(j, "ktls_crypto_cpu", iperf_ktls_crypto_cpu(test));
 
 	/* If on the server and sending server output, then do this */
 	if (test->role == 's' && test->get_server_output) {
@@ -1456,6 +2527,13 @@ send_results(struct iperf_test *test)
 	    }
 	}
 
+	/* The receiving side ran the capacity search; pass its trials along. */
+	if (test->capacity_search && !test->sender)
+	    cJSON_AddItemToObject(j, "capacity_search", capacity_search_json(test));
+	/* Likewise how the flows fared. */
+	if (test->flows && !test->sender)
+	    cJSON_AddItemToObject(j, "flows", iperf_flows_to_json(test));
+
 	j_streams = cJSON_CreateArray();
 	if (j_streams == NULL) {
 	    i_errno = IEPACKAGERESULTS;
@@ -1469,14 +2547,24 @@ send_results(struct iperf_test *test)
 		    r = -1;
 		} else {
 		    cJSON_AddItemToArray(j_streams, j_stream);
-		    bytes_transferred = test->sender ? (sp->result->bytes_sent - sp->result->bytes_sent_omit) : sp->result->bytes_received;
-		    retransmits = (test->sender && test->sender_has_retransmits) ? sp->result->stream_retrans : -1;
+		    bytes_transferred = sp->sender ? (sp->result->bytes_sent - sp->result->bytes_sent_omit) : sp->result->bytes_received;
+		    retransmits = (sp->sender && test->sender_has_retransmits) ? sp->result->stream_retrans : -1;
 		    cJSON_AddIntToObject(j_stream, "id", sp->id);
 		    cJSON_AddIntToObject(j_stream, "bytes", bytes_transferred);
 		    cJSON_AddIntToObject(j_stream, "retransmits", retransmits);
 		    cJSON_AddFloatToObject(j_stream, "jitter", sp->jitter);
 		    cJSON_AddIntToObject(j_stream, "errors", sp->cnt_error);
 		    cJSON_AddIntToObject(j_stream, "packets", sp->packet_count);
+		    if (test->size_mix && !sp->sender)
+			cJSON_AddItemToObject(j_stream, "size_mix", iperf_size_mix_to_json(sp));
+		    if (test->verify && !sp->sender)
+			cJSON_AddItemToObject(j_stream, "verify", iperf_verify_to_json(sp));
+		    if (sp->timestamp && !sp->sender)
+			cJSON_AddItemToObject(j_stream, "owd", iperf_timestamp_to_json(sp));
+		    if (sp->seq && !sp->sender)
+			cJSON_AddItemToObject(j_stream, "sequence", iperf_seq_to_json(sp));
+		    if (sp->drops && !sp->sender)
+			cJSON_AddItemToObject(j_stream, "drops", iperf_drops_to_json(sp));
 		}
 	    }
 	    if (r == 0 && test->debug) {
@@ -1514,6 +2602,7 @@ get_results(struct iperf_test *test)
     cJSON *j_errors;
     cJSON *j_packets;
     cJSON *j_server_output;
+    cJSON *j_p;
     int sid, cerror, pcount;
     double jitter;
     iperf_size_t bytes_transferred;
@@ -1540,9 +2629,13 @@ get_results(struct iperf_test *test)
 	    test->remote_cpu_util[0] = j_cpu_util_total->valuefloat;
 	    test->remote_cpu_util[1] = j_cpu_util_user->valuefloat;
 	    test->remote_cpu_util[2] = j_cpu_util_system->valuefloat;
+	    if (test->ktls && (j_p = cJSON_GetObjectItem(j, "ktls_crypto_cpu")) != NULL)
+		iperf_ktls_remote_crypto_cpu(test, j_p->valuefloat);
 	    result_has_retransmits = j_sender_has_retransmits->valueint;
 	    if (! test->sender)
 		test->sender_has_retransmits = result_has_retransmits;
+	    else if (test->bidirectional && result_has_retransmits != 1)
+		test->sender_has_retransmits = 0;	/* only report them if both sides have them */
 	    j_streams = cJSON_GetObjectItem(j, "streams");
 	    if (j_streams == NULL) {
 		i_errno = IERECVRESULTS;
@@ -1577,7 +2670,17 @@ get_results(struct iperf_test *test)
 				i_errno = IESTREAMID;
 				r = -1;
 			    } else {
-				if (test->sender) {
+				if (sp->sender) {
+				    if (test->size_mix && (j_p = cJSON_GetObjectItem(j_stream, "size_mix")) != NULL)
+					iperf_size_mix_from_json(sp, j_p);
+				    if (test->verify && (j_p = cJSON_GetObjectItem(j_stream, "verify")) != NULL)
+					iperf_verify_from_json(sp, j_p);
+				    if (sp->timestamp && (j_p = cJSON_GetObjectItem(j_stream, "owd")) != NULL)
+					iperf_timestamp_from_json(sp, j_p);
+				    if (sp->seq && (j_p = cJSON_GetObjectItem(j_stream, "sequence")) != NULL)
+					iperf_seq_from_json(sp, j_p);
+				    if (sp->drops && (j_p = cJSON_GetObjectItem(j_stream, "drops")) != NULL)
+					iperf_drops_from_json(sp, j_p);
 				    sp->jitter = jitter;
 				    sp->cnt_error = cerror;
 				    sp->packet_count = pcount;
@@ -1590,6 +2693,12 @@ get_results(struct iperf_test *test)
 			}
 		    }
 		}
+		if (test->capacity_search && test->sender &&
+		    (j_p = cJSON_GetObjectItem(j, "capacity_search")) != NULL)
+		    capacity_search_from_json(test, j_p);
+		if (test->flows && test->sender &&
+		    (j_p = cJSON_GetObjectItem(j, "flows")) != NULL)
+		    iperf_flows_from_json(test, j_p);
 		/*
 		 * If we're the client and we're supposed to get remote results,
 		 * look them up and process accordingly.
@@ -1692,9 +2801,22 @@ void
 connect_msg(struct iperf_stream *sp)
 {
     char ipl[INET6_ADDRSTRLEN], ipr[INET6_ADDRSTRLEN];
+    char ul[sizeof(struct sockaddr_un) + 1], ur[sizeof(struct sockaddr_un) + 1];
     int lport, rport;
+    int domain = getsockdomain(sp->socket);
+
+    if (domain == AF_UNIX) {
+	/* Names rather than addresses; the client's end has none. */
+	iperf_unix_name(&sp->local_addr, ul, sizeof(ul));
+	iperf_unix_name(&sp->remote_addr, ur, sizeof(ur));
+	if (sp->test->json_output)
+	    cJSON_AddItemToArray(sp->test->json_connected, iperf_json_printf("socket: %d  local_host: %s  local_port: %d  remote_host: %s  remote_port: %d", (int64_t) sp->socket, ul, (int64_t) 0, ur, (int64_t) 0));
+	else
+	    iprintf(sp->test, report_connected_unix, sp->socket, ul, ur);
+	return;
+    }
 
-    if (getsockdomain(sp->socket) == AF_INET) {
+    if (domain == AF_INET) {
         inet_ntop(AF_INET, (void *) &((struct sockaddr_in *) &sp->local_addr)->sin_addr, ipl, sizeof(ipl));
 	mapped_v4_to_regular_v4(ipl);
         inet_ntop(AF_INET, (void *) &((struct sockaddr_in *) &sp->remote_addr)->sin_addr, ipr, sizeof(ipr));
@@ -1772,7 +2894,7 @@ protocol_free(struct protocol *proto)
 int
 iperf_defaults(struct iperf_test *testp)
 {
-    struct protocol *tcp, *udp;
+    struct protocol *tcp, *udp, *ustream, *useqpacket;
 #if defined(HAVE_SCTP)
     struct protocol *sctp;
 #endif /* HAVE_SCTP */
@@ -1783,6 +2905,7 @@ iperf_defaults(struct iperf_test *testp)
     testp->affinity = -1;
     testp->server_affinity = -1;
     TAILQ_INIT(&testp->xbind_addrs);
+    TAILQ_INIT(&testp->schedule);
 #if defined(HAVE_CPUSET_SETAFFINITY)
     CPU_ZERO(&testp->cpumask);
 #endif /* HAVE_CPUSET_SETAFFINITY */
@@ -1845,6 +2968,41 @@ iperf_defaults(struct iperf_test *testp)
     udp->init = iperf_udp_init;
     SLIST_INSERT_AFTER(tcp, udp, protocols);
 
+    ustream = protocol_new();
+    if (!ustream) {
+        protocol_free(tcp);
+        protocol_free(udp);
+        return -1;
+    }
+
+    ustream->id = Punix;
+    ustream->name = "UNIX";
+    ustream->accept = iperf_unix_accept;
+    ustream->listen = iperf_unix_listen;
+    ustream->connect = iperf_unix_connect;
+    ustream->send = iperf_unix_send;
+    ustream->recv = iperf_unix_recv;
+    ustream->init = NULL;
+    SLIST_INSERT_AFTER(udp, ustream, protocols);
+
+    useqpacket = protocol_new();
+    if (!useqpacket) {
+        protocol_free(tcp);
+        protocol_free(udp);
+        protocol_free(ustream);
+        return -1;
+    }
+
+    useqpacket->id = Punixseq;
+    useqpacket->name = "UNIX-SEQPACKET";
+    useqpacket->accept = iperf_unix_accept;
+    useqpacket->listen = iperf_unix_listen;
+    useqpacket->connect = iperf_unix_connect;
+    useqpacket->send = iperf_unix_send;
+    useqpacket->recv = iperf_unix_recv;
+    useqpacket->init = NULL;
+    SLIST_INSERT_AFTER(ustream, useqpacket, protocols);
+
     set_protocol(testp, Ptcp);
 
 #if defined(HAVE_SCTP)
@@ -1910,12 +3068,38 @@ iperf_free_test(struct iperf_test *test)
             free(xbe);
         }
     }
+    while (!TAILQ_EMPTY(&test->schedule)) {
+	struct iperf_schedule_entry *se;
+
+	se = TAILQ_FIRST(&test->schedule);
+	TAILQ_REMOVE(&test->schedule, se, link);
+	if (se->timer != NULL)
+	    tmr_cancel(se->timer);
+	free(se->spec);
+	free(se);
+    }
+    if (test->json_events != NULL)
+	cJSON_Delete(test->json_events);
+    if (test->capacity_search)
+	free(test->capacity_search);
+    iperf_rr_free(test->rr);
+    iperf_profile_free(test->profile);
+    iperf_size_mix_free(test->size_mix);
+    iperf_flows_free(test->flows);
+    iperf_payload_free(test->payload);
+    iperf_verify_free(test->verify);
+    iperf_drops_free(test->drops);
+    iperf_placement_free(test);
+    iperf_capture_free(test->capture);
+    iperf_ktls_free(test->ktls);
+    iperf_payload_mode_free(test->payload_mode);
     if (test->settings)
     free(test->settings);
     if (test->title)
 	free(test->title);
     if (test->congestion)
 	free(test->congestion);
+    free(test->unix_path);
     if (test->omit_timer != NULL)
 	tmr_cancel(test->omit_timer);
     if (test->timer != NULL)
@@ -1975,6 +3159,7 @@ void
 iperf_reset_test(struct iperf_test *test)
 {
     struct iperf_stream *sp;
+    struct iperf_schedule_entry *se;
 
     /* Free streams */
     while (!SLIST_EMPTY(&test->streams)) {
@@ -1998,6 +3183,45 @@ iperf_reset_test(struct iperf_test *test)
 	tmr_cancel(test->reporter_timer);
 	test->reporter_timer = NULL;
     }
+    TAILQ_FOREACH(se, &test->schedule, link) {
+	if (se->timer != NULL) {
+	    tmr_cancel(se->timer);
+	    se->timer = NULL;
+	}
+    }
+    if (test->json_events != NULL) {
+	cJSON_Delete(test->json_events);
+	test->json_events = NULL;
+    }
+    if (test->capacity_search != NULL) {
+	free(test->capacity_search);
+	test->capacity_search = NULL;
+    }
+    iperf_rr_free(test->rr);
+    test->rr = NULL;
+    iperf_profile_free(test->profile);
+    test->profile = NULL;
+    iperf_size_mix_free(test->size_mix);
+    test->size_mix = NULL;
+    iperf_flows_free(test->flows);
+    test->flows = NULL;
+    iperf_payload_free(test->payload);
+    test->payload = NULL;
+    iperf_verify_free(test->verify);
+    test->verify = NULL;
+    iperf_ktls_free(test->ktls);
+    test->ktls = NULL;
+    free(test->unix_path);
+    test->unix_path = NULL;
+    iperf_drops_free(test->drops);
+    test->drops = NULL;
+    iperf_placement_free(test);
+    iperf_payload_mode_free(test->payload_mode);
+    test->payload_mode = NULL;
+    test->start_at = 0;
+    test->align_intervals = 0;
+    test->interval_base.tv_sec = test->interval_base.tv_usec = 0;
+    test->label_base.tv_sec = test->label_base.tv_usec = 0;
     test->done = 0;
 
     SLIST_INIT(&test->streams);
@@ -2021,6 +3245,8 @@ iperf_reset_test(struct iperf_test *test)
     test->blocks_sent = 0;
 
     test->reverse = 0;
+    test->bidirectional = 0;
+    test->zerocopy = 0;
     test->no_delay = 0;
 
     FD_ZERO(&test->read_set);
@@ -2035,6 +3261,13 @@ iperf_reset_test(struct iperf_test *test)
     memset(test->cookie, 0, COOKIE_SIZE);
     test->multisend = 10;	/* arbitrary */
     test->udp_counters_64bit = 0;
+    test->udp_timestamps = 0;
+    test->busy_poll = 0;
+    test->af_packet = 0;
+    test->busy_polls = 0;
+    test->busy_polls_empty = 0;
+    test->busy_poll_last.tv_sec = test->busy_poll_last.tv_usec = 0;
+    test->busy_poll_gap_sum = test->busy_poll_gap_max = 0.0;
 
     /* Free output line buffers, if any (on the server only) */
     struct iperf_textline *t;
@@ -2064,6 +3297,8 @@ iperf_reset_stats(struct iperf_test *test)
 	sp->omitted_packet_count = sp->packet_count;
         sp->omitted_cnt_error = sp->cnt_error;
         sp->omitted_outoforder_packets = sp->outoforder_packets;
+	if (sp->seq)
+	    iperf_seq_reset(sp);
 	sp->jitter = 0;
 	rp = sp->result;
         rp->bytes_sent_omit = rp->bytes_sent;
@@ -2093,11 +3328,23 @@ iperf_stats_callback(struct iperf_test *test)
     struct iperf_stream_result *rp = NULL;
     struct iperf_interval_results *irp, temp;
 
+    /*
+     * With aligned intervals, the stats timer is due at the boundary this
+     * interval ends on: either it is firing now, or the test is ending
+     * early within the interval.
+     */
+    if (test->align_intervals && test->stats_timer != NULL)
+	test->interval_boundary = test->stats_timer->time;
+
+    if (test->rr)
+	histogram_reset(test->rr->interval);
+    if (test->drops)
+	iperf_drops_test_stats(test);
     temp.omitted = test->omitting;
     SLIST_FOREACH(sp, &test->streams, streams) {
         rp = sp->result;
 
-	temp.bytes_transferred = test->sender ? rp->bytes_sent_this_interval : rp->bytes_received_this_interval;
+	temp.bytes_transferred = sp->sender ? rp->bytes_sent_this_interval : rp->bytes_received_this_interval;
      
 	irp = TAILQ_LAST(&rp->interval_results, irlisthead);
         /* result->end_time contains timestamp of previous interval */
@@ -2113,7 +3360,7 @@ iperf_stats_callback(struct iperf_test *test)
 	if (test->protocol->id == Ptcp) {
 	    if ( has_tcpinfo()) {
 		save_tcpinfo(sp, &temp);
-		if (test->sender && test->sender_has_retransmits) {
+		if (sp->sender && test->sender_has_retransmits) {
 		    long total_retrans = get_total_retransmits(&temp);
 		    temp.interval_retrans = total_retrans - rp->stream_prev_total_retrans;
 		    rp->stream_retrans += temp.interval_retrans;
@@ -2151,49 +3398,68 @@ iperf_stats_callback(struct iperf_test *test)
 	    temp.outoforder_packets = sp->outoforder_packets;
 	    temp.cnt_error = sp->cnt_error;
 	}
+	if (test->rr)
+	    iperf_rr_stats(sp, &temp);
+	if (sp->verify)
+	    iperf_verify_stats(sp, &temp);
+	if (sp->timestamp)
+	    iperf_timestamp_stats(sp, &temp);
+	if (sp->seq)
+	    iperf_seq_stats(sp, &temp);
+	if (sp->drops && !sp->sender)
+	    iperf_drops_stats(sp, &temp);
+	if (test->busy_poll)
+	    iperf_busy_poll_stats(sp);
         add_to_interval_list(rp, &temp);
         rp->bytes_sent_this_interval = rp->bytes_received_this_interval = 0;
     }
+
+    if (test->capacity_search && !test->sender)
+	capacity_search_step(test);
 }
 
 /**
- * Print intermediate results during a test (interval report).
- * Uses print_interval_results to print the results for each stream,
- * then prints an interval summary for all streams in this
- * interval.
+ * Trailing tag of a report line: the omitted / sender / receiver marker
+ * passed in, prefixed with the direction of the streams in --bidir mode.
+ */
+static const char *
+report_tag(struct iperf_test *test, int sender, const char *tag, char *buf, size_t len)
+{
+    if (!test->bidirectional)
+	return tag;
+    snprintf(buf, len, "%s%s%s", sender ? report_bidir_tx : report_bidir_rx, *tag ? " " : "", tag);
+    return buf;
+}
+
+/**
+ * Print the interval results of the streams going in one direction,
+ * and their sum.  The sum of the reverse direction in --bidir mode is
+ * reported under "sum_bidir_reverse".
  */
 static void
-iperf_print_intermediate(struct iperf_test *test)
+print_intermediate_direction(struct iperf_test *test, int sender, cJSON *json_interval, cJSON *json_interval_streams)
 {
     char ubuf[UNIT_LEN];
     char nbuf[UNIT_LEN];
-    struct iperf_stream *sp = NULL;
-    struct iperf_interval_results *irp;
+    char tbuf[UNIT_LEN];
+    struct iperf_stream *sp = NULL, *first = NULL;
+    struct iperf_interval_results *irp = NULL;
     iperf_size_t bytes = 0;
     double bandwidth;
     int retransmits = 0;
     double start_time, end_time;
-    cJSON *json_interval;
-    cJSON *json_interval_streams;
     int total_packets = 0, lost_packets = 0;
     double avg_jitter = 0.0, lost_percent;
-
-    if (test->json_output) {
-        json_interval = cJSON_CreateObject();
-	if (json_interval == NULL)
-	    return;
-	cJSON_AddItemToArray(test->json_intervals, json_interval);
-        json_interval_streams = cJSON_CreateArray();
-	if (json_interval_streams == NULL)
-	    return;
-	cJSON_AddItemToObject(json_interval, "streams", json_interval_streams);
-    } else {
-        json_interval = NULL;
-        json_interval_streams = NULL;
-    }
+    const char *sum_name = sender == test->sender ? "sum" : "sum_bidir_reverse";
 
     SLIST_FOREACH(sp, &test->streams, streams) {
+	if (sp->sender != sender)
+	    continue;
+	if (first == NULL)
+	    first = sp;
         print_interval_results(test, sp, json_interval_streams);
+	if (json_interval_streams != NULL && sender != test->sender)
+	    cJSON_AddItemToObject(cJSON_GetArrayItem(json_interval_streams, cJSON_GetArraySize(json_interval_streams) - 1), "bidir_reverse", cJSON_CreateBool(1));
 	/* sum up all streams */
 	irp = TAILQ_LAST(&sp->result->interval_results, irlisthead);
 	if (irp == NULL) {
@@ -2202,7 +3468,7 @@ iperf_print_intermediate(struct iperf_test *test)
 	}
         bytes += irp->bytes_transferred;
 	if (test->protocol->id == Ptcp) {
-	    if (test->sender && test->sender_has_retransmits) {
+	    if (sender && test->sender_has_retransmits) {
 		retransmits += irp->interval_retrans;
 	    }
 	} else {
@@ -2214,7 +3480,7 @@ iperf_print_intermediate(struct iperf_test *test)
 
     /* next build string with sum of all streams */
     if (test->num_streams > 1 || test->json_output) {
-        sp = SLIST_FIRST(&test->streams); /* reset back to 1st stream */
+        sp = first; /* reset back to 1st stream */
 	/* Only do this of course if there was a first stream */
 	if (sp) {
         irp = TAILQ_LAST(&sp->result->interval_results, irlisthead);    /* use 1st stream for timing info */
@@ -2223,29 +3489,29 @@ iperf_print_intermediate(struct iperf_test *test)
 	bandwidth = (double) bytes / (double) irp->interval_duration;
         unit_snprintf(nbuf, UNIT_LEN, bandwidth, test->settings->unit_format);
 
-        start_time = timeval_diff(&sp->result->start_time,&irp->interval_start_time);
-        end_time = timeval_diff(&sp->result->start_time,&irp->interval_end_time);
-	if (test->protocol->id == Ptcp || test->protocol->id == Psctp) {
-	    if (test->sender && test->sender_has_retransmits) {
+        start_time = iperf_interval_time(sp, &irp->interval_start_time);
+        end_time = iperf_interval_time(sp, &irp->interval_end_time);
+	if (test->protocol->id != Pudp) {
+	    if (sender && test->sender_has_retransmits) {
 		/* Interval sum, TCP with retransmits. */
 		if (test->json_output)
-		    cJSON_AddItemToObject(json_interval, "sum", iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  retransmits: %d  omitted: %b", (double) start_time, (double) end_time, (double) irp->interval_duration, (int64_t) bytes, bandwidth * 8, (int64_t) retransmits, irp->omitted)); /* XXX irp->omitted or test->omitting? */
+		    cJSON_AddItemToObject(json_interval, sum_name, iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  retransmits: %d  omitted: %b", (double) start_time, (double) end_time, (double) irp->interval_duration, (int64_t) bytes, bandwidth * 8, (int64_t) retransmits, irp->omitted)); /* XXX irp->omitted or test->omitting? */
 		else
-		    iprintf(test, report_sum_bw_retrans_format, start_time, end_time, ubuf, nbuf, retransmits, irp->omitted?report_omitted:""); /* XXX irp->omitted or test->omitting? */
+		    iprintf(test, report_sum_bw_retrans_format, start_time, end_time, ubuf, nbuf, retransmits, report_tag(test, sender, irp->omitted?report_omitted:"", tbuf, sizeof(tbuf))); /* XXX irp->omitted or test->omitting? */
 	    } else {
 		/* Interval sum, TCP without retransmits. */
 		if (test->json_output)
-		    cJSON_AddItemToObject(json_interval, "sum", iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  omitted: %b", (double) start_time, (double) end_time, (double) irp->interval_duration, (int64_t) bytes, bandwidth * 8, test->omitting));
+		    cJSON_AddItemToObject(json_interval, sum_name, iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  omitted: %b", (double) start_time, (double) end_time, (double) irp->interval_duration, (int64_t) bytes, bandwidth * 8, test->omitting));
 		else
-		    iprintf(test, report_sum_bw_format, start_time, end_time, ubuf, nbuf, test->omitting?report_omitted:"");
+		    iprintf(test, report_sum_bw_format, start_time, end_time, ubuf, nbuf, report_tag(test, sender, test->omitting?report_omitted:"", tbuf, sizeof(tbuf)));
 	    }
 	} else {
 	    /* Interval sum, UDP. */
-	    if (test->sender) {
+	    if (sender) {
 		if (test->json_output)
-		    cJSON_AddItemToObject(json_interval, "sum", iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  packets: %d  omitted: %b", (double) start_time, (double) end_time, (double) irp->interval_duration, (int64_t) bytes, bandwidth * 8, (int64_t) total_packets, test->omitting));
+		    cJSON_AddItemToObject(json_interval, sum_name, iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  packets: %d  omitted: %b", (double) start_time, (double) end_time, (double) irp->interval_duration, (int64_t) bytes, bandwidth * 8, (int64_t) total_packets, test->omitting));
 		else
-		    iprintf(test, report_sum_bw_udp_sender_format, start_time, end_time, ubuf, nbuf, total_packets, test->omitting?report_omitted:"");
+		    iprintf(test, report_sum_bw_udp_sender_format, start_time, end_time, ubuf, nbuf, total_packets, report_tag(test, sender, test->omitting?report_omitted:"", tbuf, sizeof(tbuf)));
 	    } else {
 		avg_jitter /= test->num_streams;
 		if (total_packets > 0) {
@@ -2255,9 +3521,9 @@ iperf_print_intermediate(struct iperf_test *test)
 		    lost_percent = 0.0;
 		}
 		if (test->json_output)
-		    cJSON_AddItemToObject(json_interval, "sum", iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  jitter_ms: %f  lost_packets: %d  packets: %d  lost_percent: %f  omitted: %b", (double) start_time, (double) end_time, (double) irp->interval_duration, (int64_t) bytes, bandwidth * 8, (double) avg_jitter * 1000.0, (int64_t) lost_packets, (int64_t) total_packets, (double) lost_percent, test->omitting));
+		    cJSON_AddItemToObject(json_interval, sum_name, iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  jitter_ms: %f  lost_packets: %d  packets: %d  lost_percent: %f  omitted: %b", (double) start_time, (double) end_time, (double) irp->interval_duration, (int64_t) bytes, bandwidth * 8, (double) avg_jitter * 1000.0, (int64_t) lost_packets, (int64_t) total_packets, (double) lost_percent, test->omitting));
 		else
-		    iprintf(test, report_sum_bw_udp_format, start_time, end_time, ubuf, nbuf, avg_jitter * 1000.0, lost_packets, total_packets, lost_percent, test->omitting?report_omitted:"");
+		    iprintf(test, report_sum_bw_udp_format, start_time, end_time, ubuf, nbuf, avg_jitter * 1000.0, lost_packets, total_packets, lost_percent, report_tag(test, sender, test->omitting?report_omitted:"", tbuf, sizeof(tbuf)));
 	    }
 	}
 	}
@@ -2265,18 +3531,78 @@ iperf_print_intermediate(struct iperf_test *test)
 }
 
 /**
- * Print overall summary statistics at the end of a test.
+ * Print intermediate results during a test (interval report).
+ * Uses print_interval_results to print the results for each stream,
+ * then prints an interval summary for all streams in this
+ * interval.  In --bidir mode this is done for each direction.
  */
 static void
-iperf_print_results(struct iperf_test *test)
+iperf_print_intermediate(struct iperf_test *test)
 {
+    cJSON *json_interval;
+    cJSON *json_interval_streams;
 
-    cJSON *json_summary_streams = NULL;
+    if (test->json_output) {
+        json_interval = cJSON_CreateObject();
+	if (json_interval == NULL)
+	    return;
+	cJSON_AddItemToArray(test->json_intervals, json_interval);
+        json_interval_streams = cJSON_CreateArray();
+	if (json_interval_streams == NULL)
+	    return;
+	cJSON_AddItemToObject(json_interval, "streams", json_interval_streams);
+	/* Parameter changes since the last interval report. */
+	if (test->json_events != NULL) {
+	    cJSON_AddItemToObject(json_interval, "events", test->json_events);
+	    test->json_events = NULL;
+	}
+    } else {
+        json_interval = NULL;
+        json_interval_streams = NULL;
+    }
+
+    if (test->rr)
+	iperf_rr_print_intermediate(test, json_interval, json_interval_streams);
+    else {
+	print_intermediate_direction(test, test->sender, json_interval, json_interval_streams);
+	if (test->bidirectional)
+	    print_intermediate_direction(test, !test->sender, json_interval, json_interval_streams);
+    }
+
+    if (test->drops)
+	iperf_drops_print_intermediate(test, json_interval);
+
+    /* Name aligned intervals by the wall-clock boundary they end on, so runs can be merged. */
+    if (json_interval != NULL && test->align_intervals)
+	cJSON_AddIntToObject(json_interval, "timestamp_usec", (int64_t) test->interval_boundary.tv_sec * SEC_TO_US + test->interval_boundary.tv_usec);
+}
+
+/**
+ * JSON name of a summary sum; the reverse direction in --bidir mode
+ * gets a "_bidir_reverse" suffix.
+ */
+static const char *
+sum_name(struct iperf_test *test, int sender, const char *name, char *buf, size_t len)
+{
+    if (sender == test->sender)
+	return name;
+    snprintf(buf, len, "%s_bidir_reverse", name);
+    return buf;
+}
+
+/**
+ * Print the summary of the streams going in one direction, and their sum.
+ */
+static void
+print_results_direction(struct iperf_test *test, int sender, cJSON *json_summary_streams)
+{
     cJSON *json_summary_stream = NULL;
     int total_retransmits = 0;
     int total_packets = 0, lost_packets = 0;
     char ubuf[UNIT_LEN];
     char nbuf[UNIT_LEN];
+    char tbuf[UNIT_LEN];
+    char nbuf_key[UNIT_LEN];
     struct stat sb;
     char sbuf[UNIT_LEN];
     struct iperf_stream *sp = NULL;
@@ -2285,26 +3611,6 @@ iperf_print_results(struct iperf_test *test)
     double start_time, end_time, avg_jitter = 0.0, lost_percent;
     double bandwidth;
 
-    /* print final summary for all intervals */
-
-    if (test->json_output) {
-        json_summary_streams = cJSON_CreateArray();
-	if (json_summary_streams == NULL)
-	    return;
-	cJSON_AddItemToObject(test->json_end, "streams", json_summary_streams);
-    } else {
-	iprintf(test, "%s", report_bw_separator);
-	if (test->verbose)
-	    iprintf(test, "%s", report_summary);
-	if (test->protocol->id == Ptcp || test->protocol->id == Psctp) {
-	    if (test->sender_has_retransmits)
-		iprintf(test, "%s", report_bw_retrans_header);
-	    else
-		iprintf(test, "%s", report_bw_header);
-	} else
-	    iprintf(test, "%s", report_bw_udp_header);
-    }
-
     start_time = 0.;
     sp = SLIST_FIRST(&test->streams);
     /* 
@@ -2316,11 +3622,15 @@ iperf_print_results(struct iperf_test *test)
     if (sp) {
     end_time = timeval_diff(&sp->result->start_time, &sp->result->end_time);
     SLIST_FOREACH(sp, &test->streams, streams) {
+	if (sp->sender != sender)
+	    continue;
 	if (test->json_output) {
 	    json_summary_stream = cJSON_CreateObject();
 	    if (json_summary_stream == NULL)
 		return;
 	    cJSON_AddItemToArray(json_summary_streams, json_summary_stream);
+	    if (sender != test->sender)
+		cJSON_AddItemToObject(json_summary_stream, "bidir_reverse", cJSON_CreateBool(1));
 	}
 
         bytes_sent = sp->result->bytes_sent - sp->result->bytes_sent_omit;
@@ -2328,7 +3638,7 @@ iperf_print_results(struct iperf_test *test)
         total_sent += bytes_sent;
         total_received += bytes_received;
 
-        if (test->protocol->id == Ptcp || test->protocol->id == Psctp) {
+        if (test->protocol->id != Pudp) {
 	    if (test->sender_has_retransmits) {
 		total_retransmits += sp->result->stream_retrans;
 	    }
@@ -2341,19 +3651,19 @@ iperf_print_results(struct iperf_test *test)
 	unit_snprintf(ubuf, UNIT_LEN, (double) bytes_sent, 'A');
 	bandwidth = (double) bytes_sent / (double) end_time;
 	unit_snprintf(nbuf, UNIT_LEN, bandwidth, test->settings->unit_format);
-	if (test->protocol->id == Ptcp || test->protocol->id == Psctp) {
+	if (test->protocol->id != Pudp) {
 	    if (test->sender_has_retransmits) {
 		/* Summary, TCP with retransmits. */
 		if (test->json_output)
 		    cJSON_AddItemToObject(json_summary_stream, "sender", iperf_json_printf("socket: %d  start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  retransmits: %d  max_snd_cwnd:  %d  max_rtt:  %d  min_rtt:  %d  mean_rtt:  %d", (int64_t) sp->socket, (double) start_time, (double) end_time, (double) end_time, (int64_t) bytes_sent, bandwidth * 8, (int64_t) sp->result->stream_retrans, (int64_t) sp->result->stream_max_snd_cwnd, (int64_t) sp->result->stream_max_rtt, (int64_t) sp->result->stream_min_rtt, (int64_t) ((sp->result->stream_count_rtt == 0) ? 0 : sp->result->stream_sum_rtt / sp->result->stream_count_rtt)));
 		else
-		    iprintf(test, report_bw_retrans_format, sp->socket, start_time, end_time, ubuf, nbuf, sp->result->stream_retrans, report_sender);
+		    iprintf(test, report_bw_retrans_format, sp->socket, start_time, end_time, ubuf, nbuf, sp->result->stream_retrans, report_tag(test, sender, report_sender, tbuf, sizeof(tbuf)));
 	    } else {
 		/* Summary, TCP without retransmits. */
 		if (test->json_output)
 		    cJSON_AddItemToObject(json_summary_stream, "sender", iperf_json_printf("socket: %d  start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f", (int64_t) sp->socket, (double) start_time, (double) end_time, (double) end_time, (int64_t) bytes_sent, bandwidth * 8));
 		else
-		    iprintf(test, report_bw_format, sp->socket, start_time, end_time, ubuf, nbuf, report_sender);
+		    iprintf(test, report_bw_format, sp->socket, start_time, end_time, ubuf, nbuf, report_tag(test, sender, report_sender, tbuf, sizeof(tbuf)));
 	    }
 	} else {
 	    /* Summary, UDP. */
@@ -2366,7 +3676,7 @@ iperf_print_results(struct iperf_test *test)
 	    if (test->json_output)
               cJSON_AddItemToObject(json_summary_stream, "udp", iperf_json_printf("socket: %d  start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  jitter_ms: %f  lost_packets: %d  packets: %d  lost_percent: %f  out_of_order: %d", (int64_t) sp->socket, (double) start_time, (double) end_time, (double) end_time, (int64_t) bytes_sent, bandwidth * 8, (double) sp->jitter * 1000.0, (int64_t) (sp->cnt_error - sp->omitted_cnt_error), (int64_t) (sp->packet_count - sp->omitted_packet_count), (double) lost_percent, (int64_t) (sp->outoforder_packets - sp->omitted_outoforder_packets)));
 	    else {
-              iprintf(test, report_bw_udp_format, sp->socket, start_time, end_time, ubuf, nbuf, sp->jitter * 1000.0, (sp->cnt_error - sp->omitted_cnt_error), (sp->packet_count - sp->omitted_packet_count), lost_percent, "");
+              iprintf(test, report_bw_udp_format, sp->socket, start_time, end_time, ubuf, nbuf, sp->jitter * 1000.0, (sp->cnt_error - sp->omitted_cnt_error), (sp->packet_count - sp->omitted_packet_count), lost_percent, report_tag(test, sender, "", tbuf, sizeof(tbuf)));
 		if (test->role == 'c')
 		    iprintf(test, report_datagrams, sp->socket, (sp->packet_count - sp->omitted_packet_count));
 		if ((sp->outoforder_packets - sp->omitted_outoforder_packets) > 0)
@@ -2375,6 +3685,8 @@ iperf_print_results(struct iperf_test *test)
 	}
 
 	if (sp->diskfile_fd >= 0) {
+	    /* Its numbers aren't final until everything is on disk. */
+	    iperf_diskfile_finish(sp);
 	    if (fstat(sp->diskfile_fd, &sb) == 0) {
 		int percent = (int) ( ( (double) bytes_sent / (double) sb.st_size ) * 100.0 );
 		unit_snprintf(sbuf, UNIT_LEN, (double) sb.st_size, 'A');
@@ -2383,16 +3695,17 @@ iperf_print_results(struct iperf_test *test)
 		else
 		    iprintf(test, report_diskfile, ubuf, sbuf, percent, test->diskfile_name);
 	    }
+	    iperf_diskfile_print(sp, json_summary_stream);
 	}
 
 	unit_snprintf(ubuf, UNIT_LEN, (double) bytes_received, 'A');
 	bandwidth = (double) bytes_received / (double) end_time;
 	unit_snprintf(nbuf, UNIT_LEN, bandwidth, test->settings->unit_format);
-	if (test->protocol->id == Ptcp || test->protocol->id == Psctp) {
+	if (test->protocol->id != Pudp) {
 	    if (test->json_output)
 		cJSON_AddItemToObject(json_summary_stream, "receiver", iperf_json_printf("socket: %d  start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f", (int64_t) sp->socket, (double) start_time, (double) end_time, (double) end_time, (int64_t) bytes_received, bandwidth * 8));
 	    else
-		iprintf(test, report_bw_format, sp->socket, start_time, end_time, ubuf, nbuf, report_receiver);
+		iprintf(test, report_bw_format, sp->socket, start_time, end_time, ubuf, nbuf, report_tag(test, sender, report_receiver, tbuf, sizeof(tbuf)));
 	}
     }
     }
@@ -2407,19 +3720,19 @@ iperf_print_results(struct iperf_test *test)
 	    bandwidth = 0.0;
 	}
         unit_snprintf(nbuf, UNIT_LEN, bandwidth, test->settings->unit_format);
-        if (test->protocol->id == Ptcp || test->protocol->id == Psctp) {
+        if (test->protocol->id != Pudp) {
 	    if (test->sender_has_retransmits) {
 		/* Summary sum, TCP with retransmits. */
 		if (test->json_output)
-		    cJSON_AddItemToObject(test->json_end, "sum_sent", iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  retransmits: %d", (double) start_time, (double) end_time, (double) end_time, (int64_t) total_sent, bandwidth * 8, (int64_t) total_retransmits));
+		    cJSON_AddItemToObject(test->json_end, sum_name(test, sender, "sum_sent", nbuf_key, sizeof(nbuf_key)), iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  retransmits: %d", (double) start_time, (double) end_time, (double) end_time, (int64_t) total_sent, bandwidth * 8, (int64_t) total_retransmits));
 		else
-		    iprintf(test, report_sum_bw_retrans_format, start_time, end_time, ubuf, nbuf, total_retransmits, report_sender);
+		    iprintf(test, report_sum_bw_retrans_format, start_time, end_time, ubuf, nbuf, total_retransmits, report_tag(test, sender, report_sender, tbuf, sizeof(tbuf)));
 	    } else {
 		/* Summary sum, TCP without retransmits. */
 		if (test->json_output)
-		    cJSON_AddItemToObject(test->json_end, "sum_sent", iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f", (double) start_time, (double) end_time, (double) end_time, (int64_t) total_sent, bandwidth * 8));
+		    cJSON_AddItemToObject(test->json_end, sum_name(test, sender, "sum_sent", nbuf_key, sizeof(nbuf_key)), iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f", (double) start_time, (double) end_time, (double) end_time, (int64_t) total_sent, bandwidth * 8));
 		else
-		    iprintf(test, report_sum_bw_format, start_time, end_time, ubuf, nbuf, report_sender);
+		    iprintf(test, report_sum_bw_format, start_time, end_time, ubuf, nbuf, report_tag(test, sender, report_sender, tbuf, sizeof(tbuf)));
 	    }
             unit_snprintf(ubuf, UNIT_LEN, (double) total_received, 'A');
 	    /* If no tests were run, set received bandwidth to 0 */
@@ -2431,9 +3744,9 @@ iperf_print_results(struct iperf_test *test)
 	    }
             unit_snprintf(nbuf, UNIT_LEN, bandwidth, test->settings->unit_format);
 	    if (test->json_output)
-		cJSON_AddItemToObject(test->json_end, "sum_received", iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f", (double) start_time, (double) end_time, (double) end_time, (int64_t) total_received, bandwidth * 8));
+		cJSON_AddItemToObject(test->json_end, sum_name(test, sender, "sum_received", nbuf_key, sizeof(nbuf_key)), iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f", (double) start_time, (double) end_time, (double) end_time, (int64_t) total_received, bandwidth * 8));
 	    else
-		iprintf(test, report_sum_bw_format, start_time, end_time, ubuf, nbuf, report_receiver);
+		iprintf(test, report_sum_bw_format, start_time, end_time, ubuf, nbuf, report_tag(test, sender, report_receiver, tbuf, sizeof(tbuf)));
         } else {
 	    /* Summary sum, UDP. */
             avg_jitter /= test->num_streams;
@@ -2445,11 +3758,116 @@ iperf_print_results(struct iperf_test *test)
 		lost_percent = 0.0;
 	    }
 	    if (test->json_output)
-		cJSON_AddItemToObject(test->json_end, "sum", iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  jitter_ms: %f  lost_packets: %d  packets: %d  lost_percent: %f", (double) start_time, (double) end_time, (double) end_time, (int64_t) total_sent, bandwidth * 8, (double) avg_jitter * 1000.0, (int64_t) lost_packets, (int64_t) total_packets, (double) lost_percent));
+		cJSON_AddItemToObject(test->json_end, sum_name(test, sender, "sum", nbuf_key, sizeof(nbuf_key)), iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  jitter_ms: %f  lost_packets: %d  packets: %d  lost_percent: %f", (double) start_time, (double) end_time, (double) end_time, (int64_t) total_sent, bandwidth * 8, (double) avg_jitter * 1000.0, (int64_t) lost_packets, (int64_t) total_packets, (double) lost_percent));
 	    else
-		iprintf(test, report_sum_bw_udp_format, start_time, end_time, ubuf, nbuf, avg_jitter * 1000.0, lost_packets, total_packets, lost_percent, "");
+		iprintf(test, report_sum_bw_udp_format, start_time, end_time, ubuf, nbuf, avg_jitter * 1000.0, lost_packets, total_packets, lost_percent, report_tag(test, sender, "", tbuf, sizeof(tbuf)));
         }
     }
+}
+
+/**
+ * --bidir: the data both ways together, as the receivers counted it.
+ */
+static void
+print_results_bidir(struct iperf_test *test)
+{
+    char ubuf[UNIT_LEN];
+    char nbuf[UNIT_LEN];
+    struct iperf_stream *sp;
+    iperf_size_t total = 0;
+    double end_time, bandwidth = 0.0;
+
+    sp = SLIST_FIRST(&test->streams);
+    if (sp == NULL)
+	return;
+    end_time = timeval_diff(&sp->result->start_time, &sp->result->end_time);
+    SLIST_FOREACH(sp, &test->streams, streams)
+	total += sp->result->bytes_received;
+    if (end_time > 0.0)
+	bandwidth = (double) total / end_time;
+    if (test->json_output)
+	cJSON_AddItemToObject(test->json_end, "sum_bidir", iperf_json_printf("start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f", 0.0, end_time, end_time, (int64_t) total, bandwidth * 8));
+    else {
+	unit_snprintf(ubuf, UNIT_LEN, (double) total, 'A');
+	unit_snprintf(nbuf, UNIT_LEN, bandwidth, test->settings->unit_format);
+	iprintf(test, report_sum_bw_format, 0.0, end_time, ubuf, nbuf, report_bidir_total);
+    }
+}
+
+/**
+ * Print overall summary statistics at the end of a test.
+ */
+static void
+iperf_print_results(struct iperf_test *test)
+{
+
+    cJSON *json_summary_streams = NULL;
+
+    /* print final summary for all intervals */
+
+    if (test->json_output) {
+        json_summary_streams = cJSON_CreateArray();
+	if (json_summary_streams == NULL)
+	    return;
+	cJSON_AddItemToObject(test->json_end, "streams", json_summary_streams);
+    } else {
+	iprintf(test, "%s", report_bw_separator);
+	if (test->verbose)
+	    iprintf(test, "%s", report_summary);
+	if (test->rr)
+	    ;	/* iperf_rr_print_results() has its own */
+	else if (test->protocol->id != Pudp) {
+	    if (test->sender_has_retransmits)
+		iprintf(test, "%s", report_bw_retrans_header);
+	    else
+		iprintf(test, "%s", report_bw_header);
+	} else
+	    iprintf(test, "%s", report_bw_udp_header);
+    }
+
+    if (test->rr)
+	iperf_rr_print_results(test, json_summary_streams);
+    else {
+	print_results_direction(test, test->sender, json_summary_streams);
+	if (test->bidirectional) {
+	    print_results_direction(test, !test->sender, json_summary_streams);
+	    print_results_bidir(test);
+	}
+    }
+
+    if (test->capacity_search && test->capacity_search->ntrials > 0)
+	print_capacity_search(test);
+
+    if (test->profile)
+	iperf_profile_print_results(test);
+
+    if (test->size_mix)
+	iperf_size_mix_print_results(test);
+
+    if (test->flows)
+	iperf_flows_print_results(test);
+
+    if (test->verify)
+	iperf_verify_print_results(test);
+
+    if (test->udp_timestamps)
+	iperf_timestamp_print_results(test);
+
+    if (test->protocol->id == Pudp)
+	iperf_seq_print_results(test);
+
+    if (test->protocol->id == Pudp)
+	iperf_drops_print_results(test);
+
+    iperf_busy_poll_print_results(test);
+
+    if (test->af_packet)
+	iperf_packet_print_results(test);
+
+    iperf_capture_print_results(test);
+
+    if (test->ktls)
+	iperf_ktls_print_results(test);
 
     if (test->json_output)
 	cJSON_AddItemToObject(test->json_end, "cpu_utilization_percent", iperf_json_printf("host_total: %f  host_user: %f  host_system: %f  remote_total: %f  remote_user: %f  remote_system: %f", (double) test->cpu_util[0], (double) test->cpu_util[1], (double) test->cpu_util[2], (double) test->remote_cpu_util[0], (double) test->remote_cpu_util[1], (double) test->remote_cpu_util[2]));
@@ -2475,6 +3893,43 @@ iperf_print_results(struct iperf_test *test)
 
 /**************************************************************************/
 
+/**
+ * Print the offered load / result curve of a capacity search, and
+ * the capacity it settled on.
+ */
+static void
+print_capacity_search(struct iperf_test *test)
+{
+    struct iperf_capacity_search *cs = test->capacity_search;
+    struct iperf_capacity_trial *ct;
+    char ubuf[UNIT_LEN];
+    char nbuf[UNIT_LEN];
+    int i;
+
+    if (test->json_output) {
+	cJSON_AddItemToObject(test->json_end, "capacity_search", capacity_search_json(test));
+	return;
+    }
+    iprintf(test, report_capacity_header, cs->max_loss);
+    for (i = 0; i < cs->ntrials; ++i) {
+	ct = &cs->trials[i];
+	unit_snprintf(ubuf, UNIT_LEN, (double) ct->rate / 8, test->settings->unit_format);
+	unit_snprintf(nbuf, UNIT_LEN, ct->throughput / 8, test->settings->unit_format);
+	iprintf(test, report_capacity_trial, ubuf, nbuf, ct->jitter * 1000.0, ct->lost, ct->packets,
+		ct->packets > 0 ? 100.0 * ct->lost / ct->packets : 0.0, ct->pass ? "pass" : "fail");
+    }
+    unit_snprintf(nbuf, UNIT_LEN, (double) cs->low * test->num_streams / 8, test->settings->unit_format);
+    if (cs->converged) {
+	iprintf(test, report_capacity, nbuf);
+    } else {
+	/* Out of time or trials: say how far it got, not what it didn't find. */
+	unit_snprintf(ubuf, UNIT_LEN, (double) cs->high * test->num_streams / 8, test->settings->unit_format);
+	iprintf(test, report_capacity_not_converged, nbuf, ubuf);
+    }
+}
+
+/**************************************************************************/
+
 /**
  * Main report-printing callback.
  * Prints results either during a test (interval report only) or 
@@ -2492,7 +3947,9 @@ iperf_reporter_callback(struct iperf_test *test)
             break;
         case TEST_END:
         case DISPLAY_RESULTS:
-            iperf_print_intermediate(test);
+            /* --capture may end before anything came for another interval. */
+            if (test->capture == NULL || iperf_capture_tail(test))
+                iperf_print_intermediate(test);
             iperf_print_results(test);
             break;
     } 
@@ -2512,6 +3969,8 @@ print_interval_results(struct iperf_test *test, struct iperf_stream *sp, cJSON *
     char cbuf[UNIT_LEN];
     double st = 0., et = 0.;
     struct iperf_interval_results *irp = NULL;
+    struct iperf_stream *first;
+    char tbuf[UNIT_LEN];
     double bandwidth, lost_percent;
 
     irp = TAILQ_LAST(&sp->result->interval_results, irlisthead); /* get last entry in linked list */
@@ -2520,25 +3979,28 @@ print_interval_results(struct iperf_test *test, struct iperf_stream *sp, cJSON *
         return;
     }
     if (!test->json_output) {
-	/* First stream? */
-	if (sp == SLIST_FIRST(&test->streams)) {
+	/* First stream in this direction? */
+	SLIST_FOREACH(first, &test->streams, streams)
+	    if (first->sender == sp->sender)
+		break;
+	if (sp == first) {
 	    /* It it's the first interval, print the header;
 	    ** else if there's more than one stream, print the separator;
 	    ** else nothing.
 	    */
 	    if (timeval_equals(&sp->result->start_time, &irp->interval_start_time)) {
-		if (test->protocol->id == Ptcp || test->protocol->id == Psctp) {
-		    if (test->sender && test->sender_has_retransmits)
+		if (test->protocol->id != Pudp) {
+		    if (sp->sender && test->sender_has_retransmits)
 			iprintf(test, "%s", report_bw_retrans_cwnd_header);
 		    else
 			iprintf(test, "%s", report_bw_header);
 		} else {
-		    if (test->sender)
+		    if (sp->sender)
 			iprintf(test, "%s", report_bw_udp_sender_header);
 		    else
 			iprintf(test, "%s", report_bw_udp_header);
 		}
-	    } else if (test->num_streams > 1)
+	    } else if (test->num_streams > 1 || test->bidirectional)
 		iprintf(test, "%s", report_bw_separator);
 	}
     }
@@ -2547,32 +4009,32 @@ print_interval_results(struct iperf_test *test, struct iperf_stream *sp, cJSON *
     bandwidth = (double) irp->bytes_transferred / (double) irp->interval_duration;
     unit_snprintf(nbuf, UNIT_LEN, bandwidth, test->settings->unit_format);
     
-    st = timeval_diff(&sp->result->start_time, &irp->interval_start_time);
-    et = timeval_diff(&sp->result->start_time, &irp->interval_end_time);
+    st = iperf_interval_time(sp, &irp->interval_start_time);
+    et = iperf_interval_time(sp, &irp->interval_end_time);
     
-    if (test->protocol->id == Ptcp || test->protocol->id == Psctp) {
-	if (test->sender && test->sender_has_retransmits) {
+    if (test->protocol->id != Pudp) {
+	if (sp->sender && test->sender_has_retransmits) {
 	    /* Interval, TCP with retransmits. */
 	    if (test->json_output)
 		cJSON_AddItemToArray(json_interval_streams, iperf_json_printf("socket: %d  start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  retransmits: %d  snd_cwnd:  %d  rtt:  %d  omitted: %b", (int64_t) sp->socket, (double) st, (double) et, (double) irp->interval_duration, (int64_t) irp->bytes_transferred, bandwidth * 8, (int64_t) irp->interval_retrans, (int64_t) irp->snd_cwnd, (int64_t) irp->rtt, irp->omitted));
 	    else {
 		unit_snprintf(cbuf, UNIT_LEN, irp->snd_cwnd, 'A');
-		iprintf(test, report_bw_retrans_cwnd_format, sp->socket, st, et, ubuf, nbuf, irp->interval_retrans, cbuf, irp->omitted?report_omitted:"");
+		iprintf(test, report_bw_retrans_cwnd_format, sp->socket, st, et, ubuf, nbuf, irp->interval_retrans, cbuf, report_tag(test, sp->sender, irp->omitted?report_omitted:"", tbuf, sizeof(tbuf)));
 	    }
 	} else {
 	    /* Interval, TCP without retransmits. */
 	    if (test->json_output)
 		cJSON_AddItemToArray(json_interval_streams, iperf_json_printf("socket: %d  start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  omitted: %b", (int64_t) sp->socket, (double) st, (double) et, (double) irp->interval_duration, (int64_t) irp->bytes_transferred, bandwidth * 8, irp->omitted));
 	    else
-		iprintf(test, report_bw_format, sp->socket, st, et, ubuf, nbuf, irp->omitted?report_omitted:"");
+		iprintf(test, report_bw_format, sp->socket, st, et, ubuf, nbuf, report_tag(test, sp->sender, irp->omitted?report_omitted:"", tbuf, sizeof(tbuf)));
 	}
     } else {
 	/* Interval, UDP. */
-	if (test->sender) {
+	if (sp->sender) {
 	    if (test->json_output)
 		cJSON_AddItemToArray(json_interval_streams, iperf_json_printf("socket: %d  start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  packets: %d  omitted: %b", (int64_t) sp->socket, (double) st, (double) et, (double) irp->interval_duration, (int64_t) irp->bytes_transferred, bandwidth * 8, (int64_t) irp->interval_packet_count, irp->omitted));
 	    else
-		iprintf(test, report_bw_udp_sender_format, sp->socket, st, et, ubuf, nbuf, irp->interval_packet_count, irp->omitted?report_omitted:"");
+		iprintf(test, report_bw_udp_sender_format, sp->socket, st, et, ubuf, nbuf, irp->interval_packet_count, report_tag(test, sp->sender, irp->omitted?report_omitted:"", tbuf, sizeof(tbuf)));
 	} else {
 	    if (irp->interval_packet_count > 0) {
 		lost_percent = 100.0 * irp->interval_cnt_error / irp->interval_packet_count;
@@ -2583,10 +4045,19 @@ print_interval_results(struct iperf_test *test, struct iperf_stream *sp, cJSON *
 	    if (test->json_output)
 		cJSON_AddItemToArray(json_interval_streams, iperf_json_printf("socket: %d  start: %f  end: %f  seconds: %f  bytes: %d  bits_per_second: %f  jitter_ms: %f  lost_packets: %d  packets: %d  lost_percent: %f  omitted: %b", (int64_t) sp->socket, (double) st, (double) et, (double) irp->interval_duration, (int64_t) irp->bytes_transferred, bandwidth * 8, (double) irp->jitter * 1000.0, (int64_t) irp->interval_cnt_error, (int64_t) irp->interval_packet_count, (double) lost_percent, irp->omitted));
 	    else
-		iprintf(test, report_bw_udp_format, sp->socket, st, et, ubuf, nbuf, irp->jitter * 1000.0, irp->interval_cnt_error, irp->interval_packet_count, lost_percent, irp->omitted?report_omitted:"");
+		iprintf(test, report_bw_udp_format, sp->socket, st, et, ubuf, nbuf, irp->jitter * 1000.0, irp->interval_cnt_error, irp->interval_packet_count, lost_percent, report_tag(test, sp->sender, irp->omitted?report_omitted:"", tbuf, sizeof(tbuf)));
 	}
     }
 
+    if (sp->verify)
+	iperf_verify_print_interval(sp, irp, st, et, json_interval_streams);
+    if (sp->timestamp)
+	iperf_timestamp_print_interval(sp, irp, st, et, json_interval_streams);
+    if (sp->seq)
+	iperf_seq_print_interval(sp, irp, st, et, json_interval_streams);
+    if (sp->drops)
+	iperf_drops_print_interval(sp, irp, st, et, json_interval_streams);
+
     if (test->logfile || test->forceflush)
         iflush(test);
 }
@@ -2598,10 +4069,8 @@ iperf_free_stream(struct iperf_stream *sp)
     struct iperf_interval_results *irp, *nirp;
 
     /* XXX: need to free interval list too! */
-    munmap(sp->buffer, sp->test->settings->blksize);
-    close(sp->buffer_fd);
-    if (sp->diskfile_fd >= 0)
-	close(sp->diskfile_fd);
+    iperf_payload_unmap(sp);
+    iperf_diskfile_free(sp);
     for (irp = TAILQ_FIRST(&sp->result->interval_results); irp != NULL; irp = nirp) {
         nirp = TAILQ_NEXT(irp, irlistentries);
         free(irp);
@@ -2609,6 +4078,14 @@ iperf_free_stream(struct iperf_stream *sp)
     free(sp->result);
     if (sp->send_timer != NULL)
 	tmr_cancel(sp->send_timer);
+    iperf_rr_free_stream(sp);
+    iperf_profile_free_stream(sp);
+    iperf_size_mix_free_stream(sp);
+    iperf_verify_free_stream(sp);
+    iperf_timestamp_free_stream(sp);
+    iperf_seq_free_stream(sp);
+    iperf_drops_free_stream(sp);
+    iperf_packet_free_stream(sp);
     free(sp);
 }
 
@@ -2616,16 +4093,14 @@ iperf_free_stream(struct iperf_stream *sp)
 struct iperf_stream *
 iperf_new_stream(struct iperf_test *test, int s)
 {
-    int i;
+    return iperf_new_stream_dir(test, s, test->sender);
+}
+
+/**************************************************************************/
+struct iperf_stream *
+iperf_new_stream_dir(struct iperf_test *test, int s, int sender)
+{
     struct iperf_stream *sp;
-    
-    char template[1024];
-    if (test->tmp_template) {
-        snprintf(template, sizeof(template) / sizeof(char), "%s", test->tmp_template);
-    } else {
-        char buf[] = "/tmp/iperf3.XXXXXX";
-        snprintf(template, sizeof(template) / sizeof(char), "%s", buf);
-    }
 
     h_errno = 0;
 
@@ -2649,63 +4124,66 @@ iperf_new_stream(struct iperf_test *test, int s)
     memset(sp->result, 0, sizeof(struct iperf_stream_result));
     TAILQ_INIT(&sp->result->interval_results);
     
-    /* Create and randomize the buffer */
-    sp->buffer_fd = mkstemp(template);
-    if (sp->buffer_fd == -1) {
-        i_errno = IECREATESTREAM;
-        free(sp->result);
-        free(sp);
-        return NULL;
-    }
-    if (unlink(template) < 0) {
-        i_errno = IECREATESTREAM;
-        free(sp->result);
-        free(sp);
-        return NULL;
-    }
-    if (ftruncate(sp->buffer_fd, test->settings->blksize) < 0) {
-        i_errno = IECREATESTREAM;
-        free(sp->result);
-        free(sp);
-        return NULL;
-    }
-    sp->buffer = (char *) mmap(NULL, test->settings->blksize, PROT_READ|PROT_WRITE, MAP_PRIVATE, sp->buffer_fd, 0);
-    if (sp->buffer == MAP_FAILED) {
-        i_errno = IECREATESTREAM;
-        free(sp->result);
-        free(sp);
-        return NULL;
+    /*
+     * Senders share the test's payload, made with the first of them.
+     * Streams that write into their buffer get their own.
+     */
+    if (sender && !test->rr && test->diskfile_name == NULL) {
+	if (test->payload == NULL)
+	    test->payload = iperf_payload_new(test, test->settings->blksize, test->verify ? test->verify->seed : 0);
+	if (test->payload == NULL) {
+	    free(sp->result);
+	    free(sp);
+	    return NULL;
+	}
+	sp->buffer = test->payload->buffer;
+	sp->buffer_fd = test->payload->fd;
+	sp->buffer_shared = 1;
+    } else {
+	sp->buffer = iperf_payload_map(test, test->settings->blksize, sender, &sp->buffer_fd);
+	if (sp->buffer == NULL) {
+	    free(sp->result);
+	    free(sp);
+	    return NULL;
+	}
     }
-    srandom(time(NULL));
-    for (i = 0; i < test->settings->blksize; ++i)
-        sp->buffer[i] = random();
+    sp->buffer_size = test->settings->blksize;
 
     /* Set socket */
     sp->socket = s;
+    sp->sender = sender;
 
     sp->snd = test->protocol->send;
     sp->rcv = test->protocol->recv;
+    if (test->protocol->id == Pudp)
+	iperf_udp_recv_select(sp);
 
     if (test->diskfile_name != (char*) 0) {
-	sp->diskfile_fd = open(test->diskfile_name, test->sender ? O_RDONLY : (O_WRONLY|O_CREAT|O_TRUNC), S_IRUSR|S_IWUSR);
-	if (sp->diskfile_fd == -1) {
-	    i_errno = IEFILE;
-            munmap(sp->buffer, sp->test->settings->blksize);
+	if (iperf_diskfile_new(sp) < 0) {
+            iperf_payload_unmap(sp);
             free(sp->result);
             free(sp);
 	    return NULL;
 	}
         sp->snd2 = sp->snd;
-	sp->snd = diskfile_send;
+	sp->snd = iperf_diskfile_send;
 	sp->rcv2 = sp->rcv;
-	sp->rcv = diskfile_recv;
+	sp->rcv = iperf_diskfile_recv;
     } else
         sp->diskfile_fd = -1;
 
     /* Initialize stream */
-    if (iperf_init_stream(sp, test) < 0) {
-        close(sp->buffer_fd);
-        munmap(sp->buffer, sp->test->settings->blksize);
+    if (iperf_init_stream(sp, test) < 0 ||
+	(test->rr && iperf_rr_init_stream(sp) < 0) ||
+	(test->size_mix && iperf_size_mix_init_stream(sp) < 0) ||
+	(test->verify && iperf_verify_init_stream(sp) < 0) ||
+	(test->udp_timestamps && iperf_timestamp_init_stream(sp) < 0) ||
+	(test->protocol->id == Pudp && iperf_seq_init_stream(sp) < 0) ||
+	(test->protocol->id == Pudp && iperf_drops_init_stream(sp) < 0) ||
+	(test->busy_poll && iperf_busy_poll_init_stream(sp) < 0) ||
+	(test->af_packet && iperf_packet_init_stream(sp) < 0)) {
+        iperf_diskfile_free(sp);
+        iperf_payload_unmap(sp);
         free(sp->result);
         free(sp);
         return NULL;
@@ -2778,41 +4256,6 @@ iperf_add_stream(struct iperf_test *test, struct iperf_stream *sp)
     }
 }
 
-/* This pair of routines gets inserted into the snd/rcv function pointers
-** when there's a -F flag. They handle the file stuff and call the real
-** snd/rcv functions, which have been saved in snd2/rcv2.
-**
-** The advantage of doing it this way is that in the much more common
-** case of no -F flag, there is zero extra overhead.
-*/
-
-static int
-diskfile_send(struct iperf_stream *sp)
-{
-    int r;
-
-    r = read(sp->diskfile_fd, sp->buffer, sp->test->settings->blksize);
-    if (r == 0)
-        sp->test->done = 1;
-    else
-	r = sp->snd2(sp);
-    return r;
-}
-
-static int
-diskfile_recv(struct iperf_stream *sp)
-{
-    int r;
-
-    r = sp->rcv2(sp);
-    if (r > 0) {
-	(void) write(sp->diskfile_fd, sp->buffer, r);
-	(void) fsync(sp->diskfile_fd);
-    }
-    return r;
-}
-
-
 void
 iperf_catch_sigend(void (*handler)(int))
 {
@@ -2916,25 +4359,34 @@ iperf_json_start(struct iperf_test *test)
 int
 iperf_json_finish(struct iperf_test *test)
 {
-    if (test->title)
-	cJSON_AddStringToObject(test->json_top, "title", test->title);
-    /* Include server output */
-    if (test->json_server_output) {
-	cJSON_AddItemToObject(test->json_top, "server_output_json", test->json_server_output);
-    }
-    if (test->server_output_text) {
-	cJSON_AddStringToObject(test->json_top, "server_output_text", test->server_output_text);
-    }
-    test->json_output_string = cJSON_Print(test->json_top);
+    cJSON *j;
+
+    j = iperf_json_detach(test);
+    test->json_output_string = cJSON_Print(j);
     if (test->json_output_string == NULL)
         return -1;
     fprintf(test->outfile, "%s\n", test->json_output_string);
     iflush(test);
-    cJSON_Delete(test->json_top);
-    test->json_top = test->json_start = test->json_connected = test->json_intervals = test->json_server_output = test->json_end = NULL;
+    cJSON_Delete(j);
     return 0;
 }
 
+/* Like iperf_json_finish(), but hand the document to the caller instead of printing it. */
+cJSON *
+iperf_json_detach(struct iperf_test *test)
+{
+    cJSON *j = test->json_top;
+
+    if (test->title)
+	cJSON_AddStringToObject(j, "title", test->title);
+    if (test->json_server_output)
+	cJSON_AddItemToObject(j, "server_output_json", test->json_server_output);
+    if (test->server_output_text)
+	cJSON_AddStringToObject(j, "server_output_text", test->server_output_text);
+    test->json_top = test->json_start = test->json_connected = test->json_intervals = test->json_server_output = test->json_end = NULL;
+    return j;
+}
+
 
 /* CPU affinity stuff - Linux and FreeBSD only. */
 
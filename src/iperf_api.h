@@ -39,9 +39,12 @@ struct iperf_stream;
 #define Ptcp SOCK_STREAM
 #define Pudp SOCK_DGRAM
 #define Psctp 12
+#define Punix 13
+#define Punixseq 14
 #define DEFAULT_UDP_BLKSIZE 8192
 #define DEFAULT_TCP_BLKSIZE (128 * 1024)  /* default read/write block size */
 #define DEFAULT_SCTP_BLKSIZE (64 * 1024)
+#define DEFAULT_CRR_SIZE 64  /* --crr request and response size without --rr */
 
 /* short option equivalents, used to support options that only have long form */
 #define OPT_SCTP 1
@@ -51,6 +54,30 @@ struct iperf_stream;
 #define OPT_CLIENT_PORT 5
 #define OPT_NUMSTREAMS 6
 #define OPT_FORCEFLUSH 7
+#define OPT_SCHEDULE 8
+#define OPT_CAPACITY_SEARCH 9
+#define OPT_START_AT 10
+#define OPT_ALIGN_INTERVALS 11
+#define OPT_BIDIRECTIONAL 12
+#define OPT_RR 13
+#define OPT_RR_OUTSTANDING 14
+#define OPT_CRR 15
+#define OPT_PROFILE 16
+#define OPT_SIZE_MIX 17
+#define OPT_FLOWS 18
+#define OPT_FLOWS_SAMPLE 19
+#define OPT_VERIFY 20
+#define OPT_PAYLOAD 21
+#define OPT_FILE_DEPTH 22
+#define OPT_FILE_DIRECT 23
+#define OPT_FILE_FSYNC 24
+#define OPT_UDP_TIMESTAMPS 25
+#define OPT_BUSY_POLL 26
+#define OPT_AF_PACKET 27
+#define OPT_CAPTURE 28
+#define OPT_UNIX 29
+#define OPT_UNIX_SEQPACKET 30
+#define OPT_KTLS 31
 
 /* states */
 #define TEST_START 1
@@ -69,6 +96,7 @@ struct iperf_stream;
 #define DISPLAY_RESULTS 14
 #define IPERF_START 15
 #define IPERF_DONE 16
+#define PARAM_CHANGE 17
 #define ACCESS_DENIED (-1)
 #define SERVER_ERROR (-2)
 
@@ -181,6 +209,13 @@ void      iperf_free_test(struct iperf_test * testp);
  */
 struct iperf_stream *iperf_new_stream(struct iperf_test *, int);
 
+/**
+ * iperf_new_stream_dir -- as iperf_new_stream, for a stream sending
+ * (sender nonzero) or receiving regardless of the test's direction
+ *
+ */
+struct iperf_stream *iperf_new_stream_dir(struct iperf_test *, int, int);
+
 /**
  * iperf_add_stream -- add a stream to a test
  *
@@ -209,6 +244,18 @@ void print_tcpinfo(struct iperf_test *test);
 void build_tcpinfo_message(struct iperf_interval_results *r, char *message);
 
 int iperf_set_send_state(struct iperf_test *test, signed char state);
+
+/**
+ * iperf_change_parameters -- change bandwidth, parallel, len and/or burst
+ * of a running test, given as "name=value,...", and tell the other side
+ *
+ */
+int iperf_change_parameters(struct iperf_test *test, const char *spec);
+int iperf_handle_param_change(struct iperf_test *test);
+int iperf_create_schedule_timers(struct iperf_test *test);
+void iperf_align_interval(struct iperf_test *test, struct timeval *nowP, struct timeval *alignedP);
+double iperf_interval_time(struct iperf_stream *sp, struct timeval *tv);
+int iperf_wait_start(struct iperf_test *test);
 void iperf_check_throttle(struct iperf_stream *sp, struct timeval *nowP);
 int iperf_send(struct iperf_test *, fd_set *) /* __attribute__((hot)) */;
 int iperf_recv(struct iperf_test *, fd_set *);
@@ -236,6 +283,7 @@ extern jmp_buf env;
 
 /* Client routines. */
 int iperf_run_client(struct iperf_test *);
+int iperf_run_clients(struct iperf_test **, int);
 int iperf_connect(struct iperf_test *);
 int iperf_create_streams(struct iperf_test *);
 int iperf_handle_message_client(struct iperf_test *);
@@ -253,6 +301,7 @@ int iperf_delete_pidfile(struct iperf_test *);
 /* JSON output routines. */
 int iperf_json_start(struct iperf_test *);
 int iperf_json_finish(struct iperf_test *);
+struct cJSON *iperf_json_detach(struct iperf_test *);
 
 /* CPU affinity routines */
 int iperf_setaffinity(struct iperf_test *, int affinity);
@@ -291,6 +340,25 @@ enum {
     IEBIND = 19,			// Local port specified with no local bind option
     IEUDPBLOCKSIZE = 20,    // Block size too large. Maximum value = %dMAX_UDP_BLOCKSIZE
     IEBADTOS = 21,	    // Bad TOS value
+    IEPARAMCHANGE = 22,     // Bad parameter change (--schedule) or test not running
+    IECAPACITYSEARCH = 23,  // --capacity-search needs UDP, a -b rate and -i intervals
+    IESTARTAT = 24,         // --start-at time is malformed or already past
+    IEBIDIR = 25,           // --bidir can't be used with -R, -F or --capacity-search
+    IEREQRESP = 26,         // bad --rr sizes, or --rr used with -R, --bidir, -F or --capacity-search
+    IECRR = 27,             // --crr needs TCP
+    IEPROFILE = 28,         // bad --profile, or one that can't be used with the other options
+    IESIZEMIX = 29,         // bad --size-mix, or --size-mix without UDP or with -l
+    IEFLOWS = 30,           // bad --flows, or --flows with options it can't be used with
+    IEVERIFY = 31,          // --verify used with -F, -Z, --rr or --flows
+    IEPAYLOAD = 32,         // bad --payload, or --payload with -F or --rr
+    IEDISKFILE = 33,        // bad --file-depth or --file-fsync, or --file-* without -F
+    IEUDPTIMESTAMPS = 34,   // bad --udp-timestamps, or --udp-timestamps without UDP
+    IEBUSYPOLL = 35,        // bad --busy-poll time
+    IEAFPACKET = 36,        // --af-packet without UDP, or with -F, --rr or --flows
+    IECAPTURE = 37,         // bad --capture interface or header layout
+    IEKTLS = 38,            // --ktls without TCP, or with --crr or --flows
+    IESTARTATFAR = 39,      // --start-at time too far ahead. Maximum value = %dMAX_START_DELAY from now
+    IEUNIX = 40,            // --unix path too long, or --unix without a path to a server that isn't local
     /* Test errors */
     IENEWTEST = 100,        // Unable to create a new test (check perror)
     IEINITTEST = 101,       // Test initialization failed (check perror)
@@ -332,6 +400,12 @@ enum {
     IESETSCTPDISABLEFRAG = 137, // Unable to set SCTP Fragmentation (check perror)
     IESETSCTPNSTREAM= 138,  //  Unable to set SCTP number of streams (check perror)
     IESETSCTPBINDX= 139,    // Unable to process sctp_bindx() parameters
+    IESENDPARAMCHANGE = 140, // Unable to send parameter change (check perror)
+    IERECVPARAMCHANGE = 141, // Unable to receive parameter change (check perror)
+    IESETBUSYPOLL = 142,    // Unable to set SO_BUSY_POLL (check perror)
+    IESETAFPACKET = 143,    // Unable to set up an AF_PACKET TX ring (check perror)
+    IESETCAPTURE = 144,     // Unable to set up an AF_PACKET capture ring (check perror)
+    IESETKTLS = 145,        // Unable to set up kernel TLS on a data stream (check perror)
     /* Stream errors */
     IECREATESTREAM = 200,   // Unable to create a new stream (check herror/perror)
     IEINITSTREAM = 201,     // Unable to initialize stream (check herror/perror)
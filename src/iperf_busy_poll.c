@@ -0,0 +1,184 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_locale.h"
+#include "iperf_util.h"
+#include "iperf_busy_poll.h"
+#include "net.h"
+
+int
+iperf_busy_poll_init_stream(struct iperf_stream *sp)
+{
+    int usec = sp->test->busy_poll;
+
+    sp->incoming_cpu = -1;
+    /* Read without waiting on each pass of the main loop; --rr reads both ways. */
+    if (!sp->sender || sp->test->rr != NULL)
+	setnonblocking(sp->socket, 1);
+#if defined(SO_BUSY_POLL)
+    /* Above net.core.busy_read, this needs CAP_NET_ADMIN. */
+    if (setsockopt(sp->socket, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) < 0) {
+	i_errno = IESETBUSYPOLL;
+	return -1;
+    }
+#if defined(SO_PREFER_BUSY_POLL)
+    {
+	int one = 1;
+
+	/* Before 5.11 there is no such option; busy-polling still works. */
+	(void) setsockopt(sp->socket, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one));
+    }
+#endif
+    return 0;
+#else
+    (void) usec;
+    i_errno = IESETBUSYPOLL;
+    errno = ENOPROTOOPT;
+    return -1;
+#endif
+}
+
+struct timeval *
+iperf_busy_poll_timeout(struct iperf_test *test, struct timeval *timeout)
+{
+    static struct timeval zero;
+
+    if (!test->busy_poll || test->state != TEST_RUNNING)
+	return timeout;
+    zero.tv_sec = 0;
+    zero.tv_usec = 0;
+    return &zero;
+}
+
+/*
+ * Count a select() result: 0 found nothing, > 0 found work, and an
+ * interrupted one (< 0) is no poll at all.  The gaps between polls that
+ * found work show how promptly it is picked up.
+ */
+void
+iperf_busy_poll_count(struct iperf_test *test, int result)
+{
+    struct timeval now;
+    double gap;
+
+    if (!test->busy_poll || test->state != TEST_RUNNING || result < 0)
+	return;
+    test->busy_polls++;
+    if (result == 0) {
+	test->busy_polls_empty++;
+	return;
+    }
+    gettimeofday(&now, NULL);
+    if (test->busy_poll_last.tv_sec != 0) {
+	gap = timeval_diff(&test->busy_poll_last, &now);
+	test->busy_poll_gap_sum += gap;
+	if (gap > test->busy_poll_gap_max)
+	    test->busy_poll_gap_max = gap;
+    }
+    test->busy_poll_last = now;
+}
+
+/*
+ * SO_BUSY_POLL spins on the device queue only in a read that finds the
+ * socket empty, never in select(): mark every receiving data socket
+ * ready, so iperf_recv() (or iperf_rr_io()) reads each of them on every
+ * pass.  Returns the select() result, counting those.
+ */
+int
+iperf_busy_poll_ready(struct iperf_test *test, fd_set *read_setP, int result)
+{
+    struct iperf_stream *sp;
+
+    /* --crr transactions have sockets of their own. */
+    if (!test->busy_poll || test->state != TEST_RUNNING || (test->rr != NULL && test->rr->crr) || result < 0)
+	return result;
+    SLIST_FOREACH(sp, &test->streams, streams)
+	if ((!sp->sender || test->rr != NULL) && !FD_ISSET(sp->socket, read_setP)) {
+	    FD_SET(sp->socket, read_setP);
+	    ++result;
+	}
+    return result;
+}
+
+void
+iperf_busy_poll_stats(struct iperf_stream *sp)
+{
+#if defined(SO_INCOMING_CPU)
+    socklen_t len = sizeof(sp->incoming_cpu);
+
+    /* The CPU the kernel last processed this socket's packets on. */
+    if (getsockopt(sp->socket, SOL_SOCKET, SO_INCOMING_CPU, &sp->incoming_cpu, &len) < 0)
+	sp->incoming_cpu = -1;
+#endif
+}
+
+void
+iperf_busy_poll_print_results(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    cJSON *json_busy_poll = NULL, *json_streams = NULL;
+    iperf_size_t work;
+    double gap_mean;
+
+    if (!test->busy_poll)
+	return;
+    work = test->busy_polls - test->busy_polls_empty;
+    gap_mean = work > 1 ? test->busy_poll_gap_sum / (work - 1) : 0.0;
+
+    if (test->json_output) {
+	json_busy_poll = iperf_json_printf("usec: %d  polls: %d  empty_polls: %d  work_gap_mean_us: %f  work_gap_max_us: %f  host_cpu: %f  remote_cpu: %f", (int64_t) test->busy_poll, (int64_t) test->busy_polls, (int64_t) test->busy_polls_empty, gap_mean * 1e6, test->busy_poll_gap_max * 1e6, test->cpu_util[0], test->remote_cpu_util[0]);
+	json_streams = cJSON_CreateArray();
+	if (json_busy_poll == NULL || json_streams == NULL)
+	    return;
+	cJSON_AddItemToObject(json_busy_poll, "streams", json_streams);
+	cJSON_AddItemToObject(test->json_end, "busy_poll", json_busy_poll);
+    } else
+	iprintf(test, report_busy_poll, test->busy_poll, (unsigned long long) test->busy_polls, (unsigned long long) work, gap_mean * 1e6, test->busy_poll_gap_max * 1e6, test->cpu_util[0], test->remote_cpu_util[0]);
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (sp->incoming_cpu < 0)
+	    continue;
+	if (json_streams != NULL)
+	    cJSON_AddItemToArray(json_streams, iperf_json_printf("socket: %d  incoming_cpu: %d", (int64_t) sp->socket, (int64_t) sp->incoming_cpu));
+	else
+	    iprintf(test, report_busy_poll_stream, sp->socket, sp->incoming_cpu);
+    }
+}
@@ -0,0 +1,55 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_BUSY_POLL_H
+#define __IPERF_BUSY_POLL_H
+
+/*
+ * --busy-poll (Linux).  Every data socket gets SO_BUSY_POLL, and
+ * SO_PREFER_BUSY_POLL where the kernel has it, so a read spins on the
+ * device queue instead of waiting for the interrupt; and while the test
+ * runs, the main loop polls select() without a timeout instead of
+ * sleeping in it, and reads every receiving socket on each pass, ready
+ * or not, since only a read busy-polls.  That trades a CPU for latency, so the end report
+ * gives how many polls came back empty and the CPU the test used, and
+ * the CPU each stream's packets were processed on.
+ */
+
+#define BUSY_POLL_DEFAULT 50		/* usec */
+
+int iperf_busy_poll_init_stream(struct iperf_stream *sp);
+
+/* The select() timeout for the main loop: none while busy-polling. */
+struct timeval *iperf_busy_poll_timeout(struct iperf_test *test, struct timeval *timeout);
+void iperf_busy_poll_count(struct iperf_test *test, int result);
+int iperf_busy_poll_ready(struct iperf_test *test, fd_set *read_setP, int result);
+
+/* Once an interval, while the socket is still open. */
+void iperf_busy_poll_stats(struct iperf_stream *sp);
+
+void iperf_busy_poll_print_results(struct iperf_test *test);
+
+#endif /* __IPERF_BUSY_POLL_H */
@@ -39,9 +39,15 @@
 #include "iperf.h"
 #include "iperf_api.h"
 #include "iperf_util.h"
+#include "iperf_rr.h"
+#include "iperf_flows.h"
+#include "iperf_placement.h"
+#include "iperf_busy_poll.h"
+#include "iperf_unix.h"
 #include "iperf_locale.h"
 #include "net.h"
 #include "timer.h"
+#include "units.h"
 
 
 int
@@ -51,7 +57,9 @@ iperf_create_streams(struct iperf_test *test)
     struct iperf_stream *sp;
 
     int orig_bind_port = test->bind_port;
-    for (i = 0; i < test->num_streams; ++i) {
+    int sender;
+
+    for (i = 0; i < test->num_streams * (test->bidirectional ? 2 : 1); ++i) {
 
         test->bind_port = orig_bind_port;
 	if (orig_bind_port)
@@ -59,13 +67,16 @@ iperf_create_streams(struct iperf_test *test)
         if ((s = test->protocol->connect(test)) < 0)
             return -1;
 
-	if (test->sender)
+	/* With --bidir, the second set of streams runs the other way. */
+	sender = i < test->num_streams ? test->sender : !test->sender;
+	/* --rr streams send requests as responses come in. */
+	if (sender && !test->rr)
 	    FD_SET(s, &test->write_set);
 	else
 	    FD_SET(s, &test->read_set);
 	if (s > test->max_fd) test->max_fd = s;
 
-        sp = iperf_new_stream(test, s);
+        sp = iperf_new_stream_dir(test, s, sender);
         if (!sp)
             return -1;
 
@@ -74,6 +85,10 @@ iperf_create_streams(struct iperf_test *test)
             test->on_new_stream(sp);
     }
 
+    /* --flows connect after the streams, which keep the low descriptors. */
+    if (test->flows && iperf_flows_connect(test) < 0)
+	return -1;
+
     return 0;
 }
 
@@ -111,13 +126,14 @@ client_reporter_timer_proc(TimerClientData client_data, struct timeval *nowP)
 static int
 create_client_timers(struct iperf_test * test)
 {
-    struct timeval now;
+    struct timeval now, aligned;
     TimerClientData cd;
 
     if (gettimeofday(&now, NULL) < 0) {
 	i_errno = IEINITTEST;
 	return -1;
     }
+    iperf_align_interval(test, &now, &aligned);
     cd.p = test;
     test->timer = test->stats_timer = test->reporter_timer = NULL;
     if (test->duration != 0) {
@@ -129,14 +145,14 @@ create_client_timers(struct iperf_test * test)
 	}
     } 
     if (test->stats_interval != 0) {
-        test->stats_timer = tmr_create(&now, client_stats_timer_proc, cd, test->stats_interval * SEC_TO_US, 1);
+        test->stats_timer = tmr_create(&aligned, client_stats_timer_proc, cd, test->stats_interval * SEC_TO_US, 1);
         if (test->stats_timer == NULL) {
             i_errno = IEINITTEST;
             return -1;
 	}
     }
     if (test->reporter_interval != 0) {
-        test->reporter_timer = tmr_create(&now, client_reporter_timer_proc, cd, test->reporter_interval * SEC_TO_US, 1);
+        test->reporter_timer = tmr_create(&aligned, client_reporter_timer_proc, cd, test->reporter_interval * SEC_TO_US, 1);
         if (test->reporter_timer == NULL) {
             i_errno = IEINITTEST;
             return -1;
@@ -156,10 +172,10 @@ client_omit_timer_proc(TimerClientData client_data, struct timeval *nowP)
     if (test->verbose && !test->json_output && test->reporter_interval == 0)
         iprintf(test, "%s", report_omit_done);
 
-    /* Reset the timers. */
-    if (test->stats_timer != NULL)
+    /* Reset the timers, unless they keep to aligned boundaries. */
+    if (test->stats_timer != NULL && !test->align_intervals)
         tmr_reset(nowP, test->stats_timer);
-    if (test->reporter_timer != NULL)
+    if (test->reporter_timer != NULL && !test->align_intervals)
         tmr_reset(nowP, test->reporter_timer);
 }
 
@@ -193,6 +209,7 @@ iperf_handle_message_client(struct iperf_test *test)
 {
     int rval;
     int32_t err;
+    signed char prev_state = test->state;
 
     /*!!! Why is this read() and not Nread()? */
     if ((rval = read(test->ctrl_sck, (char*) &test->state, sizeof(signed char))) <= 0) {
@@ -217,18 +234,31 @@ iperf_handle_message_client(struct iperf_test *test)
                 return -1;
             break;
         case TEST_START:
+	    /* A server that doesn't know --start-at may be early. */
+	    if (iperf_wait_start(test) < 0)
+		return -1;
             if (iperf_init_test(test) < 0)
                 return -1;
             if (create_client_timers(test) < 0)
                 return -1;
             if (create_client_omit_timer(test) < 0)
                 return -1;
-	    if (!test->reverse)
+	    if (!test->reverse || test->bidirectional)
 		if (iperf_create_send_timers(test) < 0)
 		    return -1;
+	    if (iperf_create_schedule_timers(test) < 0)
+		return -1;
+	    if (test->flows && iperf_flows_start(test) < 0)
+		return -1;
             break;
         case TEST_RUNNING:
             break;
+        case PARAM_CHANGE:
+	    /* Not a state of its own, carry on with whatever we were doing. */
+	    test->state = prev_state;
+            if (iperf_handle_param_change(test) < 0)
+                return -1;
+            break;
         case EXCHANGE_RESULTS:
             if (iperf_exchange_results(test) < 0)
                 return -1;
@@ -287,6 +317,10 @@ iperf_connect(struct iperf_test *test)
 
     make_cookie(test->cookie);
 
+    /* Before the server hears of us: it would only wait for the streams. */
+    if ((test->protocol->id == Punix || test->protocol->id == Punixseq) && iperf_unix_check_local(test) < 0)
+	return -1;
+
     /* Create and connect the control channel */
     if (test->ctrl_sck < 0)
 	// Create the control channel using an ephemeral port
@@ -304,6 +338,11 @@ iperf_connect(struct iperf_test *test)
     FD_SET(test->ctrl_sck, &test->read_set);
     if (test->ctrl_sck > test->max_fd) test->max_fd = test->ctrl_sck;
 
+    /* Placed by the interface the control connection goes out on. */
+    if (test->affinity == AFFINITY_AUTO)
+	if (iperf_placement_apply(test, test->ctrl_sck) != 0)
+	    return -1;
+
     return 0;
 }
 
@@ -328,17 +367,14 @@ iperf_client_end(struct iperf_test *test)
 }
 
 
-int
-iperf_run_client(struct iperf_test * test)
+/*
+ * The client event loop, split into per-test pieces so that
+ * iperf_run_clients() can drive several tests from one select().
+ */
+static int
+client_start(struct iperf_test *test)
 {
-    int startup;
-    int result = 0;
-    fd_set read_set, write_set;
-    struct timeval now;
-    struct timeval* timeout = NULL;
-    struct iperf_stream *sp;
-
-    if (test->affinity != -1)
+    if (test->affinity >= 0)
 	if (iperf_setaffinity(test, test->affinity) != 0)
 	    return -1;
 
@@ -360,6 +396,112 @@ iperf_run_client(struct iperf_test * test)
     if (iperf_connect(test) < 0)
         return -1;
 
+    return 0;
+}
+
+static int
+client_io(struct iperf_test *test, fd_set *read_set, fd_set *write_set, int ready, int *startup)
+{
+    struct iperf_stream *sp;
+
+    if (ready) {
+	if (FD_ISSET(test->ctrl_sck, read_set)) {
+	    if (iperf_handle_message_client(test) < 0) {
+		return -1;
+	    }
+	    FD_CLR(test->ctrl_sck, read_set);
+	}
+    }
+
+    if (test->state == TEST_RUNNING) {
+
+	/* Is this our first time really running? */
+	if (*startup) {
+	    *startup = 0;
+
+	    // Set non-blocking for non-UDP tests
+	    if (test->protocol->id != Pudp) {
+		SLIST_FOREACH(sp, &test->streams, streams) {
+		    setnonblocking(sp->socket, 1);
+		}
+	    }
+	}
+
+	if (test->rr) {
+	    // Request/response mode. Client reads responses, keeps requests in flight.
+	    if (iperf_rr_io(test, read_set, write_set) < 0 || iperf_rr_fill(test) < 0)
+		return -1;
+	    return 0;
+	}
+	if (test->reverse || test->bidirectional) {
+	    // Reverse or bidirectional mode. Client receives.
+	    if (iperf_recv(test, read_set) < 0)
+		return -1;
+	}
+	if (!test->reverse || test->bidirectional) {
+	    // Regular or bidirectional mode. Client sends.
+	    if (iperf_send(test, write_set) < 0)
+		return -1;
+	}
+	if (iperf_flows_io(test, read_set) < 0)
+	    return -1;
+    }
+    // If we're in reverse mode, continue draining the data
+    // connection(s) even if test is over.  This prevents a
+    // deadlock where the server side fills up its pipe(s)
+    // and gets blocked, so it can't receive state changes
+    // from the client side.
+    else if ((test->reverse || test->bidirectional) && test->state == TEST_END) {
+	if (iperf_recv(test, read_set) < 0)
+	    return -1;
+    }
+    return 0;
+}
+
+static int
+client_check_end(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+
+    /* Is the test done yet? */
+    if ((!test->omitting) &&
+	((test->duration != 0 && test->done) ||
+	 (test->capacity_search != NULL && test->done) ||
+	 (((test->settings->bytes != 0 && test->bytes_sent >= test->settings->bytes) ||
+	   (test->settings->blocks != 0 && test->blocks_sent >= test->settings->blocks)) &&
+	  (test->rr == NULL || iperf_rr_idle(test))))) {
+
+	// Unset non-blocking for non-UDP tests
+	if (test->protocol->id != Pudp) {
+	    SLIST_FOREACH(sp, &test->streams, streams) {
+		setnonblocking(sp->socket, 0);
+	    }
+	}
+
+	/* Yes, done!  Send TEST_END. */
+	test->done = 1;
+	iperf_rr_close_conns(test);
+	iperf_flows_stop(test);
+	cpu_util(test->cpu_util);
+	test->stats_callback(test);
+	if (iperf_set_send_state(test, TEST_END) != 0)
+	    return -1;
+    }
+    return 0;
+}
+
+int
+iperf_run_client(struct iperf_test * test)
+{
+    int startup;
+    int result = 0;
+    fd_set read_set, write_set;
+    struct timeval now;
+    struct timeval* timeout = NULL;
+
+    if (client_start(test) < 0)
+	return -1;
+
     /* Begin calculating CPU utilization */
     cpu_util(NULL);
 
@@ -368,77 +510,23 @@ iperf_run_client(struct iperf_test * test)
 	memcpy(&read_set, &test->read_set, sizeof(fd_set));
 	memcpy(&write_set, &test->write_set, sizeof(fd_set));
 	(void) gettimeofday(&now, NULL);
-	timeout = tmr_timeout(&now);
+	timeout = iperf_busy_poll_timeout(test, tmr_timeout(&now));
 	result = select(test->max_fd + 1, &read_set, &write_set, NULL, timeout);
 	if (result < 0 && errno != EINTR) {
   	    i_errno = IESELECT;
 	    return -1;
 	}
-	if (result > 0) {
-	    if (FD_ISSET(test->ctrl_sck, &read_set)) {
- 	        if (iperf_handle_message_client(test) < 0) {
-		    return -1;
-		}
-		FD_CLR(test->ctrl_sck, &read_set);
-	    }
-	}
+	iperf_busy_poll_count(test, result);
+	result = iperf_busy_poll_ready(test, &read_set, result);
+	if (client_io(test, &read_set, &write_set, result > 0, &startup) < 0)
+	    return -1;
 
 	if (test->state == TEST_RUNNING) {
-
-	    /* Is this our first time really running? */
-	    if (startup) {
-	        startup = 0;
-
-		// Set non-blocking for non-UDP tests
-		if (test->protocol->id != Pudp) {
-		    SLIST_FOREACH(sp, &test->streams, streams) {
-			setnonblocking(sp->socket, 1);
-		    }
-		}
-	    }
-
-	    if (test->reverse) {
-		// Reverse mode. Client receives.
-		if (iperf_recv(test, &read_set) < 0)
-		    return -1;
-	    } else {
-		// Regular mode. Client sends.
-		if (iperf_send(test, &write_set) < 0)
-		    return -1;
-	    }
-
             /* Run the timers. */
             (void) gettimeofday(&now, NULL);
             tmr_run(&now);
 
-	    /* Is the test done yet? */
-	    if ((!test->omitting) &&
-	        ((test->duration != 0 && test->done) ||
-	         (test->settings->bytes != 0 && test->bytes_sent >= test->settings->bytes) ||
-	         (test->settings->blocks != 0 && test->blocks_sent >= test->settings->blocks))) {
-
-		// Unset non-blocking for non-UDP tests
-		if (test->protocol->id != Pudp) {
-		    SLIST_FOREACH(sp, &test->streams, streams) {
-			setnonblocking(sp->socket, 0);
-		    }
-		}
-
-		/* Yes, done!  Send TEST_END. */
-		test->done = 1;
-		cpu_util(test->cpu_util);
-		test->stats_callback(test);
-		if (iperf_set_send_state(test, TEST_END) != 0)
-		    return -1;
-	    }
-	}
-	// If we're in reverse mode, continue draining the data
-	// connection(s) even if test is over.  This prevents a
-	// deadlock where the server side fills up its pipe(s)
-	// and gets blocked, so it can't receive state changes
-	// from the client side.
-	else if (test->reverse && test->state == TEST_END) {
-	    if (iperf_recv(test, &read_set) < 0)
+	    if (client_check_end(test) < 0)
 		return -1;
 	}
     }
@@ -455,3 +543,291 @@ iperf_run_client(struct iperf_test * test)
 
     return 0;
 }
+
+/*************************************************************/
+
+/*
+ * Sum of the interval every running fan-out test closed at boundary
+ * "end" (seconds since the epoch), reported relative to "origin".
+ */
+static void
+fanout_interval(struct iperf_test **tests, int ntests, double origin, double end, cJSON *json_intervals)
+{
+    struct iperf_test *test;
+    struct iperf_stream *sp;
+    struct iperf_interval_results *irp;
+    iperf_size_t bytes = 0, test_bytes;
+    double bandwidth = 0.0, duration, start_time, end_time;
+    char ubuf[UNIT_LEN];
+    char nbuf[UNIT_LEN];
+    int i, n = 0;
+
+    for (i = 0; i < ntests; ++i) {
+	test = tests[i];
+	if (test->state != TEST_RUNNING || test->omitting)
+	    continue;
+	test_bytes = 0;
+	duration = 0.0;
+	SLIST_FOREACH(sp, &test->streams, streams) {
+	    irp = TAILQ_LAST(&sp->result->interval_results, irlisthead);
+	    /* Skip streams whose last interval is an older one. */
+	    if (irp == NULL ||
+		timeval_to_double(&irp->interval_end_time) < end - tests[0]->reporter_interval / 2)
+		continue;
+	    test_bytes += irp->bytes_transferred;
+	    duration = irp->interval_duration;
+	}
+	if (duration <= 0.0)
+	    continue;
+	bytes += test_bytes;
+	bandwidth += test_bytes / duration;
+	++n;
+    }
+    if (n == 0)
+	return;
+
+    end_time = end - origin;
+    start_time = end_time - tests[0]->reporter_interval;
+    if (start_time < 0.0)
+	start_time = 0.0;
+    if (json_intervals != NULL)
+	cJSON_AddItemToArray(json_intervals, iperf_json_printf("start: %f  end: %f  bytes: %d  bits_per_second: %f  servers: %d", start_time, end_time, (int64_t) bytes, bandwidth * 8, (int64_t) n));
+    else {
+	unit_snprintf(ubuf, UNIT_LEN, (double) bytes, 'A');
+	unit_snprintf(nbuf, UNIT_LEN, bandwidth, tests[0]->settings->unit_format);
+	fprintf(tests[0]->outfile, report_fanout_sum_format, start_time, end_time, ubuf, nbuf, n, ntests);
+    }
+}
+
+/* Totals over all the tests that completed. */
+static void
+fanout_results(struct iperf_test **tests, int ntests, int *failed, cJSON *json_end)
+{
+    struct iperf_test *test;
+    struct iperf_stream *sp;
+    iperf_size_t sent = 0, received = 0, test_sent, test_received;
+    double sent_bw = 0.0, received_bw = 0.0, duration, end_time = 0.0;
+    char ubuf[UNIT_LEN];
+    char nbuf[UNIT_LEN];
+    int i, n = 0;
+
+    for (i = 0; i < ntests; ++i) {
+	test = tests[i];
+	sp = SLIST_FIRST(&test->streams);
+	if (failed[i] || sp == NULL)
+	    continue;
+	duration = timeval_diff(&sp->result->start_time, &sp->result->end_time);
+	if (duration <= 0.0)
+	    continue;
+	test_sent = test_received = 0;
+	SLIST_FOREACH(sp, &test->streams, streams) {
+	    test_sent += sp->result->bytes_sent - sp->result->bytes_sent_omit;
+	    test_received += sp->result->bytes_received;
+	}
+	sent += test_sent;
+	received += test_received;
+	sent_bw += test_sent / duration;
+	received_bw += test_received / duration;
+	if (duration > end_time)
+	    end_time = duration;
+	++n;
+    }
+
+    if (json_end != NULL) {
+	cJSON_AddItemToObject(json_end, "sum_sent", iperf_json_printf("start: %f  end: %f  bytes: %d  bits_per_second: %f  servers: %d", 0.0, end_time, (int64_t) sent, sent_bw * 8, (int64_t) n));
+	cJSON_AddItemToObject(json_end, "sum_received", iperf_json_printf("start: %f  end: %f  bytes: %d  bits_per_second: %f  servers: %d", 0.0, end_time, (int64_t) received, received_bw * 8, (int64_t) n));
+	return;
+    }
+    fprintf(tests[0]->outfile, "%s", report_bw_separator);
+    unit_snprintf(ubuf, UNIT_LEN, (double) sent, 'A');
+    unit_snprintf(nbuf, UNIT_LEN, sent_bw, tests[0]->settings->unit_format);
+    fprintf(tests[0]->outfile, report_fanout_result_format, 0.0, end_time, ubuf, nbuf, report_sender, n, ntests);
+    unit_snprintf(ubuf, UNIT_LEN, (double) received, 'A');
+    unit_snprintf(nbuf, UNIT_LEN, received_bw, tests[0]->settings->unit_format);
+    fprintf(tests[0]->outfile, report_fanout_result_format, 0.0, end_time, ubuf, nbuf, report_receiver, n, ntests);
+}
+
+/*
+ * Run one client test per server from a single event loop.  Each test
+ * prints its own reports (prefixed with its title); interval timers are
+ * aligned to a common start so that an [ALL] line can sum each interval
+ * over the servers.  A server that fails is reported and dropped; the
+ * others carry on.
+ */
+int
+iperf_run_clients(struct iperf_test **tests, int ntests)
+{
+    struct iperf_test *test;
+    int *startup, *failed;
+    int i, fd, max_fd, result, running, nfailed = 0;
+    fd_set read_set, write_set;
+    struct timeval now;
+    struct timeval* timeout = NULL;
+    cJSON *json_top = NULL, *json_servers = NULL, *json_intervals = NULL, *json_end = NULL;
+    double interval = 0.0, origin, base, next_end = 0.0;
+
+    startup = (int *) calloc(ntests, sizeof(int));
+    failed = (int *) calloc(ntests, sizeof(int));
+    if (startup == NULL || failed == NULL) {
+	free(startup);
+	free(failed);
+	i_errno = IEINITTEST;
+	return -1;
+    }
+    if (tests[0]->json_output) {
+	/* Each part is attached as it is made, so deleting json_top frees them all. */
+	json_top = cJSON_CreateObject();
+	if (json_top != NULL && (json_servers = cJSON_CreateArray()) != NULL)
+	    cJSON_AddItemToObject(json_top, "servers", json_servers);
+	if (json_servers != NULL && (json_intervals = cJSON_CreateArray()) != NULL)
+	    cJSON_AddItemToObject(json_top, "intervals", json_intervals);
+	if (json_intervals != NULL && (json_end = cJSON_CreateObject()) != NULL)
+	    cJSON_AddItemToObject(json_top, "end", json_end);
+	if (json_end == NULL) {
+	    if (json_top != NULL)
+		cJSON_Delete(json_top);
+	    free(startup);
+	    free(failed);
+	    i_errno = IEINITTEST;
+	    return -1;
+	}
+    }
+
+    /*
+     * Unless the command line already aligns intervals (--start-at,
+     * --align-intervals), align them to now.  Every test then labels
+     * its intervals from the same origin as the [ALL] lines, rather
+     * than from its own start after connecting.
+     */
+    (void) gettimeofday(&now, NULL);
+    origin = timeval_to_double(&now);
+    for (i = 0; i < ntests; ++i) {
+	if (!tests[i]->align_intervals) {
+	    tests[i]->align_intervals = 1;
+	    tests[i]->interval_base = now;
+	}
+    }
+    base = timeval_to_double(&tests[0]->interval_base);
+    if (base > origin) {
+	origin = base;
+	now = tests[0]->interval_base;
+    }
+    for (i = 0; i < ntests; ++i)
+	tests[i]->label_base = now;
+    if (tests[0]->reporter_interval != 0 &&
+	tests[0]->reporter_interval == tests[0]->stats_interval) {
+	interval = tests[0]->reporter_interval;
+	next_end = base + interval;
+	if (origin > base)
+	    next_end += (int64_t) ((origin - base) / interval) * interval;
+    }
+
+    for (i = 0; i < ntests; ++i) {
+	test = tests[i];
+	startup[i] = 1;
+	if (client_start(test) < 0) {
+	    iperf_err(test, "error - %s", iperf_strerror(i_errno));
+	    failed[i] = 1;
+	    ++nfailed;
+	}
+    }
+
+    /* Begin calculating CPU utilization */
+    cpu_util(NULL);
+
+    for (;;) {
+	FD_ZERO(&read_set);
+	FD_ZERO(&write_set);
+	max_fd = -1;
+	for (i = 0; i < ntests; ++i) {
+	    test = tests[i];
+	    if (failed[i] || test->state == IPERF_DONE)
+		continue;
+	    for (fd = 0; fd <= test->max_fd; ++fd) {
+		if (FD_ISSET(fd, &test->read_set))
+		    FD_SET(fd, &read_set);
+		if (FD_ISSET(fd, &test->write_set))
+		    FD_SET(fd, &write_set);
+	    }
+	    if (test->max_fd > max_fd)
+		max_fd = test->max_fd;
+	}
+	if (max_fd < 0)
+	    break;
+
+	(void) gettimeofday(&now, NULL);
+	timeout = tmr_timeout(&now);
+	result = select(max_fd + 1, &read_set, &write_set, NULL, timeout);
+	if (result < 0 && errno != EINTR) {
+  	    i_errno = IESELECT;
+	    if (json_top != NULL)
+		cJSON_Delete(json_top);
+	    free(startup);
+	    free(failed);
+	    return -1;
+	}
+
+	running = 0;
+	for (i = 0; i < ntests; ++i) {
+	    test = tests[i];
+	    if (failed[i] || test->state == IPERF_DONE)
+		continue;
+	    if (client_io(test, &read_set, &write_set, result > 0, &startup[i]) < 0) {
+		iperf_err(test, "error - %s", iperf_strerror(i_errno));
+		test->done = 1;
+		failed[i] = 1;
+		++nfailed;
+		continue;
+	    }
+	    if (test->state == TEST_RUNNING)
+		running = 1;
+	}
+	if (!running)
+	    continue;
+
+	/* Run the timers, then sum any interval they all just closed. */
+	(void) gettimeofday(&now, NULL);
+	tmr_run(&now);
+	if (interval != 0.0) {
+	    while (timeval_to_double(&now) >= next_end) {
+		fanout_interval(tests, ntests, origin, next_end, json_intervals);
+		next_end += interval;
+	    }
+	}
+
+	for (i = 0; i < ntests; ++i) {
+	    test = tests[i];
+	    if (failed[i] || test->state != TEST_RUNNING)
+		continue;
+	    if (client_check_end(test) < 0) {
+		iperf_err(test, "error - %s", iperf_strerror(i_errno));
+		failed[i] = 1;
+		++nfailed;
+	    }
+	}
+    }
+
+    fanout_results(tests, ntests, failed, json_end);
+
+    if (json_top != NULL) {
+	for (i = 0; i < ntests; ++i)
+	    if (tests[i]->json_top != NULL)
+		cJSON_AddItemToArray(json_servers, iperf_json_detach(tests[i]));
+	tests[0]->json_output_string = cJSON_Print(json_top);
+	if (tests[0]->json_output_string != NULL)
+	    fprintf(tests[0]->outfile, "%s\n", tests[0]->json_output_string);
+	cJSON_Delete(json_top);
+    } else {
+	fprintf(tests[0]->outfile, "\n");
+	fprintf(tests[0]->outfile, "%s", report_done);
+    }
+    fflush(tests[0]->outfile);
+
+    free(startup);
+    free(failed);
+    if (nfailed == ntests) {
+	i_errno = IECONNECT;
+	return -1;
+    }
+    return nfailed;
+}
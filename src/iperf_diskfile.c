@@ -0,0 +1,604 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#define _GNU_SOURCE
+
+#include "iperf_config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_locale.h"
+#include "iperf_util.h"
+#include "iperf_diskfile.h"
+#include "iperf_placement.h"
+#include "net.h"
+#include "units.h"
+
+/*
+ * A ring of depth slots.  The count slots from head hold data: read
+ * from the file and waiting to be sent, or received and waiting to be
+ * written.  The network side only touches the head slot (sending) or
+ * the one after the last full one (receiving), the worker the others.
+ */
+struct iperf_diskfile {
+    struct iperf_test *test;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;	/* signalled whenever head, count or stop change */
+    int       fd;
+    int       sender;
+    int       direct;		/* opened with O_DIRECT */
+    int       fsync_blocks;	/* fsync after this many slots, 0 at the end only */
+    int       depth;
+    int       slot_size;
+    char    **slot;
+    int      *len;
+    int       head, count;
+    int       off;		/* bytes sent from the head slot, or received into the next */
+    int       eof, stop, error;
+
+    /* -Z: no thread, the kernel moves the data (see diskfile_zerocopy()). */
+    int       zerocopy;
+    off_t     offset;		/* sender: how far into the file */
+    off_t     size;		/* ... and where it ends */
+    int       pipefd[2];	/* receiver: socket -> pipe -> file */
+    iperf_size_t unsynced;	/* receiver: bytes since the last fsync */
+
+    iperf_size_t bytes;		/* read or written */
+    iperf_size_t fsyncs;
+    double    disk_seconds;	/* the worker, reading, writing and syncing */
+    double    wait_seconds;	/* the network side, waiting on the worker */
+};
+
+static double
+diskfile_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Wait, with df->lock held, counting the time against the disk. */
+static void
+diskfile_wait(struct iperf_diskfile *df)
+{
+    double start = diskfile_now();
+
+    pthread_cond_wait(&df->cond, &df->lock);
+    df->wait_seconds += diskfile_now() - start;
+}
+
+static int
+diskfile_write(struct iperf_diskfile *df, const char *buf, int n)
+{
+    int r;
+
+#if defined(O_DIRECT)
+    /* O_DIRECT takes whole blocks only; the last, short one goes through the cache. */
+    if (df->direct && n % DISKFILE_ALIGN != 0) {
+	(void) fcntl(df->fd, F_SETFL, fcntl(df->fd, F_GETFL) & ~O_DIRECT);
+	df->direct = 0;
+    }
+#endif
+    while (n > 0) {
+	r = write(df->fd, buf, n);
+	if (r < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	buf += r;
+	n -= r;
+    }
+    return 0;
+}
+
+static void *
+diskfile_reader(void *arg)
+{
+    struct iperf_diskfile *df = (struct iperf_diskfile *) arg;
+    double start;
+    int slot, r;
+
+    iperf_placement_thread(df->test);
+    pthread_mutex_lock(&df->lock);
+    for (;;) {
+	while (!df->stop && df->count == df->depth)
+	    pthread_cond_wait(&df->cond, &df->lock);
+	if (df->stop)
+	    break;
+	slot = (df->head + df->count) % df->depth;
+	pthread_mutex_unlock(&df->lock);
+
+	start = diskfile_now();
+	do
+	    r = read(df->fd, df->slot[slot], df->slot_size);
+	while (r < 0 && errno == EINTR);
+
+	pthread_mutex_lock(&df->lock);
+	df->disk_seconds += diskfile_now() - start;
+	if (r <= 0) {
+	    df->eof = 1;
+	    df->error = r < 0;
+	    pthread_cond_broadcast(&df->cond);
+	    break;
+	}
+	df->len[slot] = r;
+	df->bytes += r;
+	++df->count;
+	pthread_cond_broadcast(&df->cond);
+    }
+    pthread_mutex_unlock(&df->lock);
+    return NULL;
+}
+
+static void *
+diskfile_writer(void *arg)
+{
+    struct iperf_diskfile *df = (struct iperf_diskfile *) arg;
+    iperf_size_t written = 0;
+    double start;
+    int slot, r;
+
+    iperf_placement_thread(df->test);
+    pthread_mutex_lock(&df->lock);
+    for (;;) {
+	/* Everything given is written before stopping. */
+	while (!df->stop && df->count == 0)
+	    pthread_cond_wait(&df->cond, &df->lock);
+	if (df->count == 0)
+	    break;
+	slot = df->head;
+	pthread_mutex_unlock(&df->lock);
+
+	start = diskfile_now();
+	r = diskfile_write(df, df->slot[slot], df->len[slot]);
+	if (r == 0 && df->fsync_blocks > 0 && ++written % df->fsync_blocks == 0)
+	    r = fsync(df->fd);
+
+	pthread_mutex_lock(&df->lock);
+	df->disk_seconds += diskfile_now() - start;
+	if (r < 0)
+	    df->error = 1;
+	else {
+	    df->bytes += df->len[slot];
+	    if (df->fsync_blocks > 0 && written % df->fsync_blocks == 0)
+		++df->fsyncs;
+	}
+	df->head = (df->head + 1) % df->depth;
+	--df->count;
+	pthread_cond_broadcast(&df->cond);
+    }
+    pthread_mutex_unlock(&df->lock);
+
+    start = diskfile_now();
+    r = fsync(df->fd);
+    pthread_mutex_lock(&df->lock);
+    df->disk_seconds += diskfile_now() - start;
+    if (r == 0)
+	++df->fsyncs;
+    pthread_mutex_unlock(&df->lock);
+    return NULL;
+}
+
+/*
+ * -Z moves TCP data without copying it through user space: sendfile()
+ * from the file on the sender, splice() through a pipe into the file on
+ * the receiver (Linux only; elsewhere the receiver writes behind).
+ */
+static int
+diskfile_zerocopy(struct iperf_stream *sp)
+{
+    struct iperf_test *test = sp->test;
+
+    if (!test->zerocopy || test->protocol->id != Ptcp)
+	return 0;
+#if defined(linux)
+    return 1;
+#else
+    return sp->sender;
+#endif
+}
+
+static void
+diskfile_release(struct iperf_diskfile *df)
+{
+    int i;
+
+    if (df->slot != NULL)
+	for (i = 0; i < df->depth; ++i)
+	    free(df->slot[i]);
+    free(df->slot);
+    free(df->len);
+    if (df->pipefd[0] >= 0)
+	close(df->pipefd[0]);
+    if (df->pipefd[1] >= 0)
+	close(df->pipefd[1]);
+    if (df->fd >= 0)
+	close(df->fd);
+    pthread_cond_destroy(&df->cond);
+    pthread_mutex_destroy(&df->lock);
+    free(df);
+}
+
+int
+iperf_diskfile_new(struct iperf_stream *sp)
+{
+    struct iperf_test *test = sp->test;
+    struct iperf_diskfile *df;
+    int flags, i;
+
+    df = (struct iperf_diskfile *) calloc(1, sizeof(struct iperf_diskfile));
+    if (df == NULL) {
+	i_errno = IECREATESTREAM;
+	return -1;
+    }
+    pthread_mutex_init(&df->lock, NULL);
+    pthread_cond_init(&df->cond, NULL);
+    df->pipefd[0] = df->pipefd[1] = -1;
+    df->test = test;
+    df->sender = sp->sender;
+    df->zerocopy = diskfile_zerocopy(sp);
+    df->fsync_blocks = test->diskfile_fsync;
+    df->depth = test->diskfile_depth ? test->diskfile_depth : DEFAULT_DISKFILE_DEPTH;
+    df->slot_size = test->settings->blksize > DISKFILE_SLOT ? test->settings->blksize : DISKFILE_SLOT;
+    df->slot_size = (df->slot_size + DISKFILE_ALIGN - 1) / DISKFILE_ALIGN * DISKFILE_ALIGN;
+
+    flags = sp->sender ? O_RDONLY : (O_WRONLY|O_CREAT|O_TRUNC);
+#if defined(O_DIRECT)
+    /* splice() can't write to O_DIRECT files. */
+    if (test->diskfile_direct && !(df->zerocopy && !sp->sender)) {
+	flags |= O_DIRECT;
+	df->direct = 1;
+    }
+#endif
+    df->fd = open(test->diskfile_name, flags, S_IRUSR|S_IWUSR);
+    if (df->fd < 0) {
+	diskfile_release(df);
+	i_errno = IEFILE;
+	return -1;
+    }
+
+    if (df->zerocopy) {
+	if (sp->sender) {
+	    if ((df->size = lseek(df->fd, 0, SEEK_END)) < 0) {
+		diskfile_release(df);
+		i_errno = IEFILE;
+		return -1;
+	    }
+	} else if (pipe(df->pipefd) < 0) {
+	    diskfile_release(df);
+	    i_errno = IECREATESTREAM;
+	    return -1;
+	}
+#if defined(F_SETPIPE_SZ)
+	else
+	    (void) fcntl(df->pipefd[1], F_SETPIPE_SZ, test->settings->blksize);
+#endif
+	sp->diskfile = df;
+	sp->diskfile_fd = df->fd;
+	return 0;
+    }
+
+    df->slot = (char **) calloc(df->depth, sizeof(char *));
+    df->len = (int *) calloc(df->depth, sizeof(int));
+    if (df->slot == NULL || df->len == NULL) {
+	diskfile_release(df);
+	i_errno = IECREATESTREAM;
+	return -1;
+    }
+    for (i = 0; i < df->depth; ++i)
+	if (posix_memalign((void **) &df->slot[i], DISKFILE_ALIGN, df->slot_size) != 0) {
+	    df->slot[i] = NULL;
+	    diskfile_release(df);
+	    i_errno = IECREATESTREAM;
+	    return -1;
+	}
+
+    if (pthread_create(&df->thread, NULL, sp->sender ? diskfile_reader : diskfile_writer, df) != 0) {
+	diskfile_release(df);
+	i_errno = IECREATESTREAM;
+	return -1;
+    }
+    sp->diskfile = df;
+    sp->diskfile_fd = df->fd;
+    return 0;
+}
+
+/* Hand the part-filled receive slot to the writer. */
+static void
+diskfile_flush(struct iperf_diskfile *df)
+{
+    pthread_mutex_lock(&df->lock);
+    if (df->off > 0) {
+	while (df->count == df->depth)
+	    diskfile_wait(df);
+	df->len[(df->head + df->count) % df->depth] = df->off;
+	++df->count;
+	df->off = 0;
+	pthread_cond_broadcast(&df->cond);
+    }
+    pthread_mutex_unlock(&df->lock);
+}
+
+static void
+diskfile_join(struct iperf_diskfile *df)
+{
+    double start;
+
+    if (df->zerocopy) {
+	/* Nothing in flight; just the last fsync. */
+	if (!df->sender) {
+	    start = diskfile_now();
+	    if (fsync(df->fd) == 0)
+		++df->fsyncs;
+	    df->disk_seconds += diskfile_now() - start;
+	    df->wait_seconds += diskfile_now() - start;
+	}
+	df->stop = 1;
+	return;
+    }
+    if (!df->sender)
+	diskfile_flush(df);
+    pthread_mutex_lock(&df->lock);
+    df->stop = 1;
+    pthread_cond_broadcast(&df->cond);
+    pthread_mutex_unlock(&df->lock);
+    pthread_join(df->thread, NULL);
+}
+
+void
+iperf_diskfile_free(struct iperf_stream *sp)
+{
+    struct iperf_diskfile *df = sp->diskfile;
+
+    if (df == NULL)
+	return;
+    if (!df->stop)
+	diskfile_join(df);
+    diskfile_release(df);
+    sp->diskfile = NULL;
+    sp->diskfile_fd = -1;
+}
+
+/* This pair of routines gets inserted into the snd/rcv function pointers
+** when there's a -F flag. They handle the file stuff and call the real
+** snd/rcv functions, which have been saved in snd2/rcv2 (or with -Z, move
+** the data themselves).
+**
+** The advantage of doing it this way is that in the much more common
+** case of no -F flag, there is zero extra overhead.
+*/
+
+static int
+diskfile_sendfile(struct iperf_stream *sp)
+{
+    struct iperf_diskfile *df = sp->diskfile;
+    off_t n = df->size - df->offset;
+    int r;
+
+    if (n <= 0) {
+	sp->test->done = 1;
+	return 0;
+    }
+    if (n > sp->settings->blksize)
+	n = sp->settings->blksize;
+    r = Nsendfile(df->fd, sp->socket, df->offset, n);
+    if (r < 0)
+	return r;
+    df->offset += r;
+    df->bytes += r;
+    sp->result->bytes_sent += r;
+    sp->result->bytes_sent_this_interval += r;
+    return r;
+}
+
+#if defined(linux)
+static int
+diskfile_splice(struct iperf_stream *sp)
+{
+    struct iperf_diskfile *df = sp->diskfile;
+    int left = sp->settings->blksize;
+    int total = 0;
+    ssize_t n, w;
+    double start;
+
+    /* Like Nread(): as much as is there, up to a block. */
+    while (left > 0) {
+	n = splice(sp->socket, NULL, df->pipefd[1], NULL, left, SPLICE_F_MOVE);
+	if (n < 0) {
+	    if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+		break;
+	    return NET_HARDERROR;
+	}
+	if (n == 0)
+	    break;
+
+	/* The network side waits for every bit of this. */
+	start = diskfile_now();
+	for (w = 0; w < n; ) {
+	    ssize_t m = splice(df->pipefd[0], NULL, df->fd, NULL, n - w, SPLICE_F_MOVE);
+	    if (m < 0 && errno == EINTR)
+		continue;
+	    if (m <= 0) {
+		df->error = 1;
+		return NET_HARDERROR;
+	    }
+	    w += m;
+	}
+	df->unsynced += n;
+	if (df->fsync_blocks > 0 && df->unsynced >= (iperf_size_t) df->fsync_blocks * df->slot_size) {
+	    if (fsync(df->fd) == 0)
+		++df->fsyncs;
+	    df->unsynced = 0;
+	}
+	df->disk_seconds += diskfile_now() - start;
+	df->wait_seconds += diskfile_now() - start;
+
+	total += n;
+	left -= n;
+    }
+    df->bytes += total;
+    sp->result->bytes_received += total;
+    sp->result->bytes_received_this_interval += total;
+    return total;
+}
+#endif /* linux */
+
+int
+iperf_diskfile_send(struct iperf_stream *sp)
+{
+    struct iperf_diskfile *df = sp->diskfile;
+    char *buffer = sp->buffer;
+    int send_size = sp->send_size;
+    int r, n;
+
+    if (df->zerocopy)
+	return diskfile_sendfile(sp);
+
+    pthread_mutex_lock(&df->lock);
+    while (df->count == 0 && !df->eof)
+	diskfile_wait(df);
+    if (df->count == 0) {
+	pthread_mutex_unlock(&df->lock);
+	sp->test->done = 1;
+	return 0;
+    }
+    n = df->len[df->head] - df->off;
+    pthread_mutex_unlock(&df->lock);
+
+    /* Send straight from the slot. */
+    if (n > sp->settings->blksize)
+	n = sp->settings->blksize;
+    sp->buffer = df->slot[df->head] + df->off;
+    sp->send_size = n;
+    r = sp->snd2(sp);
+    sp->buffer = buffer;
+    sp->send_size = send_size;
+
+    if (r > 0) {
+	df->off += r;
+	pthread_mutex_lock(&df->lock);
+	if (df->off >= df->len[df->head]) {
+	    df->head = (df->head + 1) % df->depth;
+	    --df->count;
+	    df->off = 0;
+	    pthread_cond_broadcast(&df->cond);
+	}
+	pthread_mutex_unlock(&df->lock);
+    }
+    return r;
+}
+
+int
+iperf_diskfile_recv(struct iperf_stream *sp)
+{
+    struct iperf_diskfile *df = sp->diskfile;
+    const char *p = sp->buffer;
+    int r, left, n, slot;
+
+#if defined(linux)
+    if (df->zerocopy)
+	return diskfile_splice(sp);
+#endif
+
+    r = sp->rcv2(sp);
+    if (r <= 0)
+	return r;
+
+    /* Gather into whole slots, so that the writer writes big. */
+    for (left = r; left > 0; left -= n, p += n) {
+	pthread_mutex_lock(&df->lock);
+	while (df->count == df->depth)
+	    diskfile_wait(df);
+	slot = (df->head + df->count) % df->depth;
+	pthread_mutex_unlock(&df->lock);
+
+	n = df->slot_size - df->off;
+	if (n > left)
+	    n = left;
+	memcpy(df->slot[slot] + df->off, p, n);
+	df->off += n;
+	if (df->off == df->slot_size) {
+	    pthread_mutex_lock(&df->lock);
+	    df->len[slot] = df->off;
+	    ++df->count;
+	    df->off = 0;
+	    pthread_cond_broadcast(&df->cond);
+	    pthread_mutex_unlock(&df->lock);
+	}
+    }
+    return r;
+}
+
+void
+iperf_diskfile_finish(struct iperf_stream *sp)
+{
+    struct iperf_diskfile *df = sp->diskfile;
+
+    if (df != NULL && !df->sender && !df->stop)
+	diskfile_join(df);
+}
+
+void
+iperf_diskfile_print(struct iperf_stream *sp, cJSON *json_summary_stream)
+{
+    struct iperf_test *test = sp->test;
+    struct iperf_diskfile *df = sp->diskfile;
+    double duration, net_seconds;
+    char ubuf[UNIT_LEN];
+
+    if (df == NULL)
+	return;
+    duration = timeval_diff(&sp->result->start_time, &sp->result->end_time);
+    net_seconds = duration > df->wait_seconds ? duration - df->wait_seconds : 0.0;
+    if (test->json_output)
+	cJSON_AddItemToObject(json_summary_stream, "disk", iperf_json_printf("bytes: %d  disk_seconds: %f  wait_seconds: %f  network_seconds: %f  fsyncs: %d  error: %b  zerocopy: %b", (int64_t) df->bytes, df->disk_seconds, df->wait_seconds, net_seconds, (int64_t) df->fsyncs, df->error, df->zerocopy));
+    else if (df->zerocopy && df->sender)
+	/* The kernel reads the file as it sends; there's no telling the two apart. */
+	iprintf(test, "%s", report_diskfile_sendfile);
+    else {
+	unit_snprintf(ubuf, UNIT_LEN, df->disk_seconds > 0 ? df->bytes / df->disk_seconds : 0.0, 'A');
+	iprintf(test, report_diskfile_disk, df->sender ? "read" : "wrote", df->disk_seconds, ubuf, (unsigned long long) df->fsyncs, net_seconds, df->wait_seconds);
+	if (df->error)
+	    iprintf(test, report_diskfile_error, df->sender ? "reading" : "writing", test->diskfile_name);
+    }
+}
@@ -0,0 +1,63 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_DISKFILE_H
+#define __IPERF_DISKFILE_H
+
+/*
+ * -F file transfers.  A worker thread per stream reads the file ahead
+ * of the sender, or writes behind the receiver, through a queue of
+ * --file-depth buffers, so that the network side only waits on the
+ * disk when the disk can't keep up.  Both sides count the time.
+ *
+ * With -Z over TCP there is no thread: the sender sendfile()s straight
+ * from the file, and the receiver splice()s from the socket into it.
+ */
+
+#define DISKFILE_SLOT (256 * 1024)	/* least bytes read or written at once */
+#define DISKFILE_ALIGN 4096		/* what O_DIRECT wants */
+
+/**
+ * iperf_diskfile_new -- open the -F file for sp and start its worker
+ *
+ * returns -1 with i_errno set on error
+ */
+int iperf_diskfile_new(struct iperf_stream *sp);
+
+/* Stop the worker, after it has written out what it was given. */
+void iperf_diskfile_free(struct iperf_stream *sp);
+
+/* In place of the protocol's send and recv functions. */
+int iperf_diskfile_send(struct iperf_stream *sp);
+int iperf_diskfile_recv(struct iperf_stream *sp);
+
+/* Wait until everything a receiver was given is on disk. */
+void iperf_diskfile_finish(struct iperf_stream *sp);
+
+/* The disk side's account, in the -F summary lines. */
+void iperf_diskfile_print(struct iperf_stream *sp, cJSON *json_summary_stream);
+
+#endif
@@ -0,0 +1,432 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_locale.h"
+#include "iperf_util.h"
+#include "iperf_drops.h"
+#include "net.h"
+
+#if defined(linux)
+/* A counter from /proc/net/snmp, whose "Udp:" lines are names, then values. */
+static int
+drops_snmp_field(FILE *f, const char *prefix, const char *name, uint64_t *valueP)
+{
+    char names[2048], values[2048], *n, *v, *nsave, *vsave;
+
+    while (fgets(names, sizeof(names), f) != NULL) {
+	if (strncmp(names, prefix, strlen(prefix)) != 0)
+	    continue;
+	if (fgets(values, sizeof(values), f) == NULL)
+	    return -1;
+	n = strtok_r(names, " \n", &nsave);
+	v = strtok_r(values, " \n", &vsave);
+	while (n != NULL && v != NULL) {
+	    if (strcmp(n, name) == 0) {
+		*valueP = strtoull(v, NULL, 10);
+		return 0;
+	    }
+	    n = strtok_r(NULL, " \n", &nsave);
+	    v = strtok_r(NULL, " \n", &vsave);
+	}
+	return -1;
+    }
+    return -1;
+}
+
+/* UDP receive buffer errors, IPv4 and IPv6. */
+static int
+drops_read_snmp(uint64_t *valueP)
+{
+    FILE *f;
+    char line[256];
+    unsigned long long v;
+    int r = -1;
+
+    *valueP = 0;
+    if ((f = fopen("/proc/net/snmp", "r")) != NULL) {
+	r = drops_snmp_field(f, "Udp:", "RcvbufErrors", valueP);
+	fclose(f);
+    }
+    if ((f = fopen("/proc/net/snmp6", "r")) != NULL) {
+	while (fgets(line, sizeof(line), f) != NULL)
+	    if (sscanf(line, "Udp6RcvbufErrors %llu", &v) == 1) {
+		*valueP += v;
+		r = 0;
+	    }
+	fclose(f);
+    }
+    return r;
+}
+
+/* What the interface dropped on receive: out of buffers, ring or FIFO full. */
+static int
+drops_read_nic(const char *ifname, uint64_t *valueP)
+{
+    static const char *counters[] = { "rx_dropped", "rx_missed_errors", "rx_fifo_errors" };
+    char path[128];
+    unsigned long long v;
+    FILE *f;
+    int i, r = -1;
+
+    *valueP = 0;
+    if (ifname[0] == '\0')
+	return -1;
+    for (i = 0; i < sizeof(counters) / sizeof(counters[0]); ++i) {
+	snprintf(path, sizeof(path), "/sys/class/net/%s/statistics/%s", ifname, counters[i]);
+	if ((f = fopen(path, "r")) == NULL)
+	    continue;
+	if (fscanf(f, "%llu", &v) == 1) {
+	    *valueP += v;
+	    r = 0;
+	}
+	fclose(f);
+    }
+    return r;
+}
+
+#endif /* linux */
+
+/* Bring the host-wide counters up to date. */
+static void
+drops_host_read(struct iperf_drops *drops)
+{
+#if defined(linux)
+    uint64_t v;
+
+    if (drops->have_snmp && drops_read_snmp(&v) == 0)
+	drops->snmp_last = v;
+    if (drops->have_nic && drops_read_nic(drops->ifname, &v) == 0)
+	drops->nic_last = v;
+#endif
+}
+
+int
+iperf_drops_init_stream(struct iperf_stream *sp)
+{
+    struct iperf_test *test = sp->test;
+    struct iperf_drops_stream *ds;
+#if defined(linux)
+    socklen_t len;
+    int on = 1;
+#endif
+
+    ds = (struct iperf_drops_stream *) calloc(1, sizeof(struct iperf_drops_stream));
+    if (ds == NULL) {
+	i_errno = IECREATESTREAM;
+	return -1;
+    }
+    sp->drops = ds;
+    if (sp->sender)
+	return 0;
+
+#if defined(linux) && defined(SO_RXQ_OVFL)
+    (void) setsockopt(sp->socket, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+    len = sizeof(ds->rcvbuf);
+    (void) getsockopt(sp->socket, SOL_SOCKET, SO_RCVBUF, &ds->rcvbuf, &len);
+
+    /* The host-wide counters start with the first receiving stream. */
+    if (test->drops == NULL) {
+	test->drops = (struct iperf_drops *) calloc(1, sizeof(struct iperf_drops));
+	if (test->drops == NULL) {
+	    i_errno = IECREATESTREAM;
+	    return -1;
+	}
+	(void) getsockifname(sp->socket, test->drops->ifname, sizeof(test->drops->ifname));
+	test->drops->have_snmp = drops_read_snmp(&test->drops->snmp_start) == 0;
+	test->drops->have_nic = drops_read_nic(test->drops->ifname, &test->drops->nic_start) == 0;
+	test->drops->snmp_last = test->drops->snmp_start;
+	test->drops->nic_last = test->drops->nic_start;
+    }
+#endif
+    return 0;
+}
+
+void
+iperf_drops_free_stream(struct iperf_stream *sp)
+{
+    free(sp->drops);
+    sp->drops = NULL;
+}
+
+void
+iperf_drops_free(struct iperf_drops *drops)
+{
+    free(drops);
+}
+
+void
+iperf_drops_cmsg(struct iperf_stream *sp, struct cmsghdr *cmsg)
+{
+#if defined(SO_RXQ_OVFL)
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL)
+	memcpy(&sp->drops->overflows, CMSG_DATA(cmsg), sizeof(uint32_t));
+#endif
+}
+
+int
+iperf_drops_recv(struct iperf_stream *sp)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    union {
+	char buf[CMSG_SPACE(sizeof(uint32_t))];
+	struct cmsghdr align;
+    } control;
+    int r;
+
+    iov.iov_base = sp->buffer;
+    iov.iov_len = sp->settings->blksize;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    r = recvmsg(sp->socket, &msg, 0);
+    if (r < 0) {
+	if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+	    return 0;
+	return NET_HARDERROR;
+    }
+    /* Only there once the socket has dropped something. */
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+	iperf_drops_cmsg(sp, cmsg);
+    return r;
+}
+
+void
+iperf_drops_test_stats(struct iperf_test *test)
+{
+    struct iperf_drops *drops = test->drops;
+    uint64_t snmp = drops->snmp_last, nic = drops->nic_last;
+
+    drops_host_read(drops);
+    drops->interval_snmp = drops->snmp_last - snmp;
+    drops->interval_nic = drops->nic_last - nic;
+}
+
+void
+iperf_drops_stats(struct iperf_stream *sp, struct iperf_interval_results *irp)
+{
+    struct iperf_drops_stream *ds = sp->drops;
+
+    /* Unsigned, so this survives the counter wrapping. */
+    irp->interval_socket_drops = (uint32_t) (ds->overflows - ds->interval_start);
+    ds->interval_start = ds->overflows;
+}
+
+/* The receiver's totals, host-wide ones included, for its report. */
+static void
+drops_summarize(struct iperf_stream *sp)
+{
+    struct iperf_drops_stream *ds = sp->drops;
+    struct iperf_drops *drops = sp->test->drops;
+
+    ds->total = ds->overflows;
+    if (drops == NULL)
+	return;
+    drops_host_read(drops);
+    ds->have_snmp = drops->have_snmp;
+    ds->have_nic = drops->have_nic;
+    ds->snmp = drops->snmp_last - drops->snmp_start;
+    ds->nic = drops->nic_last - drops->nic_start;
+    snprintf(ds->ifname, sizeof(ds->ifname), "%s", drops->ifname);
+}
+
+cJSON *
+iperf_drops_to_json(struct iperf_stream *sp)
+{
+    struct iperf_drops_stream *ds = sp->drops;
+    cJSON *j;
+
+    drops_summarize(sp);
+    j = iperf_json_printf("socket_drops: %d  rcvbuf: %d", (int64_t) ds->total, (int64_t) ds->rcvbuf);
+    if (j == NULL)
+	return NULL;
+    if (ds->have_snmp)
+	cJSON_AddIntToObject(j, "udp_rcvbuf_errors", ds->snmp);
+    if (ds->have_nic) {
+	cJSON_AddIntToObject(j, "nic_drops", ds->nic);
+	cJSON_AddStringToObject(j, "interface", ds->ifname);
+    }
+    return j;
+}
+
+void
+iperf_drops_from_json(struct iperf_stream *sp, cJSON *j)
+{
+    struct iperf_drops_stream *ds = sp->drops;
+    cJSON *j_p;
+
+    if ((j_p = cJSON_GetObjectItem(j, "socket_drops")) != NULL)
+	ds->total = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "rcvbuf")) != NULL)
+	ds->rcvbuf = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "udp_rcvbuf_errors")) != NULL) {
+	ds->snmp = j_p->valueint;
+	ds->have_snmp = 1;
+    }
+    if ((j_p = cJSON_GetObjectItem(j, "nic_drops")) != NULL) {
+	ds->nic = j_p->valueint;
+	ds->have_nic = 1;
+    }
+    if ((j_p = cJSON_GetObjectItem(j, "interface")) != NULL && j_p->valuestring != NULL)
+	snprintf(ds->ifname, sizeof(ds->ifname), "%s", j_p->valuestring);
+}
+
+void
+iperf_drops_print_interval(struct iperf_stream *sp, struct iperf_interval_results *irp, double st, double et, cJSON *json_interval_streams)
+{
+    cJSON *j;
+    int network;
+
+    if (sp->sender)
+	return;
+    if (json_interval_streams != NULL) {
+	j = cJSON_GetArrayItem(json_interval_streams, cJSON_GetArraySize(json_interval_streams) - 1);
+	if (j != NULL)
+	    cJSON_AddIntToObject(j, "socket_drops", irp->interval_socket_drops);
+    } else if (irp->interval_socket_drops > 0) {
+	network = irp->interval_cnt_error - (int) irp->interval_socket_drops;
+	iprintf(sp->test, report_drops_interval, sp->socket, st, et, irp->interval_cnt_error, (unsigned long long) irp->interval_socket_drops, network > 0 ? network : 0);
+    }
+}
+
+/* "n", or "-" where the counter couldn't be read. */
+static const char *
+drops_count(char *buf, size_t len, int have, uint64_t n)
+{
+    if (!have)
+	return "-";
+    snprintf(buf, len, "%llu", (unsigned long long) n);
+    return buf;
+}
+
+void
+iperf_drops_print_intermediate(struct iperf_test *test, cJSON *json_interval)
+{
+    struct iperf_drops *drops = test->drops;
+    struct iperf_stream *sp;
+    struct iperf_interval_results *irp = NULL;
+    char sbuf[32], nbuf[32];
+    cJSON *j;
+    double st, et;
+
+    if (drops == NULL || (!drops->have_snmp && !drops->have_nic))
+	return;
+    if (json_interval != NULL) {
+	if ((j = cJSON_CreateObject()) == NULL)
+	    return;
+	if (drops->have_snmp)
+	    cJSON_AddIntToObject(j, "udp_rcvbuf_errors", drops->interval_snmp);
+	if (drops->have_nic) {
+	    cJSON_AddIntToObject(j, "nic_drops", drops->interval_nic);
+	    cJSON_AddStringToObject(j, "interface", drops->ifname);
+	}
+	cJSON_AddItemToObject(json_interval, "kernel_drops", j);
+	return;
+    }
+    if (drops->interval_snmp == 0 && drops->interval_nic == 0)
+	return;
+    SLIST_FOREACH(sp, &test->streams, streams)
+	if (!sp->sender && (irp = TAILQ_LAST(&sp->result->interval_results, irlisthead)) != NULL)
+	    break;
+    if (irp == NULL)
+	return;
+    st = iperf_interval_time(sp, &irp->interval_start_time);
+    et = iperf_interval_time(sp, &irp->interval_end_time);
+    iprintf(test, report_drops_host_interval, st, et, drops_count(sbuf, sizeof(sbuf), drops->have_snmp, drops->interval_snmp), drops_count(nbuf, sizeof(nbuf), drops->have_nic, drops->interval_nic), drops->have_nic ? drops->ifname : "?");
+}
+
+void
+iperf_drops_print_results(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_drops_stream *ds, *host = NULL;
+    cJSON *json_drops = NULL, *json_streams = NULL;
+    char sbuf[32], nbuf[32];
+    int lost, network;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	ds = sp->drops;
+	if (ds == NULL)
+	    continue;
+	/* The sender shows what its receiver counted, once it has it, as the receiver's. */
+	if (!sp->sender)
+	    drops_summarize(sp);
+	else if (ds->rcvbuf == 0)
+	    continue;
+	if (host == NULL)
+	    host = ds;
+	lost = sp->cnt_error - sp->omitted_cnt_error;
+	network = lost - (int) ds->total;
+	if (network < 0)
+	    network = 0;
+
+	if (test->json_output) {
+	    if (json_drops == NULL) {
+		json_drops = cJSON_CreateObject();
+		json_streams = cJSON_CreateArray();
+		if (json_drops == NULL || json_streams == NULL)
+		    return;
+		cJSON_AddItemToObject(json_drops, "streams", json_streams);
+		cJSON_AddItemToObject(test->json_end, "kernel_drops", json_drops);
+	    }
+	    cJSON_AddItemToArray(json_streams, iperf_json_printf("socket: %d  sender: %b  lost_packets: %d  socket_drops: %d  network_loss: %d  rcvbuf: %d", (int64_t) sp->socket, sp->sender, (int64_t) lost, (int64_t) ds->total, (int64_t) network, (int64_t) ds->rcvbuf));
+	    continue;
+	}
+	if (lost > 0 || ds->total > 0)
+	    iprintf(test, report_drops_format, sp->socket, lost, (unsigned long long) ds->total, ds->rcvbuf, network, report_receiver);
+    }
+
+    if (host == NULL || (!host->have_snmp && !host->have_nic))
+	return;
+    if (json_drops != NULL) {
+	if (host->have_snmp)
+	    cJSON_AddIntToObject(json_drops, "udp_rcvbuf_errors", host->snmp);
+	if (host->have_nic) {
+	    cJSON_AddIntToObject(json_drops, "nic_drops", host->nic);
+	    cJSON_AddStringToObject(json_drops, "interface", host->ifname);
+	}
+    } else if (test->verbose && (host->snmp > 0 || host->nic > 0))
+	iprintf(test, report_drops_host, drops_count(sbuf, sizeof(sbuf), host->have_snmp, host->snmp), drops_count(nbuf, sizeof(nbuf), host->have_nic, host->nic), host->have_nic ? host->ifname : "?");
+}
@@ -0,0 +1,62 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_DROPS_H
+#define __IPERF_DROPS_H
+
+/*
+ * Kernel drop accounting for UDP receivers (Linux).  Each receiving
+ * socket has SO_RXQ_OVFL set, so its datagrams come with the count the
+ * socket has dropped for want of buffer space, which the interval and
+ * end reports take out of the loss: what is left was lost on the way.
+ * Host-wide, the UDP receive buffer errors in /proc/net/snmp{,6} and the
+ * receiving interface's drop counters in /sys/class/net are reported
+ * alongside, where they can be read; other traffic counts there too.
+ */
+
+int iperf_drops_init_stream(struct iperf_stream *sp);
+void iperf_drops_free_stream(struct iperf_stream *sp);
+void iperf_drops_free(struct iperf_drops *drops);
+
+/* Read a datagram into sp->buffer, as Nread() would, noting the drops. */
+int iperf_drops_recv(struct iperf_stream *sp);
+
+/* Note the drop count if cmsg carries it, for other recvmsg() callers. */
+void iperf_drops_cmsg(struct iperf_stream *sp, struct cmsghdr *cmsg);
+
+/* Once an interval: the host-wide counters, then each stream's. */
+void iperf_drops_test_stats(struct iperf_test *test);
+void iperf_drops_stats(struct iperf_stream *sp, struct iperf_interval_results *irp);
+
+/* Results exchange: the receiver's counts, for the sender. */
+cJSON *iperf_drops_to_json(struct iperf_stream *sp);
+void iperf_drops_from_json(struct iperf_stream *sp, cJSON *j);
+
+void iperf_drops_print_interval(struct iperf_stream *sp, struct iperf_interval_results *irp, double st, double et, cJSON *json_interval_streams);
+void iperf_drops_print_intermediate(struct iperf_test *test, cJSON *json_interval);
+void iperf_drops_print_results(struct iperf_test *test);
+
+#endif
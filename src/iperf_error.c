@@ -130,6 +130,63 @@ iperf_strerror(int i_errno)
 	case IEBADTOS:
 	    snprintf(errstr, len, "bad TOS value (must be between 0 and 255 inclusive)");
 	    break;
+	case IEPARAMCHANGE:
+	    snprintf(errstr, len, "bad parameter change (must be bandwidth, parallel, len or burst, during a running test)");
+	    break;
+	case IECAPACITYSEARCH:
+	    snprintf(errstr, len, "--capacity-search needs UDP, a nonzero -b to search below and a nonzero -i");
+	    break;
+	case IEBIDIR:
+	    snprintf(errstr, len, "--bidir can't be used with -R, -F or --capacity-search");
+	    break;
+	case IEREQRESP:
+	    snprintf(errstr, len, "--rr sizes must be at least %d bytes, and --rr can't be used with -R, --bidir, -F or --capacity-search", RR_HEADER_LEN);
+	    break;
+	case IECRR:
+	    snprintf(errstr, len, "--crr works over TCP only");
+	    break;
+	case IEPROFILE:
+	    snprintf(errstr, len, "--profile must be poisson (which needs -b), onoff:ON/OFF or trace:FILE with a readable trace (not with -R or --bidir), and can't be used with --rr, -F or --capacity-search");
+	    break;
+	case IESIZEMIX:
+	    snprintf(errstr, len, "--size-mix must be imix or a list of SIZE[:WEIGHT] with sizes of %d to %d bytes, and works over UDP only, not with -l, --rr or a --profile trace", MIN_SIZE_MIX_SIZE, MAX_UDP_BLOCKSIZE);
+	    break;
+	case IEFLOWS:
+	    snprintf(errstr, len, "--flows takes 1 to %d flows, works over TCP or UDP on Linux only, and not with --bidir, --rr, --profile, --size-mix, -F or UDP with -R", MAX_FLOWS);
+	    break;
+	case IEDISKFILE:
+	    snprintf(errstr, len, "--file-depth takes 1 to %d buffers, --file-fsync a number of buffers, and both they and --file-direct need -F", MAX_DISKFILE_DEPTH);
+	    break;
+	case IEPAYLOAD:
+	    snprintf(errstr, len, "--payload must be random, zeros, pattern, text or ratio:# (1 to 4096), and can't be used with -F or --rr");
+	    break;
+	case IEUDPTIMESTAMPS:
+	    snprintf(errstr, len, "--udp-timestamps takes no argument or hw, and works over UDP only");
+	    break;
+	case IECAPTURE:
+	    snprintf(errstr, len, "--capture takes an interface name, then optionally ,64 or ,ts for the senders' header layout");
+	    break;
+	case IEKTLS:
+	    snprintf(errstr, len, "--ktls works over TCP on Linux only, and not with --crr or --flows");
+	    break;
+	case IEAFPACKET:
+	    snprintf(errstr, len, "--af-packet works over UDP only, and not with -F, --rr or --flows");
+	    break;
+	case IEBUSYPOLL:
+	    snprintf(errstr, len, "--busy-poll takes a time in microseconds, from 1 to 1000000");
+	    break;
+	case IEVERIFY:
+	    snprintf(errstr, len, "--verify can't be used with -F, -Z, --rr or --flows");
+	    break;
+	case IESTARTAT:
+	    snprintf(errstr, len, "bad --start-at time (seconds since the epoch, or +seconds from now, not in the past)");
+	    break;
+	case IEUNIX:
+	    snprintf(errstr, len, "--unix without a path needs the server on this host, in the same network namespace; and a --unix path must be short enough for a socket address");
+	    break;
+	case IESTARTATFAR:
+	    snprintf(errstr, len, "--start-at time is too far ahead (maximum = %d seconds from now)", MAX_START_DELAY);
+	    break;
         case IEMSS:
             snprintf(errstr, len, "TCP MSS too large (maximum = %d bytes)", MAX_MSS);
             break;
@@ -281,6 +338,22 @@ iperf_strerror(int i_errno)
         case IEPROTOCOL:
             snprintf(errstr, len, "protocol does not exist");
             break;
+        case IESETCAPTURE:
+            snprintf(errstr, len, "unable to capture on the interface (it needs CAP_NET_RAW)");
+            perr = 1;
+            break;
+        case IESETKTLS:
+            snprintf(errstr, len, "unable to set up kernel TLS on a data stream (is the tls module loaded?)");
+            perr = 1;
+            break;
+        case IESETAFPACKET:
+            snprintf(errstr, len, "unable to set up an AF_PACKET ring (it needs CAP_NET_RAW, an IPv4 peer and its link address)");
+            perr = 1;
+            break;
+        case IESETBUSYPOLL:
+            snprintf(errstr, len, "unable to set SO_BUSY_POLL (above net.core.busy_read, it needs CAP_NET_ADMIN)");
+            perr = 1;
+            break;
         case IEAFFINITY:
             snprintf(errstr, len, "unable to set CPU affinity");
             perr = 1;
@@ -354,6 +427,14 @@ iperf_strerror(int i_errno)
             snprintf(errstr, len, "unable to set SCTP_INIT num of SCTP streams\n");
             perr = 1;
             break;
+        case IESENDPARAMCHANGE:
+            snprintf(errstr, len, "unable to send parameter change");
+            perr = 1;
+            break;
+        case IERECVPARAMCHANGE:
+            snprintf(errstr, len, "unable to receive parameter change");
+            perr = 1;
+            break;
     }
 
     if (herr || perr)
@@ -0,0 +1,650 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+#include <sys/time.h>
+#include <sys/select.h>
+#if defined(linux)
+#include <sys/epoll.h>
+#endif
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_util.h"
+#include "iperf_locale.h"
+#include "iperf_flows.h"
+#include "net.h"
+#include "units.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* UDP flows start each datagram with their number and a sequence number. */
+#define FLOW_HEADER_LEN 8
+
+struct iperf_flows *
+iperf_flows_new(int nflows, int sample)
+{
+    struct iperf_flows *flows;
+    struct rlimit rl;
+    int i;
+
+    if (nflows < 1 || nflows > MAX_FLOWS || sample < 0) {
+	i_errno = IEFLOWS;
+	return NULL;
+    }
+    flows = (struct iperf_flows *) calloc(1, sizeof(struct iperf_flows));
+    if (flows == NULL) {
+	i_errno = IENEWTEST;
+	return NULL;
+    }
+    flows->nflows = nflows;
+    flows->sample = sample;
+    flows->udp_fd = -1;
+    flows->fd = (int *) malloc(nflows * sizeof(int));
+    flows->seq = (uint32_t *) calloc(nflows, sizeof(uint32_t));
+    flows->packets = (uint32_t *) calloc(nflows, sizeof(uint32_t));
+    flows->bytes = (iperf_size_t *) calloc(nflows, sizeof(iperf_size_t));
+#if defined(linux)
+    flows->epfd = epoll_create(1);
+#else
+    flows->epfd = -1;
+#endif
+    if (flows->fd == NULL || flows->seq == NULL || flows->packets == NULL || flows->bytes == NULL ||
+	flows->epfd < 0 || flows->epfd >= FD_SETSIZE) {
+	i_errno = flows->epfd < 0 ? IEFLOWS : IENEWTEST;
+	iperf_flows_free(flows);
+	return NULL;
+    }
+    for (i = 0; i < nflows; ++i)
+	flows->fd[i] = -1;
+
+    /* Every flow takes a descriptor: allow as many as we may. */
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+	rl.rlim_cur = rl.rlim_max;
+	(void) setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    return flows;
+}
+
+void
+iperf_flows_free(struct iperf_flows *flows)
+{
+    int i;
+
+    if (flows == NULL)
+	return;
+    for (i = 0; flows->fd != NULL && i < flows->nflows; ++i)
+	if (flows->fd[i] >= 0)
+	    close(flows->fd[i]);
+    if (flows->udp_fd >= 0)
+	close(flows->udp_fd);
+    if (flows->epfd >= 0)
+	close(flows->epfd);
+    free(flows->streams);
+    free(flows->fd);
+    free(flows->seq);
+    free(flows->packets);
+    free(flows->bytes);
+    free(flows);
+}
+
+int
+iperf_flows_listen(struct iperf_test *test, int s)
+{
+    if (test->protocol->id == Ptcp && listen(s, SOMAXCONN) < 0) {
+	i_errno = IELISTEN;
+	return -1;
+    }
+    return 0;
+}
+
+/* -w, as the UDP streams get it; TCP flows get theirs from protocol->connect(). */
+static int
+flows_bufsize(struct iperf_test *test, int s)
+{
+    int opt;
+
+    if ((opt = test->settings->socket_bufsize)) {
+	if (setsockopt(s, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt)) < 0 ||
+	    setsockopt(s, SOL_SOCKET, SO_SNDBUF, &opt, sizeof(opt)) < 0) {
+	    i_errno = IESETBUF;
+	    return -1;
+	}
+    }
+    return 0;
+}
+
+int
+iperf_flows_connect(struct iperf_test *test)
+{
+    struct iperf_flows *flows = test->flows;
+    int i, s = 0;
+    int bind_port = test->bind_port;
+
+    /* Only the streams take --cport. */
+    test->bind_port = 0;
+    for (i = 0; i < flows->nflows; ++i) {
+	if (test->protocol->id == Pudp) {
+	    /* No handshake: the server tells UDP flows apart by their header. */
+	    s = netdial(test->settings->domain, Pudp, test->bind_address, 0, test->server_hostname, test->server_port);
+	    if (s < 0)
+		i_errno = IESTREAMCONNECT;
+	    else if (flows_bufsize(test, s) < 0) {
+		close(s);
+		s = -1;
+	    }
+	} else
+	    s = test->protocol->connect(test);
+	if (s < 0)
+	    break;
+	setnonblocking(s, 1);
+	flows->fd[i] = s;
+	++flows->nopen;
+    }
+    test->bind_port = bind_port;
+
+    return s < 0 ? -1 : 0;
+}
+
+int
+iperf_flows_add(struct iperf_test *test, int s)
+{
+    struct iperf_flows *flows = test->flows;
+
+    if (flows->nopen >= flows->nflows) {
+	close(s);
+	i_errno = IEFLOWS;
+	return -1;
+    }
+    setnonblocking(s, 1);
+    flows->fd[flows->nopen++] = s;
+    return 0;
+}
+
+static int
+flows_watch(struct iperf_flows *flows, int fd, uint32_t i, int out)
+{
+#if defined(linux)
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = out ? EPOLLOUT : EPOLLIN;
+    ev.data.u32 = i;
+    return epoll_ctl(flows->epfd, EPOLL_CTL_ADD, fd, &ev);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+int
+iperf_flows_start(struct iperf_test *test)
+{
+    struct iperf_flows *flows = test->flows;
+    struct iperf_stream *sp;
+    int i;
+
+    /* Flow i counts towards stream i % -P. */
+    flows->nstreams = 0;
+    SLIST_FOREACH(sp, &test->streams, streams)
+	++flows->nstreams;
+    free(flows->streams);
+    flows->streams = (struct iperf_stream **) calloc(flows->nstreams, sizeof(struct iperf_stream *));
+    if (flows->nstreams == 0 || flows->streams == NULL) {
+	i_errno = IEINITTEST;
+	return -1;
+    }
+    i = 0;
+    SLIST_FOREACH(sp, &test->streams, streams)
+	flows->streams[i++] = sp;
+
+    /*
+     * UDP flows arrive on one unconnected socket on the data port; the
+     * connected stream sockets there only match their own clients.
+     */
+    if (test->protocol->id == Pudp && !test->sender) {
+	flows->udp_fd = netannounce(test->settings->domain, Pudp, test->bind_address, test->server_port);
+	if (flows->udp_fd < 0) {
+	    i_errno = IELISTEN;
+	    return -1;
+	}
+	if (flows_bufsize(test, flows->udp_fd) < 0)
+	    return -1;
+	setnonblocking(flows->udp_fd, 1);
+	if (flows_watch(flows, flows->udp_fd, flows->nflows, 0) < 0) {
+	    i_errno = IEINITTEST;
+	    return -1;
+	}
+    } else {
+	for (i = 0; i < flows->nopen; ++i)
+	    if (flows_watch(flows, flows->fd[i], i, test->sender) < 0) {
+		i_errno = IEINITTEST;
+		return -1;
+	    }
+    }
+
+    FD_SET(flows->epfd, &test->read_set);
+    if (flows->epfd > test->max_fd) test->max_fd = flows->epfd;
+    gettimeofday(&flows->start_time, NULL);
+
+    return 0;
+}
+
+static void
+flow_close(struct iperf_flows *flows, int i)
+{
+    /* That takes it out of the epoll set as well. */
+    close(flows->fd[i]);
+    flows->fd[i] = -1;
+}
+
+/*
+ * Under -b a stream and the flows that count towards it share its rate
+ * equally.  Each flow is held to its share on its own, so the flows
+ * epoll happens to report first can't use up the others' (and the
+ * stream's) before they get a turn.
+ */
+static int
+flow_green_light(struct iperf_test *test, int i, struct timeval *nowP)
+{
+    struct iperf_flows *flows = test->flows;
+    struct iperf_stream *sp = flows->streams[i % flows->nstreams];
+    double seconds;
+    int members;
+
+    if (!sp->green_light)
+	return 0;
+    if (test->settings->rate == 0)
+	return 1;
+    members = 1 + flows->nflows / flows->nstreams + (i % flows->nstreams < flows->nflows % flows->nstreams);
+    seconds = timeval_diff(&flows->start_time, nowP);
+    return seconds <= 0 || flows->bytes[i] * 8 / seconds < (double) test->settings->rate / members;
+}
+
+static int
+flow_send(struct iperf_test *test, int i, struct timeval *nowP)
+{
+    struct iperf_flows *flows = test->flows;
+    struct iperf_stream *sp = flows->streams[i % flows->nstreams];
+    uint32_t hdr[2];
+    struct iovec iov[2];
+    struct msghdr msg;
+    int r;
+
+    if (flows->fd[i] < 0)
+	return 0;
+    if (test->protocol->id == Pudp) {
+	/* The header goes out from here: the payload is read-only. */
+	hdr[0] = htonl(i);
+	hdr[1] = htonl(flows->seq[i] + 1);
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = FLOW_HEADER_LEN;
+	iov[1].iov_base = sp->buffer + FLOW_HEADER_LEN;
+	iov[1].iov_len = test->settings->blksize > FLOW_HEADER_LEN ? test->settings->blksize - FLOW_HEADER_LEN : 0;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+	r = sendmsg(flows->fd[i], &msg, MSG_NOSIGNAL);
+    } else
+	r = send(flows->fd[i], sp->buffer, test->settings->blksize, MSG_NOSIGNAL);
+    if (r < 0) {
+	if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS || errno == ECONNREFUSED)
+	    return 0;
+	/* The receiver closes its end first when the test is over. */
+	if (errno == EPIPE || errno == ECONNRESET) {
+	    flow_close(flows, i);
+	    return 0;
+	}
+	i_errno = IESTREAMWRITE;
+	return -1;
+    }
+
+    ++flows->seq[i];
+    flows->bytes[i] += r;
+    sp->result->bytes_sent += r;
+    sp->result->bytes_sent_this_interval += r;
+    test->bytes_sent += r;
+    ++test->blocks_sent;
+    if (test->settings->rate != 0)
+	iperf_check_throttle(sp, nowP);
+    return r;
+}
+
+static void
+flow_received(struct iperf_test *test, int i, int r)
+{
+    struct iperf_flows *flows = test->flows;
+    struct iperf_stream *sp = flows->streams[i % flows->nstreams];
+
+    flows->bytes[i] += r;
+    sp->result->bytes_received += r;
+    sp->result->bytes_received_this_interval += r;
+    /* -n and -k count what is sent; in reverse mode that arrives here. */
+    if (test->role == 'c') {
+	test->bytes_sent += r;
+	++test->blocks_sent;
+    }
+}
+
+static int
+flow_recv(struct iperf_test *test, int i)
+{
+    struct iperf_flows *flows = test->flows;
+    int r;
+
+    if (flows->fd[i] < 0)
+	return 0;
+    r = recv(flows->fd[i], flows->streams[i % flows->nstreams]->buffer, test->settings->blksize, 0);
+    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	return 0;
+    if (r == 0 || (r < 0 && errno == ECONNRESET)) {
+	flow_close(flows, i);
+	return 0;
+    }
+    if (r < 0) {
+	i_errno = IESTREAMREAD;
+	return -1;
+    }
+    flow_received(test, i, r);
+    return r;
+}
+
+static int
+flows_recv_udp(struct iperf_test *test)
+{
+    struct iperf_flows *flows = test->flows;
+    char *buf = flows->streams[0]->buffer;
+    uint32_t hdr[2], i, seq;
+    int n, r;
+
+    for (n = 0; n < FLOWS_EVENTS; ++n) {
+	r = recv(flows->udp_fd, buf, test->settings->blksize, 0);
+	if (r < 0) {
+	    if (errno == EAGAIN || errno == EWOULDBLOCK)
+		break;
+	    i_errno = IESTREAMREAD;
+	    return -1;
+	}
+	if (r < FLOW_HEADER_LEN)
+	    continue;
+	memcpy(hdr, buf, sizeof(hdr));
+	i = ntohl(hdr[0]);
+	seq = ntohl(hdr[1]);
+	if (i >= flows->nflows)
+	    continue;
+	++flows->packets[i];
+	if (seq > flows->seq[i])
+	    flows->seq[i] = seq;
+	flow_received(test, i, r);
+    }
+    return 0;
+}
+
+int
+iperf_flows_io(struct iperf_test *test, fd_set *read_setP)
+{
+    struct iperf_flows *flows = test->flows;
+    struct timeval now;
+    unsigned turn;
+    int n, j, k, i, held = 0, r = 0;
+#if defined(linux)
+    struct epoll_event events[FLOWS_EVENTS];
+#endif
+
+    if (flows == NULL || !FD_ISSET(flows->epfd, read_setP))
+	return 0;
+    FD_CLR(flows->epfd, read_setP);
+
+#if defined(linux)
+    n = epoll_wait(flows->epfd, events, FLOWS_EVENTS, 0);
+    if (n < 0) {
+	if (errno == EINTR)
+	    return 0;
+	i_errno = IESELECT;
+	return -1;
+    }
+    if (test->sender && test->settings->rate != 0)
+	gettimeofday(&now, NULL);
+    /*
+     * epoll reports ready flows in the same order each time; start where
+     * the last pass stopped, so the -b budget goes round all of them.
+     */
+    turn = flows->turn;
+    for (j = 0; j < n && r >= 0; ++j) {
+	k = test->sender ? (turn + j) % n : j;
+	i = events[k].data.u32;
+	if (i == flows->nflows)
+	    r = flows_recv_udp(test);
+	else if (test->sender) {
+	    if (!flow_green_light(test, i, &now)) {
+		++held;
+		continue;
+	    }
+	    r = flow_send(test, i, &now);
+	    if (r > 0)
+		++flows->turn;
+	    if ((test->settings->bytes != 0 && test->bytes_sent >= test->settings->bytes) ||
+		(test->settings->blocks != 0 && test->blocks_sent >= test->settings->blocks))
+		break;
+	} else
+	    r = flow_recv(test, i);
+    }
+    if (r < 0)
+	return -1;
+#else
+    n = j = k = i = 0;
+    turn = 0;
+#endif
+
+    /*
+     * All held back by -b, by their streams or their own shares: wait for
+     * a send timer to let one go rather than spin on epoll.
+     */
+    if (test->sender && n > 0 && held == n)
+	FD_CLR(flows->epfd, &test->read_set);
+
+    return 0;
+}
+
+void
+iperf_flows_stop(struct iperf_test *test)
+{
+    struct iperf_flows *flows = test->flows;
+    int i;
+
+    if (flows == NULL)
+	return;
+    if (flows->start_time.tv_sec != 0 && flows->end_time.tv_sec == 0)
+	gettimeofday(&flows->end_time, NULL);
+    for (i = 0; i < flows->nflows; ++i)
+	if (flows->fd[i] >= 0)
+	    flow_close(flows, i);
+    if (flows->udp_fd >= 0) {
+	close(flows->udp_fd);
+	flows->udp_fd = -1;
+    }
+    FD_CLR(flows->epfd, &test->read_set);
+}
+
+static void
+flows_summary(struct iperf_test *test, struct iperf_flows_summary *s)
+{
+    struct iperf_flows *flows = test->flows;
+    double b, sum = 0.0, sumsq = 0.0;
+    int i;
+
+    memset(s, 0, sizeof(*s));
+    s->bytes_min = flows->bytes[0];
+    for (i = 0; i < flows->nflows; ++i) {
+	b = flows->bytes[i];
+	if (flows->bytes[i] == 0)
+	    ++s->idle;
+	sum += b;
+	sumsq += b * b;
+	if (flows->bytes[i] < s->bytes_min)
+	    s->bytes_min = flows->bytes[i];
+	if (flows->bytes[i] > s->bytes_max)
+	    s->bytes_max = flows->bytes[i];
+	if (test->protocol->id == Pudp) {
+	    /* The sender knows what it sent; the receiver goes by the gaps. */
+	    if (test->sender)
+		s->packets += flows->seq[i];
+	    else {
+		s->packets += flows->packets[i];
+		if (flows->seq[i] > flows->packets[i])
+		    s->lost += flows->seq[i] - flows->packets[i];
+	    }
+	}
+    }
+    s->bytes_mean = sum / flows->nflows;
+    s->fairness = sumsq > 0.0 ? sum * sum / (flows->nflows * sumsq) : 0.0;
+    s->valid = 1;
+}
+
+static cJSON *
+flows_summary_json(struct iperf_flows_summary *s)
+{
+    return iperf_json_printf("bytes_min: %d  bytes_mean: %f  bytes_max: %d  fairness: %f  idle: %d  packets: %d  lost: %d", (int64_t) s->bytes_min, s->bytes_mean, (int64_t) s->bytes_max, s->fairness, (int64_t) s->idle, (int64_t) s->packets, (int64_t) s->lost);
+}
+
+cJSON *
+iperf_flows_to_json(struct iperf_test *test)
+{
+    struct iperf_flows_summary s;
+
+    flows_summary(test, &s);
+    return flows_summary_json(&s);
+}
+
+void
+iperf_flows_from_json(struct iperf_test *test, cJSON *j)
+{
+    struct iperf_flows_summary *peer = &test->flows->peer;
+    struct iperf_flows_summary s;
+    cJSON *j_p;
+
+    memset(peer, 0, sizeof(*peer));
+    if ((j_p = cJSON_GetObjectItem(j, "bytes_min")) != NULL)
+	peer->bytes_min = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "bytes_mean")) != NULL)
+	peer->bytes_mean = j_p->valuefloat;
+    if ((j_p = cJSON_GetObjectItem(j, "bytes_max")) != NULL)
+	peer->bytes_max = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "fairness")) != NULL)
+	peer->fairness = j_p->valuefloat;
+    if ((j_p = cJSON_GetObjectItem(j, "idle")) != NULL)
+	peer->idle = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "packets")) != NULL)
+	peer->packets = j_p->valueint;
+    peer->valid = 1;
+
+    /* What didn't arrive of what we sent, trailing losses included. */
+    if (test->protocol->id == Pudp) {
+	flows_summary(test, &s);
+	peer->lost = s.packets > peer->packets ? s.packets - peer->packets : 0;
+    }
+}
+
+static void
+flows_print_summary(struct iperf_test *test, struct iperf_flows_summary *s, const char *role)
+{
+    char minbuf[UNIT_LEN], meanbuf[UNIT_LEN], maxbuf[UNIT_LEN];
+
+    unit_snprintf(minbuf, UNIT_LEN, (double) s->bytes_min, 'A');
+    unit_snprintf(meanbuf, UNIT_LEN, s->bytes_mean, 'A');
+    unit_snprintf(maxbuf, UNIT_LEN, (double) s->bytes_max, 'A');
+    iprintf(test, report_flows_format, test->flows->nflows, minbuf, meanbuf, maxbuf, s->fairness, role);
+    if (s->idle > 0)
+	iprintf(test, report_flows_idle, s->idle, test->flows->nflows, role);
+}
+
+void
+iperf_flows_print_results(struct iperf_test *test)
+{
+    struct iperf_flows *flows = test->flows;
+    struct iperf_flows_summary local, *rs;
+    cJSON *json_flows, *json_sample;
+    double seconds, bps;
+    char ubuf[UNIT_LEN], nbuf[UNIT_LEN];
+    int i;
+
+    flows_summary(test, &local);
+    seconds = timeval_diff(&flows->start_time, &flows->end_time);
+    rs = test->sender ? (flows->peer.valid ? &flows->peer : NULL) : &local;
+
+    if (test->json_output) {
+	json_flows = cJSON_CreateObject();
+	if (json_flows == NULL)
+	    return;
+	cJSON_AddIntToObject(json_flows, "flows", flows->nflows);
+	cJSON_AddIntToObject(json_flows, "streams", flows->nstreams);
+	if (test->sender)
+	    cJSON_AddItemToObject(json_flows, "sender", flows_summary_json(&local));
+	if (rs != NULL)
+	    cJSON_AddItemToObject(json_flows, "receiver", flows_summary_json(rs));
+	if (flows->sample > 0) {
+	    json_sample = cJSON_CreateArray();
+	    if (json_sample != NULL) {
+		for (i = 0; i < flows->nflows; i += flows->sample)
+		    cJSON_AddItemToArray(json_sample, iperf_json_printf("flow: %d  bytes: %d  bits_per_second: %f  packets: %d", (int64_t) i, (int64_t) flows->bytes[i], seconds > 0 ? flows->bytes[i] * 8.0 / seconds : 0.0, (int64_t) (test->sender ? flows->seq[i] : flows->packets[i])));
+		cJSON_AddItemToObject(json_flows, "sample", json_sample);
+	    }
+	}
+	cJSON_AddItemToObject(test->json_end, "flows", json_flows);
+	return;
+    }
+
+    iprintf(test, "%s", report_flows_header);
+    if (test->sender)
+	flows_print_summary(test, &local, report_sender);
+    if (rs != NULL) {
+	flows_print_summary(test, rs, report_receiver);
+	if (test->protocol->id == Pudp && rs->packets + rs->lost > 0)
+	    iprintf(test, report_flows_lost, rs->lost, rs->packets + rs->lost, 100.0 * rs->lost / (rs->packets + rs->lost));
+    }
+    for (i = 0; flows->sample > 0 && i < flows->nflows; i += flows->sample) {
+	bps = seconds > 0 ? flows->bytes[i] * 8.0 / seconds : 0.0;
+	unit_snprintf(ubuf, UNIT_LEN, (double) flows->bytes[i], 'A');
+	unit_snprintf(nbuf, UNIT_LEN, bps / 8, test->settings->unit_format);
+	iprintf(test, report_flows_sample, i, ubuf, nbuf);
+    }
+}
@@ -0,0 +1,72 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_FLOWS_H
+#define __IPERF_FLOWS_H
+
+/*
+ * Many-flows mode (--flows): thousands of connections on top of the -P
+ * streams, with a few words of state each instead of an iperf_stream.
+ * They are driven from one epoll instance, whose descriptor is all the
+ * select() loop sees, so their count is limited only by the descriptor
+ * limit.  Their traffic adds to the streams', and they are reported as
+ * a whole: how evenly the bytes spread, and optionally every n-th flow.
+ */
+
+/**
+ * iperf_flows_new -- set up for nflows flows
+ *
+ * returns NULL with i_errno set on error
+ */
+struct iperf_flows *iperf_flows_new(int nflows, int sample);
+
+void iperf_flows_free(struct iperf_flows *flows);
+
+/* Server: let the TCP flows queue up while the streams are accepted. */
+int iperf_flows_listen(struct iperf_test *test, int s);
+
+/* Client: connect the flows, after the streams. */
+int iperf_flows_connect(struct iperf_test *test);
+
+/* Server: take an accepted TCP connection past the -P streams. */
+int iperf_flows_add(struct iperf_test *test, int s);
+
+/* Both: start moving data once the test starts. */
+int iperf_flows_start(struct iperf_test *test);
+
+int iperf_flows_io(struct iperf_test *test, fd_set *read_setP);
+
+/* Both: close the flows at the end of the test. */
+void iperf_flows_stop(struct iperf_test *test);
+
+/* Results exchange: the receiver's summary, for the sender. */
+cJSON *iperf_flows_to_json(struct iperf_test *test);
+
+void iperf_flows_from_json(struct iperf_test *test, cJSON *j);
+
+void iperf_flows_print_results(struct iperf_test *test);
+
+#endif
@@ -0,0 +1,453 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#if defined(linux)
+#include <linux/tls.h>
+#include <linux/if_alg.h>
+#endif /* linux */
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_locale.h"
+#include "iperf_util.h"
+#include "iperf_ktls.h"
+#include "units.h"
+
+#if defined(linux) && defined(TLS_TX) && defined(TCP_ULP) && defined(SOL_TLS)
+#define KTLS 1
+#if defined(TLS_1_3_VERSION)
+#define KTLS_VERSION TLS_1_3_VERSION
+#define KTLS_VERSION_NAME "TLS 1.3"
+#define KTLS_AAD_LEN 5		/* record header */
+#else
+#define KTLS_VERSION TLS_1_2_VERSION
+#define KTLS_VERSION_NAME "TLS 1.2"
+#define KTLS_AAD_LEN 13		/* sequence number and record header */
+#endif
+#else
+#define KTLS_VERSION_NAME "TLS"
+#endif /* linux && TLS_TX */
+
+#define KTLS_RECORD 16384	/* the largest TLS record, which bulk sends fill */
+
+/* The /proc/net/tls_stat counters of sessions set up, each way. */
+#define KTLS_TX_SW 0
+#define KTLS_RX_SW 1
+#define KTLS_TX_DEVICE 2
+#define KTLS_RX_DEVICE 3
+#define KTLS_STATS 4
+
+static const char *ktls_stat_names[KTLS_STATS] = { "TlsTxSw", "TlsRxSw", "TlsTxDevice", "TlsRxDevice" };
+
+struct iperf_ktls {
+    unsigned char secret[KTLS_SECRET_LEN];
+    char hex[KTLS_SECRET_LEN * 2 + 1];
+    double gcm_rate;			/* bytes/sec; 0 if unknown */
+    int64_t stats[KTLS_STATS];		/* before the test, then what it added */
+    int have_stats;
+    struct timeval start;
+    int measured;
+    double crypto_cpu;
+    double remote_crypto_cpu;
+};
+
+static int
+ktls_read_stats(int64_t stats[KTLS_STATS])
+{
+    FILE *fp;
+    char name[64];
+    long long value;
+    int i;
+
+    memset(stats, 0, KTLS_STATS * sizeof(stats[0]));
+    /* It's there once the tls module is loaded, which the first ULP does. */
+    if ((fp = fopen("/proc/net/tls_stat", "r")) == NULL)
+	return -1;
+    while (fscanf(fp, "%63s %lld", name, &value) == 2)
+	for (i = 0; i < KTLS_STATS; i++)
+	    if (strcmp(name, ktls_stat_names[i]) == 0)
+		stats[i] = value;
+    fclose(fp);
+    return 0;
+}
+
+/*
+ * How fast the kernel's gcm(aes), which kTLS uses in software too,
+ * seals full-size records here, through AF_ALG.  That adds a system
+ * call and a copy per record, so the crypto CPU estimated from it errs
+ * high, a little.
+ */
+static double
+ktls_gcm_rate(void)
+{
+#if defined(KTLS) && defined(ALG_SET_AEAD_ASSOCLEN)
+    struct sockaddr_alg sa;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    struct af_alg_iv *iv;
+    union {
+	char buf[CMSG_SPACE(sizeof(uint32_t)) * 2 + CMSG_SPACE(sizeof(struct af_alg_iv) + 12)];
+	struct cmsghdr align;
+    } control;
+    unsigned char key[TLS_CIPHER_AES_GCM_128_KEY_SIZE];
+    struct timeval t0, t1;
+    char *in = NULL, *out = NULL;
+    size_t len = KTLS_AAD_LEN + KTLS_RECORD, done;
+    double rate = 0, secs;
+    int tfm, op = -1;
+
+    if ((tfm = socket(AF_ALG, SOCK_SEQPACKET, 0)) < 0)
+	return 0;
+    memset(&sa, 0, sizeof(sa));
+    sa.salg_family = AF_ALG;
+    strcpy((char *) sa.salg_type, "aead");
+    strcpy((char *) sa.salg_name, "gcm(aes)");
+    memset(key, 0x5a, sizeof(key));
+    if (bind(tfm, (struct sockaddr *) &sa, sizeof(sa)) < 0 ||
+	setsockopt(tfm, SOL_ALG, ALG_SET_KEY, key, sizeof(key)) < 0 ||
+	setsockopt(tfm, SOL_ALG, ALG_SET_AEAD_AUTHSIZE, NULL, TLS_CIPHER_AES_GCM_128_TAG_SIZE) < 0 ||
+	(op = accept(tfm, NULL, 0)) < 0 ||
+	(in = calloc(1, len)) == NULL ||
+	(out = malloc(len + TLS_CIPHER_AES_GCM_128_TAG_SIZE)) == NULL)
+	goto done;
+
+    gettimeofday(&t0, NULL);
+    for (done = 0; done < KTLS_CALIBRATE_BYTES; done += KTLS_RECORD) {
+	memset(&control, 0, sizeof(control));
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = in;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_ALG;
+	cmsg->cmsg_type = ALG_SET_OP;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(uint32_t));
+	*(uint32_t *) CMSG_DATA(cmsg) = ALG_OP_ENCRYPT;
+
+	cmsg = CMSG_NXTHDR(&msg, cmsg);
+	cmsg->cmsg_level = SOL_ALG;
+	cmsg->cmsg_type = ALG_SET_IV;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(struct af_alg_iv) + 12);
+	iv = (struct af_alg_iv *) CMSG_DATA(cmsg);
+	iv->ivlen = 12;
+	memcpy(iv->iv, &done, sizeof(done));
+
+	cmsg = CMSG_NXTHDR(&msg, cmsg);
+	cmsg->cmsg_level = SOL_ALG;
+	cmsg->cmsg_type = ALG_SET_AEAD_ASSOCLEN;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(uint32_t));
+	*(uint32_t *) CMSG_DATA(cmsg) = KTLS_AAD_LEN;
+
+	if (sendmsg(op, &msg, 0) != (ssize_t) len ||
+	    read(op, out, len + TLS_CIPHER_AES_GCM_128_TAG_SIZE) != (ssize_t) (len + TLS_CIPHER_AES_GCM_128_TAG_SIZE))
+	    goto done;
+    }
+    gettimeofday(&t1, NULL);
+    secs = timeval_diff(&t0, &t1);
+    if (secs > 0)
+	rate = done / secs;
+
+ done:
+    free(in);
+    free(out);
+    if (op >= 0)
+	close(op);
+    close(tfm);
+    return rate;
+#else
+    return 0;
+#endif /* KTLS && ALG_SET_AEAD_ASSOCLEN */
+}
+
+struct iperf_ktls *
+iperf_ktls_new(const char *secret)
+{
+#if defined(KTLS)
+    struct iperf_ktls *ktls;
+    unsigned int byte;
+    int i;
+
+    if ((ktls = calloc(1, sizeof(*ktls))) == NULL) {
+	i_errno = IEKTLS;
+	return NULL;
+    }
+    if (secret == NULL) {
+	FILE *fp;
+
+	if ((fp = fopen("/dev/urandom", "r")) == NULL ||
+	    fread(ktls->secret, 1, sizeof(ktls->secret), fp) != sizeof(ktls->secret)) {
+	    if (fp != NULL)
+		fclose(fp);
+	    free(ktls);
+	    i_errno = IEKTLS;
+	    return NULL;
+	}
+	fclose(fp);
+    } else {
+	if (strlen(secret) != KTLS_SECRET_LEN * 2) {
+	    free(ktls);
+	    i_errno = IEKTLS;
+	    return NULL;
+	}
+	for (i = 0; i < KTLS_SECRET_LEN; i++) {
+	    if (sscanf(secret + 2 * i, "%2x", &byte) != 1) {
+		free(ktls);
+		i_errno = IEKTLS;
+		return NULL;
+	    }
+	    ktls->secret[i] = byte;
+	}
+    }
+    for (i = 0; i < KTLS_SECRET_LEN; i++)
+	snprintf(ktls->hex + 2 * i, 3, "%02x", ktls->secret[i]);
+
+    /* Sessions set up from here on are this test's (and whoever else's). */
+    ktls_read_stats(ktls->stats);
+    ktls->crypto_cpu = ktls->remote_crypto_cpu = -1;
+    return ktls;
+#else
+    i_errno = IEKTLS;
+    return NULL;
+#endif /* KTLS */
+}
+
+void
+iperf_ktls_free(struct iperf_ktls *ktls)
+{
+    free(ktls);
+}
+
+const char *
+iperf_ktls_secret(struct iperf_ktls *ktls)
+{
+    return ktls->hex;
+}
+
+#if defined(KTLS)
+static uint64_t
+ktls_mix(uint64_t x)
+{
+    /* splitmix64's finalizer */
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/* Keys for one direction of the stream from the client's port. */
+static void
+ktls_keys(struct iperf_ktls *ktls, unsigned int port, int from_client, struct tls12_crypto_info_aes_gcm_128 *ci)
+{
+    unsigned char m[TLS_CIPHER_AES_GCM_128_KEY_SIZE + TLS_CIPHER_AES_GCM_128_IV_SIZE + TLS_CIPHER_AES_GCM_128_SALT_SIZE];
+    uint64_t h = 0, s;
+    size_t i, j, k;
+
+    for (i = 0; i < sizeof(m); i++) {
+	if (i % 8 == 0) {
+	    h = (((uint64_t) port << 1) | from_client) + (i / 8) * 0x9e3779b97f4a7c15ULL;
+	    for (j = 0; j < KTLS_SECRET_LEN; j += 8) {
+		/* Big-endian, so that hosts of either byte order agree on the keys. */
+		for (s = 0, k = 0; k < 8; k++)
+		    s = (s << 8) | ktls->secret[j + k];
+		h = ktls_mix(h ^ s);
+	    }
+	}
+	m[i] = (unsigned char) (h >> (8 * (i % 8)));
+    }
+
+    memset(ci, 0, sizeof(*ci));
+    ci->info.version = KTLS_VERSION;
+    ci->info.cipher_type = TLS_CIPHER_AES_GCM_128;
+    memcpy(ci->key, m, TLS_CIPHER_AES_GCM_128_KEY_SIZE);
+    memcpy(ci->iv, m + TLS_CIPHER_AES_GCM_128_KEY_SIZE, TLS_CIPHER_AES_GCM_128_IV_SIZE);
+    memcpy(ci->salt, m + TLS_CIPHER_AES_GCM_128_KEY_SIZE + TLS_CIPHER_AES_GCM_128_IV_SIZE, TLS_CIPHER_AES_GCM_128_SALT_SIZE);
+    /* rec_seq starts at zero */
+}
+#endif /* KTLS */
+
+int
+iperf_ktls_socket(struct iperf_test *test, int s)
+{
+#if defined(KTLS)
+    struct tls12_crypto_info_aes_gcm_128 ci;
+    struct sockaddr_storage sa;
+    socklen_t len = sizeof(sa);
+    unsigned int port;
+    int client = test->role == 'c';
+    int one = 1;
+
+    /* The client's port tells the streams apart, and both ends know it. */
+    if ((client ? getsockname(s, (struct sockaddr *) &sa, &len) : getpeername(s, (struct sockaddr *) &sa, &len)) < 0) {
+	i_errno = IESETKTLS;
+	return -1;
+    }
+    if (sa.ss_family == AF_INET6)
+	port = ntohs(((struct sockaddr_in6 *) &sa)->sin6_port);
+    else
+	port = ntohs(((struct sockaddr_in *) &sa)->sin_port);
+
+    if (setsockopt(s, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) < 0) {
+	i_errno = IESETKTLS;
+	return -1;
+    }
+    ktls_keys(test->ktls, port, client, &ci);
+    if (setsockopt(s, SOL_TLS, TLS_TX, &ci, sizeof(ci)) < 0) {
+	i_errno = IESETKTLS;
+	return -1;
+    }
+    ktls_keys(test->ktls, port, !client, &ci);
+    if (setsockopt(s, SOL_TLS, TLS_RX, &ci, sizeof(ci)) < 0) {
+	i_errno = IESETKTLS;
+	return -1;
+    }
+
+    /* Both are optimizations that older kernels don't have. */
+#if defined(TLS_TX_ZEROCOPY_RO)
+    /* sendfile() straight from the page cache when the NIC encrypts. */
+    if (test->zerocopy)
+	(void) setsockopt(s, SOL_TLS, TLS_TX_ZEROCOPY_RO, &one, sizeof(one));
+#endif
+#if defined(TLS_RX_EXPECT_NO_PAD) && defined(TLS_1_3_VERSION)
+    /* Decrypt into the reader's buffer: iperf3 records have no padding. */
+    (void) setsockopt(s, SOL_TLS, TLS_RX_EXPECT_NO_PAD, &one, sizeof(one));
+#endif
+    (void) one;
+    return 0;
+#else
+    i_errno = IESETKTLS;
+    errno = ENOPROTOOPT;
+    return -1;
+#endif /* KTLS */
+}
+
+/* Once the parameters are agreed and the streams are up, not while the peer waits on them. */
+void
+iperf_ktls_start(struct iperf_test *test)
+{
+    test->ktls->gcm_rate = ktls_gcm_rate();
+    gettimeofday(&test->ktls->start, NULL);
+}
+
+double
+iperf_ktls_crypto_cpu(struct iperf_test *test)
+{
+    struct iperf_ktls *ktls = test->ktls;
+    struct iperf_stream *sp;
+    int64_t now[KTLS_STATS];
+    double tx = 0, rx = 0, secs;
+    struct timeval end;
+    int i;
+
+    if (ktls->measured)
+	return ktls->crypto_cpu;
+    ktls->measured = 1;
+
+    if (ktls_read_stats(now) == 0) {
+	for (i = 0; i < KTLS_STATS; i++)
+	    ktls->stats[i] = now[i] - ktls->stats[i];
+	ktls->have_stats = 1;
+    }
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	tx += sp->result->bytes_sent;
+	rx += sp->result->bytes_received;
+    }
+    /* Take out the share the NIC did; without the counters, assume none. */
+    if (ktls->have_stats && ktls->stats[KTLS_TX_SW] + ktls->stats[KTLS_TX_DEVICE] > 0)
+	tx = tx * ktls->stats[KTLS_TX_SW] / (ktls->stats[KTLS_TX_SW] + ktls->stats[KTLS_TX_DEVICE]);
+    if (ktls->have_stats && ktls->stats[KTLS_RX_SW] + ktls->stats[KTLS_RX_DEVICE] > 0)
+	rx = rx * ktls->stats[KTLS_RX_SW] / (ktls->stats[KTLS_RX_SW] + ktls->stats[KTLS_RX_DEVICE]);
+
+    gettimeofday(&end, NULL);
+    secs = timeval_diff(&ktls->start, &end);
+    if (ktls->gcm_rate > 0 && secs > 0)
+	ktls->crypto_cpu = (tx + rx) / ktls->gcm_rate / secs * 100;
+    return ktls->crypto_cpu;
+}
+
+void
+iperf_ktls_remote_crypto_cpu(struct iperf_test *test, double cpu)
+{
+    test->ktls->remote_crypto_cpu = cpu;
+}
+
+static void
+ktls_percent(char *buf, size_t len, double cpu)
+{
+    if (cpu < 0)
+	snprintf(buf, len, "unknown");
+    else
+	snprintf(buf, len, "%.1f%%", cpu);
+}
+
+void
+iperf_ktls_print_results(struct iperf_test *test)
+{
+    struct iperf_ktls *ktls = test->ktls;
+    char local[16], remote[16], rate[UNIT_LEN];
+    double cpu = iperf_ktls_crypto_cpu(test);
+
+    if (test->json_output) {
+	cJSON_AddItemToObject(test->json_end, "ktls", iperf_json_printf("version: %s  cipher: %s  tx_sw: %d  tx_device: %d  rx_sw: %d  rx_device: %d  gcm_bytes_per_second: %f  host_crypto_cpu: %f  remote_crypto_cpu: %f", KTLS_VERSION_NAME, "AES-GCM-128", ktls->have_stats ? ktls->stats[KTLS_TX_SW] : -1, ktls->have_stats ? ktls->stats[KTLS_TX_DEVICE] : -1, ktls->have_stats ? ktls->stats[KTLS_RX_SW] : -1, ktls->have_stats ? ktls->stats[KTLS_RX_DEVICE] : -1, ktls->gcm_rate, cpu, ktls->remote_crypto_cpu));
+	return;
+    }
+
+    if (ktls->have_stats)
+	iprintf(test, report_ktls, KTLS_VERSION_NAME, (long long) ktls->stats[KTLS_TX_SW], (long long) ktls->stats[KTLS_TX_DEVICE], (long long) ktls->stats[KTLS_RX_SW], (long long) ktls->stats[KTLS_RX_DEVICE]);
+    else
+	iprintf(test, report_ktls_no_stats, KTLS_VERSION_NAME);
+    ktls_percent(local, sizeof(local), cpu);
+    ktls_percent(remote, sizeof(remote), ktls->remote_crypto_cpu);
+    if (ktls->gcm_rate > 0) {
+	unit_snprintf(rate, UNIT_LEN, ktls->gcm_rate, 'A');
+	iprintf(test, report_ktls_crypto, local, remote, rate);
+    } else
+	iprintf(test, report_ktls_crypto_no_rate, local, remote);
+}
@@ -0,0 +1,71 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_KTLS_H
+#define __IPERF_KTLS_H
+
+/*
+ * --ktls (Linux): TCP data streams through kernel TLS.  Once a stream
+ * has connected and its cookie is through, both ends attach the "tls"
+ * ULP and give the kernel TLS 1.3 AES-GCM-128 keys for each direction,
+ * so send(), sendfile() (-Z) and recv() carry TLS records, encrypted
+ * and decrypted by the kernel or, where the NIC can, by the NIC.
+ *
+ * There is no handshake: the keys are derived from a secret the client
+ * makes and sends in the test parameters, and from the client's port,
+ * so each stream and direction has its own.  The secret goes over the
+ * control connection in the clear; this measures the cost of TLS, and
+ * keeps nothing private.
+ *
+ * Where the crypto ran is read from /proc/net/tls_stat, host-wide, and
+ * its CPU time estimated from the bytes done in software and the rate
+ * at which the kernel's gcm(aes) runs here, as measured through AF_ALG
+ * before the test.
+ */
+
+#define KTLS_SECRET_LEN 32
+#define KTLS_CALIBRATE_BYTES (32 * 1024 * 1024)	/* for the gcm(aes) rate */
+
+/* NULL secret: make one (client).  Otherwise the hex the client sent. */
+struct iperf_ktls *iperf_ktls_new(const char *secret);
+void iperf_ktls_free(struct iperf_ktls *ktls);
+
+/* The secret, in hex, for the test parameters. */
+const char *iperf_ktls_secret(struct iperf_ktls *ktls);
+
+/* Turn on kernel TLS on a connected data stream socket. */
+int iperf_ktls_socket(struct iperf_test *test, int s);
+
+/* At the start of the test. */
+void iperf_ktls_start(struct iperf_test *test);
+
+/* Estimated crypto CPU, percent, as cpu_util[] has it; -1 if unknown. */
+double iperf_ktls_crypto_cpu(struct iperf_test *test);
+void iperf_ktls_remote_crypto_cpu(struct iperf_test *test, double cpu);
+
+void iperf_ktls_print_results(struct iperf_test *test);
+
+#endif
@@ -101,8 +101,13 @@ const char usage_longstr[] = "Usage: iperf [-s|-c host] [options]\n"
                            "  -f, --format    [kmgKMG]  format to report: Kbits, Mbits, KBytes, MBytes\n"
                            "  -i, --interval  #         seconds between periodic bandwidth reports\n"
                            "  -F, --file name           xmit/recv the specified file\n"
+                           "  --file-depth #            buffers read ahead of sending / behind receiving\n"
+                           "                            (default 8)\n"
+                           "  --file-direct             read and write the file with O_DIRECT\n"
+                           "  --file-fsync #            fsync after every # buffers written\n"
+                           "                            (default: once, at the end)\n"
 #if defined(HAVE_CPU_AFFINITY)
-                           "  -A, --affinity n/n,m      set CPU affinity\n"
+                           "  -A, --affinity n/n,m|auto set CPU affinity (auto: by the NIC's NUMA node)\n"
 #endif /* HAVE_CPU_AFFINITY */
                            "  -B, --bind      <host>    bind to a specific interface\n"
                            "  -V, --verbose             more detailed output\n"
@@ -117,14 +122,20 @@ const char usage_longstr[] = "Usage: iperf [-s|-c host] [options]\n"
                            "  -D, --daemon              run the server as a daemon\n"
                            "  -I, --pidfile file        write PID file\n"
                            "  -1, --one-off             handle one client connection then exit\n"
+                           "  --capture if[,64|,ts]     measure the UDP traffic to the port that passes\n"
+                           "                            interface if, instead of running tests (Linux)\n"
                            "Client specific:\n"
                            "  -c, --client    <host>    run in client mode, connecting to <host>\n"
+                           "                            (host,host,... runs against several servers at once)\n"
 #if defined(HAVE_SCTP)
                            "  --sctp                    use SCTP rather than TCP\n"
                            "  -X, --xbind <name>        bind SCTP association to links\n"
                            "  --nstreams      #         number of SCTP streams\n"
 #endif /* HAVE_SCTP */
                            "  -u, --udp                 use UDP rather than TCP\n"
+                           "  --unix[=path]             use an AF_UNIX stream socket (server on this host;\n"
+                           "                            at path, a socket file both ends can reach)\n"
+                           "  --unix-seqpacket[=path]   use an AF_UNIX seqpacket socket (likewise)\n"
                            "  -b, --bandwidth #[KMG][/#] target bandwidth in bits/sec (0 for unlimited)\n"
                            "                            (default %d Mbit/sec for UDP, unlimited for TCP)\n"
                            "                            (optional slash and packet count for burst mode)\n"
@@ -149,10 +160,48 @@ const char usage_longstr[] = "Usage: iperf [-s|-c host] [options]\n"
                            "  -L, --flowlabel N         set the IPv6 flow label (only supported on Linux)\n"
 #endif /* HAVE_FLOWLABEL */
                            "  -Z, --zerocopy            use a 'zero copy' method of sending data\n"
+                           "  --ktls                    send TCP data through kernel TLS (Linux), and\n"
+                           "                            estimate the CPU the crypto takes\n"
                            "  -O, --omit N              omit the first n seconds\n"
                            "  -T, --title str           prefix every output line with this string\n"
                            "  --get-server-output       get results from server\n"
                            "  --udp-counters-64bit      use 64-bit counters in UDP test packets\n"
+                           "  --capacity-search #       search for the highest UDP bandwidth up to -b\n"
+                           "                            with at most # percent loss\n"
+                           "  --schedule #:name=value[,name=value]\n"
+                           "                            change bandwidth, parallel, len or burst\n"
+                           "                            # seconds into the test (may be repeated)\n"
+                           "  --start-at #              start at # seconds since the epoch (+# from now)\n"
+                           "  --align-intervals         end intervals on wall-clock multiples of -i\n"
+                           "  --bidir                   run in both directions at once, -P streams each way\n"
+                           "  --rr #[KMG][/#[KMG]]      request/response mode: # byte requests answered\n"
+                           "                            by # byte responses (default: same size)\n"
+                           "  --rr-outstanding #        transactions in flight per stream (default 1)\n"
+                           "  --crr                     a new TCP connection for every --rr transaction\n"
+                           "                            (default --rr 64), to measure connections/sec\n"
+                           "  --profile poisson|onoff:#/#|trace:<file>\n"
+                           "                            send on a schedule: Poisson arrivals at the -b\n"
+                           "                            rate, # seconds on and # off, or the\n"
+                           "                            \"seconds bytes\" lines of a trace file\n"
+                           "  --size-mix imix|#[:#][,...]\n"
+                           "                            send UDP datagrams of these sizes, weighted\n"
+                           "                            (imix: 64:7,576:4,1500:1), with loss per size\n"
+                           "  --flows #                 # more TCP or UDP flows on top of the -P streams,\n"
+                           "                            reported together (Linux only)\n"
+                           "  --flows-sample #          also report every #th flow on its own\n"
+                           "  --verify                  send a seeded pattern and check every block\n"
+                           "                            the receiver gets; reports corruption\n"
+                           "  --payload random|zeros|pattern|text|ratio:#\n"
+                           "                            what to send: incompressible (default), zeros,\n"
+                           "                            a repeated block, text, or data that compresses\n"
+                           "                            about #:1\n"
+                           "  --udp-timestamps[=hw]     nanosecond UDP send times, and arrival times from\n"
+                           "                            the kernel (or NIC), for RFC 3550 jitter and\n"
+                           "                            one-way delay (needs synchronized clocks)\n"
+                           "  --af-packet               send UDP through an AF_PACKET TX ring, a batch\n"
+                           "                            of datagrams per system call (Linux, IPv4)\n"
+                           "  --busy-poll[=#]           busy-poll the data sockets for # usec (default\n"
+                           "                            50) and spin instead of sleeping in select()\n"
 
 #ifdef NOT_YET_SUPPORTED /* still working on these */
 #endif
@@ -247,6 +296,30 @@ const char report_connecting[] =
 const char report_reverse[] =
 "Reverse mode, remote host %s is sending\n";
 
+const char report_bidir[] =
+"Bidirectional mode, remote host %s is sending too\n";
+
+const char report_rr[] =
+"Request/response mode, %d byte requests, %d byte responses, %d in flight per stream\n";
+
+const char report_crr[] =
+"Connect/request/response mode, %d byte requests, %d byte responses, %d connections per stream\n";
+
+const char report_profile[] =
+"Traffic profile %s\n";
+
+const char report_flows[] =
+"%d flows on top of the streams\n";
+
+const char report_payload[] =
+"Payload %s\n";
+
+const char report_verify[] =
+"Verifying the payload, seed %u\n";
+
+const char report_udp_timestamps[] =
+"Timestamping datagrams in nanoseconds, arrivals by the %s\n";
+
 const char report_accepted[] =
 "Accepted connection from %s, port %d\n";
 
@@ -256,6 +329,9 @@ const char report_cookie[] =
 const char report_connected[] =
 "[%3d] local %s port %d connected to %s port %d\n";
 
+const char report_connected_unix[] =
+"[%3d] local %s connected to %s\n";
+
 const char report_window[] =
 "TCP window size: %s\n";
 
@@ -268,6 +344,15 @@ const char report_omit_done[] =
 const char report_diskfile[] =
 "        Sent %s / %s (%d%%) of %s\n";
 
+const char report_diskfile_disk[] =
+"        Disk %s for %.3f sec (%ss/sec), %llu fsyncs; network %.3f sec, %.3f sec waiting on disk\n";
+
+const char report_diskfile_sendfile[] =
+"        Sent straight from the file with sendfile()\n";
+
+const char report_diskfile_error[] =
+"        Error %s %s; the transfer is incomplete\n";
+
 const char report_done[] =
 "iperf Done.\n";
 
@@ -322,8 +407,169 @@ const char report_sum_bw_udp_format[] =
 const char report_sum_bw_udp_sender_format[] =
 "[SUM] %6.2f-%-6.2f sec  %ss  %ss/sec  %d  %s\n";
 
+const char report_fanout_sum_format[] =
+"[ALL] %6.2f-%-6.2f sec  %ss  %ss/sec  %d/%d servers\n";
+
+const char report_fanout_result_format[] =
+"[ALL] %6.2f-%-6.2f sec  %ss  %ss/sec  %-8s  %d/%d servers\n";
+
 const char report_omitted[] = "(omitted)";
 
+const char report_bidir_tx[] = "TX";
+const char report_bidir_rx[] = "RX";
+const char report_bidir_total[] = "TX+RX receiver";
+
+const char report_param_change[] =
+"[EVT] %6.2f sec  parameter change: %s\n";
+
+const char report_capacity_header[] =
+"Capacity search, maximum loss %g%%:\n"
+"  Offered            Received           Jitter    Lost/Total Datagrams\n";
+
+const char report_capacity_trial[] =
+"  %ss/sec  %ss/sec  %5.3f ms  %d/%d (%.2g%%)  %s\n";
+
+const char report_capacity[] =
+"Capacity: %ss/sec\n";
+
+const char report_capacity_not_converged[] =
+"Capacity: not converged; last passed at %ss/sec, last failed at %ss/sec\n";
+
+const char report_rr_header[] =
+"[ ID] Interval           Transactions  Trans/sec   Latency avg/p50/p99/max (ms)\n";
+
+const char report_rr_format[] =
+"[%3d] %6.2f-%-6.2f sec  %12llu  %9.1f   %.3f/%.3f/%.3f/%.3f  %s\n";
+
+const char report_sum_rr_format[] =
+"[SUM] %6.2f-%-6.2f sec  %12llu  %9.1f   %.3f/%.3f/%.3f/%.3f  %s\n";
+
+const char report_rr_server_header[] =
+"[ ID] Interval           Transactions  Trans/sec\n";
+
+const char report_rr_server_format[] =
+"[%3d] %6.2f-%-6.2f sec  %12llu  %9.1f  %s\n";
+
+const char report_sum_rr_server_format[] =
+"[SUM] %6.2f-%-6.2f sec  %12llu  %9.1f  %s\n";
+
+const char report_crr_header[] =
+"[ ID] Interval           Connections   Conn/sec    Connect avg/p50/p99/max (ms)\n";
+
+const char report_crr_server_header[] =
+"[ ID] Interval           Connections   Conn/sec\n";
+
+const char report_profile_header[] =
+"[ ID] Profile   Requested           Achieved            Sends/sec req/ach    Late avg/max (ms)\n";
+
+const char report_profile_format[] =
+"[%3d] %-8s  %-18s  %-18s  %9.1f/%-9.1f  %.3f/%.3f\n";
+
+const char report_size_mix_header[] =
+"[ ID]   Size  Lost/Total Datagrams  Bandwidth\n";
+
+const char report_size_mix_format[] =
+"[%3d] %6d  %llu/%llu (%.2g%%)  %ss/sec\n";
+
+const char report_flows_header[] =
+"Flows        Min/flow      Mean/flow       Max/flow  Fairness\n";
+
+const char report_flows_format[] =
+"%-7d  %12ss  %12ss  %12ss  %8.4f  %s\n";
+
+const char report_flows_lost[] =
+"Flow datagrams lost/total: %llu/%llu (%.2g%%)\n";
+
+const char report_flows_idle[] =
+"warning: %d of %d flows carried no data (%s)\n";
+
+const char report_flows_sample[] =
+"[flow %7d]  %ss  %ss/sec\n";
+
+const char report_verify_interval[] =
+"[%3d] %6.2f-%-6.2f sec  %llu blocks verified, %llu corrupted\n";
+
+const char report_verify_header[] =
+"[ ID]     Blocks  Corrupted          Verify rate    CPU\n";
+
+const char report_verify_format[] =
+"[%3d] %10llu %10llu  %14ss/sec  %5.1f%%  %s\n";
+
+const char report_owd_interval[] =
+"[%3d] %6.2f-%-6.2f sec  one-way delay min/avg/p50/p99/max %.1f/%.1f/%.1f/%.1f/%.1f usec\n";
+
+const char report_owd_header[] =
+"[ ID]  Datagrams    Min usec    Avg usec    p50 usec    p99 usec    Max usec  Stamped by\n";
+
+const char report_owd_format[] =
+"[%3d] %10llu  %10.1f  %10.1f  %10.1f  %10.1f  %10.1f  %-10s %s\n";
+
+const char report_owd_negative[] =
+"[%3d] %llu datagrams arrived before they were sent: are the clocks in sync?\n";
+
+const char report_owd_implausible[] =
+"[%3d] a one-way delay of at least %.3f sec is implausible: are the clocks in sync?\n";
+
+const char report_drops_interval[] =
+"[%3d] %6.2f-%-6.2f sec  lost %d: %llu dropped by the receiving socket, %d in the network\n";
+
+const char report_drops_host_interval[] =
+"[SUM] %6.2f-%-6.2f sec  host-wide: %s UDP receive buffer errors, %s dropped by the NIC (%s)\n";
+
+const char report_drops_format[] =
+"[%3d] Lost %d: %llu dropped by the receiving socket (buffer %d bytes), %d in the network  %s\n";
+
+const char report_drops_host[] =
+"Host-wide during the test: %s UDP receive buffer errors, %s dropped by the NIC (%s)\n";
+
+const char report_packet[] =
+"[%3d] %llu datagrams through the AF_PACKET ring on %s in %llu sendto() calls (%.1f each), ring full %llu times\n";
+
+const char report_capture[] =
+"Capturing UDP datagrams to port %d on %s\n";
+
+const char report_capture_results[] =
+"Captured on %s: %llu datagrams to port %d; %u packets dropped by the ring, of %u\n";
+
+const char report_ktls[] =
+"kTLS %s AES-GCM-128 sessions set up on this host during the test: TX %lld in software, %lld on the NIC; RX %lld in software, %lld on the NIC\n";
+
+const char report_ktls_no_stats[] =
+"kTLS %s AES-GCM-128: no /proc/net/tls_stat, so where the crypto ran is unknown\n";
+
+const char report_ktls_crypto[] =
+"kTLS crypto CPU (estimated): local %s, remote %s; gcm(aes) runs at %s/sec here\n";
+
+const char report_ktls_crypto_no_rate[] =
+"kTLS crypto CPU (estimated): local %s, remote %s; gcm(aes) couldn't be timed here (no AF_ALG)\n";
+
+const char report_busy_poll[] =
+"Busy-poll %d usec: %llu polls, %llu of them found work, %.1f usec apart on average, %.1f at most; CPU %.1f%% local, %.1f%% remote\n";
+
+const char report_busy_poll_stream[] =
+"[%3d] packets processed on CPU %d\n";
+
+const char report_placement[] =
+"Placement: %s on NUMA node %s, its IRQs on CPUs %s; main loop on CPU %d, worker threads on CPUs %s%s\n";
+
+const char report_placement_memory[] =
+", memory from the node";
+
+const char report_seq_interval[] =
+"[%3d] %6.2f-%-6.2f sec  %d datagrams out of order, %llu duplicated, %llu too late (first: %llu after %llu)\n";
+
+const char report_seq_header[] =
+"[ ID]       Lost  Bursts  Max burst  Reordered  Extent avg/max  Displacement avg/max  Dups  Late\n";
+
+const char report_seq_format[] =
+"[%3d] %10llu %7llu %10llu %10llu  %8.1f/%-5llu  %13.1f/%-6llu %5llu %5llu  %s\n";
+
+const char report_seq_bursts[] =
+"[%3d] Loss burst lengths%s\n";
+
+const char report_rr_lost[] =
+"[%3d] %llu requests lost\n";
+
 const char report_bw_separator[] =
 "- - - - - - - - - - - - - - - - - - - - - - - - -\n";
 
@@ -51,13 +51,25 @@ extern const char test_start_blocks[];
 extern const char report_time[] ;
 extern const char report_connecting[] ;
 extern const char report_reverse[] ;
+extern const char report_bidir[] ;
+extern const char report_rr[] ;
+extern const char report_crr[] ;
+extern const char report_profile[] ;
+extern const char report_flows[] ;
+extern const char report_verify[] ;
+extern const char report_payload[] ;
+extern const char report_udp_timestamps[] ;
 extern const char report_accepted[] ;
 extern const char report_cookie[] ;
 extern const char report_connected[] ;
+extern const char report_connected_unix[] ;
 extern const char report_window[] ;
 extern const char report_autotune[] ;
 extern const char report_omit_done[] ;
 extern const char report_diskfile[] ;
+extern const char report_diskfile_disk[] ;
+extern const char report_diskfile_error[] ;
+extern const char report_diskfile_sendfile[] ;
 extern const char report_done[] ;
 extern const char report_read_lengths[] ;
 extern const char report_read_length_times[] ;
@@ -76,7 +88,62 @@ extern const char report_sum_bw_format[] ;
 extern const char report_sum_bw_retrans_format[] ;
 extern const char report_sum_bw_udp_format[] ;
 extern const char report_sum_bw_udp_sender_format[] ;
+extern const char report_fanout_sum_format[] ;
+extern const char report_fanout_result_format[] ;
 extern const char report_omitted[] ;
+extern const char report_bidir_tx[] ;
+extern const char report_bidir_rx[] ;
+extern const char report_bidir_total[] ;
+extern const char report_param_change[] ;
+extern const char report_capacity_header[] ;
+extern const char report_capacity_trial[] ;
+extern const char report_capacity[] ;
+extern const char report_capacity_not_converged[] ;
+extern const char report_rr_header[] ;
+extern const char report_rr_format[] ;
+extern const char report_sum_rr_format[] ;
+extern const char report_rr_server_header[] ;
+extern const char report_rr_server_format[] ;
+extern const char report_sum_rr_server_format[] ;
+extern const char report_crr_header[] ;
+extern const char report_crr_server_header[] ;
+extern const char report_profile_header[] ;
+extern const char report_profile_format[] ;
+extern const char report_size_mix_header[] ;
+extern const char report_size_mix_format[] ;
+extern const char report_flows_header[] ;
+extern const char report_flows_format[] ;
+extern const char report_flows_lost[] ;
+extern const char report_flows_idle[] ;
+extern const char report_flows_sample[] ;
+extern const char report_verify_interval[] ;
+extern const char report_verify_header[] ;
+extern const char report_verify_format[] ;
+extern const char report_owd_interval[] ;
+extern const char report_drops_interval[] ;
+extern const char report_drops_host_interval[] ;
+extern const char report_drops_format[] ;
+extern const char report_drops_host[] ;
+extern const char report_packet[] ;
+extern const char report_capture[] ;
+extern const char report_capture_results[] ;
+extern const char report_ktls[] ;
+extern const char report_ktls_no_stats[] ;
+extern const char report_ktls_crypto[] ;
+extern const char report_ktls_crypto_no_rate[] ;
+extern const char report_busy_poll[] ;
+extern const char report_busy_poll_stream[] ;
+extern const char report_placement[] ;
+extern const char report_placement_memory[] ;
+extern const char report_seq_interval[] ;
+extern const char report_seq_header[] ;
+extern const char report_seq_format[] ;
+extern const char report_seq_bursts[] ;
+extern const char report_owd_header[] ;
+extern const char report_owd_format[] ;
+extern const char report_owd_negative[] ;
+extern const char report_owd_implausible[] ;
+extern const char report_rr_lost[] ;
 extern const char report_bw_separator[] ;
 extern const char report_outoforder[] ;
 extern const char report_sum_outoforder[] ;
@@ -0,0 +1,896 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+#if defined(linux)
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <net/ethernet.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <linux/if_packet.h>
+#include <netinet/ip6.h>
+#include <poll.h>
+#endif
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_locale.h"
+#include "iperf_util.h"
+#include "iperf_udp.h"
+#include "iperf_seq.h"
+#include "iperf_timestamp.h"
+#include "iperf_packet.h"
+#include "net.h"
+
+#if defined(linux) && defined(PACKET_TX_RING)
+
+/* Where a TX frame's data starts: right after its tpacket2_hdr. */
+#define PACKET_DATA_OFFSET TPACKET_ALIGN(sizeof(struct tpacket2_hdr))
+#define PACKET_HEADERS (sizeof(struct iphdr) + sizeof(struct udphdr))
+
+struct iperf_packet_stream {
+    int       fd;			/* the AF_PACKET socket */
+    char     *ring;
+    size_t    ring_size;
+    unsigned  block_size, frame_size, frames_per_block, frame_nr;
+    unsigned  head;			/* next frame to fill */
+    unsigned  pending;			/* filled, not yet handed over */
+    int       max_size;			/* largest datagram a frame holds */
+    struct sockaddr_ll ll;		/* interface and next hop */
+    struct iphdr ip;			/* template */
+    struct udphdr udp;			/* template */
+    uint16_t  ip_id;
+    iperf_size_t frames;		/* handed to the kernel */
+    iperf_size_t calls;			/* sendto()s that did it */
+    iperf_size_t full;			/* times the ring had no free frame */
+    char      ifname[IFNAMSIZ];
+};
+
+static struct tpacket2_hdr *
+packet_frame(struct iperf_packet_stream *ps, unsigned i)
+{
+    return (struct tpacket2_hdr *) (ps->ring + (i / ps->frames_per_block) * ps->block_size + (i % ps->frames_per_block) * ps->frame_size);
+}
+
+/* An IPv4 address from a socket address, mapped or not; -1 if it's IPv6. */
+static int
+packet_inaddr(struct sockaddr_storage *sa, struct in_addr *in)
+{
+    struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *) sa;
+
+    if (sa->ss_family == AF_INET) {
+	*in = ((struct sockaddr_in *) sa)->sin_addr;
+	return 0;
+    }
+    if (sa->ss_family == AF_INET6 && IN6_IS_ADDR_V4MAPPED(&sin6->sin6_addr)) {
+	memcpy(in, &sin6->sin6_addr.s6_addr[12], sizeof(*in));
+	return 0;
+    }
+    return -1;
+}
+
+static uint16_t
+packet_port(struct sockaddr_storage *sa)
+{
+    if (sa->ss_family == AF_INET)
+	return ((struct sockaddr_in *) sa)->sin_port;
+    return ((struct sockaddr_in6 *) sa)->sin6_port;
+}
+
+/* The next hop toward dst out of ifname, from the longest match in /proc/net/route. */
+static struct in_addr
+packet_nexthop(const char *ifname, struct in_addr dst)
+{
+    FILE *f;
+    char line[256], iface[IFNAMSIZ + 1];
+    unsigned long dest, gw, mask, best_mask = 0;
+    unsigned flags;
+    struct in_addr hop = dst;
+    int best = 0;
+
+    if ((f = fopen("/proc/net/route", "r")) == NULL)
+	return hop;
+    while (fgets(line, sizeof(line), f) != NULL) {
+	/* The addresses are printed as they lie in memory, so they compare as is. */
+	if (sscanf(line, "%16s %lx %lx %x %*d %*d %*d %lx", iface, &dest, &gw, &flags, &mask) != 5)
+	    continue;
+	if (strcmp(iface, ifname) != 0 || (dst.s_addr & mask) != dest)
+	    continue;
+	if (!best || ntohl(mask) > ntohl(best_mask)) {
+	    best = 1;
+	    best_mask = mask;
+	    hop.s_addr = (flags & 0x2) ? gw : dst.s_addr;	/* RTF_GATEWAY */
+	}
+    }
+    fclose(f);
+    return hop;
+}
+
+/* hop's link address from /proc/net/arp; -1 if it isn't resolved. */
+static int
+packet_neighbour(const char *ifname, struct in_addr hop, unsigned char *mac)
+{
+    FILE *f;
+    char line[256], ip[64], hw[64], dev[IFNAMSIZ + 1];
+    unsigned flags, m[6];
+    int i, r = -1;
+
+    if ((f = fopen("/proc/net/arp", "r")) == NULL)
+	return -1;
+    while (r < 0 && fgets(line, sizeof(line), f) != NULL) {
+	if (sscanf(line, "%63s %*x %x %63s %*s %16s", ip, &flags, hw, dev) != 4)
+	    continue;
+	if (!(flags & 0x2) || strcmp(dev, ifname) != 0 || inet_addr(ip) != hop.s_addr)
+	    continue;
+	if (sscanf(hw, "%x:%x:%x:%x:%x:%x", &m[0], &m[1], &m[2], &m[3], &m[4], &m[5]) != 6)
+	    continue;
+	for (i = 0; i < 6; ++i)
+	    mac[i] = m[i];
+	r = 0;
+    }
+    fclose(f);
+    return r;
+}
+
+static uint16_t
+packet_ip_checksum(const struct iphdr *ip)
+{
+    const uint16_t *w = (const uint16_t *) ip;
+    uint32_t sum = 0;
+    int i;
+
+    for (i = 0; i < (int) sizeof(*ip) / 2; ++i)
+	sum += w[i];
+    while (sum >> 16)
+	sum = (sum & 0xffff) + (sum >> 16);
+    return ~sum;
+}
+
+/* Find the way out and set up the ring; the socket is connected by now. */
+static int
+packet_open(struct iperf_stream *sp, struct iperf_packet_stream *ps)
+{
+    struct sockaddr_storage local, peer;
+    socklen_t len;
+    struct in_addr src, dst;
+    struct ifreq ifr;
+    struct tpacket_req req;
+    int version = TPACKET_V2, loopback, s;
+
+    len = sizeof(local);
+    if (getsockname(sp->socket, (struct sockaddr *) &local, &len) < 0)
+	return -1;
+    len = sizeof(peer);
+    if (getpeername(sp->socket, (struct sockaddr *) &peer, &len) < 0)
+	return -1;
+    if (packet_inaddr(&local, &src) < 0 || packet_inaddr(&peer, &dst) < 0) {
+	errno = EAFNOSUPPORT;
+	return -1;
+    }
+    if (getsockifname(sp->socket, ps->ifname, sizeof(ps->ifname)) < 0) {
+	errno = ENODEV;
+	return -1;
+    }
+
+    /* The interface's index, MTU and whether it's the loopback. */
+    if ((s = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+	return -1;
+    memset(&ifr, 0, sizeof(ifr));
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", ps->ifname);
+    if (ioctl(s, SIOCGIFINDEX, &ifr) < 0) {
+	close(s);
+	return -1;
+    }
+    ps->ll.sll_ifindex = ifr.ifr_ifindex;
+    if (ioctl(s, SIOCGIFMTU, &ifr) < 0) {
+	close(s);
+	return -1;
+    }
+    ps->max_size = ifr.ifr_mtu - PACKET_HEADERS;
+    if (ioctl(s, SIOCGIFFLAGS, &ifr) < 0) {
+	close(s);
+	return -1;
+    }
+    loopback = (ifr.ifr_flags & IFF_LOOPBACK) != 0;
+    close(s);
+    if (sp->settings->blksize > ps->max_size) {
+	errno = EMSGSIZE;
+	return -1;
+    }
+
+    ps->ll.sll_family = AF_PACKET;
+    ps->ll.sll_protocol = htons(ETH_P_IP);
+    ps->ll.sll_halen = ETH_ALEN;
+    if (!loopback && packet_neighbour(ps->ifname, packet_nexthop(ps->ifname, dst), ps->ll.sll_addr) < 0) {
+	errno = EHOSTUNREACH;
+	return -1;
+    }
+
+    ps->ip.version = 4;
+    ps->ip.ihl = sizeof(struct iphdr) / 4;
+    ps->ip.tos = sp->settings->tos;
+    ps->ip.ttl = 64;
+    ps->ip.protocol = IPPROTO_UDP;
+    ps->ip.saddr = src.s_addr;
+    ps->ip.daddr = dst.s_addr;
+    ps->udp.source = packet_port(&local);
+    ps->udp.dest = packet_port(&peer);
+    ps->udp.check = 0;			/* optional over IPv4 */
+
+    /* SOCK_DGRAM: the kernel puts the link header on, from ps->ll. */
+    if ((ps->fd = socket(AF_PACKET, SOCK_DGRAM, 0)) < 0)
+	return -1;
+    if (setsockopt(ps->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+	return -1;
+
+    ps->frame_size = TPACKET_ALIGN(PACKET_DATA_OFFSET + PACKET_HEADERS + sp->settings->blksize);
+    ps->block_size = getpagesize();
+    while (ps->block_size < ps->frame_size)
+	ps->block_size <<= 1;
+    ps->frames_per_block = ps->block_size / ps->frame_size;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = ps->block_size;
+    req.tp_frame_size = ps->frame_size;
+    req.tp_block_nr = (PACKET_RING_FRAMES + ps->frames_per_block - 1) / ps->frames_per_block;
+    req.tp_frame_nr = req.tp_block_nr * ps->frames_per_block;
+    ps->frame_nr = req.tp_frame_nr;
+    if (setsockopt(ps->fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0)
+	return -1;
+    ps->ring_size = (size_t) req.tp_block_size * req.tp_block_nr;
+    ps->ring = mmap(NULL, ps->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, ps->fd, 0);
+    if (ps->ring == MAP_FAILED) {
+	ps->ring = NULL;
+	return -1;
+    }
+
+    /* Protocol 0: this socket only sends. */
+    {
+	struct sockaddr_ll bind_ll;
+
+	memset(&bind_ll, 0, sizeof(bind_ll));
+	bind_ll.sll_family = AF_PACKET;
+	bind_ll.sll_ifindex = ps->ll.sll_ifindex;
+	if (bind(ps->fd, (struct sockaddr *) &bind_ll, sizeof(bind_ll)) < 0)
+	    return -1;
+    }
+    return 0;
+}
+
+int
+iperf_packet_init_stream(struct iperf_stream *sp)
+{
+    struct iperf_packet_stream *ps;
+
+    if (!sp->sender)
+	return 0;
+    ps = (struct iperf_packet_stream *) calloc(1, sizeof(struct iperf_packet_stream));
+    if (ps == NULL) {
+	i_errno = IESETAFPACKET;
+	return -1;
+    }
+    ps->fd = -1;
+    sp->packet = ps;
+    if (packet_open(sp, ps) < 0) {
+	i_errno = IESETAFPACKET;
+	iperf_packet_free_stream(sp);
+	return -1;
+    }
+    if (sp->test->multisend < PACKET_BATCH)
+	sp->test->multisend = PACKET_BATCH;
+    sp->snd = iperf_packet_send;
+    return 0;
+}
+
+void
+iperf_packet_free_stream(struct iperf_stream *sp)
+{
+    struct iperf_packet_stream *ps = sp->packet;
+
+    if (ps == NULL)
+	return;
+    if (ps->ring != NULL)
+	munmap(ps->ring, ps->ring_size);
+    if (ps->fd >= 0)
+	close(ps->fd);
+    free(ps);
+    sp->packet = NULL;
+}
+
+int
+iperf_packet_flush(struct iperf_stream *sp)
+{
+    struct iperf_packet_stream *ps = sp->packet;
+    int r;
+
+    if (ps == NULL || ps->pending == 0)
+	return 0;
+    r = sendto(ps->fd, NULL, 0, MSG_DONTWAIT, (struct sockaddr *) &ps->ll, sizeof(ps->ll));
+    if (r < 0 && errno != EAGAIN && errno != ENOBUFS)
+	return NET_HARDERROR;
+    ++ps->calls;
+    ps->frames += ps->pending;
+    ps->pending = 0;
+    return 0;
+}
+
+int
+iperf_packet_send(struct iperf_stream *sp)
+{
+    struct iperf_packet_stream *ps = sp->packet;
+    struct tpacket2_hdr *th = packet_frame(ps, ps->head);
+    struct iphdr *ip;
+    struct udphdr *udp;
+    char *data;
+    int size, hlen;
+
+    if (th->tp_status != TP_STATUS_AVAILABLE) {
+	if (th->tp_status == TP_STATUS_WRONG_FORMAT) {
+	    errno = EMSGSIZE;
+	    return NET_HARDERROR;
+	}
+	/* The kernel is still sending this one: it gets what's queued and we come back. */
+	++ps->full;
+	if (iperf_packet_flush(sp) < 0)
+	    return NET_HARDERROR;
+	return NET_SOFTERROR;
+    }
+
+    data = (char *) th + PACKET_DATA_OFFSET;
+    ip = (struct iphdr *) data;
+    udp = (struct udphdr *) (data + sizeof(struct iphdr));
+    hlen = iperf_udp_header(sp, data + PACKET_HEADERS, &size);
+    if (size > ps->max_size) {
+	errno = EMSGSIZE;
+	return NET_HARDERROR;
+    }
+    memcpy(data + PACKET_HEADERS + hlen, sp->buffer + hlen, size - hlen);
+
+    *ip = ps->ip;
+    ip->tot_len = htons(PACKET_HEADERS + size);
+    ip->id = htons(ps->ip_id++);
+    ip->check = packet_ip_checksum(ip);
+    *udp = ps->udp;
+    udp->len = htons(sizeof(struct udphdr) + size);
+
+    th->tp_len = PACKET_HEADERS + size;
+    __sync_synchronize();
+    th->tp_status = TP_STATUS_SEND_REQUEST;
+    ps->head = (ps->head + 1) % ps->frame_nr;
+    ++ps->pending;
+
+    sp->result->bytes_sent += size;
+    sp->result->bytes_sent_this_interval += size;
+    return size;
+}
+
+void
+iperf_packet_print_results(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_packet_stream *ps;
+    cJSON *json_streams = NULL;
+    double batch;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if ((ps = sp->packet) == NULL)
+	    continue;
+	batch = ps->calls > 0 ? (double) ps->frames / ps->calls : 0.0;
+	if (test->json_output) {
+	    if (json_streams == NULL) {
+		if ((json_streams = cJSON_CreateArray()) == NULL)
+		    return;
+		cJSON_AddItemToObject(test->json_end, "af_packet", json_streams);
+	    }
+	    cJSON_AddItemToArray(json_streams, iperf_json_printf("socket: %d  interface: %s  frames: %d  sendto_calls: %d  ring_full: %d", (int64_t) sp->socket, ps->ifname, (int64_t) ps->frames, (int64_t) ps->calls, (int64_t) ps->full));
+	} else
+	    iprintf(test, report_packet, sp->socket, (unsigned long long) ps->frames, ps->ifname, (unsigned long long) ps->calls, batch, (unsigned long long) ps->full);
+    }
+}
+
+#else /* linux && PACKET_TX_RING */
+
+int
+iperf_packet_init_stream(struct iperf_stream *sp)
+{
+    if (!sp->sender)
+	return 0;
+    i_errno = IESETAFPACKET;
+    errno = ENOSYS;
+    return -1;
+}
+
+void
+iperf_packet_free_stream(struct iperf_stream *sp)
+{
+}
+
+int
+iperf_packet_send(struct iperf_stream *sp)
+{
+    return NET_HARDERROR;
+}
+
+int
+iperf_packet_flush(struct iperf_stream *sp)
+{
+    return 0;
+}
+
+void
+iperf_packet_print_results(struct iperf_test *test)
+{
+}
+
+#endif /* linux && PACKET_TX_RING */
+
+/*************************************************************/
+
+struct iperf_capture {
+    char      ifname[IFNAMSIZ];
+    int       counters64, timestamps;	/* the senders' header layout */
+    int       fd;
+    char     *ring;
+    size_t    ring_size;
+    unsigned  block;			/* next block to look at */
+    struct timeval last;		/* the last datagram's arrival */
+    int       tail;			/* at the end: data after the last interval reported */
+    iperf_size_t datagrams;		/* matched */
+    unsigned  ring_packets, ring_drops;	/* PACKET_STATISTICS, all packets */
+};
+
+struct iperf_capture *
+iperf_capture_new(const char *spec)
+{
+    struct iperf_capture *capture;
+    const char *comma = strchr(spec, ',');
+    size_t len = comma != NULL ? (size_t) (comma - spec) : strlen(spec);
+
+    if (len == 0 || len >= IFNAMSIZ)
+	return NULL;
+    capture = (struct iperf_capture *) calloc(1, sizeof(struct iperf_capture));
+    if (capture == NULL)
+	return NULL;
+    memcpy(capture->ifname, spec, len);
+    capture->fd = -1;
+    if (comma != NULL) {
+	if (strcmp(comma + 1, "64") == 0)
+	    capture->counters64 = 1;
+	else if (strcmp(comma + 1, "ts") == 0)
+	    capture->counters64 = capture->timestamps = 1;
+	else {
+	    free(capture);
+	    return NULL;
+	}
+    }
+    return capture;
+}
+
+void
+iperf_capture_free(struct iperf_capture *capture)
+{
+    free(capture);
+}
+
+#if defined(linux) && defined(TPACKET3_HDRLEN)
+
+static struct tpacket_block_desc *
+capture_block(struct iperf_capture *capture, unsigned i)
+{
+    return (struct tpacket_block_desc *) (capture->ring + (size_t) i * CAPTURE_BLOCK_SIZE);
+}
+
+int
+iperf_capture_open(struct iperf_test *test)
+{
+    struct iperf_capture *capture = test->capture;
+    struct tpacket_req3 req;
+    struct sockaddr_ll ll;
+    int version = TPACKET_V3;
+
+    /* The layout, and UDP, each time: iperf_reset_test() clears them. */
+    set_protocol(test, Pudp);
+    test->udp_counters_64bit = capture->counters64;
+    test->udp_timestamps = capture->timestamps ? UDP_TIMESTAMPS_SW : 0;
+    capture->datagrams = 0;
+    capture->ring_packets = capture->ring_drops = 0;
+    capture->block = 0;
+    timerclear(&capture->last);
+
+    memset(&ll, 0, sizeof(ll));
+    ll.sll_family = AF_PACKET;
+    ll.sll_protocol = htons(ETH_P_ALL);
+    if ((ll.sll_ifindex = if_nametoindex(capture->ifname)) == 0)
+	goto fail;
+    /* SOCK_DGRAM: packets start at the network header, whatever the link. */
+    if ((capture->fd = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_ALL))) < 0)
+	goto fail;
+    if (setsockopt(capture->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+	goto fail;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = CAPTURE_BLOCK_SIZE;
+    req.tp_block_nr = CAPTURE_BLOCKS;
+    req.tp_frame_size = TPACKET_ALIGNMENT << 7;
+    req.tp_frame_nr = (CAPTURE_BLOCK_SIZE / req.tp_frame_size) * CAPTURE_BLOCKS;
+    req.tp_retire_blk_tov = CAPTURE_BLOCK_TIMEOUT;
+    if (setsockopt(capture->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0)
+	goto fail;
+    capture->ring_size = (size_t) CAPTURE_BLOCK_SIZE * CAPTURE_BLOCKS;
+    capture->ring = mmap(NULL, capture->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, capture->fd, 0);
+    if (capture->ring == MAP_FAILED) {
+	capture->ring = NULL;
+	goto fail;
+    }
+    if (bind(capture->fd, (struct sockaddr *) &ll, sizeof(ll)) < 0)
+	goto fail;
+
+    if (test->json_output)
+	cJSON_AddItemToObject(test->json_start, "capture", iperf_json_printf("interface: %s  port: %d", capture->ifname, (int64_t) test->server_port));
+    else
+	iprintf(test, report_capture, test->server_port, capture->ifname);
+    return 0;
+
+ fail:
+    i_errno = IESETCAPTURE;
+    iperf_capture_close(test);
+    return -1;
+}
+
+/* The ring's counts since they were last read (reading clears them). */
+static void
+capture_statistics(struct iperf_capture *capture)
+{
+    struct tpacket_stats_v3 st;
+    socklen_t len = sizeof(st);
+
+    if (capture->fd >= 0 && getsockopt(capture->fd, SOL_PACKET, PACKET_STATISTICS, &st, &len) == 0) {
+	capture->ring_packets += st.tp_packets;
+	capture->ring_drops += st.tp_drops;
+    }
+}
+
+void
+iperf_capture_close(struct iperf_test *test)
+{
+    struct iperf_capture *capture = test->capture;
+
+    if (capture == NULL)
+	return;
+    capture_statistics(capture);
+    if (capture->ring != NULL)
+	munmap(capture->ring, capture->ring_size);
+    capture->ring = NULL;
+    if (capture->fd >= 0)
+	close(capture->fd);
+    capture->fd = -1;
+}
+
+/* The stream for datagrams from remote to local, made on the first of them. */
+static struct iperf_stream *
+capture_stream(struct iperf_test *test, struct sockaddr_storage *local, struct sockaddr_storage *remote, socklen_t salen)
+{
+    struct iperf_stream *sp, *n;
+    char ipl[INET6_ADDRSTRLEN], ipr[INET6_ADDRSTRLEN];
+    int lport, rport;
+    const void *la, *ra;
+
+    SLIST_FOREACH(sp, &test->streams, streams)
+	if (memcmp(&sp->remote_addr, remote, salen) == 0 && memcmp(&sp->local_addr, local, salen) == 0)
+	    return sp;
+
+    if ((sp = (struct iperf_stream *) calloc(1, sizeof(struct iperf_stream))) == NULL)
+	return NULL;
+    if ((sp->result = (struct iperf_stream_result *) calloc(1, sizeof(struct iperf_stream_result))) == NULL) {
+	free(sp);
+	return NULL;
+    }
+    TAILQ_INIT(&sp->result->interval_results);
+    sp->test = test;
+    sp->settings = test->settings;
+    sp->socket = -1;
+    sp->diskfile_fd = -1;
+    memcpy(&sp->local_addr, local, salen);
+    memcpy(&sp->remote_addr, remote, salen);
+    if (iperf_seq_init_stream(sp) < 0 ||
+	(test->udp_timestamps && iperf_timestamp_init_stream(sp) < 0)) {
+	iperf_free_stream(sp);
+	return NULL;
+    }
+    iperf_timestamp_captured(sp);
+    (void) gettimeofday(&sp->result->start_time, NULL);
+    sp->result->start_time_fixed = sp->result->start_time;
+    iperf_add_stream(test, sp);
+    /* There is no socket: the stream's number stands in for it in reports. */
+    sp->socket = sp->id;
+    /* [SUM] lines come with more than one. */
+    test->num_streams = 0;
+    SLIST_FOREACH(n, &test->streams, streams)
+	++test->num_streams;
+
+    if (local->ss_family == AF_INET) {
+	la = &((struct sockaddr_in *) local)->sin_addr;
+	ra = &((struct sockaddr_in *) remote)->sin_addr;
+	lport = ntohs(((struct sockaddr_in *) local)->sin_port);
+	rport = ntohs(((struct sockaddr_in *) remote)->sin_port);
+    } else {
+	la = &((struct sockaddr_in6 *) local)->sin6_addr;
+	ra = &((struct sockaddr_in6 *) remote)->sin6_addr;
+	lport = ntohs(((struct sockaddr_in6 *) local)->sin6_port);
+	rport = ntohs(((struct sockaddr_in6 *) remote)->sin6_port);
+    }
+    inet_ntop(local->ss_family, la, ipl, sizeof(ipl));
+    inet_ntop(local->ss_family, ra, ipr, sizeof(ipr));
+    if (test->json_output)
+	cJSON_AddItemToArray(test->json_connected, iperf_json_printf("socket: %d  local_host: %s  local_port: %d  remote_host: %s  remote_port: %d", (int64_t) sp->socket, ipl, (int64_t) lport, ipr, (int64_t) rport));
+    else
+	iprintf(test, report_connected, sp->socket, ipl, lport, ipr, rport);
+    return sp;
+}
+
+/* One captured packet: an iperf3 datagram to our port, or something to skip. */
+static int
+capture_packet(struct iperf_test *test, struct tpacket3_hdr *ph)
+{
+    struct iperf_capture *capture = test->capture;
+    struct sockaddr_ll *ll = (struct sockaddr_ll *) ((char *) ph + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+    struct sockaddr_storage local, remote;
+    struct sockaddr_in *l4 = (struct sockaddr_in *) &local, *r4 = (struct sockaddr_in *) &remote;
+    struct sockaddr_in6 *l6 = (struct sockaddr_in6 *) &local, *r6 = (struct sockaddr_in6 *) &remote;
+    const unsigned char *p = (const unsigned char *) ph + ph->tp_net;
+    const struct udphdr *udp;
+    struct iperf_stream *sp;
+    unsigned len = ph->tp_snaplen, hl;
+    socklen_t salen;
+    int ulen;
+
+    /* On the sender's own host, each datagram would be seen going out too. */
+    if (ll->sll_pkttype == PACKET_OUTGOING || len < 1)
+	return 0;
+    memset(&local, 0, sizeof(local));
+    memset(&remote, 0, sizeof(remote));
+    if ((p[0] >> 4) == 4) {
+	const struct iphdr *ip = (const struct iphdr *) p;
+
+	hl = ip->ihl * 4;
+	/* Later fragments have no UDP header; the first has the iperf3 one. */
+	if (len < sizeof(*ip) || ip->protocol != IPPROTO_UDP || (ntohs(ip->frag_off) & 0x1fff) != 0)
+	    return 0;
+	l4->sin_family = r4->sin_family = AF_INET;
+	l4->sin_addr.s_addr = ip->daddr;
+	r4->sin_addr.s_addr = ip->saddr;
+	salen = sizeof(struct sockaddr_in);
+    } else if ((p[0] >> 4) == 6) {
+	const struct ip6_hdr *ip6 = (const struct ip6_hdr *) p;
+
+	hl = sizeof(*ip6);
+	if (len < sizeof(*ip6) || ip6->ip6_nxt != IPPROTO_UDP)
+	    return 0;
+	l6->sin6_family = r6->sin6_family = AF_INET6;
+	l6->sin6_addr = ip6->ip6_dst;
+	r6->sin6_addr = ip6->ip6_src;
+	salen = sizeof(struct sockaddr_in6);
+    } else
+	return 0;
+    if (len < hl + sizeof(struct udphdr))
+	return 0;
+    udp = (const struct udphdr *) (p + hl);
+    if (ntohs(udp->dest) != test->server_port)
+	return 0;
+    ulen = ntohs(udp->len) - (int) sizeof(struct udphdr);
+    /* The handshake's datagrams are 4 bytes; test datagrams carry a header. */
+    if (ulen < (capture->counters64 ? 16 : 12) || len < hl + sizeof(struct udphdr) + (capture->counters64 ? 16 : 12))
+	return 0;
+    if (salen == sizeof(struct sockaddr_in)) {
+	l4->sin_port = udp->dest;
+	r4->sin_port = udp->source;
+    } else {
+	l6->sin6_port = udp->dest;
+	r6->sin6_port = udp->source;
+    }
+
+    if ((sp = capture_stream(test, &local, &remote, salen)) == NULL)
+	return -1;
+    iperf_udp_capture(sp, (const char *) (udp + 1), ulen, (int64_t) ph->tp_sec * 1000000000 + ph->tp_nsec);
+    /* No sender reports back, so the totals are what came past. */
+    sp->result->bytes_sent += ulen;
+    ++capture->datagrams;
+    capture->last.tv_sec = ph->tp_sec;
+    capture->last.tv_usec = ph->tp_nsec / 1000;
+    return 0;
+}
+
+int
+iperf_capture_read(struct iperf_test *test, struct timeval *timeout)
+{
+    struct iperf_capture *capture = test->capture;
+    struct tpacket_block_desc *bd = capture_block(capture, capture->block);
+    struct tpacket3_hdr *ph;
+    struct pollfd pfd;
+    struct timeval now;
+    double left;
+    int ms;
+    unsigned i;
+
+    if (!(bd->hdr.bh1.block_status & TP_STATUS_USER)) {
+	ms = timeout == NULL ? -1 : timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000;
+	/* Wake when the test goes quiet, not at the next timer after that. */
+	if (capture->datagrams > 0) {
+	    gettimeofday(&now, NULL);
+	    left = CAPTURE_IDLE - timeval_diff(&capture->last, &now);
+	    if (left < 0)
+		left = 0;
+	    if (ms < 0 || left * 1000 + 1 < ms)
+		ms = left * 1000 + 1;
+	}
+	pfd.fd = capture->fd;
+	pfd.events = POLLIN | POLLERR;
+	pfd.revents = 0;
+	if (poll(&pfd, 1, ms) < 0 && errno != EINTR) {
+	    i_errno = IESELECT;
+	    return -1;
+	}
+    }
+
+    /* Blocks come back in ring order; each is handed back once it's read. */
+    while (bd->hdr.bh1.block_status & TP_STATUS_USER) {
+	ph = (struct tpacket3_hdr *) ((char *) bd + bd->hdr.bh1.offset_to_first_pkt);
+	for (i = 0; i < bd->hdr.bh1.num_pkts; ++i) {
+	    if (capture_packet(test, ph) < 0)
+		return -1;
+	    ph = (struct tpacket3_hdr *) ((char *) ph + ph->tp_next_offset);
+	}
+	__sync_synchronize();
+	bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+	capture->block = (capture->block + 1) % CAPTURE_BLOCKS;
+	bd = capture_block(capture, capture->block);
+    }
+    return 0;
+}
+
+int
+iperf_capture_idle(struct iperf_test *test, struct timeval *now)
+{
+    struct iperf_capture *capture = test->capture;
+
+    return capture->datagrams > 0 && timeval_diff(&capture->last, now) > CAPTURE_IDLE;
+}
+
+/*
+ * The test ended with its last datagram, not when we noticed the quiet:
+ * end the last interval, if anything came after the one before, and the
+ * streams' times there.
+ */
+void
+iperf_capture_end(struct iperf_test *test)
+{
+    struct iperf_capture *capture = test->capture;
+    struct iperf_stream *sp;
+    struct iperf_interval_results *irp;
+    struct timeval end;
+
+    capture->tail = 0;
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	irp = TAILQ_LAST(&sp->result->interval_results, irlisthead);
+	if (irp == NULL || sp->result->bytes_received_this_interval != 0 ||
+	    timercmp(&capture->last, &irp->interval_end_time, >))
+	    capture->tail = 1;
+    }
+    if (capture->tail)
+	test->stats_callback(test);
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	end = capture->last;
+	irp = TAILQ_LAST(&sp->result->interval_results, irlisthead);
+	if (capture->tail && irp != NULL) {
+	    if (timercmp(&end, &irp->interval_start_time, <))
+		end = irp->interval_start_time;
+	    irp->interval_end_time = end;
+	    irp->interval_duration = timeval_diff(&irp->interval_start_time, &end);
+	}
+	if (timercmp(&end, &sp->result->start_time, <))
+	    end = sp->result->start_time;
+	sp->result->end_time = end;
+    }
+}
+
+int
+iperf_capture_tail(struct iperf_test *test)
+{
+    return test->capture->tail;
+}
+
+void
+iperf_capture_print_results(struct iperf_test *test)
+{
+    struct iperf_capture *capture = test->capture;
+
+    if (capture == NULL)
+	return;
+    capture_statistics(capture);
+    if (test->json_output)
+	cJSON_AddItemToObject(test->json_end, "capture", iperf_json_printf("interface: %s  port: %d  datagrams: %d  ring_packets: %d  ring_drops: %d", capture->ifname, (int64_t) test->server_port, (int64_t) capture->datagrams, (int64_t) capture->ring_packets, (int64_t) capture->ring_drops));
+    else
+	iprintf(test, report_capture_results, capture->ifname, (unsigned long long) capture->datagrams, test->server_port, capture->ring_drops, capture->ring_packets);
+}
+
+#else /* linux && TPACKET3_HDRLEN */
+
+int
+iperf_capture_open(struct iperf_test *test)
+{
+    i_errno = IESETCAPTURE;
+    errno = ENOSYS;
+    return -1;
+}
+
+void
+iperf_capture_close(struct iperf_test *test)
+{
+}
+
+int
+iperf_capture_read(struct iperf_test *test, struct timeval *timeout)
+{
+    i_errno = IESETCAPTURE;
+    return -1;
+}
+
+int
+iperf_capture_idle(struct iperf_test *test, struct timeval *now)
+{
+    return 0;
+}
+
+void
+iperf_capture_end(struct iperf_test *test)
+{
+}
+
+int
+iperf_capture_tail(struct iperf_test *test)
+{
+    return 0;
+}
+
+void
+iperf_capture_print_results(struct iperf_test *test)
+{
+}
+
+#endif /* linux && TPACKET3_HDRLEN */
@@ -0,0 +1,91 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_PACKET_H
+#define __IPERF_PACKET_H
+
+/*
+ * --af-packet (Linux): UDP senders build each datagram, IPv4 and UDP
+ * headers included, in a PACKET_TX_RING shared with the kernel, and
+ * hand it over a batch at a time with one sendto() rather than a
+ * system call per datagram.  The stream's UDP socket still does the
+ * handshake and stays bound, and the datagrams carry its addresses and
+ * ports and the usual iperf3 header, so the receiver is an ordinary
+ * UDP receiver.  Needs CAP_NET_RAW and an IPv4 peer whose link address
+ * (or its gateway's) is in the ARP table, as the handshake leaves it.
+ */
+
+#define PACKET_RING_FRAMES 512		/* at least; rounded up to whole blocks */
+#define PACKET_BATCH 64			/* datagrams per sendto() when not paced */
+
+int iperf_packet_init_stream(struct iperf_stream *sp);
+void iperf_packet_free_stream(struct iperf_stream *sp);
+
+/* sp->snd: queue one datagram in the ring. */
+int iperf_packet_send(struct iperf_stream *sp);
+
+/* Hand the kernel what has been queued; iperf_send() does, every round. */
+int iperf_packet_flush(struct iperf_stream *sp);
+
+void iperf_packet_print_results(struct iperf_test *test);
+
+/*
+ * --capture (Linux): a server that measures passively.  It doesn't
+ * listen; it reads the UDP datagrams to its port that arrive on an
+ * interface (a tap or mirror port, or the sink's own) from a TPACKET_V3
+ * receive ring, a block of them at a time, takes each source address
+ * and port for a stream, and gives them the receiver's usual loss,
+ * jitter, reordering and, with the timestamp layout, one-way delay
+ * reports.  The test starts at the first datagram and ends once none
+ * has come for CAPTURE_IDLE seconds.
+ */
+
+#define CAPTURE_IDLE 1.0		/* seconds */
+#define CAPTURE_BLOCK_SIZE (1 << 20)
+#define CAPTURE_BLOCKS 16
+#define CAPTURE_BLOCK_TIMEOUT 10	/* ms before a part-filled block is handed over */
+
+/* "interface[,64|,ts]": the header layout is the sender's to choose, so it's given. */
+struct iperf_capture *iperf_capture_new(const char *spec);
+void iperf_capture_free(struct iperf_capture *capture);
+
+/* Set up the ring, and say so. */
+int iperf_capture_open(struct iperf_test *test);
+void iperf_capture_close(struct iperf_test *test);
+
+/* Wait up to timeout (forever if NULL) for a block; then take in every ready one. */
+int iperf_capture_read(struct iperf_test *test, struct timeval *timeout);
+
+/* Has a test started, and then gone quiet? */
+int iperf_capture_idle(struct iperf_test *test, struct timeval *now);
+
+/* Then end its intervals and streams at the last datagram; was there a last interval? */
+void iperf_capture_end(struct iperf_test *test);
+int iperf_capture_tail(struct iperf_test *test);
+
+void iperf_capture_print_results(struct iperf_test *test);
+
+#endif /* __IPERF_PACKET_H */
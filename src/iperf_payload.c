@@ -0,0 +1,319 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#if defined(linux)
+#include <sys/syscall.h>
+#endif
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_payload.h"
+
+/* Transparent hugepages only pay off for buffers at least this big. */
+#define PAYLOAD_HUGEPAGE (2 * 1024 * 1024)
+
+/* --payload pattern repeats this many bytes. */
+#define PAYLOAD_PATTERN_SIZE 256
+
+/*
+ * --payload ratio:# mixes random bytes and zeros within chunks this
+ * big, well inside the windows compressors look back over.
+ */
+#define PAYLOAD_CHUNK 4096
+
+/* xorshift64*: eight random bytes a step, instead of random() per byte. */
+static uint64_t
+payload_next(uint64_t *x)
+{
+    *x ^= *x >> 12;
+    *x ^= *x << 25;
+    *x ^= *x >> 27;
+    return *x * 0x2545f4914f6cdd1dULL;
+}
+
+static void
+payload_fill(char *buf, int size, uint64_t *x)
+{
+    uint64_t r;
+    int i;
+
+    for (i = 0; i < size; i += sizeof(r)) {
+	r = payload_next(x);
+	memcpy(buf + i, &r, (size_t) (size - i) < sizeof(r) ? (size_t) (size - i) : sizeof(r));
+    }
+}
+
+/* Fill the rest of buf with copies of its first n bytes, doubling each time. */
+static void
+payload_repeat(char *buf, int size, int n)
+{
+    while (n < size) {
+	memcpy(buf + n, buf, n < size - n ? n : size - n);
+	n *= 2;
+    }
+}
+
+static const char *payload_words[] = {
+    "the", "of", "and", "to", "in", "is", "that", "for", "it", "as", "was",
+    "with", "be", "by", "on", "not", "this", "are", "at", "from", "but",
+    "have", "an", "they", "which", "one", "you", "were", "all", "there",
+    "data", "network", "packet", "link", "server", "client", "stream",
+    "buffer", "window", "latency", "throughput", "transfer", "request",
+    "response", "connection", "protocol", "header", "payload", "second",
+    "interval", "report", "test", "time", "rate", "loss", "route", "queue",
+    "socket", "kernel", "address", "port", "host", "traffic", "between",
+};
+
+/* Words, spaces and the odd full stop and newline, like prose. */
+static void
+payload_text(char *buf, int size, uint64_t *x)
+{
+    uint64_t r = 0;
+    const char *w;
+    int i = 0, n, bits = 0, words = 0;
+
+    while (i < size) {
+	if (bits < 6) {
+	    r = payload_next(x);
+	    bits = 64;
+	}
+	w = payload_words[r & 63];
+	r >>= 6;
+	bits -= 6;
+	n = strlen(w);
+	if (n > size - i)
+	    n = size - i;
+	memcpy(buf + i, w, n);
+	i += n;
+	if (i < size)
+	    buf[i++] = ++words % 12 == 0 ? '\n' : words % 7 == 0 ? '.' : ' ';
+    }
+}
+
+/*
+ * Generate size bytes of payload, the same for the same seed.  All of
+ * it is done up front, so that none of it costs anything while sending.
+ */
+static void
+payload_generate(struct iperf_test *test, char *buf, int size, uint64_t seed)
+{
+    struct iperf_payload_mode *mode = test->payload_mode;
+    uint64_t x = seed ? seed : 0x9e3779b97f4a7c15ULL;
+    int i, n;
+
+    switch (mode ? mode->type : PAYLOAD_RANDOM) {
+    case PAYLOAD_ZEROS:
+	memset(buf, 0, size);
+	break;
+    case PAYLOAD_PATTERN:
+	payload_fill(buf, size < PAYLOAD_PATTERN_SIZE ? size : PAYLOAD_PATTERN_SIZE, &x);
+	payload_repeat(buf, size, PAYLOAD_PATTERN_SIZE);
+	break;
+    case PAYLOAD_TEXT:
+	payload_text(buf, size, &x);
+	break;
+    case PAYLOAD_RATIO:
+	/* Each chunk: a random part, one ratio-th of it, then zeros. */
+	n = PAYLOAD_CHUNK / mode->ratio;
+	for (i = 0; i < size; i += PAYLOAD_CHUNK) {
+	    payload_fill(buf + i, n < size - i ? n : size - i, &x);
+	    if (n < size - i)
+		memset(buf + i + n, 0, (PAYLOAD_CHUNK < size - i ? PAYLOAD_CHUNK : size - i) - n);
+	}
+	break;
+    default:
+	payload_fill(buf, size, &x);
+	break;
+    }
+}
+
+/* A different payload each run, unless a seed is given. */
+static uint64_t
+payload_seed(void)
+{
+    return (uint64_t) time(NULL) * 0x9e3779b97f4a7c15ULL ^ (uint64_t) getpid();
+}
+
+static int
+payload_open(struct iperf_test *test)
+{
+    char template[1024];
+    int fd = -1;
+
+#if defined(linux) && defined(SYS_memfd_create)
+    /* Nothing touches the disk unless a template asked for it. */
+    if (test->tmp_template == NULL)
+	fd = syscall(SYS_memfd_create, "iperf3", 0);
+#endif
+    if (fd >= 0)
+	return fd;
+
+    snprintf(template, sizeof(template), "%s", test->tmp_template ? test->tmp_template : "/tmp/iperf3.XXXXXX");
+    fd = mkstemp(template);
+    if (fd < 0)
+	return -1;
+    if (unlink(template) < 0) {
+	close(fd);
+	return -1;
+    }
+    return fd;
+}
+
+char *
+iperf_payload_map(struct iperf_test *test, int size, int fill, int *fdP)
+{
+    char *buf;
+    int fd;
+
+    fd = payload_open(test);
+    if (fd < 0) {
+	i_errno = IECREATESTREAM;
+	return NULL;
+    }
+    if (ftruncate(fd, size) < 0) {
+	close(fd);
+	i_errno = IECREATESTREAM;
+	return NULL;
+    }
+    /* Shared, so that what is in the buffer is what -Z sends. */
+    buf = (char *) mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (buf == MAP_FAILED) {
+	close(fd);
+	i_errno = IECREATESTREAM;
+	return NULL;
+    }
+#if defined(MADV_HUGEPAGE)
+    if (size >= PAYLOAD_HUGEPAGE)
+	(void) madvise(buf, size, MADV_HUGEPAGE);
+#endif
+    if (fill)
+	payload_generate(test, buf, size, payload_seed());
+
+    *fdP = fd;
+    return buf;
+}
+
+struct iperf_payload *
+iperf_payload_new(struct iperf_test *test, int size, uint32_t seed)
+{
+    struct iperf_payload *payload;
+
+    payload = (struct iperf_payload *) calloc(1, sizeof(struct iperf_payload));
+    if (payload == NULL) {
+	i_errno = IECREATESTREAM;
+	return NULL;
+    }
+    payload->size = size;
+    payload->buffer = iperf_payload_map(test, size, 0, &payload->fd);
+    if (payload->buffer == NULL) {
+	free(payload);
+	return NULL;
+    }
+    /* One pass; a seed makes it reproducible, so that --verify can check it. */
+    payload_generate(test, payload->buffer, size, seed ? seed : payload_seed());
+    /* From here on nobody may scribble on it. */
+    (void) mprotect(payload->buffer, size, PROT_READ);
+    return payload;
+}
+
+void
+iperf_payload_free(struct iperf_payload *payload)
+{
+    if (payload == NULL)
+	return;
+    munmap(payload->buffer, payload->size);
+    close(payload->fd);
+    free(payload);
+}
+
+void
+iperf_payload_unmap(struct iperf_stream *sp)
+{
+    if (sp->buffer_shared || sp->buffer == NULL)
+	return;
+    munmap(sp->buffer, sp->buffer_size);
+    close(sp->buffer_fd);
+}
+
+struct iperf_payload_mode *
+iperf_payload_mode_new(const char *spec)
+{
+    struct iperf_payload_mode *mode;
+    char *end;
+
+    mode = (struct iperf_payload_mode *) calloc(1, sizeof(struct iperf_payload_mode));
+    if (mode == NULL) {
+	i_errno = IENEWTEST;
+	return NULL;
+    }
+    mode->spec = strdup(spec);
+    if (mode->spec == NULL) {
+	iperf_payload_mode_free(mode);
+	i_errno = IENEWTEST;
+	return NULL;
+    }
+    if (strcmp(spec, "random") == 0)
+	mode->type = PAYLOAD_RANDOM;
+    else if (strcmp(spec, "zeros") == 0)
+	mode->type = PAYLOAD_ZEROS;
+    else if (strcmp(spec, "pattern") == 0)
+	mode->type = PAYLOAD_PATTERN;
+    else if (strcmp(spec, "text") == 0)
+	mode->type = PAYLOAD_TEXT;
+    else if (strncmp(spec, "ratio:", 6) == 0) {
+	mode->type = PAYLOAD_RATIO;
+	mode->ratio = strtod(spec + 6, &end);
+	if (end == spec + 6 || *end != '\0' || !(mode->ratio >= 1.0 && mode->ratio <= PAYLOAD_CHUNK)) {
+	    iperf_payload_mode_free(mode);
+	    i_errno = IEPAYLOAD;
+	    return NULL;
+	}
+    } else {
+	iperf_payload_mode_free(mode);
+	i_errno = IEPAYLOAD;
+	return NULL;
+    }
+    return mode;
+}
+
+void
+iperf_payload_mode_free(struct iperf_payload_mode *mode)
+{
+    if (mode == NULL)
+	return;
+    free(mode->spec);
+    free(mode);
+}
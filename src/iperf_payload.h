@@ -0,0 +1,73 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_PAYLOAD_H
+#define __IPERF_PAYLOAD_H
+
+/*
+ * Stream buffers.  Sending streams share one payload, generated once
+ * and mapped read-only; the UDP header goes out from a separate iovec.
+ * Streams that write into their buffer (receivers, --rr and -F) get
+ * one of their own.  Either way the buffer is backed by a memfd (a file
+ * made from the --tmp-template if one was set) that -Z sends from.
+ *
+ * What goes in it is random unless --payload asked for something a
+ * compressor can do more with.
+ */
+
+/**
+ * iperf_payload_new -- the shared payload, size bytes
+ *
+ * Generated from a fresh seed, unless seed is nonzero: then the same seed
+ * gives the same bytes.
+ * returns NULL with i_errno set on error
+ */
+struct iperf_payload *iperf_payload_new(struct iperf_test *test, int size, uint32_t seed);
+
+void iperf_payload_free(struct iperf_payload *payload);
+
+/**
+ * iperf_payload_map -- a private, writable buffer of size bytes
+ *
+ * Its descriptor goes in *fdP.  With fill set it starts out as payload.
+ * returns NULL with i_errno set on error
+ */
+char *iperf_payload_map(struct iperf_test *test, int size, int fill, int *fdP);
+
+/* Release a stream's buffer, unless it is the shared one. */
+void iperf_payload_unmap(struct iperf_stream *sp);
+
+/**
+ * iperf_payload_mode_new -- parse a --payload spec:
+ * random, zeros, pattern, text or ratio:#
+ *
+ * returns NULL with i_errno set on error
+ */
+struct iperf_payload_mode *iperf_payload_mode_new(const char *spec);
+
+void iperf_payload_mode_free(struct iperf_payload_mode *mode);
+
+#endif
@@ -0,0 +1,331 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#define _GNU_SOURCE
+#include "iperf_config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#if defined(HAVE_SCHED_SETAFFINITY)
+#include <sched.h>
+#endif
+#if defined(linux)
+#include <sys/syscall.h>
+#endif
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_locale.h"
+#include "iperf_util.h"
+#include "iperf_placement.h"
+#include "net.h"
+
+#if defined(linux) && defined(HAVE_SCHED_SETAFFINITY)
+
+#ifndef MPOL_DEFAULT
+#define MPOL_DEFAULT 0
+#define MPOL_PREFERRED 1
+#endif
+
+struct iperf_placement {
+    char      ifname[32];
+    int       node;			/* -1: not known */
+    cpu_set_t irq_cpus;
+    int       cpu;			/* the main loop's */
+    cpu_set_t workers;
+    int       mempolicy;		/* set_mempolicy() took */
+    cpu_set_t allowed;			/* the affinity before, put back when freed */
+};
+
+/* Parse a CPU list ("0-3,8,10-11") into set; returns -1 if nothing was read. */
+static int
+cpulist_parse(const char *list, cpu_set_t *set)
+{
+    const char *p = list;
+    char *end;
+    long a, b;
+    int n = 0;
+
+    while (*p != '\0' && *p != '\n') {
+	a = strtol(p, &end, 10);
+	if (end == p)
+	    break;
+	b = a;
+	if (*end == '-')
+	    b = strtol(end + 1, &end, 10);
+	for (; a <= b && a < CPU_SETSIZE; ++a, ++n)
+	    CPU_SET(a, set);
+	p = *end == ',' ? end + 1 : end;
+    }
+    return n > 0 ? 0 : -1;
+}
+
+static int
+cpulist_read(const char *path, cpu_set_t *set)
+{
+    char buf[1024];
+    FILE *f;
+    int r = -1;
+
+    if ((f = fopen(path, "r")) == NULL)
+	return -1;
+    if (fgets(buf, sizeof(buf), f) != NULL)
+	r = cpulist_parse(buf, set);
+    fclose(f);
+    return r;
+}
+
+/* The inverse of cpulist_parse(), "-" for an empty set. */
+static char *
+cpulist_format(const cpu_set_t *set, char *buf, size_t len)
+{
+    size_t off = 0;
+    int a, b;
+
+    buf[0] = '\0';
+    for (a = 0; a < CPU_SETSIZE && off < len; ++a) {
+	if (!CPU_ISSET(a, set))
+	    continue;
+	for (b = a; b + 1 < CPU_SETSIZE && CPU_ISSET(b + 1, set); ++b)
+	    ;
+	if (b == a)
+	    off += snprintf(buf + off, len - off, "%s%d", off ? "," : "", a);
+	else
+	    off += snprintf(buf + off, len - off, "%s%d-%d", off ? "," : "", a, b);
+	a = b;
+    }
+    if (buf[0] == '\0')
+	snprintf(buf, len, "-");
+    return buf;
+}
+
+static void
+placement_irq(const char *irq, cpu_set_t *set)
+{
+    char path[128];
+
+    /* Where the kernel actually delivers it, or failing that, may. */
+    snprintf(path, sizeof(path), "/proc/irq/%s/effective_affinity_list", irq);
+    if (cpulist_read(path, set) == 0)
+	return;
+    snprintf(path, sizeof(path), "/proc/irq/%s/smp_affinity_list", irq);
+    (void) cpulist_read(path, set);
+}
+
+/*
+ * Whether a /proc/interrupts line's names include the interface: as a
+ * whole word, or with a queue suffix ("eth1-rx-3", "eth1@pci"), but
+ * not eth10 for eth1.
+ */
+static int
+placement_irq_names(char *names, const char *ifname)
+{
+    size_t len = strlen(ifname);
+    char *name, *last;
+
+    for (name = strtok_r(names, " \t\n,", &last); name != NULL; name = strtok_r(NULL, " \t\n,", &last))
+	if (strncmp(name, ifname, len) == 0 &&
+	    (name[len] == '\0' || name[len] == '-' || name[len] == '@'))
+	    return 1;
+    return 0;
+}
+
+/* The CPUs handling the interface's IRQs: MSI vectors, else /proc/interrupts. */
+static void
+placement_irqs(const char *ifname, cpu_set_t *set)
+{
+    char path[128], line[4096], *colon;
+    struct dirent *de;
+    DIR *dir;
+    FILE *f;
+    int found = 0;
+
+    CPU_ZERO(set);
+    snprintf(path, sizeof(path), "/sys/class/net/%s/device/msi_irqs", ifname);
+    if ((dir = opendir(path)) != NULL) {
+	while ((de = readdir(dir)) != NULL)
+	    if (de->d_name[0] != '.') {
+		placement_irq(de->d_name, set);
+		found = 1;
+	    }
+	closedir(dir);
+    }
+    if (found || (f = fopen("/proc/interrupts", "r")) == NULL)
+	return;
+    while (fgets(line, sizeof(line), f) != NULL) {
+	if ((colon = strchr(line, ':')) == NULL)
+	    continue;
+	*colon = '\0';
+	if (!placement_irq_names(colon + 1, ifname))
+	    continue;
+	placement_irq(line + strspn(line, " "), set);
+    }
+    fclose(f);
+}
+
+static int
+placement_node(const char *ifname)
+{
+    char path[128];
+    FILE *f;
+    int node = -1;
+
+    snprintf(path, sizeof(path), "/sys/class/net/%s/device/numa_node", ifname);
+    if ((f = fopen(path, "r")) == NULL)
+	return -1;
+    if (fscanf(f, "%d", &node) != 1)
+	node = -1;
+    fclose(f);
+    return node;
+}
+
+int
+iperf_placement_apply(struct iperf_test *test, int sock)
+{
+    struct iperf_placement *pl;
+    cpu_set_t allowed, node_cpus, candidates, main_cpu;
+    char path[128], nbuf[16], ibuf[256], wbuf[256];
+    unsigned long nodemask[16];
+    int cpu;
+
+    if (test->placement != NULL)
+	return 0;
+    pl = (struct iperf_placement *) calloc(1, sizeof(struct iperf_placement));
+    if (pl == NULL) {
+	i_errno = IEAFFINITY;
+	return -1;
+    }
+    test->placement = pl;
+
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+	i_errno = IEAFFINITY;
+	return -1;
+    }
+    pl->allowed = allowed;
+    (void) getsockifname(sock, pl->ifname, sizeof(pl->ifname));
+    pl->node = pl->ifname[0] != '\0' ? placement_node(pl->ifname) : -1;
+    if (pl->ifname[0] != '\0')
+	placement_irqs(pl->ifname, &pl->irq_cpus);
+    else
+	CPU_ZERO(&pl->irq_cpus);
+
+    /* The node's CPUs we may use, less those taking the IRQs... */
+    CPU_ZERO(&node_cpus);
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", pl->node);
+    if (pl->node < 0 || cpulist_read(path, &node_cpus) < 0)
+	node_cpus = allowed;
+    CPU_AND(&candidates, &allowed, &node_cpus);
+    if (CPU_COUNT(&candidates) == 0)
+	candidates = allowed;
+    CPU_XOR(&pl->workers, &candidates, &pl->irq_cpus);
+    CPU_AND(&pl->workers, &pl->workers, &candidates);
+    /* ... unless that leaves none. */
+    if (CPU_COUNT(&pl->workers) == 0)
+	pl->workers = candidates;
+
+    for (cpu = 0; cpu < CPU_SETSIZE && !CPU_ISSET(cpu, &pl->workers); ++cpu)
+	;
+    pl->cpu = cpu;
+    if (CPU_COUNT(&pl->workers) > 1)
+	CPU_CLR(cpu, &pl->workers);
+    CPU_ZERO(&main_cpu);
+    CPU_SET(cpu, &main_cpu);
+    if (sched_setaffinity(0, sizeof(main_cpu), &main_cpu) != 0) {
+	i_errno = IEAFFINITY;
+	return -1;
+    }
+
+    /* The stream buffers are allocated after this, so they come from the node. */
+#if defined(SYS_set_mempolicy)
+    if (pl->node >= 0 && pl->node < (int) (sizeof(nodemask) * 8)) {
+	memset(nodemask, 0, sizeof(nodemask));
+	nodemask[pl->node / (8 * sizeof(unsigned long))] |= 1UL << (pl->node % (8 * sizeof(unsigned long)));
+	pl->mempolicy = syscall(SYS_set_mempolicy, MPOL_PREFERRED, nodemask, sizeof(nodemask) * 8) == 0;
+    }
+#endif
+
+    if (pl->node >= 0)
+	snprintf(nbuf, sizeof(nbuf), "%d", pl->node);
+    else
+	snprintf(nbuf, sizeof(nbuf), "-");
+    cpulist_format(&pl->irq_cpus, ibuf, sizeof(ibuf));
+    cpulist_format(&pl->workers, wbuf, sizeof(wbuf));
+    if (test->json_output) {
+	if (test->json_start != NULL)
+	    cJSON_AddItemToObject(test->json_start, "placement", iperf_json_printf("interface: %s  numa_node: %d  irq_cpus: %s  cpu: %d  worker_cpus: %s  memory_on_node: %b", pl->ifname[0] ? pl->ifname : "-", (int64_t) pl->node, ibuf, (int64_t) pl->cpu, wbuf, pl->mempolicy));
+    } else
+	iprintf(test, report_placement, pl->ifname[0] ? pl->ifname : "?", nbuf, ibuf, pl->cpu, wbuf, pl->mempolicy ? report_placement_memory : "");
+    return 0;
+}
+
+void
+iperf_placement_thread(struct iperf_test *test)
+{
+    if (test->placement != NULL)
+	(void) sched_setaffinity(0, sizeof(cpu_set_t), &test->placement->workers);
+}
+
+void
+iperf_placement_free(struct iperf_test *test)
+{
+    if (test->placement == NULL)
+	return;
+#if defined(SYS_set_mempolicy)
+    if (test->placement->mempolicy)
+	(void) syscall(SYS_set_mempolicy, MPOL_DEFAULT, NULL, 0);
+#endif
+    /* A server goes back to every CPU it had for the next test. */
+    if (CPU_COUNT(&test->placement->allowed) > 0)
+	(void) sched_setaffinity(0, sizeof(cpu_set_t), &test->placement->allowed);
+    free(test->placement);
+    test->placement = NULL;
+}
+
+#else /* linux && HAVE_SCHED_SETAFFINITY */
+
+int
+iperf_placement_apply(struct iperf_test *test, int sock)
+{
+    i_errno = IEAFFINITY;
+    return -1;
+}
+
+void
+iperf_placement_thread(struct iperf_test *test)
+{
+}
+
+void
+iperf_placement_free(struct iperf_test *test)
+{
+}
+
+#endif /* linux && HAVE_SCHED_SETAFFINITY */
@@ -0,0 +1,48 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_PLACEMENT_H
+#define __IPERF_PLACEMENT_H
+
+/*
+ * -A auto (Linux): find the interface the control connection goes out
+ * on, its NUMA node and the CPUs its IRQs are routed to, all from sysfs
+ * and /proc, and run the main loop on a CPU of that node that isn't
+ * handling them.  Worker threads (-F read-ahead and write-behind) go on
+ * the node's other such CPUs, and memory is preferably allocated from
+ * the node, which covers the stream buffers since they are made after.
+ */
+
+/* Place the test by the interface sock is bound to, and report the layout. */
+int iperf_placement_apply(struct iperf_test *test, int sock);
+
+/* Move the calling worker thread onto the workers' CPUs, if placed. */
+void iperf_placement_thread(struct iperf_test *test);
+
+/* Undo the memory policy; iperf_clearaffinity() undoes the rest. */
+void iperf_placement_free(struct iperf_test *test);
+
+#endif
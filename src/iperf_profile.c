@@ -0,0 +1,347 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+#include <sys/time.h>
+#include <sys/select.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_util.h"
+#include "iperf_locale.h"
+#include "iperf_profile.h"
+#include "timer.h"
+#include "units.h"
+
+static int
+profile_load_trace(struct iperf_profile *profile, const char *filename)
+{
+    FILE *f;
+    char line[256];
+    double t, *times;
+    int size, *sizes, n, r;
+    int allocated = 0;
+
+    f = fopen(filename, "r");
+    if (f == NULL)
+	return -1;
+    for (n = 0; fgets(line, sizeof(line), f) != NULL; ++n) {
+	r = sscanf(line, "%lf %d", &t, &size);
+	if (r == EOF || line[0] == '#') {
+	    --n;
+	    continue;
+	}
+	if (r != 2 || size <= 0 || (n > 0 && t < profile->trace_time[n - 1]))
+	    break;
+	if (n == allocated) {
+	    allocated = allocated ? allocated * 2 : 1024;
+	    times = (double *) realloc(profile->trace_time, allocated * sizeof(double));
+	    if (times != NULL)
+		profile->trace_time = times;
+	    sizes = (int *) realloc(profile->trace_size, allocated * sizeof(int));
+	    if (sizes != NULL)
+		profile->trace_size = sizes;
+	    if (times == NULL || sizes == NULL)
+		break;
+	}
+	profile->trace_time[n] = t;
+	profile->trace_size[n] = size;
+    }
+    r = feof(f);
+    fclose(f);
+    if (!r || n < 2 || profile->trace_time[n - 1] <= profile->trace_time[0])
+	return -1;
+
+    /* Times count from the first packet; the next pass of the trace
+    ** starts one average gap after its last packet. */
+    profile->ntrace = n;
+    for (n = profile->ntrace - 1; n >= 0; --n)
+	profile->trace_time[n] -= profile->trace_time[0];
+    t = profile->trace_time[profile->ntrace - 1];
+    profile->trace_period = t + t / (profile->ntrace - 1);
+    return 0;
+}
+
+struct iperf_profile *
+iperf_profile_new(const char *spec)
+{
+    struct iperf_profile *profile;
+    char *end;
+
+    profile = (struct iperf_profile *) calloc(1, sizeof(struct iperf_profile));
+    if (profile == NULL) {
+	i_errno = IENEWTEST;
+	return NULL;
+    }
+    profile->spec = strdup(spec);
+    if (profile->spec == NULL) {
+	iperf_profile_free(profile);
+	i_errno = IENEWTEST;
+	return NULL;
+    }
+    if (strcmp(spec, "poisson") == 0)
+	profile->type = PROFILE_POISSON;
+    else if (strncmp(spec, "onoff:", 6) == 0) {
+	profile->type = PROFILE_ONOFF;
+	profile->on = strtod(spec + 6, &end);
+	if (*end == '/')
+	    profile->off = strtod(end + 1, &end);
+	if (*end != '\0' || profile->on <= 0 || profile->off <= 0)
+	    profile->type = 0;
+    } else if (strncmp(spec, "trace:", 6) == 0) {
+	profile->type = PROFILE_TRACE;
+	if (profile_load_trace(profile, spec + 6) < 0)
+	    profile->type = 0;
+    }
+    if (profile->type == 0) {
+	iperf_profile_free(profile);
+	i_errno = IEPROFILE;
+	return NULL;
+    }
+    return profile;
+}
+
+void
+iperf_profile_free(struct iperf_profile *profile)
+{
+    if (profile == NULL)
+	return;
+    free(profile->spec);
+    free(profile->trace_time);
+    free(profile->trace_size);
+    free(profile);
+}
+
+/* A trace packet size, within what the stream can send. */
+static int
+profile_size(struct iperf_stream *sp, int size)
+{
+    int min_size = 1;
+
+    if (sp->test->protocol->id == Pudp)
+	min_size = sp->test->udp_counters_64bit ? 16 : 12;
+    if (size < min_size)
+	return min_size;
+    if (size > sp->buffer_size)
+	return sp->buffer_size;
+    return size;
+}
+
+/* An exponential variate with mean 1, -ln u for uniform u in (0, 1]. */
+static double
+profile_exp(void)
+{
+    return -log((random() + 1.0) / 2147483649.0);
+}
+
+int
+iperf_profile_start(struct iperf_stream *sp)
+{
+    struct iperf_profile *profile = sp->test->profile;
+    struct iperf_profile_stream *ps;
+
+    ps = (struct iperf_profile_stream *) calloc(1, sizeof(struct iperf_profile_stream));
+    if (ps == NULL) {
+	i_errno = IEINITTEST;
+	return -1;
+    }
+    sp->profile = ps;
+    gettimeofday(&ps->start, NULL);
+    if (profile->type == PROFILE_TRACE)
+	sp->send_size = profile_size(sp, profile->trace_size[0]);
+    sp->green_light = 1;
+    return 0;
+}
+
+void
+iperf_profile_free_stream(struct iperf_stream *sp)
+{
+    if (sp->profile == NULL)
+	return;
+    if (sp->profile->timer != NULL)
+	tmr_cancel(sp->profile->timer);
+    free(sp->profile);
+    sp->profile = NULL;
+}
+
+static void
+profile_timer_proc(TimerClientData client_data, struct timeval *nowP)
+{
+    struct iperf_stream *sp = client_data.p;
+
+    sp->profile->timer = NULL;
+    if (!sp->paused && !sp->test->done) {
+	sp->green_light = 1;
+	FD_SET(sp->socket, &sp->test->write_set);
+    }
+}
+
+void
+iperf_profile_sent(struct iperf_stream *sp, int size)
+{
+    struct iperf_test *test = sp->test;
+    struct iperf_profile *profile = test->profile;
+    struct iperf_profile_stream *ps = sp->profile;
+    struct timeval now;
+    TimerClientData cd;
+    double t, late, period, phase;
+
+    gettimeofday(&now, NULL);
+    t = timeval_diff(&ps->start, &now);
+    late = t - ps->next;
+    if (late > 0) {
+	ps->late_total += late;
+	if (late > ps->late_max)
+	    ps->late_max = late;
+    }
+    ++ps->sends;
+
+    switch (profile->type) {
+	case PROFILE_POISSON:
+	    ps->next += profile_exp() * size * 8.0 / test->settings->rate;
+	    break;
+	case PROFILE_ONOFF:
+	    /* Don't catch up on time lost to a full socket. */
+	    if (ps->next < t)
+		ps->next = t;
+	    if (test->settings->rate != 0)
+		ps->next += size * 8.0 / test->settings->rate;
+	    period = profile->on + profile->off;
+	    phase = ps->next - (int64_t) (ps->next / period) * period;
+	    if (phase >= profile->on)
+		ps->next += period - phase;
+	    break;
+	case PROFILE_TRACE:
+	    if (++ps->trace_pos == profile->ntrace) {
+		ps->trace_pos = 0;
+		++ps->trace_pass;
+	    }
+	    ps->next = ps->trace_pass * profile->trace_period + profile->trace_time[ps->trace_pos];
+	    sp->send_size = profile_size(sp, profile->trace_size[ps->trace_pos]);
+	    break;
+    }
+
+    /* Not due yet: hold the stream back until it is. */
+    if (ps->next > t && !test->done) {
+	cd.p = sp;
+	ps->timer = tmr_create(&now, profile_timer_proc, cd, (int64_t) ((ps->next - t) * SEC_TO_US), 0);
+	if (ps->timer != NULL) {
+	    sp->green_light = 0;
+	    FD_CLR(sp->socket, &test->write_set);
+	}
+    }
+}
+
+static const char *
+profile_name(struct iperf_profile *profile)
+{
+    switch (profile->type) {
+	case PROFILE_POISSON:
+	    return "poisson";
+	case PROFILE_ONOFF:
+	    return "onoff";
+	default:
+	    return "trace";
+    }
+}
+
+/* What the profile asks of one stream; 0 for no limit. */
+static void
+profile_requested(struct iperf_test *test, double *bpsP, double *spsP)
+{
+    struct iperf_profile *profile = test->profile;
+    double bytes;
+    int i;
+
+    switch (profile->type) {
+	case PROFILE_POISSON:
+	    *bpsP = test->settings->rate;
+	    *spsP = *bpsP / (test->settings->blksize * 8.0);
+	    break;
+	case PROFILE_ONOFF:
+	    *bpsP = test->settings->rate * profile->on / (profile->on + profile->off);
+	    *spsP = *bpsP / (test->settings->blksize * 8.0);
+	    break;
+	default:
+	    bytes = 0;
+	    for (i = 0; i < profile->ntrace; ++i)
+		bytes += profile->trace_size[i];
+	    *bpsP = bytes * 8.0 / profile->trace_period;
+	    *spsP = profile->ntrace / profile->trace_period;
+	    break;
+    }
+}
+
+void
+iperf_profile_print_results(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_profile_stream *ps;
+    cJSON *json_profile = NULL;
+    double seconds, req_bps, req_sps, bps, sps, late_mean;
+    char req_buf[UNIT_LEN + 8], buf[UNIT_LEN + 8];
+    int header = 0;
+
+    profile_requested(test, &req_bps, &req_sps);
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	ps = sp->profile;
+	if (!sp->sender || ps == NULL)
+	    continue;
+	seconds = timeval_diff(&sp->result->start_time, &sp->result->end_time);
+	bps = seconds > 0 ? sp->result->bytes_sent * 8.0 / seconds : 0.0;
+	sps = seconds > 0 ? ps->sends / seconds : 0.0;
+	late_mean = ps->sends ? ps->late_total / ps->sends : 0.0;
+
+	if (test->json_output) {
+	    if (json_profile == NULL) {
+		json_profile = cJSON_CreateArray();
+		if (json_profile == NULL)
+		    return;
+		cJSON_AddItemToObject(test->json_end, "profile", json_profile);
+	    }
+	    cJSON_AddItemToArray(json_profile, iperf_json_printf("socket: %d  profile: %s  requested_bits_per_second: %f  achieved_bits_per_second: %f  requested_sends_per_second: %f  achieved_sends_per_second: %f  late_mean_us: %f  late_max_us: %f", (int64_t) sp->socket, test->profile->spec, req_bps, bps, req_sps, sps, late_mean * SEC_TO_US, ps->late_max * SEC_TO_US));
+	    continue;
+	}
+	if (!header) {
+	    iprintf(test, "%s", report_profile_header);
+	    header = 1;
+	}
+	if (req_bps > 0) {
+	    unit_snprintf(req_buf, UNIT_LEN, req_bps / 8, test->settings->unit_format);
+	    strcat(req_buf, "s/sec");
+	} else
+	    strcpy(req_buf, "unlimited");
+	unit_snprintf(buf, UNIT_LEN, bps / 8, test->settings->unit_format);
+	strcat(buf, "s/sec");
+	iprintf(test, report_profile_format, sp->socket, profile_name(test->profile), req_buf, buf, req_sps, sps, late_mean * 1000.0, ps->late_max * 1000.0);
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_PROFILE_H
+#define __IPERF_PROFILE_H
+
+/*
+ * Traffic profiles (--profile): instead of sending as fast as -b
+ * allows, each sending stream follows a schedule of send times and
+ * sizes.
+ *
+ *   poisson        exponential gaps averaging the -b rate
+ *   onoff:ON/OFF   ON seconds at the -b rate (or unlimited), OFF silent
+ *   trace:FILE     replay "seconds bytes" lines from FILE, in a loop
+ */
+
+/**
+ * iperf_profile_new -- parse a --profile spec, reading its trace file
+ *
+ * returns NULL with i_errno set on error
+ */
+struct iperf_profile *iperf_profile_new(const char *spec);
+
+void iperf_profile_free(struct iperf_profile *profile);
+
+/**
+ * iperf_profile_start -- put a sending stream on its schedule, with the
+ * first send due now
+ */
+int iperf_profile_start(struct iperf_stream *sp);
+
+void iperf_profile_free_stream(struct iperf_stream *sp);
+
+/**
+ * iperf_profile_sent -- account for a send of `size` bytes and schedule
+ * the next one; the stream is held back (green_light off) until it is due.
+ */
+void iperf_profile_sent(struct iperf_stream *sp, int size);
+
+/**
+ * iperf_profile_print_results -- requested against achieved rates and
+ * how late the sends were, for each sending stream
+ */
+void iperf_profile_print_results(struct iperf_test *test);
+
+#endif
@@ -0,0 +1,933 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+#include <sys/time.h>
+#include <sys/select.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_util.h"
+#include "iperf_locale.h"
+#include "iperf_rr.h"
+#include "histogram.h"
+#include "net.h"
+
+/* Give up on UDP requests not answered for this long. */
+#define RR_UDP_TIMEOUT 0.2
+
+static void crr_close_stream(struct iperf_stream *sp);
+
+struct iperf_rr *
+iperf_rr_new(int request_size, int response_size, int outstanding, int crr)
+{
+    struct iperf_rr *rr;
+
+    rr = (struct iperf_rr *) calloc(1, sizeof(struct iperf_rr));
+    if (rr == NULL)
+	return NULL;
+    rr->request_size = request_size;
+    rr->response_size = response_size;
+    rr->outstanding = outstanding;
+    rr->crr = crr;
+    SLIST_INIT(&rr->conns);
+    rr->interval = histogram_new();
+    rr->total = histogram_new();
+    if (rr->interval == NULL || rr->total == NULL) {
+	iperf_rr_free(rr);
+	return NULL;
+    }
+    return rr;
+}
+
+void
+iperf_rr_free(struct iperf_rr *rr)
+{
+    struct iperf_rr_conn *c;
+
+    if (rr == NULL)
+	return;
+    while (!SLIST_EMPTY(&rr->conns)) {
+	c = SLIST_FIRST(&rr->conns);
+	SLIST_REMOVE_HEAD(&rr->conns, conns);
+	close(c->fd);
+	free(c);
+    }
+    histogram_free(rr->interval);
+    histogram_free(rr->total);
+    free(rr);
+}
+
+int
+iperf_rr_init_stream(struct iperf_stream *sp)
+{
+    struct iperf_test *test = sp->test;
+    struct iperf_rr_stream *rs;
+    int size = test->role == 'c' ? test->rr->request_size : test->rr->response_size;
+    int i;
+
+    rs = (struct iperf_rr_stream *) calloc(1, sizeof(struct iperf_rr_stream));
+    if (rs == NULL) {
+	i_errno = IECREATESTREAM;
+	return -1;
+    }
+    sp->rr = rs;
+    rs->message = (char *) malloc(size);
+    rs->interval = histogram_new();
+    rs->latency = histogram_new();
+    if (rs->message == NULL || rs->interval == NULL || rs->latency == NULL) {
+	iperf_rr_free_stream(sp);
+	i_errno = IECREATESTREAM;
+	return -1;
+    }
+    if (!test->rr->crr && test->role == 's') {
+	rs->tx_headers = (char *) malloc(test->rr->outstanding * RR_HEADER_LEN);
+	if (rs->tx_headers == NULL) {
+	    iperf_rr_free_stream(sp);
+	    i_errno = IECREATESTREAM;
+	    return -1;
+	}
+    }
+    if (test->rr->crr && test->role == 'c') {
+	rs->conns = (struct iperf_rr_conn *) calloc(test->rr->outstanding, sizeof(struct iperf_rr_conn));
+	if (rs->conns == NULL) {
+	    iperf_rr_free_stream(sp);
+	    i_errno = IECREATESTREAM;
+	    return -1;
+	}
+	for (i = 0; i < test->rr->outstanding; ++i)
+	    rs->conns[i].fd = -1;
+    }
+    /* Fill the message from the (random) stream buffer. */
+    memcpy(rs->message, sp->buffer, size < sp->buffer_size ? size : sp->buffer_size);
+    if (size > sp->buffer_size)
+	memset(rs->message + sp->buffer_size, 0, size - sp->buffer_size);
+    return 0;
+}
+
+void
+iperf_rr_free_stream(struct iperf_stream *sp)
+{
+    struct iperf_rr_stream *rs = sp->rr;
+
+    if (rs == NULL)
+	return;
+    if (rs->conns != NULL) {
+	crr_close_stream(sp);
+	free(rs->conns);
+    }
+    free(rs->message);
+    free(rs->tx_headers);
+    histogram_free(rs->interval);
+    histogram_free(rs->latency);
+    free(rs);
+    sp->rr = NULL;
+}
+
+/*
+ * Write what is left of the message being sent.  Returns 1 once all of
+ * it has gone, or 0 if the socket is full; the rest goes when it is
+ * writable again, so a message is never cut short or sent twice.
+ */
+static int
+rr_write(struct iperf_stream *sp)
+{
+    struct iperf_rr_stream *rs = sp->rr;
+    int r;
+
+    r = Nwrite(sp->socket, rs->message + rs->tx_pos, rs->tx_len - rs->tx_pos, sp->test->protocol->id);
+    if (r == NET_SOFTERROR)
+	r = 0;
+    if (r < 0)
+	return r;
+    sp->result->bytes_sent += r;
+    sp->result->bytes_sent_this_interval += r;
+    rs->tx_pos += r;
+    if (rs->tx_pos < rs->tx_len) {
+	FD_SET(sp->socket, &sp->test->write_set);
+	return 0;
+    }
+    rs->tx_len = rs->tx_pos = 0;
+    FD_CLR(sp->socket, &sp->test->write_set);
+    return 1;
+}
+
+/* Client: send requests until `outstanding` are in flight. */
+static int
+rr_send_requests(struct iperf_stream *sp)
+{
+    struct iperf_test *test = sp->test;
+    struct iperf_rr_stream *rs = sp->rr;
+    struct timeval now;
+    uint32_t hdr[3];
+    int r;
+
+    for (;;) {
+	gettimeofday(&now, NULL);
+	if (rs->tx_len == 0) {
+	    if (rs->inflight >= test->rr->outstanding || sp->paused || test->done)
+		break;
+	    if (test->settings->bytes != 0 && test->bytes_sent >= test->settings->bytes)
+		break;
+	    if (test->settings->blocks != 0 && test->blocks_sent >= test->settings->blocks)
+		break;
+	    hdr[0] = htonl(now.tv_sec);
+	    hdr[1] = htonl(now.tv_usec);
+	    hdr[2] = htonl(rs->next_id++);
+	    memcpy(rs->message, hdr, RR_HEADER_LEN);
+	    rs->tx_len = test->rr->request_size;
+	}
+	if ((r = rr_write(sp)) <= 0)
+	    return r;
+	/* Only a whole request is one in flight. */
+	if (rs->inflight++ == 0)
+	    rs->last_progress = now;
+	test->bytes_sent += test->rr->request_size;
+	++test->blocks_sent;
+    }
+    return 0;
+}
+
+/* Server: answer the requests that have come in, oldest first. */
+static int
+rr_send_responses(struct iperf_stream *sp)
+{
+    struct iperf_rr_stream *rs = sp->rr;
+    int outstanding = sp->test->rr->outstanding;
+    int r;
+
+    while (rs->tx_len != 0 || rs->tx_queued > 0) {
+	if (rs->tx_len == 0) {
+	    memcpy(rs->message, rs->tx_headers + rs->tx_first * RR_HEADER_LEN, RR_HEADER_LEN);
+	    rs->tx_first = (rs->tx_first + 1) % outstanding;
+	    --rs->tx_queued;
+	    rs->tx_len = sp->test->rr->response_size;
+	}
+	if ((r = rr_write(sp)) <= 0)
+	    return r;
+	++rs->interval_transactions;
+    }
+    return 0;
+}
+
+/* A whole message has arrived; its header is in rx_header. */
+static int
+rr_message(struct iperf_stream *sp, struct timeval *nowP)
+{
+    struct iperf_test *test = sp->test;
+    struct iperf_rr_stream *rs = sp->rr;
+    uint32_t hdr[3];
+    struct timeval sent;
+    int64_t latency;
+
+    if (test->role == 's') {
+	/*
+	 * A TCP client has no more than `outstanding` requests unanswered.
+	 * A UDP one gives up on them and sends more; drop those, as the
+	 * network might have.
+	 */
+	if (rs->tx_queued == test->rr->outstanding)
+	    return 0;
+	memcpy(rs->tx_headers + (rs->tx_first + rs->tx_queued) % test->rr->outstanding * RR_HEADER_LEN, rs->rx_header, RR_HEADER_LEN);
+	++rs->tx_queued;
+	return rr_send_responses(sp);
+    }
+
+    ++rs->interval_transactions;
+    memcpy(hdr, rs->rx_header, RR_HEADER_LEN);
+    sent.tv_sec = ntohl(hdr[0]);
+    sent.tv_usec = ntohl(hdr[1]);
+    latency = (int64_t) (nowP->tv_sec - sent.tv_sec) * 1000000 + (nowP->tv_usec - sent.tv_usec);
+    histogram_add(rs->interval, latency > 0 ? latency : 0);
+    if (rs->inflight > 0)
+	--rs->inflight;
+    rs->last_progress = *nowP;
+    return 0;
+}
+
+static int
+rr_read(struct iperf_stream *sp)
+{
+    struct iperf_test *test = sp->test;
+    struct iperf_rr_stream *rs = sp->rr;
+    int size = test->role == 'c' ? test->rr->response_size : test->rr->request_size;
+    struct timeval now;
+    int r, off, take, hlen;
+
+    r = read(sp->socket, sp->buffer, sp->buffer_size);
+    if (r < 0) {
+	if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+	    return 0;
+	return NET_HARDERROR;
+    }
+    sp->result->bytes_received += r;
+    sp->result->bytes_received_this_interval += r;
+    gettimeofday(&now, NULL);
+
+    if (test->protocol->id == Pudp) {
+	/* One message per datagram. */
+	if (r >= RR_HEADER_LEN) {
+	    memcpy(rs->rx_header, sp->buffer, RR_HEADER_LEN);
+	    if (rr_message(sp, &now) < 0)
+		return NET_HARDERROR;
+	}
+    } else {
+	for (off = 0; off < r; off += take) {
+	    take = size - rs->rx_pos;
+	    if (take > r - off)
+		take = r - off;
+	    if (rs->rx_pos < RR_HEADER_LEN) {
+		hlen = RR_HEADER_LEN - rs->rx_pos;
+		memcpy(rs->rx_header + rs->rx_pos, sp->buffer + off, take < hlen ? take : hlen);
+	    }
+	    rs->rx_pos += take;
+	    if (rs->rx_pos == size) {
+		rs->rx_pos = 0;
+		if (rr_message(sp, &now) < 0)
+		    return NET_HARDERROR;
+	    }
+	}
+    }
+
+    if (test->role == 'c' && test->state == TEST_RUNNING)
+	return rr_send_requests(sp);
+    return 0;
+}
+
+/*
+ * --crr: each transaction connects, sends the cookie and one request,
+ * reads the response and closes.  The server closes first, so its side
+ * keeps the TIME_WAIT and the client's ephemeral ports come back at once.
+ */
+
+static void
+crr_close(struct iperf_test *test, struct iperf_rr_conn *c)
+{
+    FD_CLR(c->fd, &test->read_set);
+    FD_CLR(c->fd, &test->write_set);
+    close(c->fd);
+    c->fd = -1;
+}
+
+static void
+crr_close_stream(struct iperf_stream *sp)
+{
+    struct iperf_rr_stream *rs = sp->rr;
+    int i;
+
+    for (i = 0; i < sp->test->rr->outstanding; ++i)
+	if (rs->conns[i].fd >= 0) {
+	    crr_close(sp->test, &rs->conns[i]);
+	    --rs->inflight;
+	}
+}
+
+void
+iperf_rr_close_conns(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_rr_conn *c;
+
+    if (test->rr == NULL || !test->rr->crr)
+	return;
+    SLIST_FOREACH(sp, &test->streams, streams)
+	if (sp->rr != NULL && sp->rr->conns != NULL)
+	    crr_close_stream(sp);
+    while (!SLIST_EMPTY(&test->rr->conns)) {
+	c = SLIST_FIRST(&test->rr->conns);
+	SLIST_REMOVE_HEAD(&test->rr->conns, conns);
+	crr_close(test, c);
+	free(c);
+    }
+    if (test->role == 's')
+	setnonblocking(test->listener, 0);
+}
+
+/* Client: start a connection to the stream's server address. */
+static int
+crr_connect(struct iperf_stream *sp, struct iperf_rr_conn *c)
+{
+    struct iperf_test *test = sp->test;
+    struct sockaddr_storage local;
+    socklen_t len;
+    int s, opt;
+
+    len = sp->remote_addr.ss_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+    s = socket(sp->remote_addr.ss_family, SOCK_STREAM, 0);
+    if (s < 0)
+	return -1;
+    /* Cycling through ports quickly: let them be reused. */
+    opt = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (char *) &opt, sizeof(opt));
+    if (test->bind_address) {
+#if defined(IP_BIND_ADDRESS_NO_PORT)
+	/* Pick the port at connect() time, by the whole 4-tuple. */
+	setsockopt(s, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, (char *) &opt, sizeof(opt));
+#endif /* IP_BIND_ADDRESS_NO_PORT */
+	memcpy(&local, &sp->local_addr, sizeof(local));
+	if (local.ss_family == AF_INET6)
+	    ((struct sockaddr_in6 *) &local)->sin6_port = 0;
+	else
+	    ((struct sockaddr_in *) &local)->sin_port = 0;
+	if (bind(s, (struct sockaddr *) &local, len) < 0) {
+	    close(s);
+	    return -1;
+	}
+    }
+    setnonblocking(s, 1);
+    gettimeofday(&c->start, NULL);
+    if (connect(s, (struct sockaddr *) &sp->remote_addr, len) < 0 && errno != EINPROGRESS) {
+	close(s);
+	return -1;
+    }
+    c->fd = s;
+    c->connected = 0;
+    c->pos = 0;
+    c->sent = 0;
+    FD_SET(s, &test->write_set);
+    if (s > test->max_fd)
+	test->max_fd = s;
+    return 0;
+}
+
+/* Client: open connections until `outstanding` are in flight. */
+static int
+crr_open(struct iperf_stream *sp)
+{
+    struct iperf_test *test = sp->test;
+    struct iperf_rr_stream *rs = sp->rr;
+    int i;
+
+    for (i = 0; i < test->rr->outstanding; ++i) {
+	if (rs->conns[i].fd >= 0)
+	    continue;
+	if (sp->paused || test->done || test->state != TEST_RUNNING)
+	    break;
+	if (test->settings->bytes != 0 && test->bytes_sent >= test->settings->bytes)
+	    break;
+	if (test->settings->blocks != 0 && test->blocks_sent >= test->settings->blocks)
+	    break;
+	if (crr_connect(sp, &rs->conns[i]) < 0)
+	    return -1;
+	++rs->inflight;
+	test->bytes_sent += test->rr->request_size;
+	++test->blocks_sent;
+    }
+    return 0;
+}
+
+/*
+ * Write what is left of `head` and then `body`, from c->sent on; the
+ * socket stays in write_set until all of it is out.  Returns 1 when
+ * done, 0 when the socket is full and -1 on error.
+ */
+static int
+crr_write(struct iperf_test *test, struct iperf_rr_conn *c, char *head, int hlen, char *body, int blen)
+{
+    struct iovec iov[2];
+    int n = 0, r;
+
+    if (c->sent < hlen) {
+	iov[n].iov_base = head + c->sent;
+	iov[n++].iov_len = hlen - c->sent;
+	iov[n].iov_base = body;
+	iov[n++].iov_len = blen;
+    } else {
+	iov[n].iov_base = body + (c->sent - hlen);
+	iov[n++].iov_len = blen - (c->sent - hlen);
+    }
+    r = writev(c->fd, iov, n);
+    if (r < 0) {
+	if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)
+	    return -1;
+	r = 0;
+    }
+    c->sent += r;
+    if (c->sent < hlen + blen) {
+	FD_SET(c->fd, &test->write_set);
+	return 0;
+    }
+    FD_CLR(c->fd, &test->write_set);
+    return 1;
+}
+
+/* Client: send the cookie and the request, or the rest of them. */
+static int
+crr_send(struct iperf_stream *sp, struct iperf_rr_conn *c)
+{
+    struct iperf_test *test = sp->test;
+    int r;
+
+    /* The message is shared by the connections; the header is the connection's own. */
+    r = crr_write(test, c, c->head, sizeof(c->head), sp->rr->message + RR_HEADER_LEN, test->rr->request_size - RR_HEADER_LEN);
+    if (r <= 0)
+	return r;
+    sp->result->bytes_sent += test->rr->request_size;
+    sp->result->bytes_sent_this_interval += test->rr->request_size;
+    FD_SET(c->fd, &test->read_set);
+    return 0;
+}
+
+/* Client: the connection is up; time it and send the request. */
+static int
+crr_connected(struct iperf_stream *sp, struct iperf_rr_conn *c)
+{
+    struct iperf_test *test = sp->test;
+    struct iperf_rr_stream *rs = sp->rr;
+    struct timeval now;
+    uint32_t hdr[3];
+    int64_t latency;
+    int err;
+    socklen_t len;
+
+    len = sizeof(err);
+    if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, (char *) &err, &len) < 0)
+	return -1;
+    if (err != 0) {
+	errno = err;
+	return -1;
+    }
+    gettimeofday(&now, NULL);
+    latency = (int64_t) (now.tv_sec - c->start.tv_sec) * 1000000 + (now.tv_usec - c->start.tv_usec);
+    histogram_add(rs->interval, latency > 0 ? latency : 0);
+    c->connected = 1;
+
+    /* The stream id tells the server which stream to count this against. */
+    hdr[0] = htonl(now.tv_sec);
+    hdr[1] = htonl(now.tv_usec);
+    hdr[2] = htonl(sp->id);
+    memcpy(c->head, test->cookie, COOKIE_SIZE);
+    memcpy(c->head + COOKIE_SIZE, hdr, RR_HEADER_LEN);
+    return crr_send(sp, c);
+}
+
+/* Client: read the response, then wait for the server to close. */
+static int
+crr_response(struct iperf_stream *sp, struct iperf_rr_conn *c)
+{
+    struct iperf_test *test = sp->test;
+    struct iperf_rr_stream *rs = sp->rr;
+    int r;
+
+    r = read(c->fd, sp->buffer, sp->buffer_size);
+    if (r < 0) {
+	if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+	    return 0;
+	return -1;
+    }
+    if (r > 0) {
+	c->pos += r;
+	sp->result->bytes_received += r;
+	sp->result->bytes_received_this_interval += r;
+	return 0;
+    }
+    if (c->pos < test->rr->response_size)
+	return -1;
+    ++rs->interval_transactions;
+    --rs->inflight;
+    crr_close(test, c);
+    return 0;
+}
+
+static int
+crr_client_io(struct iperf_test *test, fd_set *read_setP, fd_set *write_setP)
+{
+    struct iperf_stream *sp;
+    struct iperf_rr_conn *c;
+    int i;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	for (i = 0; i < test->rr->outstanding; ++i) {
+	    c = &sp->rr->conns[i];
+	    if (c->fd < 0)
+		continue;
+	    if (!c->connected && FD_ISSET(c->fd, write_setP)) {
+		if (crr_connected(sp, c) < 0) {
+		    i_errno = IESTREAMCONNECT;
+		    return -1;
+		}
+	    } else if (c->connected && FD_ISSET(c->fd, write_setP)) {
+		if (crr_send(sp, c) < 0) {
+		    i_errno = IESTREAMWRITE;
+		    return -1;
+		}
+	    } else if (c->connected && FD_ISSET(c->fd, read_setP)) {
+		if (crr_response(sp, c) < 0) {
+		    i_errno = IESTREAMREAD;
+		    return -1;
+		}
+	    }
+	}
+    }
+    return 0;
+}
+
+void
+iperf_rr_listen(struct iperf_test *test)
+{
+    /* The control connection's backlog of 5 would drop SYNs. */
+    listen(test->listener, SOMAXCONN);
+    setnonblocking(test->listener, 1);
+}
+
+/* Server: take the new connections waiting on the listener. */
+static int
+crr_accept(struct iperf_test *test)
+{
+    struct iperf_rr_conn *c;
+    int s;
+
+    for (;;) {
+	if ((s = accept(test->listener, NULL, NULL)) < 0) {
+	    if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED)
+		return 0;
+	    return -1;
+	}
+	c = (struct iperf_rr_conn *) calloc(1, sizeof(struct iperf_rr_conn));
+	if (c == NULL) {
+	    close(s);
+	    return -1;
+	}
+	c->fd = s;
+	setnonblocking(s, 1);
+	SLIST_INSERT_HEAD(&test->rr->conns, c, conns);
+	FD_SET(s, &test->read_set);
+	if (s > test->max_fd)
+	    test->max_fd = s;
+    }
+}
+
+/*
+ * Server: send the response, or the rest of it.  Returns 1 when the
+ * connection is finished with.
+ */
+static int
+crr_answer(struct iperf_test *test, struct iperf_rr_conn *c)
+{
+    struct iperf_stream *sp = c->sp;
+    int r;
+
+    r = crr_write(test, c, c->head + COOKIE_SIZE, RR_HEADER_LEN, sp->rr->message + RR_HEADER_LEN, test->rr->response_size - RR_HEADER_LEN);
+    if (r == 0)
+	return 0;
+    if (r > 0) {
+	sp->result->bytes_sent += test->rr->response_size;
+	sp->result->bytes_sent_this_interval += test->rr->response_size;
+	++sp->rr->interval_transactions;
+    }
+    return 1;
+}
+
+/*
+ * Server: read the cookie and the request, then answer.
+ * Returns 1 when the connection is finished with.
+ */
+static int
+crr_request(struct iperf_test *test, struct iperf_rr_conn *c)
+{
+    struct iperf_stream *sp;
+    int size = COOKIE_SIZE + test->rr->request_size;
+    char buf[8192];
+    uint32_t hdr[3];
+    int r, want, hlen;
+
+    want = size - c->pos;
+    if (want > (int) sizeof(buf))
+	want = sizeof(buf);
+    r = read(c->fd, buf, want);
+    if (r < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+	return 0;
+    if (r <= 0)
+	return 1;	/* the client gave up, e.g. at the end of the test */
+    hlen = (int) sizeof(c->head) - c->pos;
+    if (hlen > 0)
+	memcpy(c->head + c->pos, buf, r < hlen ? r : hlen);
+    c->pos += r;
+    if (c->pos < size)
+	return 0;
+
+    if (strncmp(c->head, test->cookie, COOKIE_SIZE) != 0)
+	return 1;
+    memcpy(hdr, c->head + COOKIE_SIZE, RR_HEADER_LEN);
+    SLIST_FOREACH(sp, &test->streams, streams)
+	if (sp->id == (int) ntohl(hdr[2]))
+	    break;
+    if (sp == NULL)
+	return 1;
+    sp->result->bytes_received += test->rr->request_size;
+    sp->result->bytes_received_this_interval += test->rr->request_size;
+    /* Nothing more to read: the client waits for the response. */
+    FD_CLR(c->fd, &test->read_set);
+    c->sp = sp;
+    return crr_answer(test, c);
+}
+
+static int
+crr_server_io(struct iperf_test *test, fd_set *read_setP, fd_set *write_setP)
+{
+    struct iperf_rr_conn *c, *next;
+    int done;
+
+    for (c = SLIST_FIRST(&test->rr->conns); c != NULL; c = next) {
+	next = SLIST_NEXT(c, conns);
+	if (c->sp != NULL)
+	    done = FD_ISSET(c->fd, write_setP) && crr_answer(test, c);
+	else
+	    done = FD_ISSET(c->fd, read_setP) && crr_request(test, c);
+	if (done) {
+	    SLIST_REMOVE(&test->rr->conns, c, iperf_rr_conn, conns);
+	    crr_close(test, c);
+	    free(c);
+	}
+    }
+    if (FD_ISSET(test->listener, read_setP) && crr_accept(test) < 0) {
+	i_errno = IESTREAMACCEPT;
+	return -1;
+    }
+    return 0;
+}
+
+int
+iperf_rr_io(struct iperf_test *test, fd_set *read_setP, fd_set *write_setP)
+{
+    struct iperf_stream *sp;
+
+    if (test->rr->crr)
+	return test->role == 'c' ? crr_client_io(test, read_setP, write_setP) : crr_server_io(test, read_setP, write_setP);
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (FD_ISSET(sp->socket, read_setP)) {
+	    if (rr_read(sp) < 0) {
+		i_errno = IESTREAMREAD;
+		return -1;
+	    }
+	}
+	/* The rest of a message that didn't fit in the socket. */
+	if (sp->rr->tx_len != 0 && FD_ISSET(sp->socket, write_setP)) {
+	    if ((test->role == 'c' ? rr_send_requests(sp) : rr_send_responses(sp)) < 0) {
+		i_errno = IESTREAMWRITE;
+		return -1;
+	    }
+	}
+    }
+    return 0;
+}
+
+int
+iperf_rr_fill(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_rr_stream *rs;
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	rs = sp->rr;
+	if (test->rr->crr) {
+	    if (crr_open(sp) < 0) {
+		i_errno = IESTREAMCONNECT;
+		return -1;
+	    }
+	    continue;
+	}
+	if (test->protocol->id == Pudp && rs->inflight > 0 &&
+	    timeval_diff(&rs->last_progress, &now) > RR_UDP_TIMEOUT) {
+	    rs->lost += rs->inflight;
+	    rs->inflight = 0;
+	}
+	if (rr_send_requests(sp) < 0) {
+	    i_errno = IESTREAMWRITE;
+	    return -1;
+	}
+    }
+    return 0;
+}
+
+int
+iperf_rr_idle(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+
+    SLIST_FOREACH(sp, &test->streams, streams)
+	if (sp->rr->inflight > 0)
+	    return 0;
+    return 1;
+}
+
+/* Called for each stream by the stats callback. */
+void
+iperf_rr_stats(struct iperf_stream *sp, struct iperf_interval_results *irp)
+{
+    struct iperf_rr *rr = sp->test->rr;
+    struct iperf_rr_stream *rs = sp->rr;
+
+    irp->interval_transactions = rs->interval_transactions;
+    irp->latency_mean = histogram_mean(rs->interval);
+    irp->latency_p50 = histogram_quantile(rs->interval, 0.5);
+    irp->latency_p99 = histogram_quantile(rs->interval, 0.99);
+    irp->latency_max = rs->interval->max;
+    histogram_merge(rr->interval, rs->interval);
+    if (!irp->omitted) {
+	rs->transactions += rs->interval_transactions;
+	histogram_merge(rs->latency, rs->interval);
+	histogram_merge(rr->total, rs->interval);
+    }
+    histogram_reset(rs->interval);
+    rs->interval_transactions = 0;
+}
+
+/*
+ * One line of a report.  Only the client times transactions, so the
+ * server reports their rate alone.  socket < 0 is the sum of all streams.
+ * With --crr a transaction is a connection, and its latency the connect.
+ */
+static void
+rr_report(struct iperf_test *test, cJSON *json, const char *name, int socket, double start, double end, double seconds, iperf_size_t transactions, double mean, uint64_t p50, uint64_t p99, uint64_t max, int omitted)
+{
+    double rate = seconds > 0.0 ? transactions / seconds : 0.0;
+    cJSON *j;
+
+    if (test->json_output) {
+	if (test->rr->crr && test->role == 'c')
+	    j = iperf_json_printf("start: %f  end: %f  seconds: %f  connections: %d  connections_per_second: %f  connect_mean_us: %f  connect_p50_us: %d  connect_p99_us: %d  connect_max_us: %d  omitted: %b", start, end, seconds, (int64_t) transactions, rate, mean, (int64_t) p50, (int64_t) p99, (int64_t) max, omitted);
+	else if (test->rr->crr)
+	    j = iperf_json_printf("start: %f  end: %f  seconds: %f  connections: %d  connections_per_second: %f  omitted: %b", start, end, seconds, (int64_t) transactions, rate, omitted);
+	else if (test->role == 'c')
+	    j = iperf_json_printf("start: %f  end: %f  seconds: %f  transactions: %d  transactions_per_second: %f  latency_mean_us: %f  latency_p50_us: %d  latency_p99_us: %d  latency_max_us: %d  omitted: %b", start, end, seconds, (int64_t) transactions, rate, mean, (int64_t) p50, (int64_t) p99, (int64_t) max, omitted);
+	else
+	    j = iperf_json_printf("start: %f  end: %f  seconds: %f  transactions: %d  transactions_per_second: %f  omitted: %b", start, end, seconds, (int64_t) transactions, rate, omitted);
+	if (j == NULL)
+	    return;
+	if (socket >= 0)
+	    cJSON_AddIntToObject(j, "socket", socket);
+	if (name != NULL)
+	    cJSON_AddItemToObject(json, name, j);
+	else
+	    cJSON_AddItemToArray(json, j);
+	return;
+    }
+    if (test->role == 'c') {
+	if (socket >= 0)
+	    iprintf(test, report_rr_format, socket, start, end, (unsigned long long) transactions, rate, mean / 1000.0, p50 / 1000.0, p99 / 1000.0, max / 1000.0, omitted ? report_omitted : "");
+	else
+	    iprintf(test, report_sum_rr_format, start, end, (unsigned long long) transactions, rate, mean / 1000.0, p50 / 1000.0, p99 / 1000.0, max / 1000.0, omitted ? report_omitted : "");
+    } else {
+	if (socket >= 0)
+	    iprintf(test, report_rr_server_format, socket, start, end, (unsigned long long) transactions, rate, omitted ? report_omitted : "");
+	else
+	    iprintf(test, report_sum_rr_server_format, start, end, (unsigned long long) transactions, rate, omitted ? report_omitted : "");
+    }
+}
+
+static const char *
+rr_header(struct iperf_test *test)
+{
+    if (test->rr->crr)
+	return test->role == 'c' ? report_crr_header : report_crr_server_header;
+    return test->role == 'c' ? report_rr_header : report_rr_server_header;
+}
+
+void
+iperf_rr_print_intermediate(struct iperf_test *test, cJSON *json_interval, cJSON *json_interval_streams)
+{
+    struct iperf_stream *sp;
+    struct iperf_interval_results *irp = NULL;
+    iperf_size_t transactions = 0;
+    double st, et;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	irp = TAILQ_LAST(&sp->result->interval_results, irlisthead);
+	if (irp == NULL) {
+	    iperf_err(test, "iperf_rr_print_intermediate error: interval_results is NULL");
+	    return;
+	}
+	st = iperf_interval_time(sp, &irp->interval_start_time);
+	et = iperf_interval_time(sp, &irp->interval_end_time);
+	if (!test->json_output && sp == SLIST_FIRST(&test->streams)) {
+	    if (timeval_equals(&sp->result->start_time, &irp->interval_start_time))
+		iprintf(test, "%s", rr_header(test));
+	    else if (test->num_streams > 1)
+		iprintf(test, "%s", report_bw_separator);
+	}
+	rr_report(test, json_interval_streams, NULL, sp->socket, st, et, irp->interval_duration, irp->interval_transactions, irp->latency_mean, irp->latency_p50, irp->latency_p99, irp->latency_max, irp->omitted);
+	transactions += irp->interval_transactions;
+    }
+
+    if ((test->num_streams > 1 || test->json_output) && irp != NULL) {
+	sp = SLIST_FIRST(&test->streams);
+	irp = TAILQ_LAST(&sp->result->interval_results, irlisthead);
+	st = iperf_interval_time(sp, &irp->interval_start_time);
+	et = iperf_interval_time(sp, &irp->interval_end_time);
+	rr_report(test, json_interval, "sum", -1, st, et, irp->interval_duration, transactions, histogram_mean(test->rr->interval), histogram_quantile(test->rr->interval, 0.5), histogram_quantile(test->rr->interval, 0.99), test->rr->interval->max, irp->omitted);
+    }
+}
+
+void
+iperf_rr_print_results(struct iperf_test *test, cJSON *json_summary_streams)
+{
+    struct iperf_stream *sp;
+    struct iperf_rr_stream *rs;
+    iperf_size_t transactions = 0;
+    double end_time = 0.0;
+    cJSON *json_summary_stream;
+
+    if (!test->json_output)
+	iprintf(test, "%s", rr_header(test));
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	rs = sp->rr;
+	end_time = timeval_diff(&sp->result->start_time, &sp->result->end_time);
+	json_summary_stream = NULL;
+	if (test->json_output) {
+	    json_summary_stream = cJSON_CreateObject();
+	    if (json_summary_stream == NULL)
+		return;
+	    cJSON_AddItemToArray(json_summary_streams, json_summary_stream);
+	}
+	rr_report(test, json_summary_stream, "rr", sp->socket, 0.0, end_time, end_time, rs->transactions, histogram_mean(rs->latency), histogram_quantile(rs->latency, 0.5), histogram_quantile(rs->latency, 0.99), rs->latency->max, 0);
+	if (test->role == 'c' && test->protocol->id == Pudp) {
+	    if (test->json_output)
+		cJSON_AddIntToObject(cJSON_GetObjectItem(json_summary_stream, "rr"), "lost", rs->lost);
+	    else if (rs->lost > 0)
+		iprintf(test, report_rr_lost, sp->socket, (unsigned long long) rs->lost);
+	}
+	transactions += rs->transactions;
+    }
+    if (test->num_streams > 1 || test->json_output)
+	rr_report(test, test->json_end, "sum_rr", -1, 0.0, end_time, end_time, transactions, histogram_mean(test->rr->total), histogram_quantile(test->rr->total, 0.5), histogram_quantile(test->rr->total, 0.99), test->rr->total->max, 0);
+}
@@ -0,0 +1,89 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_RR_H
+#define __IPERF_RR_H
+
+/*
+ * Request/response (--rr) mode: the client keeps up to `outstanding`
+ * fixed-size requests in flight on each stream and the server answers
+ * every request with a fixed-size response, echoing the request's
+ * header so the client can time the transaction.
+ *
+ * With --crr every transaction has a TCP connection of its own, and
+ * the streams of the test only carry the stream ids; `outstanding` is
+ * then the number of connections each stream keeps open.
+ */
+
+struct iperf_rr *iperf_rr_new(int request_size, int response_size, int outstanding, int crr);
+
+void iperf_rr_free(struct iperf_rr *rr);
+
+int iperf_rr_init_stream(struct iperf_stream *sp);
+
+void iperf_rr_free_stream(struct iperf_stream *sp);
+
+/**
+ * iperf_rr_io -- read the streams that are ready; the server responds
+ * to complete requests, the client times complete responses and sends
+ * new requests.  With --crr the server also accepts new connections
+ * and the client completes its connects.
+ *
+ * returns 0 on success, -1 on error with i_errno set
+ */
+int iperf_rr_io(struct iperf_test *test, fd_set *read_setP, fd_set *write_setP);
+
+/**
+ * iperf_rr_fill -- (client) give up on lost UDP requests and send
+ * requests (or open --crr connections) until each stream has
+ * `outstanding` in flight.
+ */
+int iperf_rr_fill(struct iperf_test *test);
+
+/**
+ * iperf_rr_idle -- 1 once every request sent has been answered or
+ * given up on, so a -n/-k test ends with complete transactions.
+ */
+int iperf_rr_idle(struct iperf_test *test);
+
+/**
+ * iperf_rr_listen -- (server) ready the listener for --crr connections.
+ */
+void iperf_rr_listen(struct iperf_test *test);
+
+/**
+ * iperf_rr_close_conns -- drop the --crr connections still open at the
+ * end of the test.
+ */
+void iperf_rr_close_conns(struct iperf_test *test);
+
+void iperf_rr_stats(struct iperf_stream *sp, struct iperf_interval_results *irp);
+
+void iperf_rr_print_intermediate(struct iperf_test *test, cJSON *json_interval, cJSON *json_interval_streams);
+
+void iperf_rr_print_results(struct iperf_test *test, cJSON *json_summary_streams);
+
+#endif
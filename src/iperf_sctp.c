@@ -46,6 +46,7 @@
 #include "iperf.h"
 #include "iperf_api.h"
 #include "iperf_sctp.h"
+#include "iperf_verify.h"
 #include "net.h"
 
 
@@ -64,6 +65,9 @@ iperf_sctp_recv(struct iperf_stream *sp)
     if (r < 0)
         return r;
 
+    if (sp->verify)
+	iperf_verify_recv(sp, sp->buffer, r);
+
     sp->result->bytes_received += r;
     sp->result->bytes_received_this_interval += r;
 
@@ -84,11 +88,19 @@ iperf_sctp_send(struct iperf_stream *sp)
 {
 #if defined(HAVE_SCTP)
     int r;
+    int size = sp->send_size ? sp->send_size : sp->settings->blksize;
+    char *buf = sp->buffer;
+
+    if (sp->verify)
+	buf = iperf_verify_send_buffer(sp, &size);
 
-    r = Nwrite(sp->socket, sp->buffer, sp->settings->blksize, Psctp);
+    r = Nwrite(sp->socket, buf, size, Psctp);
     if (r < 0)
         return r;    
 
+    if (sp->verify)
+	iperf_verify_sent(sp, r);
+
     sp->result->bytes_sent += r;
     sp->result->bytes_sent_this_interval += r;
 
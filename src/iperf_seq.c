@@ -0,0 +1,416 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_locale.h"
+#include "iperf_util.h"
+#include "iperf_seq.h"
+
+static const char *burst_bucket[SEQ_BURST_BUCKETS] = {
+    "1", "2", "3-4", "5-8", "9-16", "17-32", "33-64", "65+"
+};
+
+/* Trailing zero bits of a nonzero word. */
+static inline int
+seq_ctz(uint64_t x)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+
+    while (!(x & 1)) {
+	x >>= 1;
+	++n;
+    }
+    return n;
+#endif
+}
+
+int
+iperf_seq_init_stream(struct iperf_stream *sp)
+{
+    struct iperf_seq_stream *sq;
+
+    sq = (struct iperf_seq_stream *) calloc(1, sizeof(struct iperf_seq_stream));
+    if (sq == NULL) {
+	i_errno = IECREATESTREAM;
+	return -1;
+    }
+    if ((sq->extent = histogram_new()) == NULL) {
+	free(sq);
+	i_errno = IECREATESTREAM;
+	return -1;
+    }
+    /* Numbering starts at 1: there is no datagram 0 to lose. */
+    sq->received[0] = 1;
+    sq->next = 1;
+    sp->seq = sq;
+    return 0;
+}
+
+void
+iperf_seq_free_stream(struct iperf_stream *sp)
+{
+    if (sp->seq == NULL)
+	return;
+    histogram_free(sp->seq->extent);
+    free(sp->seq);
+    sp->seq = NULL;
+}
+
+static void
+seq_end_burst(struct iperf_seq_stream *sq)
+{
+    uint64_t v;
+    int b = 0;
+
+    if (sq->run == 0)
+	return;
+    sq->lost += sq->run;
+    ++sq->bursts;
+    if (sq->run > sq->burst_max)
+	sq->burst_max = sq->run;
+    for (v = sq->run - 1; v != 0 && b < SEQ_BURST_BUCKETS - 1; v >>= 1)
+	++b;
+    ++sq->burst_lengths[b];
+    sq->run = 0;
+}
+
+/* The oldest 64 numbers leave the window: whatever didn't arrive is lost. */
+static void
+seq_settle_word(struct iperf_seq_stream *sq)
+{
+    int w = (sq->settled / 64) % SEQ_WORDS;
+    uint64_t got = sq->received[w], rest;
+    int bit = 0, n;
+
+    while (bit < 64) {
+	rest = got >> bit;
+	if (rest & 1) {
+	    seq_end_burst(sq);
+	    n = ~rest ? seq_ctz(~rest) : 64;
+	} else {
+	    n = rest ? seq_ctz(rest) : 64 - bit;
+	    sq->run += n;
+	}
+	bit += n;
+    }
+    sq->received[w] = sq->advanced[w] = 0;
+    sq->settled += 64;
+}
+
+static void
+seq_settle_to(struct iperf_seq_stream *sq, uint64_t target)
+{
+    int i;
+
+    /* Past the whole window: the rest of the gap never arrived either. */
+    if (target - sq->settled > SEQ_WINDOW) {
+	for (i = 0; i < SEQ_WORDS; ++i)
+	    seq_settle_word(sq);
+	sq->run += target - sq->settled;
+	sq->settled = target;
+	return;
+    }
+    while (sq->settled < target)
+	seq_settle_word(sq);
+}
+
+/*
+ * When the first datagram numbered past pcount arrived.  That one was
+ * the highest yet when it came, and the lowest of those past pcount.
+ */
+static uint64_t
+seq_first_past(struct iperf_seq_stream *sq, uint64_t pcount)
+{
+    uint64_t base = pcount & ~(uint64_t) 63, mask;
+    int b = pcount % 64, i;
+
+    mask = b == 63 ? 0 : sq->advanced[(base / 64) % SEQ_WORDS] & (~(uint64_t) 0 << (b + 1));
+    for (i = 0; i < SEQ_WORDS; ++i) {
+	if (mask)
+	    return sq->arrival[(base + seq_ctz(mask)) % SEQ_WINDOW];
+	base += 64;
+	mask = sq->advanced[(base / 64) % SEQ_WORDS];
+    }
+    return sq->arrivals;	/* not reached: next - 1 is past pcount */
+}
+
+/* Keep the first anomaly of the interval, for its summary. */
+static inline void
+seq_event(struct iperf_seq_stream *sq, uint64_t pcount)
+{
+    if (sq->event)
+	return;
+    sq->event = 1;
+    sq->event_pcount = pcount;
+    sq->event_highest = sq->next - 1;
+}
+
+int
+iperf_seq_packet(struct iperf_stream *sp, uint64_t pcount)
+{
+    struct iperf_seq_stream *sq = sp->seq;
+    uint64_t bit = (uint64_t) 1 << (pcount % 64), top, d;
+    int w = (pcount / 64) % SEQ_WORDS;
+
+    if (sq->finished)
+	return 0;
+    ++sq->arrivals;
+
+    if (pcount >= sq->next) {
+	/* The word this number goes in must be clear of older numbers. */
+	top = (pcount & ~(uint64_t) 63) + 64;
+	if (top > sq->settled + SEQ_WINDOW)
+	    seq_settle_to(sq, top - SEQ_WINDOW);
+	if (pcount > sq->next)
+	    sp->cnt_error += pcount - sq->next;
+	sq->received[w] |= bit;
+	sq->advanced[w] |= bit;
+	sq->arrival[pcount % SEQ_WINDOW] = sq->arrivals;
+	sq->next = pcount + 1;
+	sp->packet_count = pcount;
+	return 1;
+    }
+
+    seq_event(sq, pcount);
+    if (pcount < sq->settled) {
+	++sq->late;
+	++sq->interval_late;
+	return 0;
+    }
+    if (sq->received[w] & bit) {
+	++sq->duplicates;
+	++sq->interval_duplicates;
+	return 0;
+    }
+
+    /* It fills a gap: counted as lost so far, it was only late. */
+    sq->received[w] |= bit;
+    --sp->cnt_error;
+    ++sp->outoforder_packets;
+    ++sq->reordered;
+    histogram_add(sq->extent, sq->arrivals - seq_first_past(sq, pcount));
+    d = sq->next - 1 - pcount;
+    sq->displacement_sum += d;
+    if (d > sq->displacement_max)
+	sq->displacement_max = d;
+    return 1;
+}
+
+void
+iperf_seq_stats(struct iperf_stream *sp, struct iperf_interval_results *irp)
+{
+    struct iperf_seq_stream *sq = sp->seq;
+
+    irp->interval_duplicates = sq->interval_duplicates;
+    irp->interval_late = sq->interval_late;
+    irp->seq_event = sq->event;
+    irp->event_pcount = sq->event_pcount;
+    irp->event_highest = sq->event_highest;
+    sq->interval_duplicates = sq->interval_late = 0;
+    sq->event = 0;
+}
+
+void
+iperf_seq_print_interval(struct iperf_stream *sp, struct iperf_interval_results *irp, double st, double et, cJSON *json_interval_streams)
+{
+    cJSON *j;
+
+    if (sp->sender)
+	return;
+    if (json_interval_streams != NULL) {
+	j = cJSON_GetArrayItem(json_interval_streams, cJSON_GetArraySize(json_interval_streams) - 1);
+	if (j != NULL) {
+	    cJSON_AddIntToObject(j, "out_of_order", irp->interval_outoforder_packets);
+	    cJSON_AddIntToObject(j, "duplicates", irp->interval_duplicates);
+	    cJSON_AddIntToObject(j, "late", irp->interval_late);
+	}
+    } else if (irp->seq_event)
+	iprintf(sp->test, report_seq_interval, sp->socket, st, et, irp->interval_outoforder_packets, (unsigned long long) irp->interval_duplicates, (unsigned long long) irp->interval_late, (unsigned long long) irp->event_pcount, (unsigned long long) irp->event_highest);
+}
+
+void
+iperf_seq_reset(struct iperf_stream *sp)
+{
+    struct iperf_seq_stream *sq = sp->seq;
+
+    sq->lost = sq->bursts = sq->burst_max = 0;
+    memset(sq->burst_lengths, 0, sizeof(sq->burst_lengths));
+    sq->reordered = sq->duplicates = sq->late = 0;
+    sq->displacement_sum = 0;
+    sq->displacement_max = 0;
+    sq->interval_duplicates = sq->interval_late = 0;
+    sq->event = 0;
+    histogram_reset(sq->extent);
+}
+
+/* Receiver, at the end: settle what is left in the window. */
+static void
+seq_finish(struct iperf_seq_stream *sq)
+{
+    if (sq->finished)
+	return;
+    sq->finished = 1;
+    /* Nothing past the highest number was sent, as far as we know. */
+    if (sq->next % 64)
+	sq->received[(sq->next / 64) % SEQ_WORDS] |= ~(uint64_t) 0 << (sq->next % 64);
+    seq_settle_to(sq, (sq->next + 63) & ~(uint64_t) 63);
+    seq_end_burst(sq);
+
+    sq->extent_mean = histogram_mean(sq->extent);
+    sq->extent_p99 = histogram_quantile(sq->extent, 0.99);
+    sq->extent_max = sq->extent->max;
+    sq->displacement_mean = sq->reordered ? sq->displacement_sum / sq->reordered : 0.0;
+}
+
+cJSON *
+iperf_seq_to_json(struct iperf_stream *sp)
+{
+    struct iperf_seq_stream *sq = sp->seq;
+    cJSON *j, *j_lengths;
+    int i;
+
+    seq_finish(sq);
+    j = iperf_json_printf("lost: %d  bursts: %d  burst_max: %d  reordered: %d  extent_mean: %f  extent_p99: %d  extent_max: %d  displacement_mean: %f  displacement_max: %d  duplicates: %d  late: %d", (int64_t) sq->lost, (int64_t) sq->bursts, (int64_t) sq->burst_max, (int64_t) sq->reordered, sq->extent_mean, (int64_t) sq->extent_p99, (int64_t) sq->extent_max, sq->displacement_mean, (int64_t) sq->displacement_max, (int64_t) sq->duplicates, (int64_t) sq->late);
+    if (j == NULL)
+	return NULL;
+    j_lengths = cJSON_CreateArray();
+    if (j_lengths != NULL) {
+	for (i = 0; i < SEQ_BURST_BUCKETS; ++i)
+	    cJSON_AddItemToArray(j_lengths, cJSON_CreateInt(sq->burst_lengths[i]));
+	cJSON_AddItemToObject(j, "burst_lengths", j_lengths);
+    }
+    return j;
+}
+
+void
+iperf_seq_from_json(struct iperf_stream *sp, cJSON *j)
+{
+    struct iperf_seq_stream *sq = sp->seq;
+    cJSON *j_p;
+    int i, n;
+
+    if ((j_p = cJSON_GetObjectItem(j, "lost")) != NULL)
+	sq->lost = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "bursts")) != NULL)
+	sq->bursts = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "burst_max")) != NULL)
+	sq->burst_max = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "reordered")) != NULL)
+	sq->reordered = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "extent_mean")) != NULL)
+	sq->extent_mean = j_p->valuefloat;
+    if ((j_p = cJSON_GetObjectItem(j, "extent_p99")) != NULL)
+	sq->extent_p99 = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "extent_max")) != NULL)
+	sq->extent_max = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "displacement_mean")) != NULL)
+	sq->displacement_mean = j_p->valuefloat;
+    if ((j_p = cJSON_GetObjectItem(j, "displacement_max")) != NULL)
+	sq->displacement_max = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "duplicates")) != NULL)
+	sq->duplicates = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "late")) != NULL)
+	sq->late = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "burst_lengths")) != NULL) {
+	n = cJSON_GetArraySize(j_p);
+	for (i = 0; i < n && i < SEQ_BURST_BUCKETS; ++i)
+	    sq->burst_lengths[i] = cJSON_GetArrayItem(j_p, i)->valueint;
+    }
+    sq->finished = 1;
+}
+
+void
+iperf_seq_print_results(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_seq_stream *sq;
+    cJSON *json_seq = NULL, *j, *j_lengths;
+    char buf[256];
+    int header = 0, i, len;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	sq = sp->seq;
+	if (sq == NULL)
+	    continue;
+	/* The sender shows what its receiver counted, once it has it, as the receiver's. */
+	if (!sp->sender)
+	    seq_finish(sq);
+	else if (!sq->finished)
+	    continue;
+
+	if (test->json_output) {
+	    if (json_seq == NULL) {
+		json_seq = cJSON_CreateArray();
+		if (json_seq == NULL)
+		    return;
+		cJSON_AddItemToObject(test->json_end, "sequence", json_seq);
+	    }
+	    j = iperf_json_printf("socket: %d  sender: %b  lost: %d  loss_bursts: %d  burst_mean: %f  burst_max: %d  reordered: %d  extent_mean: %f  extent_p99: %d  extent_max: %d  displacement_mean: %f  displacement_max: %d  duplicates: %d  late: %d", (int64_t) sp->socket, sp->sender, (int64_t) sq->lost, (int64_t) sq->bursts, sq->bursts ? (double) sq->lost / sq->bursts : 0.0, (int64_t) sq->burst_max, (int64_t) sq->reordered, sq->extent_mean, (int64_t) sq->extent_p99, (int64_t) sq->extent_max, sq->displacement_mean, (int64_t) sq->displacement_max, (int64_t) sq->duplicates, (int64_t) sq->late);
+	    if (j == NULL)
+		continue;
+	    j_lengths = cJSON_CreateObject();
+	    if (j_lengths != NULL) {
+		for (i = 0; i < SEQ_BURST_BUCKETS; ++i)
+		    cJSON_AddIntToObject(j_lengths, burst_bucket[i], sq->burst_lengths[i]);
+		cJSON_AddItemToObject(j, "burst_lengths", j_lengths);
+	    }
+	    cJSON_AddItemToArray(json_seq, j);
+	    continue;
+	}
+
+	/* The table is detail; -V asks for it.  Nothing worth a line when
+	 * every datagram came once and in order. */
+	if (!test->verbose)
+	    continue;
+	if (sq->lost == 0 && sq->reordered == 0 && sq->duplicates == 0 && sq->late == 0)
+	    continue;
+	if (!header) {
+	    iprintf(test, "%s", report_seq_header);
+	    header = 1;
+	}
+	iprintf(test, report_seq_format, sp->socket, (unsigned long long) sq->lost, (unsigned long long) sq->bursts, (unsigned long long) sq->burst_max, (unsigned long long) sq->reordered, sq->extent_mean, (unsigned long long) sq->extent_max, sq->displacement_mean, (unsigned long long) sq->displacement_max, (unsigned long long) sq->duplicates, (unsigned long long) sq->late, report_receiver);
+	if (sq->bursts > 0) {
+	    len = 0;
+	    for (i = 0; i < SEQ_BURST_BUCKETS && len < (int) sizeof(buf); ++i)
+		if (sq->burst_lengths[i] > 0)
+		    len += snprintf(buf + len, sizeof(buf) - len, "  %s: %llu", burst_bucket[i], (unsigned long long) sq->burst_lengths[i]);
+	    iprintf(test, report_seq_bursts, sp->socket, buf);
+	}
+    }
+}
@@ -0,0 +1,71 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_SEQ_H
+#define __IPERF_SEQ_H
+
+/*
+ * UDP sequence tracking.  The receiver keeps a bitmap of the last
+ * SEQ_WINDOW datagram numbers, so that a datagram that fills a gap is
+ * counted as reordered rather than lost, a second copy as a duplicate,
+ * and only gaps that leave the window unfilled as loss.  Those are
+ * settled 64 numbers at a time, which is where the loss bursts are
+ * measured; everything is O(1) per datagram.
+ *
+ * Reordering is measured as RFC 4737 reorder extent (datagrams that
+ * arrived between the first one numbered past a reordered datagram and
+ * the datagram itself), and as its displacement (how far its number was
+ * behind the highest yet, the quantity RFC 5236 reorder density is a
+ * distribution of).
+ */
+
+int iperf_seq_init_stream(struct iperf_stream *sp);
+void iperf_seq_free_stream(struct iperf_stream *sp);
+
+/*
+ * Receiver: account for datagram number pcount.  Keeps sp->packet_count
+ * (the highest number yet), sp->cnt_error (the gaps not filled so far)
+ * and sp->outoforder_packets (the gaps that were filled) up to date.
+ * Nothing is printed here: anomalies are counted, and summed up once
+ * an interval by iperf_seq_print_interval().  Returns 1 if the datagram
+ * counts as received, 0 for a duplicate or one already given up as lost.
+ */
+int iperf_seq_packet(struct iperf_stream *sp, uint64_t pcount);
+
+/* Move this interval's counts, and its first anomaly, into its results. */
+void iperf_seq_stats(struct iperf_stream *sp, struct iperf_interval_results *irp);
+
+/* Start the counts over, at the end of the omitted seconds. */
+void iperf_seq_reset(struct iperf_stream *sp);
+
+/* Results exchange: the receiver's counts, for the sender. */
+cJSON *iperf_seq_to_json(struct iperf_stream *sp);
+void iperf_seq_from_json(struct iperf_stream *sp, cJSON *j);
+
+void iperf_seq_print_interval(struct iperf_stream *sp, struct iperf_interval_results *irp, double st, double et, cJSON *json_interval_streams);
+void iperf_seq_print_results(struct iperf_test *test);
+
+#endif
@@ -54,6 +54,11 @@
 #include "iperf_api.h"
 #include "iperf_udp.h"
 #include "iperf_tcp.h"
+#include "iperf_rr.h"
+#include "iperf_flows.h"
+#include "iperf_placement.h"
+#include "iperf_busy_poll.h"
+#include "iperf_packet.h"
 #include "iperf_util.h"
 #include "timer.h"
 #include "net.h"
@@ -153,7 +158,10 @@ iperf_accept(struct iperf_test *test)
             return -1;
         if (iperf_exchange_parameters(test) < 0)
             return -1;
-	if (test->server_affinity != -1) 
+	if (test->server_affinity == AFFINITY_AUTO || (test->server_affinity == -1 && test->affinity == AFFINITY_AUTO)) {
+	    if (iperf_placement_apply(test, test->ctrl_sck) != 0)
+		return -1;
+	} else if (test->server_affinity != -1)
 	    if (iperf_setaffinity(test, test->server_affinity) != 0)
 		return -1;
         if (test->on_connect)
@@ -180,6 +188,7 @@ iperf_handle_message_server(struct iperf_test *test)
 {
     int rval;
     struct iperf_stream *sp;
+    signed char prev_state = test->state;
 
     // XXX: Need to rethink how this behaves to fit API
     if ((rval = Nread(test->ctrl_sck, (char*) &test->state, sizeof(signed char), Ptcp)) <= 0) {
@@ -199,6 +208,8 @@ iperf_handle_message_server(struct iperf_test *test)
             break;
         case TEST_END:
 	    test->done = 1;
+	    iperf_rr_close_conns(test);
+	    iperf_flows_stop(test);
             cpu_util(test->cpu_util);
             test->stats_callback(test);
             SLIST_FOREACH(sp, &test->streams, streams) {
@@ -218,6 +229,12 @@ iperf_handle_message_server(struct iperf_test *test)
             break;
         case IPERF_DONE:
             break;
+        case PARAM_CHANGE:
+	    /* Not a state of its own, carry on with whatever we were doing. */
+	    test->state = prev_state;
+            if (iperf_handle_param_change(test) < 0)
+                return -1;
+            break;
         case CLIENT_TERMINATE:
             i_errno = IECLIENTTERM;
 
@@ -294,6 +311,7 @@ iperf_test_reset(struct iperf_test *test)
     test->bytes_sent = 0;
 
     test->reverse = 0;
+    test->bidirectional = 0;
     test->sender = 0;
     test->sender_has_retransmits = 0;
     test->no_delay = 0;
@@ -336,24 +354,25 @@ server_reporter_timer_proc(TimerClientData client_data, struct timeval *nowP)
 static int
 create_server_timers(struct iperf_test * test)
 {
-    struct timeval now;
+    struct timeval now, aligned;
     TimerClientData cd;
 
     if (gettimeofday(&now, NULL) < 0) {
 	i_errno = IEINITTEST;
 	return -1;
     }
+    iperf_align_interval(test, &now, &aligned);
     cd.p = test;
     test->stats_timer = test->reporter_timer = NULL;
     if (test->stats_interval != 0) {
-        test->stats_timer = tmr_create(&now, server_stats_timer_proc, cd, test->stats_interval * SEC_TO_US, 1);
+        test->stats_timer = tmr_create(&aligned, server_stats_timer_proc, cd, test->stats_interval * SEC_TO_US, 1);
         if (test->stats_timer == NULL) {
             i_errno = IEINITTEST;
             return -1;
 	}
     }
     if (test->reporter_interval != 0) {
-        test->reporter_timer = tmr_create(&now, server_reporter_timer_proc, cd, test->reporter_interval * SEC_TO_US, 1);
+        test->reporter_timer = tmr_create(&aligned, server_reporter_timer_proc, cd, test->reporter_interval * SEC_TO_US, 1);
         if (test->reporter_timer == NULL) {
             i_errno = IEINITTEST;
             return -1;
@@ -373,10 +392,10 @@ server_omit_timer_proc(TimerClientData client_data, struct timeval *nowP)
     if (test->verbose && !test->json_output && test->reporter_interval == 0)
 	iprintf(test, "%s", report_omit_done);
 
-    /* Reset the timers. */
-    if (test->stats_timer != NULL)
+    /* Reset the timers, unless they keep to aligned boundaries. */
+    if (test->stats_timer != NULL && !test->align_intervals)
 	tmr_reset(nowP, test->stats_timer);
-    if (test->reporter_timer != NULL)
+    if (test->reporter_timer != NULL && !test->align_intervals)
 	tmr_reset(nowP, test->reporter_timer);
 }
 
@@ -429,16 +448,108 @@ cleanup_server(struct iperf_test *test)
 }
 
 
+/*
+ * --capture: no control connection and no sockets of our own; the test
+ * is whatever UDP traffic to our port the interface carries.
+ */
+static int
+iperf_run_capture(struct iperf_test *test)
+{
+    struct timeval now;
+    struct timeval* timeout;
+
+    if (test->affinity >= 0)
+	if (iperf_setaffinity(test, test->affinity) != 0)
+	    return -1;
+
+    if (test->json_output)
+	if (iperf_json_start(test) < 0)
+	    return -1;
+
+    if (test->json_output) {
+	cJSON_AddItemToObject(test->json_start, "version", cJSON_CreateString(version));
+	cJSON_AddItemToObject(test->json_start, "system_info", cJSON_CreateString(get_system_info()));
+    } else if (test->verbose) {
+	iprintf(test, "%s\n", version);
+	iprintf(test, "%s", "");
+	iprintf(test, "%s\n", get_system_info());
+	iflush(test);
+    }
+
+    if (!test->json_output)
+	iprintf(test, "-----------------------------------------------------------\n");
+    if (iperf_capture_open(test) < 0)
+	return -1;
+    if (!test->json_output) {
+	iprintf(test, "-----------------------------------------------------------\n");
+	iflush(test);
+    }
+
+    cpu_util(NULL);
+    test->state = IPERF_START;
+
+    while (test->state != IPERF_DONE) {
+	(void) gettimeofday(&now, NULL);
+	timeout = tmr_timeout(&now);
+	if (test->state == IPERF_START)
+	    timeout = NULL;
+	if (iperf_capture_read(test, timeout) < 0) {
+	    cleanup_server(test);
+	    iperf_capture_close(test);
+	    return -1;
+	}
+
+	/* The first datagram starts the test. */
+	if (test->state == IPERF_START && !SLIST_EMPTY(&test->streams)) {
+	    test->state = TEST_START;
+	    if (iperf_init_test(test) < 0 || create_server_timers(test) < 0) {
+		cleanup_server(test);
+		iperf_capture_close(test);
+		return -1;
+	    }
+	    test->state = TEST_RUNNING;
+	}
+
+	/* Before the timers: an interval due in the quiet would be empty. */
+	(void) gettimeofday(&now, NULL);
+	if (test->state == TEST_RUNNING && iperf_capture_idle(test, &now)) {
+	    test->done = 1;
+	    cpu_util(test->cpu_util);
+	    iperf_capture_end(test);
+	    test->state = DISPLAY_RESULTS;
+	    test->reporter_callback(test);
+	    if (test->on_test_finish)
+		test->on_test_finish(test);
+	    test->state = IPERF_DONE;
+	} else
+	    tmr_run(&now);
+    }
+
+    cleanup_server(test);
+    iperf_capture_close(test);
+
+    if (test->json_output) {
+	if (iperf_json_finish(test) < 0)
+	    return -1;
+    }
+
+    iflush(test);
+    return 0;
+}
+
 int
 iperf_run_server(struct iperf_test *test)
 {
-    int result, s, streams_accepted;
+    int result, s, streams_accepted, sender;
     fd_set read_set, write_set;
     struct iperf_stream *sp;
     struct timeval now;
     struct timeval* timeout;
 
-    if (test->affinity != -1) 
+    if (test->capture != NULL)
+	return iperf_run_capture(test);
+
+    if (test->affinity >= 0)
 	if (iperf_setaffinity(test, test->affinity) != 0)
 	    return -1;
 
@@ -473,15 +584,19 @@ iperf_run_server(struct iperf_test *test)
         memcpy(&write_set, &test->write_set, sizeof(fd_set));
 
 	(void) gettimeofday(&now, NULL);
-	timeout = tmr_timeout(&now);
+	timeout = iperf_busy_poll_timeout(test, tmr_timeout(&now));
         result = select(test->max_fd + 1, &read_set, &write_set, NULL, timeout);
         if (result < 0 && errno != EINTR) {
 	    cleanup_server(test);
             i_errno = IESELECT;
             return -1;
         }
+	iperf_busy_poll_count(test, result);
+	result = iperf_busy_poll_ready(test, &read_set, result);
 	if (result > 0) {
-            if (FD_ISSET(test->listener, &read_set)) {
+            /* --crr connections are accepted by iperf_rr_io(). */
+            if (FD_ISSET(test->listener, &read_set) &&
+                !(test->state == TEST_RUNNING && test->rr && test->rr->crr)) {
                 if (test->state != CREATE_STREAMS) {
                     if (iperf_accept(test) < 0) {
 			cleanup_server(test);
@@ -506,14 +621,23 @@ iperf_run_server(struct iperf_test *test)
                         return -1;
 		    }
 
-                    if (!is_closed(s)) {
-                        sp = iperf_new_stream(test, s);
+                    if (!is_closed(s) && test->flows && streams_accepted >= test->num_streams) {
+                        /* Connections past the -P streams are --flows. */
+                        if (iperf_flows_add(test, s) < 0) {
+			    cleanup_server(test);
+                            return -1;
+			}
+                        streams_accepted++;
+                    } else if (!is_closed(s)) {
+                        /* With --bidir, the second set of streams runs the other way. */
+                        sender = streams_accepted < test->num_streams ? test->sender : !test->sender;
+                        sp = iperf_new_stream_dir(test, s, sender);
                         if (!sp) {
 			    cleanup_server(test);
                             return -1;
 			}
 
-			if (test->sender)
+			if (sender)
 			    FD_SET(s, &test->write_set);
 			else
 			    FD_SET(s, &test->read_set);
@@ -526,7 +650,7 @@ iperf_run_server(struct iperf_test *test)
 			 * maintain interactivity with the control channel.
 			 */
 			if (test->protocol->id != Pudp ||
-			    !test->sender) {
+			    !sender) {
 			    setnonblocking(s, 1);
 			}
 
@@ -537,7 +661,9 @@ iperf_run_server(struct iperf_test *test)
                     FD_CLR(test->prot_listener, &read_set);
                 }
 
-                if (streams_accepted == test->num_streams) {
+                /* UDP flows don't connect: they turn up once the test runs. */
+                if (streams_accepted == test->num_streams * (test->bidirectional ? 2 : 1) +
+                    (test->flows && test->protocol->id == Ptcp ? test->flows->nflows : 0)) {
                     if (test->protocol->id != Ptcp) {
                         FD_CLR(test->prot_listener, &test->read_set);
                         close(test->prot_listener);
@@ -556,6 +682,13 @@ iperf_run_server(struct iperf_test *test)
                         }
                     }
                     test->prot_listener = -1;
+		    if (test->rr && test->rr->crr)
+			iperf_rr_listen(test);
+		    /* Everything is connected: start both sides together at --start-at. */
+		    if (iperf_wait_start(test) < 0) {
+			cleanup_server(test);
+                        return -1;
+		    }
 		    if (iperf_set_send_state(test, TEST_START) != 0) {
 			cleanup_server(test);
                         return -1;
@@ -572,11 +705,15 @@ iperf_run_server(struct iperf_test *test)
 			cleanup_server(test);
                         return -1;
 		    }
-		    if (test->reverse)
+		    if (test->reverse || test->bidirectional)
 			if (iperf_create_send_timers(test) < 0) {
 			    cleanup_server(test);
 			    return -1;
 			}
+		    if (test->flows && iperf_flows_start(test) < 0) {
+			cleanup_server(test);
+			return -1;
+		    }
 		    if (iperf_set_send_state(test, TEST_RUNNING) != 0) {
 			cleanup_server(test);
                         return -1;
@@ -585,15 +722,28 @@ iperf_run_server(struct iperf_test *test)
             }
 
             if (test->state == TEST_RUNNING) {
-                if (test->reverse) {
-                    // Reverse mode. Server sends.
-                    if (iperf_send(test, &write_set) < 0) {
+                if (test->rr) {
+                    // Request/response mode. Server answers requests.
+                    if (iperf_rr_io(test, &read_set, &write_set) < 0) {
 			cleanup_server(test);
                         return -1;
 		    }
                 } else {
-                    // Regular mode. Server receives.
-                    if (iperf_recv(test, &read_set) < 0) {
+                    if (test->reverse || test->bidirectional) {
+                        // Reverse or bidirectional mode. Server sends.
+                        if (iperf_send(test, &write_set) < 0) {
+			    cleanup_server(test);
+                            return -1;
+		        }
+                    }
+                    if (!test->reverse || test->bidirectional) {
+                        // Regular or bidirectional mode. Server receives.
+                        if (iperf_recv(test, &read_set) < 0) {
+			    cleanup_server(test);
+                            return -1;
+		        }
+                    }
+                    if (iperf_flows_io(test, &read_set) < 0) {
 			cleanup_server(test);
                         return -1;
 		    }
@@ -618,9 +768,11 @@ iperf_run_server(struct iperf_test *test)
 
     iflush(test);
 
-    if (test->server_affinity != -1) 
+    if (test->server_affinity != -1 || test->placement != NULL) {
+	iperf_placement_free(test);
 	if (iperf_clearaffinity(test) != 0)
 	    return -1;
+    }
 
     return 0;
 }
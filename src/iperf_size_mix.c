@@ -0,0 +1,248 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_util.h"
+#include "iperf_locale.h"
+#include "iperf_size_mix.h"
+#include "units.h"
+
+/* The weights add up to at most this, to keep the table small. */
+#define MAX_SIZE_MIX_WEIGHT 65536
+
+static int
+size_mix_parse(struct iperf_size_mix *mix, const char *spec)
+{
+    const char *p = spec;
+    char *end;
+    long size, weight;
+
+    if (strcmp(spec, "imix") == 0)
+	p = "64:7,576:4,1500:1";
+    for (;;) {
+	size = strtol(p, &end, 10);
+	weight = 1;
+	if (*end == ':')
+	    weight = strtol(end + 1, &end, 10);
+	if (end == p || size < MIN_SIZE_MIX_SIZE || size > MAX_UDP_BLOCKSIZE ||
+	    weight < 1 || weight > MAX_SIZE_MIX_WEIGHT || mix->nclasses == MAX_SIZE_MIX)
+	    return -1;
+	mix->size[mix->nclasses] = size;
+	mix->weight[mix->nclasses] = weight;
+	++mix->nclasses;
+	if (*end == '\0')
+	    return 0;
+	if (*end != ',')
+	    return -1;
+	p = end + 1;
+    }
+}
+
+struct iperf_size_mix *
+iperf_size_mix_new(const char *spec)
+{
+    struct iperf_size_mix *mix;
+    uint32_t seed = 1;
+    int total, i, j, n, t;
+
+    mix = (struct iperf_size_mix *) calloc(1, sizeof(struct iperf_size_mix));
+    if (mix == NULL) {
+	i_errno = IENEWTEST;
+	return NULL;
+    }
+    mix->spec = strdup(spec);
+    if (mix->spec == NULL || size_mix_parse(mix, spec) < 0) {
+	iperf_size_mix_free(mix);
+	i_errno = IESIZEMIX;
+	return NULL;
+    }
+    total = 0;
+    for (i = 0; i < mix->nclasses; ++i)
+	total += mix->weight[i];
+    if (total > MAX_SIZE_MIX_WEIGHT) {
+	iperf_size_mix_free(mix);
+	i_errno = IESIZEMIX;
+	return NULL;
+    }
+
+    /* Whole repetitions of the weights, so the proportions are exact. */
+    mix->cycle = total * (total < SIZE_MIX_TABLE ? SIZE_MIX_TABLE / total : 1);
+    mix->table = (int *) malloc(mix->cycle * sizeof(int));
+    mix->class_of = (unsigned char *) malloc(mix->cycle);
+    if (mix->table == NULL || mix->class_of == NULL) {
+	iperf_size_mix_free(mix);
+	i_errno = IENEWTEST;
+	return NULL;
+    }
+    n = 0;
+    for (i = 0; i < mix->nclasses; ++i)
+	for (j = mix->weight[i] * (mix->cycle / total); j > 0; --j)
+	    mix->class_of[n++] = i;
+    /* Shuffle with a fixed generator, so both sides get the same order. */
+    for (i = mix->cycle - 1; i > 0; --i) {
+	seed = seed * 1103515245 + 12345;
+	j = (seed >> 8) % (i + 1);
+	t = mix->class_of[i];
+	mix->class_of[i] = mix->class_of[j];
+	mix->class_of[j] = t;
+    }
+    for (i = 0; i < mix->cycle; ++i)
+	mix->table[i] = mix->size[mix->class_of[i]];
+    return mix;
+}
+
+void
+iperf_size_mix_free(struct iperf_size_mix *mix)
+{
+    if (mix == NULL)
+	return;
+    free(mix->spec);
+    free(mix->table);
+    free(mix->class_of);
+    free(mix);
+}
+
+int
+iperf_size_mix_max(struct iperf_size_mix *mix)
+{
+    int i, max = 0;
+
+    for (i = 0; i < mix->nclasses; ++i)
+	if (mix->size[i] > max)
+	    max = mix->size[i];
+    return max;
+}
+
+int
+iperf_size_mix_init_stream(struct iperf_stream *sp)
+{
+    sp->size_mix = (struct iperf_size_mix_stream *) calloc(1, sizeof(struct iperf_size_mix_stream));
+    if (sp->size_mix == NULL) {
+	i_errno = IECREATESTREAM;
+	return -1;
+    }
+    return 0;
+}
+
+void
+iperf_size_mix_free_stream(struct iperf_stream *sp)
+{
+    free(sp->size_mix);
+    sp->size_mix = NULL;
+}
+
+cJSON *
+iperf_size_mix_to_json(struct iperf_stream *sp)
+{
+    cJSON *j;
+    int i;
+
+    j = cJSON_CreateArray();
+    if (j == NULL)
+	return NULL;
+    for (i = 0; i < sp->test->size_mix->nclasses; ++i)
+	cJSON_AddItemToArray(j, cJSON_CreateInt(sp->size_mix->count[i]));
+    return j;
+}
+
+void
+iperf_size_mix_from_json(struct iperf_stream *sp, cJSON *j)
+{
+    int i, n;
+
+    n = cJSON_GetArraySize(j);
+    for (i = 0; i < n && i < sp->test->size_mix->nclasses; ++i)
+	sp->size_mix->peer[i] = cJSON_GetArrayItem(j, i)->valueint;
+}
+
+/* Datagrams of each class among the first n sent. */
+static void
+size_mix_expected(struct iperf_size_mix *mix, iperf_size_t n, iperf_size_t *expected)
+{
+    int i;
+
+    for (i = 0; i < mix->nclasses; ++i)
+	expected[i] = 0;
+    for (i = 0; i < mix->cycle; ++i)
+	expected[mix->class_of[i]] += n / mix->cycle;
+    for (i = 0; i < (int) (n % mix->cycle); ++i)
+	++expected[mix->class_of[i]];
+}
+
+void
+iperf_size_mix_print_results(struct iperf_test *test)
+{
+    struct iperf_size_mix *mix = test->size_mix;
+    struct iperf_stream *sp;
+    iperf_size_t total[MAX_SIZE_MIX], *received, lost;
+    double seconds, bandwidth, lost_percent;
+    char ubuf[UNIT_LEN];
+    cJSON *json_mix = NULL;
+    int i, header = 0;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	if (sp->size_mix == NULL)
+	    continue;
+	/* The sender counted what it sent; the receiver numbers them. */
+	if (sp->sender) {
+	    memcpy(total, sp->size_mix->count, sizeof(total));
+	    received = sp->size_mix->peer;
+	} else {
+	    size_mix_expected(mix, sp->packet_count, total);
+	    received = sp->size_mix->count;
+	}
+	seconds = timeval_diff(&sp->result->start_time, &sp->result->end_time);
+	for (i = 0; i < mix->nclasses; ++i) {
+	    lost = total[i] > received[i] ? total[i] - received[i] : 0;
+	    lost_percent = total[i] ? 100.0 * lost / total[i] : 0.0;
+	    bandwidth = seconds > 0 ? (double) received[i] * mix->size[i] / seconds : 0.0;
+	    if (test->json_output) {
+		if (json_mix == NULL) {
+		    json_mix = cJSON_CreateArray();
+		    if (json_mix == NULL)
+			return;
+		    cJSON_AddItemToObject(test->json_end, "size_mix", json_mix);
+		}
+		cJSON_AddItemToArray(json_mix, iperf_json_printf("socket: %d  size: %d  packets: %d  lost_packets: %d  lost_percent: %f  bits_per_second: %f", (int64_t) sp->socket, (int64_t) mix->size[i], (int64_t) total[i], (int64_t) lost, lost_percent, bandwidth * 8));
+		continue;
+	    }
+	    if (!header) {
+		iprintf(test, "%s", report_size_mix_header);
+		header = 1;
+	    }
+	    unit_snprintf(ubuf, UNIT_LEN, bandwidth, test->settings->unit_format);
+	    iprintf(test, report_size_mix_format, sp->socket, mix->size[i], (unsigned long long) lost, (unsigned long long) total[i], lost_percent, ubuf);
+	}
+    }
+}
@@ -0,0 +1,64 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_SIZE_MIX_H
+#define __IPERF_SIZE_MIX_H
+
+/*
+ * UDP datagram size mixes (--size-mix): "imix" (64, 576 and 1500
+ * bytes weighted 7:4:1) or a list of SIZE[:WEIGHT].  The order of the
+ * sizes is drawn once, the same way on both sides, so the receiver
+ * knows the size class of every datagram number, lost ones included.
+ */
+
+/**
+ * iperf_size_mix_new -- parse a --size-mix spec and draw the size table
+ *
+ * returns NULL with i_errno set on error
+ */
+struct iperf_size_mix *iperf_size_mix_new(const char *spec);
+
+void iperf_size_mix_free(struct iperf_size_mix *mix);
+
+/* The largest size in the mix, which the buffers must hold. */
+int iperf_size_mix_max(struct iperf_size_mix *mix);
+
+int iperf_size_mix_init_stream(struct iperf_stream *sp);
+
+void iperf_size_mix_free_stream(struct iperf_stream *sp);
+
+/* Results exchange: the receiver's per-class counts, for the sender. */
+cJSON *iperf_size_mix_to_json(struct iperf_stream *sp);
+
+void iperf_size_mix_from_json(struct iperf_stream *sp, cJSON *j);
+
+/**
+ * iperf_size_mix_print_results -- datagrams, loss and bandwidth per
+ * size class for each stream
+ */
+void iperf_size_mix_print_results(struct iperf_test *test);
+
+#endif
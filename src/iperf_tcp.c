@@ -42,6 +42,8 @@
 #include "iperf.h"
 #include "iperf_api.h"
 #include "iperf_tcp.h"
+#include "iperf_verify.h"
+#include "iperf_ktls.h"
 #include "net.h"
 
 #if defined(HAVE_FLOWLABEL)
@@ -62,6 +64,9 @@ iperf_tcp_recv(struct iperf_stream *sp)
     if (r < 0)
         return r;
 
+    if (sp->verify)
+	iperf_verify_recv(sp, sp->buffer, r);
+
     sp->result->bytes_received += r;
     sp->result->bytes_received_this_interval += r;
 
@@ -77,15 +82,24 @@ int
 iperf_tcp_send(struct iperf_stream *sp)
 {
     int r;
+    int size = sp->send_size ? sp->send_size : sp->settings->blksize;
+    char *buf = sp->buffer;
+
+    /* Carry on through the pattern where the last send stopped. */
+    if (sp->verify)
+	buf = iperf_verify_send_buffer(sp, &size);
 
     if (sp->test->zerocopy)
-	r = Nsendfile(sp->buffer_fd, sp->socket, sp->buffer, sp->settings->blksize);
+	r = Nsendfile(sp->buffer_fd, sp->socket, 0, size);
     else
-	r = Nwrite(sp->socket, sp->buffer, sp->settings->blksize, Ptcp);
+	r = Nwrite(sp->socket, buf, size, Ptcp);
 
     if (r < 0)
         return r;
 
+    if (sp->verify)
+	iperf_verify_sent(sp, r);
+
     sp->result->bytes_sent += r;
     sp->result->bytes_sent_this_interval += r;
 
@@ -123,6 +137,9 @@ iperf_tcp_accept(struct iperf_test * test)
             return -1;
         }
         close(s);
+    } else if (test->ktls && iperf_ktls_socket(test, s) < 0) {
+	close(s);
+	return -1;
     }
 
     return s;
@@ -488,5 +505,13 @@ iperf_tcp_connect(struct iperf_test *test)
         return -1;
     }
 
+    /* Plaintext up to here; TLS records from here on. */
+    if (test->ktls && iperf_ktls_socket(test, s) < 0) {
+	saved_errno = errno;
+	close(s);
+	errno = saved_errno;
+	return -1;
+    }
+
     return s;
 }
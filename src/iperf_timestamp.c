@@ -0,0 +1,337 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+#if defined(linux)
+#include <linux/net_tstamp.h>
+#endif
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_locale.h"
+#include "iperf_util.h"
+#include "iperf_timestamp.h"
+#include "iperf_drops.h"
+#include "net.h"
+
+/* Who stamped a datagram's arrival, best last. */
+#define STAMPED_USER 0
+#define STAMPED_KERNEL 1
+#define STAMPED_NIC 2
+
+static const char *stamped_by[] = { "iperf3", "kernel", "NIC" };
+
+int64_t
+iperf_timestamp_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int
+iperf_timestamp_init_stream(struct iperf_stream *sp)
+{
+    struct iperf_timestamp_stream *ts;
+#if defined(linux) && defined(SO_TIMESTAMPING)
+    int flags, on = 1;
+#endif
+
+    ts = (struct iperf_timestamp_stream *) calloc(1, sizeof(struct iperf_timestamp_stream));
+    if (ts == NULL) {
+	i_errno = IECREATESTREAM;
+	return -1;
+    }
+    ts->interval = histogram_new();
+    ts->total = histogram_new();
+    if (ts->interval == NULL || ts->total == NULL) {
+	histogram_free(ts->interval);
+	histogram_free(ts->total);
+	free(ts);
+	i_errno = IECREATESTREAM;
+	return -1;
+    }
+    sp->timestamp = ts;
+
+    if (sp->sender)
+	return 0;
+    /* Kernel (or NIC) arrival times where there are any; ours otherwise. */
+#if defined(linux) && defined(SO_TIMESTAMPING)
+    flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    if (sp->test->udp_timestamps == UDP_TIMESTAMPS_HW)
+	flags |= SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+    if (setsockopt(sp->socket, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0)
+	(void) setsockopt(sp->socket, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+#endif
+    return 0;
+}
+
+void
+iperf_timestamp_free_stream(struct iperf_stream *sp)
+{
+    if (sp->timestamp == NULL)
+	return;
+    histogram_free(sp->timestamp->interval);
+    histogram_free(sp->timestamp->total);
+    free(sp->timestamp);
+    sp->timestamp = NULL;
+}
+
+int
+iperf_timestamp_recv(struct iperf_stream *sp, int64_t *arrivalP)
+{
+    struct iperf_timestamp_stream *ts = sp->timestamp;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    char control[256];
+    struct timespec *stamp;
+    int64_t offset;
+    int r, source = STAMPED_USER;
+
+    iov.iov_base = sp->buffer;
+    iov.iov_len = sp->settings->blksize;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    r = recvmsg(sp->socket, &msg, 0);
+    if (r < 0) {
+	if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+	    return 0;
+	return NET_HARDERROR;
+    }
+
+    *arrivalP = 0;
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+	if (cmsg->cmsg_level != SOL_SOCKET)
+	    continue;
+	if (sp->drops)
+	    iperf_drops_cmsg(sp, cmsg);
+#if defined(linux) && defined(SO_TIMESTAMPING)
+	if (cmsg->cmsg_type == SO_TIMESTAMPING) {
+	    /* [0] software, [2] raw hardware */
+	    stamp = (struct timespec *) CMSG_DATA(cmsg);
+	    if (stamp[2].tv_sec != 0 || stamp[2].tv_nsec != 0) {
+		*arrivalP = (int64_t) stamp[2].tv_sec * 1000000000 + stamp[2].tv_nsec;
+		source = STAMPED_NIC;
+		/*
+		 * The NIC's clock usually runs on TAI, 37 s ahead of the
+		 * sender's CLOCK_REALTIME.  The kernel's stamp of the same
+		 * datagram is on CLOCK_REALTIME: take out the whole seconds
+		 * between the two, which leaves any real clock error alone.
+		 */
+		if (stamp[0].tv_sec != 0 || stamp[0].tv_nsec != 0) {
+		    offset = *arrivalP - ((int64_t) stamp[0].tv_sec * 1000000000 + stamp[0].tv_nsec);
+		    offset += offset < 0 ? -500000000 : 500000000;
+		    *arrivalP -= offset / 1000000000 * 1000000000;
+		}
+	    } else if (stamp[0].tv_sec != 0 || stamp[0].tv_nsec != 0) {
+		*arrivalP = (int64_t) stamp[0].tv_sec * 1000000000 + stamp[0].tv_nsec;
+		source = STAMPED_KERNEL;
+	    }
+	}
+#endif
+#if defined(SO_TIMESTAMPNS)
+	if (cmsg->cmsg_type == SO_TIMESTAMPNS) {
+	    stamp = (struct timespec *) CMSG_DATA(cmsg);
+	    *arrivalP = (int64_t) stamp->tv_sec * 1000000000 + stamp->tv_nsec;
+	    source = STAMPED_KERNEL;
+	}
+#endif
+    }
+    if (*arrivalP == 0)
+	*arrivalP = iperf_timestamp_now();
+    if (source > ts->source)
+	ts->source = source;
+    return r;
+}
+
+void
+iperf_timestamp_captured(struct iperf_stream *sp)
+{
+    if (sp->timestamp != NULL)
+	sp->timestamp->source = STAMPED_KERNEL;
+}
+
+void
+iperf_timestamp_packet(struct iperf_stream *sp, int64_t sent, int64_t arrival)
+{
+    struct iperf_timestamp_stream *ts = sp->timestamp;
+    int64_t transit = arrival - sent;
+    int64_t d;
+
+    /* RFC 3550: J += (|D(i-1,i)| - J) / 16, from the second datagram on. */
+    if (ts->have_prev) {
+	d = transit - ts->prev_transit;
+	if (d < 0)
+	    d = -d;
+	sp->jitter += (d / 1e9 - sp->jitter) / 16.0;
+    }
+    ts->prev_transit = transit;
+    ts->have_prev = 1;
+
+    if (transit < 0) {
+	++ts->negative;
+	transit = 0;
+    }
+    histogram_add(ts->interval, transit);
+}
+
+void
+iperf_timestamp_stats(struct iperf_stream *sp, struct iperf_interval_results *irp)
+{
+    struct iperf_timestamp_stream *ts = sp->timestamp;
+    struct histogram *h = ts->interval;
+
+    irp->owd_count = h->count;
+    irp->owd_min = h->count ? h->min : 0;
+    irp->owd_mean = histogram_mean(h);
+    irp->owd_p50 = histogram_quantile(h, 0.5);
+    irp->owd_p99 = histogram_quantile(h, 0.99);
+    irp->owd_max = h->max;
+    histogram_merge(ts->total, h);
+    histogram_reset(h);
+}
+
+/* The receiver's summary, which the sender gets in the results. */
+static void
+timestamp_summarize(struct iperf_timestamp_stream *ts)
+{
+    struct histogram *h = ts->total;
+
+    ts->count = h->count;
+    ts->min = h->count ? h->min : 0;
+    ts->mean = histogram_mean(h);
+    ts->p50 = histogram_quantile(h, 0.5);
+    ts->p99 = histogram_quantile(h, 0.99);
+    ts->max = h->max;
+}
+
+cJSON *
+iperf_timestamp_to_json(struct iperf_stream *sp)
+{
+    struct iperf_timestamp_stream *ts = sp->timestamp;
+
+    timestamp_summarize(ts);
+    return iperf_json_printf("count: %d  min: %d  mean: %f  p50: %d  p99: %d  max: %d  negative: %d  source: %d", (int64_t) ts->count, (int64_t) ts->min, ts->mean, (int64_t) ts->p50, (int64_t) ts->p99, (int64_t) ts->max, (int64_t) ts->negative, (int64_t) ts->source);
+}
+
+void
+iperf_timestamp_from_json(struct iperf_stream *sp, cJSON *j)
+{
+    struct iperf_timestamp_stream *ts = sp->timestamp;
+    cJSON *j_p;
+
+    if ((j_p = cJSON_GetObjectItem(j, "count")) != NULL)
+	ts->count = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "min")) != NULL)
+	ts->min = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "mean")) != NULL)
+	ts->mean = j_p->valuefloat;
+    if ((j_p = cJSON_GetObjectItem(j, "p50")) != NULL)
+	ts->p50 = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "p99")) != NULL)
+	ts->p99 = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "max")) != NULL)
+	ts->max = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "negative")) != NULL)
+	ts->negative = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "source")) != NULL &&
+	j_p->valueint >= STAMPED_USER && j_p->valueint <= STAMPED_NIC)
+	ts->source = j_p->valueint;
+}
+
+void
+iperf_timestamp_print_interval(struct iperf_stream *sp, struct iperf_interval_results *irp, double st, double et, cJSON *json_interval_streams)
+{
+    cJSON *j;
+
+    if (sp->sender)
+	return;
+    if (json_interval_streams != NULL) {
+	j = cJSON_GetArrayItem(json_interval_streams, cJSON_GetArraySize(json_interval_streams) - 1);
+	if (j != NULL && irp->owd_count > 0)
+	    cJSON_AddItemToObject(j, "one_way_delay", iperf_json_printf("min_us: %f  mean_us: %f  p50_us: %f  p99_us: %f  max_us: %f", irp->owd_min / 1e3, irp->owd_mean / 1e3, irp->owd_p50 / 1e3, irp->owd_p99 / 1e3, irp->owd_max / 1e3));
+    } else if (irp->owd_count > 0)
+	iprintf(sp->test, report_owd_interval, sp->socket, st, et, irp->owd_min / 1e3, irp->owd_mean / 1e3, irp->owd_p50 / 1e3, irp->owd_p99 / 1e3, irp->owd_max / 1e3);
+}
+
+void
+iperf_timestamp_print_results(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_timestamp_stream *ts;
+    cJSON *json_owd = NULL;
+    int header = 0;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	ts = sp->timestamp;
+	if (ts == NULL)
+	    continue;
+	/* The sender shows what its receiver measured, once it has it. */
+	if (!sp->sender)
+	    timestamp_summarize(ts);
+	else if (ts->count == 0)
+	    continue;
+
+	if (test->json_output) {
+	    if (json_owd == NULL) {
+		json_owd = cJSON_CreateArray();
+		if (json_owd == NULL)
+		    return;
+		cJSON_AddItemToObject(test->json_end, "one_way_delay", json_owd);
+	    }
+	    cJSON_AddItemToArray(json_owd, iperf_json_printf("socket: %d  sender: %b  datagrams: %d  min_us: %f  mean_us: %f  p50_us: %f  p99_us: %f  max_us: %f  negative: %d  stamped_by: %s", (int64_t) sp->socket, sp->sender, (int64_t) ts->count, ts->min / 1e3, ts->mean / 1e3, ts->p50 / 1e3, ts->p99 / 1e3, ts->max / 1e3, (int64_t) ts->negative, stamped_by[ts->source]));
+	    continue;
+	}
+	if (!header) {
+	    iprintf(test, "%s", report_owd_header);
+	    header = 1;
+	}
+	iprintf(test, report_owd_format, sp->socket, (unsigned long long) ts->count, ts->min / 1e3, ts->mean / 1e3, ts->p50 / 1e3, ts->p99 / 1e3, ts->max / 1e3, stamped_by[ts->source], report_receiver);
+	if (ts->negative > 0)
+	    iprintf(test, report_owd_negative, sp->socket, (unsigned long long) ts->negative);
+	/* Nothing real takes a second; a clock is off, by whole seconds if it's TAI against UTC. */
+	if (ts->min >= 1000000000)
+	    iprintf(test, report_owd_implausible, sp->socket, ts->min / 1e9);
+    }
+}
@@ -0,0 +1,72 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_TIMESTAMP_H
+#define __IPERF_TIMESTAMP_H
+
+/*
+ * --udp-timestamps: the UDP header carries the send time in nanoseconds
+ * (CLOCK_REALTIME) along with a 64-bit packet number, and the receiver
+ * takes each datagram's arrival time from the kernel, or from the NIC
+ * with =hw.  Jitter (RFC 3550) and one-way delay are computed from the
+ * two.  One-way delay is only meaningful with the clocks in sync.
+ */
+
+#define UDP_TIMESTAMPS_SW 1
+#define UDP_TIMESTAMPS_HW 2
+
+/*
+ * Set in the header's second word when it holds nanoseconds: microseconds
+ * never reach it, so a receiver can tell the layouts apart.
+ */
+#define UDP_HEADER_NSEC 0x80000000U
+
+int iperf_timestamp_init_stream(struct iperf_stream *sp);
+void iperf_timestamp_free_stream(struct iperf_stream *sp);
+
+/* Now, in nanoseconds since the epoch. */
+int64_t iperf_timestamp_now(void);
+
+/**
+ * iperf_timestamp_recv -- read a datagram into sp->buffer
+ *
+ * Its arrival time goes in *arrivalP.  Returns what Nread() would.
+ */
+int iperf_timestamp_recv(struct iperf_stream *sp, int64_t *arrivalP);
+
+/* Arrival times come from a capture ring, i.e. the kernel stamped them. */
+void iperf_timestamp_captured(struct iperf_stream *sp);
+
+/* Account for a datagram sent at sent and received at arrival. */
+void iperf_timestamp_packet(struct iperf_stream *sp, int64_t sent, int64_t arrival);
+
+void iperf_timestamp_stats(struct iperf_stream *sp, struct iperf_interval_results *irp);
+cJSON *iperf_timestamp_to_json(struct iperf_stream *sp);
+void iperf_timestamp_from_json(struct iperf_stream *sp, cJSON *j);
+void iperf_timestamp_print_interval(struct iperf_stream *sp, struct iperf_interval_results *irp, double st, double et, cJSON *json_interval_streams);
+void iperf_timestamp_print_results(struct iperf_test *test);
+
+#endif
@@ -32,6 +32,7 @@
 #include <assert.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #ifdef HAVE_STDINT_H
 #include <stdint.h>
@@ -43,41 +44,47 @@
 #include "iperf_api.h"
 #include "iperf_util.h"
 #include "iperf_udp.h"
+#include "iperf_verify.h"
+#include "iperf_timestamp.h"
+#include "iperf_seq.h"
+#include "iperf_drops.h"
 #include "timer.h"
 #include "net.h"
 #include "portable_endian.h"
 
-/* iperf_udp_recv
- *
- * receives the data for UDP
+/*
+ * Each stream gets a variant of udp_recv() with the header layout and
+ * debug setting built in (see iperf_udp_recv_select()), so the
+ * per-datagram path doesn't test them.
  */
-int
-iperf_udp_recv(struct iperf_stream *sp)
+#if defined(__GNUC__)
+#define UDP_RECV_INLINE static inline __attribute__((always_inline))
+#else
+#define UDP_RECV_INLINE static inline
+#endif
+
+/*
+ * Account for one datagram of r bytes whose header is at buf.  Arrival
+ * is arrival_ns if the caller has it (ns since the epoch), now if not.
+ */
+UDP_RECV_INLINE void
+udp_datagram(struct iperf_stream *sp, const char *buf, int r, int64_t arrival_ns, const int counters64, const int debug)
 {
     uint32_t  sec, usec;
     uint64_t  pcount;
-    int       r;
-    int       size = sp->settings->blksize;
     double    transit = 0, d = 0;
     struct timeval sent_time, arrival_time;
 
-    r = Nread(sp->socket, sp->buffer, size, Pudp);
-
-    /*
-     * If we got an error in the read, or if we didn't read anything
-     * because the underlying read(2) got a EAGAIN, then skip packet
-     * processing.
-     */
-    if (r <= 0)
-        return r;
-
     sp->result->bytes_received += r;
     sp->result->bytes_received_this_interval += r;
 
-    if (sp->test->udp_counters_64bit) {
-	memcpy(&sec, sp->buffer, sizeof(sec));
-	memcpy(&usec, sp->buffer+4, sizeof(usec));
-	memcpy(&pcount, sp->buffer+8, sizeof(pcount));
+    if (sp->verify)
+	iperf_verify_datagram(sp, buf, r, counters64 ? 16 : 12);
+
+    if (counters64) {
+	memcpy(&sec, buf, sizeof(sec));
+	memcpy(&usec, buf+4, sizeof(usec));
+	memcpy(&pcount, buf+8, sizeof(pcount));
 	sec = ntohl(sec);
 	usec = ntohl(usec);
 	pcount = be64toh(pcount);
@@ -86,9 +93,9 @@ iperf_udp_recv(struct iperf_stream *sp)
     }
     else {
 	uint32_t pc;
-	memcpy(&sec, sp->buffer, sizeof(sec));
-	memcpy(&usec, sp->buffer+4, sizeof(usec));
-	memcpy(&pc, sp->buffer+8, sizeof(pc));
+	memcpy(&sec, buf, sizeof(sec));
+	memcpy(&usec, buf+4, sizeof(usec));
+	memcpy(&pc, buf+8, sizeof(pc));
 	sec = ntohl(sec);
 	usec = ntohl(usec);
 	pcount = ntohl(pc);
@@ -96,19 +103,33 @@ iperf_udp_recv(struct iperf_stream *sp)
 	sent_time.tv_usec = usec;
     }
 
-    /* Out of order packets */
-    if (pcount >= sp->packet_count + 1) {
-        if (pcount > sp->packet_count + 1) {
-            sp->cnt_error += (pcount - 1) - sp->packet_count;
-        }
-        sp->packet_count = pcount;
-    } else {
-        sp->outoforder_packets++;
-	iperf_err(sp->test, "OUT OF ORDER - incoming packet = %zu and received packet = %d AND SP = %d", pcount, sp->packet_count, sp->socket);
+    /* Nanoseconds, by the flag, whether or not we asked for them. */
+    if (usec & UDP_HEADER_NSEC) {
+	usec &= ~UDP_HEADER_NSEC;
+	if (!sp->timestamp)
+	    sent_time.tv_usec = usec / 1000;
+    } else if (sp->timestamp)
+	usec *= 1000;
+
+    /*
+     * Loss, reordering and duplicates, reported per interval; the size
+     * class of each datagram follows from its number, once.
+     */
+    if (iperf_seq_packet(sp, pcount) && sp->test->size_mix)
+	++sp->size_mix->count[sp->test->size_mix->class_of[(pcount - 1) % sp->test->size_mix->cycle]];
+
+    /* --udp-timestamps: usec now holds nanoseconds, and jitter is RFC 3550's. */
+    if (sp->timestamp) {
+	iperf_timestamp_packet(sp, (int64_t) sec * 1000000000 + usec, arrival_ns);
+	goto done;
     }
 
     /* jitter measurement */
-    gettimeofday(&arrival_time, NULL);
+    if (arrival_ns != 0) {
+	arrival_time.tv_sec = arrival_ns / 1000000000;
+	arrival_time.tv_usec = (arrival_ns % 1000000000) / 1000;
+    } else
+	gettimeofday(&arrival_time, NULL);
 
     transit = timeval_diff(&sent_time, &arrival_time);
     d = transit - sp->prev_transit;
@@ -119,41 +140,140 @@ iperf_udp_recv(struct iperf_stream *sp)
     //      J = |(R1 - S1) - (R0 - S0)| [/ number of packets, for average]
     sp->jitter += (d - sp->jitter) / 16.0;
 
-    if (sp->test->debug) {
+ done:
+    if (debug) {
 	fprintf(stderr, "packet_count %d\n", sp->packet_count);
     }
+}
 
+UDP_RECV_INLINE int
+udp_recv(struct iperf_stream *sp, const int counters64, const int debug)
+{
+    int       r;
+    int       size = sp->settings->blksize;
+    int64_t   arrival_ns = 0;
+
+    if (sp->timestamp)
+	r = iperf_timestamp_recv(sp, &arrival_ns);
+    else if (sp->drops)
+	r = iperf_drops_recv(sp);
+    else
+	r = Nread(sp->socket, sp->buffer, size, Pudp);
+
+    /*
+     * If we got an error in the read, or if we didn't read anything
+     * because the underlying read(2) got a EAGAIN, then skip packet
+     * processing.
+     */
+    if (r <= 0)
+        return r;
+
+    udp_datagram(sp, sp->buffer, r, arrival_ns, counters64, debug);
     return r;
 }
 
+static int
+udp_recv32(struct iperf_stream *sp)
+{
+    return udp_recv(sp, 0, 0);
+}
 
-/* iperf_udp_send
+static int
+udp_recv64(struct iperf_stream *sp)
+{
+    return udp_recv(sp, 1, 0);
+}
+
+static int
+udp_recv32_debug(struct iperf_stream *sp)
+{
+    return udp_recv(sp, 0, 1);
+}
+
+static int
+udp_recv64_debug(struct iperf_stream *sp)
+{
+    return udp_recv(sp, 1, 1);
+}
+
+void
+iperf_udp_recv_select(struct iperf_stream *sp)
+{
+    if (sp->test->udp_counters_64bit)
+	sp->rcv = sp->test->debug ? udp_recv64_debug : udp_recv64;
+    else
+	sp->rcv = sp->test->debug ? udp_recv32_debug : udp_recv32;
+}
+
+/* iperf_udp_capture
  *
- * sends the data for UDP
+ * accounts for a datagram captured off the wire
+ */
+void
+iperf_udp_capture(struct iperf_stream *sp, const char *buf, int len, int64_t arrival_ns)
+{
+    if (sp->test->udp_counters_64bit)
+	udp_datagram(sp, buf, len, arrival_ns, 1, 0);
+    else
+	udp_datagram(sp, buf, len, arrival_ns, 0, 0);
+}
+
+/* iperf_udp_recv
+ *
+ * receives the data for UDP
  */
 int
-iperf_udp_send(struct iperf_stream *sp)
+iperf_udp_recv(struct iperf_stream *sp)
 {
-    int r;
-    int       size = sp->settings->blksize;
+    if (sp->test->udp_counters_64bit)
+	return sp->test->debug ? udp_recv64_debug(sp) : udp_recv64(sp);
+    return sp->test->debug ? udp_recv32_debug(sp) : udp_recv32(sp);
+}
+
+
+/* iperf_udp_header
+ *
+ * numbers the next datagram and fills in its header
+ */
+int
+iperf_udp_header(struct iperf_stream *sp, char *header, int *sizeP)
+{
+    int       size = sp->send_size ? sp->send_size : sp->settings->blksize;
     struct timeval before;
+    struct iperf_size_mix *mix = sp->test->size_mix;
+    int       i, hlen;
 
     gettimeofday(&before, 0);
 
     ++sp->packet_count;
 
+    /* --size-mix: the size was drawn ahead of time for this number. */
+    if (mix) {
+	i = (sp->packet_count - 1) % mix->cycle;
+	size = mix->table[i];
+	++sp->size_mix->count[mix->class_of[i]];
+    }
+
+    /* The header goes out from here: the payload may be shared and read-only. */
     if (sp->test->udp_counters_64bit) {
 
 	uint32_t  sec, usec;
 	uint64_t  pcount;
 
-	sec = htonl(before.tv_sec);
-	usec = htonl(before.tv_usec);
+	if (sp->test->udp_timestamps) {
+	    int64_t now = iperf_timestamp_now();
+	    sec = htonl(now / 1000000000);
+	    usec = htonl(UDP_HEADER_NSEC | (uint32_t) (now % 1000000000));
+	} else {
+	    sec = htonl(before.tv_sec);
+	    usec = htonl(before.tv_usec);
+	}
 	pcount = htobe64(sp->packet_count);
 	
-	memcpy(sp->buffer, &sec, sizeof(sec));
-	memcpy(sp->buffer+4, &usec, sizeof(usec));
-	memcpy(sp->buffer+8, &pcount, sizeof(pcount));
+	memcpy(header, &sec, sizeof(sec));
+	memcpy(header+4, &usec, sizeof(usec));
+	memcpy(header+8, &pcount, sizeof(pcount));
+	hlen = 16;
 	
     }
     else {
@@ -164,13 +284,37 @@ iperf_udp_send(struct iperf_stream *sp)
 	usec = htonl(before.tv_usec);
 	pcount = htonl(sp->packet_count);
 	
-	memcpy(sp->buffer, &sec, sizeof(sec));
-	memcpy(sp->buffer+4, &usec, sizeof(usec));
-	memcpy(sp->buffer+8, &pcount, sizeof(pcount));
+	memcpy(header, &sec, sizeof(sec));
+	memcpy(header+4, &usec, sizeof(usec));
+	memcpy(header+8, &pcount, sizeof(pcount));
+	hlen = 12;
 	
     }
+    if (hlen > size)
+	hlen = size;
+    *sizeP = size;
+    return hlen;
+}
+
+/* iperf_udp_send
+ *
+ * sends the data for UDP
+ */
+int
+iperf_udp_send(struct iperf_stream *sp)
+{
+    int r;
+    int       size, hlen;
+    char      header[16];
+    struct iovec iov[2];
+
+    hlen = iperf_udp_header(sp, header, &size);
+    iov[0].iov_base = header;
+    iov[0].iov_len = hlen;
+    iov[1].iov_base = sp->buffer + hlen;
+    iov[1].iov_len = size - hlen;
 
-    r = Nwrite(sp->socket, sp->buffer, size, Pudp);
+    r = Nwritev(sp->socket, iov, 2, Pudp);
 
     if (r < 0)
 	return r;
@@ -36,6 +36,20 @@
  */
 int iperf_udp_recv(struct iperf_stream *);
 
+/**
+ * iperf_udp_recv_select -- point sp->rcv at the receive variant for
+ * the test's header layout and debug setting
+ *
+ */
+void iperf_udp_recv_select(struct iperf_stream *);
+
+/**
+ * iperf_udp_capture -- accounts for a datagram of len bytes, captured
+ * at arrival_ns, whose iperf3 header is at buf (see --capture)
+ *
+ */
+void iperf_udp_capture(struct iperf_stream *, const char *buf, int len, int64_t arrival_ns);
+
 /**
  * iperf_udp_send -- sends the client data for UDP
  *
@@ -44,6 +58,15 @@ int iperf_udp_recv(struct iperf_stream *);
  */
 int iperf_udp_send(struct iperf_stream *) /* __attribute__((hot)) */;
 
+/**
+ * iperf_udp_header -- numbers the next datagram and writes its header
+ * (up to 16 bytes) to header; *sizeP gets the datagram's size
+ *
+ * returns: header length
+ *
+ */
+int iperf_udp_header(struct iperf_stream *, char *header, int *sizeP);
+
 
 /**
  * iperf_udp_accept -- accepts a new UDP connection
@@ -0,0 +1,352 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <sys/time.h>
+#include <sys/select.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_unix.h"
+#include "iperf_verify.h"
+#include "net.h"
+
+/* The server's name for the test on its port, unless the client gave one. */
+static socklen_t
+unix_address(struct iperf_test *test, struct sockaddr_un *sun)
+{
+    memset(sun, 0, sizeof(*sun));
+    sun->sun_family = AF_UNIX;
+    if (test->unix_path != NULL) {
+	snprintf(sun->sun_path, sizeof(sun->sun_path), "%s", test->unix_path);
+	return offsetof(struct sockaddr_un, sun_path) + strlen(sun->sun_path);
+    }
+#if defined(linux)
+    /* Abstract, so there is no file to clean up. */
+    snprintf(sun->sun_path + 1, sizeof(sun->sun_path) - 1, "iperf3.%d", test->server_port);
+    return offsetof(struct sockaddr_un, sun_path) + 1 + strlen(sun->sun_path + 1);
+#else
+    snprintf(sun->sun_path, sizeof(sun->sun_path), "/tmp/iperf3.%d.sock", test->server_port);
+    return offsetof(struct sockaddr_un, sun_path) + strlen(sun->sun_path);
+#endif
+}
+
+static int
+unix_type(struct iperf_test *test)
+{
+    return test->protocol->id == Punixseq ? SOCK_SEQPACKET : SOCK_STREAM;
+}
+
+static int
+unix_bufsize(struct iperf_test *test, int s)
+{
+    int opt;
+
+    if ((opt = test->settings->socket_bufsize)) {
+        if (setsockopt(s, SOL_SOCKET, SO_RCVBUF, &opt, sizeof(opt)) < 0 ||
+	    setsockopt(s, SOL_SOCKET, SO_SNDBUF, &opt, sizeof(opt)) < 0) {
+            i_errno = IESETBUF;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void
+iperf_unix_name(const struct sockaddr_storage *ss, char *buf, size_t len)
+{
+    const struct sockaddr_un *sun = (const struct sockaddr_un *) ss;
+
+    if (sun->sun_path[0] != '\0')
+	snprintf(buf, len, "%s", sun->sun_path);
+    else if (sun->sun_path[1] != '\0')
+	snprintf(buf, len, "@%s", sun->sun_path + 1);
+    else
+	snprintf(buf, len, "(unnamed)");
+}
+
+
+/* iperf_unix_recv
+ *
+ * receives the data for AF_UNIX
+ */
+int
+iperf_unix_recv(struct iperf_stream *sp)
+{
+    int r;
+
+    if (sp->test->protocol->id == Punixseq) {
+	/* One message each time: reading on would cut the next one short. */
+	r = recv(sp->socket, sp->buffer, sp->settings->blksize, 0);
+	if (r < 0) {
+	    if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+		return 0;
+	    return NET_HARDERROR;
+	}
+    } else
+	r = Nread(sp->socket, sp->buffer, sp->settings->blksize, Punix);
+
+    if (r < 0)
+        return r;
+
+    if (sp->verify)
+	iperf_verify_recv(sp, sp->buffer, r);
+
+    sp->result->bytes_received += r;
+    sp->result->bytes_received_this_interval += r;
+
+    return r;
+}
+
+
+/* iperf_unix_send
+ *
+ * sends the data for AF_UNIX
+ */
+int
+iperf_unix_send(struct iperf_stream *sp)
+{
+    int r;
+    int size = sp->send_size ? sp->send_size : sp->settings->blksize;
+    char *buf = sp->buffer;
+
+    if (sp->verify)
+	buf = iperf_verify_send_buffer(sp, &size);
+
+    /* A SOCK_SEQPACKET write goes whole or not at all. */
+    if (sp->test->zerocopy && sp->test->protocol->id == Punix)
+	r = Nsendfile(sp->buffer_fd, sp->socket, 0, size);
+    else
+	r = Nwrite(sp->socket, buf, size, sp->test->protocol->id);
+
+    if (r < 0)
+        return r;
+
+    if (sp->verify)
+	iperf_verify_sent(sp, r);
+
+    sp->result->bytes_sent += r;
+    sp->result->bytes_sent_this_interval += r;
+
+    return r;
+}
+
+
+/* iperf_unix_accept
+ *
+ * accept a new AF_UNIX stream connection
+ */
+int
+iperf_unix_accept(struct iperf_test *test)
+{
+    int     s;
+    signed char rbuf = ACCESS_DENIED;
+    char    cookie[COOKIE_SIZE];
+    struct sockaddr_un sun;
+    struct iperf_stream *sp;
+    int n;
+
+    if ((s = accept(test->prot_listener, NULL, NULL)) < 0) {
+        i_errno = IESTREAMCONNECT;
+        return -1;
+    }
+
+    if (Nread(s, cookie, COOKIE_SIZE, Punix) < 0) {
+	close(s);
+        i_errno = IERECVCOOKIE;
+        return -1;
+    }
+
+    if (strcmp(test->cookie, cookie) != 0) {
+        if (Nwrite(s, (char*) &rbuf, sizeof(rbuf), Punix) < 0) {
+	    close(s);
+            i_errno = IESENDMESSAGE;
+            return -1;
+        }
+        close(s);
+	return s;
+    }
+
+    if (unix_bufsize(test, s) < 0) {
+	close(s);
+	return -1;
+    }
+
+    /* With the last stream in, nobody else needs the file, if it is one. */
+    n = 1;
+    SLIST_FOREACH(sp, &test->streams, streams)
+	n++;
+    unix_address(test, &sun);
+    if (n == test->num_streams * (test->bidirectional ? 2 : 1) && sun.sun_path[0] != '\0')
+	(void) unlink(sun.sun_path);
+
+    return s;
+}
+
+
+/* iperf_unix_listen
+ *
+ * start up a listener for AF_UNIX stream connections
+ */
+int
+iperf_unix_listen(struct iperf_test *test)
+{
+    struct sockaddr_un sun;
+    socklen_t len;
+    int s, saved_errno;
+
+    len = unix_address(test, &sun);
+    /* Left behind by a server that didn't finish. */
+    if (sun.sun_path[0] != '\0')
+	(void) unlink(sun.sun_path);
+
+    if ((s = socket(AF_UNIX, unix_type(test), 0)) < 0) {
+        i_errno = IESTREAMLISTEN;
+        return -1;
+    }
+
+    if (bind(s, (struct sockaddr *) &sun, len) < 0 || listen(s, 5) < 0) {
+	saved_errno = errno;
+        close(s);
+	errno = saved_errno;
+        i_errno = IESTREAMLISTEN;
+        return -1;
+    }
+
+    return s;
+}
+
+
+/* iperf_unix_connect
+ *
+ * connect to an AF_UNIX stream listener
+ */
+int
+iperf_unix_connect(struct iperf_test *test)
+{
+    struct sockaddr_un sun;
+    socklen_t len;
+    int s, saved_errno;
+
+    len = unix_address(test, &sun);
+
+    if ((s = socket(AF_UNIX, unix_type(test), 0)) < 0) {
+        i_errno = IESTREAMCONNECT;
+        return -1;
+    }
+
+    if (unix_bufsize(test, s) < 0) {
+	saved_errno = errno;
+	close(s);
+	errno = saved_errno;
+	return -1;
+    }
+
+    if (connect(s, (struct sockaddr *) &sun, len) < 0) {
+	saved_errno = errno;
+	close(s);
+	errno = saved_errno;
+        i_errno = IESTREAMCONNECT;
+        return -1;
+    }
+
+    /* Send cookie for verification */
+    if (Nwrite(s, test->cookie, COOKIE_SIZE, Punix) < 0) {
+	saved_errno = errno;
+	close(s);
+	errno = saved_errno;
+        i_errno = IESENDCOOKIE;
+        return -1;
+    }
+
+    return s;
+}
+
+
+
+/* iperf_unix_check_local
+ *
+ * without a path, the data sockets' name is only in reach of a server
+ * on this host: one reached over loopback or at an address of our own.
+ * A connected UDP socket tells which, without a packet sent.
+ */
+int
+iperf_unix_check_local(struct iperf_test *test)
+{
+    struct addrinfo hints, *res;
+    struct sockaddr_storage local, peer;
+    socklen_t llen = sizeof(local);
+    const unsigned char *a;
+    int s, r = -1;
+
+    if (test->unix_path != NULL)
+	return 0;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = test->settings->domain;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(test->server_hostname, NULL, &hints, &res) != 0) {
+	i_errno = IECONNECT;
+	return -1;
+    }
+    memcpy(&peer, res->ai_addr, res->ai_addrlen);
+    if (peer.ss_family == AF_INET)
+	((struct sockaddr_in *) &peer)->sin_port = htons(test->server_port);
+    else
+	((struct sockaddr_in6 *) &peer)->sin6_port = htons(test->server_port);
+    if ((s = socket(peer.ss_family, SOCK_DGRAM, 0)) >= 0) {
+	if (connect(s, (struct sockaddr *) &peer, res->ai_addrlen) == 0 &&
+	    getsockname(s, (struct sockaddr *) &local, &llen) == 0) {
+	    if (peer.ss_family == AF_INET) {
+		a = (const unsigned char *) &((struct sockaddr_in *) &peer)->sin_addr;
+		if (a[0] == 127 || memcmp(a, &((struct sockaddr_in *) &local)->sin_addr, 4) == 0)
+		    r = 0;
+	    } else {
+		a = (const unsigned char *) &((struct sockaddr_in6 *) &peer)->sin6_addr;
+		if (IN6_IS_ADDR_LOOPBACK((struct in6_addr *) a) ||
+		    (IN6_IS_ADDR_V4MAPPED((struct in6_addr *) a) && a[12] == 127) ||
+		    memcmp(a, &((struct sockaddr_in6 *) &local)->sin6_addr, 16) == 0)
+		    r = 0;
+	    }
+	}
+	close(s);
+    }
+    freeaddrinfo(res);
+    if (r < 0)
+	i_errno = IEUNIX;
+    return r;
+}
@@ -0,0 +1,72 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef        IPERF_UNIX_H
+#define        IPERF_UNIX_H
+
+/*
+ * Data streams over AF_UNIX sockets, for measuring local IPC without
+ * the network stack: SOCK_STREAM for --unix, SOCK_SEQPACKET (one
+ * message per send, kept whole) for --unix-seqpacket.  The control
+ * connection stays TCP.  Both ends are on one host, so the socket's
+ * name follows from the server port: "@iperf3.<port>" in the Linux
+ * abstract namespace, a file under /tmp elsewhere.  --unix=path names a
+ * socket file instead, which a bind mount can share with a container.
+ */
+
+/**
+ * iperf_unix_accept -- accepts a new AF_UNIX data connection
+ * and checks its cookie
+ *
+ */
+int iperf_unix_accept(struct iperf_test *);
+
+/**
+ * iperf_unix_recv -- receives the data for --unix and --unix-seqpacket
+ * returns: bytes received
+ *
+ */
+int iperf_unix_recv(struct iperf_stream *);
+
+/**
+ * iperf_unix_send -- sends the data for --unix and --unix-seqpacket
+ * returns: bytes sent
+ *
+ */
+int iperf_unix_send(struct iperf_stream *);
+
+
+int iperf_unix_listen(struct iperf_test *);
+
+int iperf_unix_connect(struct iperf_test *);
+
+/* The printable name of an AF_UNIX address: "@name" if abstract. */
+void iperf_unix_name(const struct sockaddr_storage *ss, char *buf, size_t len);
+
+/* Client: can the server reach the data sockets' default name? */
+int iperf_unix_check_local(struct iperf_test *test);
+
+#endif
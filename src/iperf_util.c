@@ -43,6 +43,7 @@
 #include <sys/utsname.h>
 #include <time.h>
 #include <errno.h>
+#include <fcntl.h>
 
 #include "cjson.h"
 
@@ -89,18 +90,9 @@ make_cookie(char *cookie)
 int
 is_closed(int fd)
 {
-    struct timeval tv;
-    fd_set readset;
-
-    FD_ZERO(&readset);
-    FD_SET(fd, &readset);
-    tv.tv_sec = 0;
-    tv.tv_usec = 0;
-
-    if (select(fd+1, &readset, NULL, NULL, &tv) < 0) {
-        if (errno == EBADF)
-            return 1;
-    }
+    /* Not select(): --flows descriptors can be past FD_SETSIZE. */
+    if (fcntl(fd, F_GETFD) < 0 && errno == EBADF)
+        return 1;
     return 0;
 }
 
@@ -110,7 +102,7 @@ timeval_to_double(struct timeval * tv)
 {
     double d;
 
-    d = tv->tv_sec + tv->tv_usec / 1000000;
+    d = tv->tv_sec + tv->tv_usec / 1000000.0;
 
     return d;
 }
@@ -161,6 +153,36 @@ delay(int64_t ns)
     return 0;
 }
 
+/* Sleep until wall-clock time t, in seconds since the epoch. */
+int
+delay_until(double t)
+{
+#if defined(TIMER_ABSTIME)
+    struct timespec req;
+    int r;
+
+    req.tv_sec = (time_t) t;
+    req.tv_nsec = (t - req.tv_sec) * 1000000000L;
+    while ((r = clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &req, NULL)) == EINTR)
+	;
+    if (r != 0) {
+	errno = r;
+	return -1;
+    }
+    return 0;
+#else
+    struct timeval now;
+    double d;
+
+    if (gettimeofday(&now, NULL) < 0)
+	return -1;
+    d = t - timeval_to_double(&now);
+    if (d <= 0.0)
+	return 0;
+    return delay(d * 1000000000L);
+#endif
+}
+
 # ifdef DELAY_SELECT_METHOD
 int
 delay(int us)
@@ -42,6 +42,8 @@ double timeval_diff(struct timeval *tv0, struct timeval *tv1);
 
 int delay(int64_t ns);
 
+int delay_until(double t);
+
 void cpu_util(double pcpu[3]);
 
 const char* get_system_info(void);
@@ -0,0 +1,256 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+#include <sys/time.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_util.h"
+#include "iperf_locale.h"
+#include "iperf_payload.h"
+#include "iperf_verify.h"
+#include "units.h"
+
+struct iperf_verify *
+iperf_verify_new(uint32_t seed)
+{
+    struct iperf_verify *verify;
+
+    verify = (struct iperf_verify *) calloc(1, sizeof(struct iperf_verify));
+    if (verify == NULL) {
+	i_errno = IENEWTEST;
+	return NULL;
+    }
+    verify->seed = seed;
+    return verify;
+}
+
+void
+iperf_verify_free(struct iperf_verify *verify)
+{
+    free(verify);
+}
+
+int
+iperf_verify_init_stream(struct iperf_stream *sp)
+{
+    struct iperf_test *test = sp->test;
+
+    /* Receivers need the payload too, to compare against. */
+    if (test->payload == NULL &&
+	(test->payload = iperf_payload_new(test, test->settings->blksize, test->verify->seed)) == NULL)
+	return -1;
+    test->verify->period = test->payload->size;
+
+    sp->verify = (struct iperf_verify_stream *) calloc(1, sizeof(struct iperf_verify_stream));
+    if (sp->verify == NULL) {
+	i_errno = IECREATESTREAM;
+	return -1;
+    }
+    return 0;
+}
+
+void
+iperf_verify_free_stream(struct iperf_stream *sp)
+{
+    free(sp->verify);
+    sp->verify = NULL;
+}
+
+char *
+iperf_verify_send_buffer(struct iperf_stream *sp, int *sizeP)
+{
+    int period = sp->test->verify->period;
+    int off = sp->verify->pos % period;
+
+    if (*sizeP > period - off)
+	*sizeP = period - off;
+    return sp->buffer + off;
+}
+
+void
+iperf_verify_sent(struct iperf_stream *sp, int size)
+{
+    if (size > 0)
+	sp->verify->pos += size;
+}
+
+static double
+verify_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+verify_block(struct iperf_verify_stream *vs, const char *buf, const char *pattern, int n, iperf_size_t block)
+{
+    /* Count each bad block once, however many reads it came in. */
+    if (memcmp(buf, pattern, n) != 0 && vs->bad_block != block + 1) {
+	++vs->corrupted;
+	++vs->interval_corrupted;
+	vs->bad_block = block + 1;
+    }
+}
+
+void
+iperf_verify_recv(struct iperf_stream *sp, const char *buf, int r)
+{
+    struct iperf_verify_stream *vs = sp->verify;
+    const char *pattern = sp->test->payload->buffer;
+    int period = sp->test->verify->period;
+    double start = verify_now();
+    int off, n;
+
+    vs->bytes += r;
+    while (r > 0) {
+	off = vs->pos % period;
+	n = r < period - off ? r : period - off;
+	verify_block(vs, buf, pattern + off, n, vs->pos / period);
+	if (off + n == period) {
+	    ++vs->blocks;
+	    ++vs->interval_blocks;
+	}
+	vs->pos += n;
+	buf += n;
+	r -= n;
+    }
+    vs->seconds += verify_now() - start;
+}
+
+void
+iperf_verify_datagram(struct iperf_stream *sp, const char *buf, int r, int hlen)
+{
+    struct iperf_verify_stream *vs = sp->verify;
+    double start = verify_now();
+
+    if (r > sp->test->verify->period)
+	r = sp->test->verify->period;
+    vs->bytes += r;
+    ++vs->blocks;
+    ++vs->interval_blocks;
+    if (r > hlen)
+	verify_block(vs, buf + hlen, sp->test->payload->buffer + hlen, r - hlen, vs->blocks);
+    vs->seconds += verify_now() - start;
+}
+
+void
+iperf_verify_stats(struct iperf_stream *sp, struct iperf_interval_results *irp)
+{
+    struct iperf_verify_stream *vs = sp->verify;
+
+    irp->interval_verified = vs->interval_blocks;
+    irp->interval_corrupted = vs->interval_corrupted;
+    vs->interval_blocks = vs->interval_corrupted = 0;
+}
+
+cJSON *
+iperf_verify_to_json(struct iperf_stream *sp)
+{
+    struct iperf_verify_stream *vs = sp->verify;
+
+    return iperf_json_printf("blocks: %d  corrupted: %d  bytes: %d  seconds: %f", (int64_t) vs->blocks, (int64_t) vs->corrupted, (int64_t) vs->bytes, vs->seconds);
+}
+
+void
+iperf_verify_from_json(struct iperf_stream *sp, cJSON *j)
+{
+    struct iperf_verify_stream *vs = sp->verify;
+    cJSON *j_p;
+
+    if ((j_p = cJSON_GetObjectItem(j, "blocks")) != NULL)
+	vs->blocks = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "corrupted")) != NULL)
+	vs->corrupted = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "bytes")) != NULL)
+	vs->bytes = j_p->valueint;
+    if ((j_p = cJSON_GetObjectItem(j, "seconds")) != NULL)
+	vs->seconds = j_p->valuefloat;
+}
+
+void
+iperf_verify_print_interval(struct iperf_stream *sp, struct iperf_interval_results *irp, double st, double et, cJSON *json_interval_streams)
+{
+    cJSON *j;
+
+    if (sp->sender)
+	return;
+    if (json_interval_streams != NULL) {
+	j = cJSON_GetArrayItem(json_interval_streams, cJSON_GetArraySize(json_interval_streams) - 1);
+	if (j != NULL) {
+	    cJSON_AddIntToObject(j, "verified_blocks", irp->interval_verified);
+	    cJSON_AddIntToObject(j, "corrupted_blocks", irp->interval_corrupted);
+	}
+    } else
+	iprintf(sp->test, report_verify_interval, sp->socket, st, et, (unsigned long long) irp->interval_verified, (unsigned long long) irp->interval_corrupted);
+}
+
+void
+iperf_verify_print_results(struct iperf_test *test)
+{
+    struct iperf_stream *sp;
+    struct iperf_verify_stream *vs;
+    cJSON *json_verify = NULL;
+    double duration, cpu, rate;
+    char ubuf[UNIT_LEN];
+    int header = 0;
+
+    SLIST_FOREACH(sp, &test->streams, streams) {
+	vs = sp->verify;
+	if (vs == NULL)
+	    continue;
+	/* The sender shows what its receiver found, so the row is the receiver's. */
+	duration = timeval_diff(&sp->result->start_time, &sp->result->end_time);
+	cpu = duration > 0 ? 100.0 * vs->seconds / duration : 0.0;
+	rate = vs->seconds > 0 ? vs->bytes / vs->seconds : 0.0;
+
+	if (test->json_output) {
+	    if (json_verify == NULL) {
+		json_verify = cJSON_CreateArray();
+		if (json_verify == NULL)
+		    return;
+		cJSON_AddItemToObject(test->json_end, "verify", json_verify);
+	    }
+	    cJSON_AddItemToArray(json_verify, iperf_json_printf("socket: %d  sender: %b  blocks: %d  corrupted: %d  verify_bytes_per_second: %f  verify_cpu_percent: %f", (int64_t) sp->socket, sp->sender, (int64_t) vs->blocks, (int64_t) vs->corrupted, rate, cpu));
+	    continue;
+	}
+	if (!header) {
+	    iprintf(test, "%s", report_verify_header);
+	    header = 1;
+	}
+	unit_snprintf(ubuf, UNIT_LEN, rate, 'A');
+	iprintf(test, report_verify_format, sp->socket, (unsigned long long) vs->blocks, (unsigned long long) vs->corrupted, ubuf, cpu, report_receiver);
+    }
+}
@@ -0,0 +1,73 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#ifndef __IPERF_VERIFY_H
+#define __IPERF_VERIFY_H
+
+/*
+ * Payload verification (--verify).  Both sides make the payload from
+ * the same seed, and senders send it over and over, starting each send
+ * where the previous one left off, so that byte n of a stream is byte
+ * n % -l of the payload.  Receivers compare what arrives against their
+ * copy with memcmp(), which libc vectorizes, and count the -l byte
+ * blocks (UDP: datagrams) that differ, and the time that took.
+ */
+
+struct iperf_verify *iperf_verify_new(uint32_t seed);
+
+void iperf_verify_free(struct iperf_verify *verify);
+
+int iperf_verify_init_stream(struct iperf_stream *sp);
+
+void iperf_verify_free_stream(struct iperf_stream *sp);
+
+/*
+ * Sender: where the next send of up to *sizeP bytes starts, trimming
+ * *sizeP so the send ends at the end of the payload at the latest.
+ * iperf_verify_sent() then moves on past what went out.
+ */
+char *iperf_verify_send_buffer(struct iperf_stream *sp, int *sizeP);
+
+void iperf_verify_sent(struct iperf_stream *sp, int size);
+
+/* Receiver: check r bytes of a byte stream, or a datagram after its header. */
+void iperf_verify_recv(struct iperf_stream *sp, const char *buf, int r);
+
+void iperf_verify_datagram(struct iperf_stream *sp, const char *buf, int r, int hlen);
+
+/* Move this interval's counts into its results. */
+void iperf_verify_stats(struct iperf_stream *sp, struct iperf_interval_results *irp);
+
+/* Results exchange: the receiver's counts, for the sender. */
+cJSON *iperf_verify_to_json(struct iperf_stream *sp);
+
+void iperf_verify_from_json(struct iperf_stream *sp, cJSON *j);
+
+void iperf_verify_print_interval(struct iperf_stream *sp, struct iperf_interval_results *irp, double st, double et, cJSON *json_interval_streams);
+
+void iperf_verify_print_results(struct iperf_test *test);
+
+#endif
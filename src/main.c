@@ -53,7 +53,8 @@
 #include "net.h"
 
 
-static int run(struct iperf_test *test);
+static int run(struct iperf_test *test, int argc, char **argv);
+static int run_fanout(struct iperf_test *test, int argc, char **argv);
 
 
 /**************************************************************************/
@@ -108,7 +109,7 @@ main(int argc, char **argv)
         exit(1);
     }
 
-    if (run(test) < 0)
+    if (run(test, argc, argv) < 0)
         iperf_errexit(test, "error - %s", iperf_strerror(i_errno));
 
     iperf_free_test(test);
@@ -127,7 +128,7 @@ sigend_handler(int sig)
 
 /**************************************************************************/
 static int
-run(struct iperf_test *test)
+run(struct iperf_test *test, int argc, char **argv)
 {
     int consecutive_errors;
 
@@ -167,7 +168,10 @@ run(struct iperf_test *test)
 	    iperf_delete_pidfile(test);
             break;
 	case 'c':
-	    if (iperf_run_client(test) < 0)
+	    if (strchr(iperf_get_test_server_hostname(test), ',') != NULL) {
+		if (run_fanout(test, argc, argv) < 0)
+		    iperf_errexit(test, "error - %s", iperf_strerror(i_errno));
+	    } else if (iperf_run_client(test) < 0)
 		iperf_errexit(test, "error - %s", iperf_strerror(i_errno));
             break;
         default:
@@ -179,3 +183,76 @@ run(struct iperf_test *test)
 
     return 0;
 }
+
+/**************************************************************************/
+static struct iperf_test **fanout_tests;
+static int fanout_ntests;
+
+/*
+ * -c host,host,...: one test per server, each set up from the same
+ * command line, run together by iperf_run_clients().
+ */
+static int
+run_fanout(struct iperf_test *test, int argc, char **argv)
+{
+    char *hosts, *host, *last;
+    struct iperf_test *t;
+    int i, r;
+
+    hosts = strdup(iperf_get_test_server_hostname(test));
+    if (hosts == NULL) {
+	i_errno = IEINITTEST;
+	return -1;
+    }
+    for (i = 1, host = hosts; *host != '\0'; ++host)
+	if (*host == ',')
+	    ++i;
+    fanout_tests = (struct iperf_test **) calloc(i, sizeof(struct iperf_test *));
+    if (fanout_tests == NULL) {
+	free(hosts);
+	i_errno = IEINITTEST;
+	return -1;
+    }
+
+    fanout_ntests = 0;
+    for (host = strtok_r(hosts, ",", &last); host != NULL; host = strtok_r(NULL, ",", &last)) {
+	if (fanout_ntests == 0)
+	    t = test;
+	else {
+	    t = iperf_new_test();
+	    if (!t)
+		iperf_errexit(NULL, "create new test error - %s", iperf_strerror(i_errno));
+	    iperf_defaults(t);
+	    optind = 0;		/* start getopt over */
+	    if (iperf_parse_arguments(t, argc, argv) < 0)
+		iperf_errexit(t, "parameter error - %s", iperf_strerror(i_errno));
+	}
+	iperf_set_test_server_hostname(t, host);
+	/* The title prefixes each line of output; default it to the server. */
+	if (t->title == NULL)
+	    t->title = strdup(host);
+	fanout_tests[fanout_ntests++] = t;
+    }
+    free(hosts);
+
+    /* Stop every test on a termination signal, reporting the first. */
+    if (setjmp(sigend_jmp_buf)) {
+	for (i = 1; i < fanout_ntests; ++i) {
+	    t = fanout_tests[i];
+	    if (t->ctrl_sck >= 0) {
+		t->state = CLIENT_TERMINATE;
+		(void) Nwrite(t->ctrl_sck, (char*) &t->state, sizeof(signed char), Ptcp);
+	    }
+	}
+	iperf_got_sigend(test);
+    }
+
+    r = iperf_run_clients(fanout_tests, fanout_ntests);
+
+    for (i = 1; i < fanout_ntests; ++i)
+	iperf_free_test(fanout_tests[i]);
+    free(fanout_tests);
+    if (r > 0)
+	exit(1);
+    return r;
+}
@@ -38,6 +38,8 @@
 #include <netdb.h>
 #include <string.h>
 #include <sys/fcntl.h>
+#include <sys/uio.h>
+#include <ifaddrs.h>
 
 #ifdef HAVE_SENDFILE
 #ifdef linux
@@ -273,6 +275,38 @@ Nwrite(int fd, const char *buf, size_t count, int prot)
 }
 
 
+/*
+ *                      N W R I T E V
+ *
+ * One writev() of a datagram, which goes out whole or not at all.
+ */
+
+int
+Nwritev(int fd, const struct iovec *iov, int iovcnt, int prot)
+{
+    register ssize_t r;
+
+    r = writev(fd, iov, iovcnt);
+    if (r < 0) {
+	switch (errno) {
+	    case EINTR:
+	    case EAGAIN:
+#if (EAGAIN != EWOULDBLOCK)
+	    case EWOULDBLOCK:
+#endif
+	    return 0;
+
+	    case ENOBUFS:
+	    return NET_SOFTERROR;
+
+	    default:
+	    return NET_HARDERROR;
+	}
+    }
+    return r;
+}
+
+
 int
 has_sendfile(void)
 {
@@ -287,10 +321,12 @@ has_sendfile(void)
 
 /*
  *                      N S E N D F I L E
+ *
+ * count bytes of fromfd, from offset start on, to the socket tofd.
  */
 
 int
-Nsendfile(int fromfd, int tofd, const char *buf, size_t count)
+Nsendfile(int fromfd, int tofd, off_t start, size_t count)
 {
     off_t offset;
 #if defined(HAVE_SENDFILE)
@@ -302,7 +338,7 @@ Nsendfile(int fromfd, int tofd, const char *buf, size_t count)
 
     nleft = count;
     while (nleft > 0) {
-	offset = count - nleft;
+	offset = start + count - nleft;
 #ifdef linux
 	r = sendfile(tofd, fromfd, &offset, nleft);
 	if (r > 0)
@@ -465,3 +501,49 @@ getsockdomain(int sock)
     }
     return ((struct sockaddr *) &sa)->sa_family;
 }
+
+/* The name of the interface with the socket's local address. */
+int
+getsockifname(int sock, char *ifname, size_t len)
+{
+    struct sockaddr_storage sa;
+    socklen_t salen = sizeof(sa);
+    struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *) &sa;
+    struct ifaddrs *ifap, *ifa;
+    const void *addr;
+    size_t alen;
+    int family, r = -1;
+
+    ifname[0] = '\0';
+    if (getsockname(sock, (struct sockaddr *) &sa, &salen) < 0)
+	return -1;
+    family = sa.ss_family;
+    if (family == AF_INET6 && IN6_IS_ADDR_V4MAPPED(&sin6->sin6_addr)) {
+	/* An IPv4 peer on a dual-stack socket. */
+	family = AF_INET;
+	addr = &sin6->sin6_addr.s6_addr[12];
+	alen = sizeof(struct in_addr);
+    } else if (family == AF_INET6) {
+	addr = &sin6->sin6_addr;
+	alen = sizeof(struct in6_addr);
+    } else {
+	addr = &((struct sockaddr_in *) &sa)->sin_addr;
+	alen = sizeof(struct in_addr);
+    }
+    if (getifaddrs(&ifap) < 0)
+	return -1;
+    for (ifa = ifap; ifa != NULL; ifa = ifa->ifa_next) {
+	if (ifa->ifa_addr == NULL || ifa->ifa_addr->sa_family != family)
+	    continue;
+	if ((family == AF_INET &&
+	     memcmp(&((struct sockaddr_in *) ifa->ifa_addr)->sin_addr, addr, alen) == 0) ||
+	    (family == AF_INET6 &&
+	     memcmp(&((struct sockaddr_in6 *) ifa->ifa_addr)->sin6_addr, addr, alen) == 0)) {
+	    snprintf(ifname, len, "%s", ifa->ifa_name);
+	    r = 0;
+	    break;
+	}
+    }
+    freeifaddrs(ifap);
+    return r;
+}
@@ -31,12 +31,15 @@ int netdial(int domain, int proto, char *local, int local_port, char *server, in
 int netannounce(int domain, int proto, char *local, int port);
 int Nread(int fd, char *buf, size_t count, int prot);
 int Nwrite(int fd, const char *buf, size_t count, int prot) /* __attribute__((hot)) */;
+struct iovec;
+int Nwritev(int fd, const struct iovec *iov, int iovcnt, int prot) /* __attribute__((hot)) */;
 int has_sendfile(void);
-int Nsendfile(int fromfd, int tofd, const char *buf, size_t count) /* __attribute__((hot)) */;
+int Nsendfile(int fromfd, int tofd, off_t offset, size_t count) /* __attribute__((hot)) */;
 int getsock_tcp_mss(int inSock);
 int set_tcp_options(int sock, int no_delay, int mss);
 int setnonblocking(int fd, int nonblocking);
 int getsockdomain(int sock);
+int getsockifname(int sock, char *ifname, size_t len);
 
 #define NET_SOFTERROR -1
 #define NET_HARDERROR -2
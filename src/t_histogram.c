@@ -0,0 +1,74 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "histogram.h"
+
+int
+main(int argc, char **argv)
+{
+    struct histogram *h, *h2;
+    uint64_t v, q;
+
+    h = histogram_new();
+    assert(h != NULL);
+    assert(histogram_quantile(h, 0.5) == 0);
+    assert(histogram_mean(h) == 0.0);
+
+    /* Small values are exact. */
+    for (v = 1; v <= 10; ++v)
+	histogram_add(h, v);
+    assert(h->count == 10 && h->min == 1 && h->max == 10);
+    assert(histogram_mean(h) == 5.5);
+    assert(histogram_quantile(h, 0.5) == 5);
+    assert(histogram_quantile(h, 0.9) == 9);
+    assert(histogram_quantile(h, 1.0) == 10);
+
+    /* Larger values are within 1/HISTOGRAM_SUB. */
+    histogram_reset(h);
+    for (v = 1000; v < 2000; ++v)
+	histogram_add(h, v);
+    q = histogram_quantile(h, 0.5);
+    assert(q >= 1500 && q <= 1500 + 1500 / HISTOGRAM_SUB);
+    q = histogram_quantile(h, 0.99);
+    assert(q >= 1990 && q <= 1999);
+
+    /* Huge values land in the last buckets. */
+    histogram_add(h, UINT64_MAX);
+    assert(histogram_quantile(h, 1.0) == UINT64_MAX);
+
+    h2 = histogram_new();
+    histogram_add(h2, 3);
+    histogram_merge(h2, h);
+    assert(h2->count == h->count + 1 && h2->min == 3 && h2->max == UINT64_MAX);
+
+    histogram_free(h);
+    histogram_free(h2);
+    return 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <assert.h>
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_seq.h"
+
+int
+main(int argc, char **argv)
+{
+    struct iperf_stream *sp;
+    struct iperf_seq_stream *sq;
+    cJSON *j;
+    uint64_t n;
+
+    sp = (struct iperf_stream *) calloc(1, sizeof(struct iperf_stream));
+    assert(sp != NULL);
+    assert(iperf_seq_init_stream(sp) == 0);
+    sq = sp->seq;
+
+    /* In order: nothing to count. */
+    for (n = 1; n <= 10; ++n)
+	assert(iperf_seq_packet(sp, n) == 1);
+    assert(sp->packet_count == 10 && sp->cnt_error == 0);
+
+    /* 11 comes after 12 and 13: a gap, then filled, so reordered. */
+    assert(iperf_seq_packet(sp, 12) == 1);
+    assert(iperf_seq_packet(sp, 13) == 1);
+    assert(sp->cnt_error == 1);
+    assert(iperf_seq_packet(sp, 11) == 1);
+    assert(sp->cnt_error == 0 && sp->outoforder_packets == 1);
+    assert(sq->reordered == 1 && sq->displacement_max == 2);
+    assert(sq->extent->max == 2);
+
+    /* A second copy. */
+    assert(iperf_seq_packet(sp, 12) == 0);
+    assert(sq->duplicates == 1);
+
+    /* 14-19 lost, then a jump far past the window: 21-1999 lost too. */
+    assert(iperf_seq_packet(sp, 20) == 1);
+    assert(iperf_seq_packet(sp, 2000) == 1);
+    assert(sp->cnt_error == 6 + 1979);
+
+    /* 15 comes after it has left the window: late, not reordered. */
+    assert(iperf_seq_packet(sp, 15) == 0);
+    assert(sq->late == 1 && sq->reordered == 1);
+    assert(sp->cnt_error == 6 + 1979);
+
+    /* Settling the rest measures the bursts. */
+    j = iperf_seq_to_json(sp);
+    assert(j != NULL);
+    cJSON_Delete(j);
+    assert(sq->lost == 6 + 1979);
+    assert(sq->bursts == 2 && sq->burst_max == 1979);
+    assert(sq->burst_lengths[3] == 1);		/* 5-8 */
+    assert(sq->burst_lengths[SEQ_BURST_BUCKETS - 1] == 1);	/* 65+ */
+    assert(sq->extent_max == 2 && sq->displacement_mean == 2.0);
+
+    /* Once finished, nothing more is taken. */
+    assert(iperf_seq_packet(sp, 2001) == 0);
+
+    iperf_seq_free_stream(sp);
+    assert(sp->seq == NULL);
+    free(sp);
+    return 0;
+}
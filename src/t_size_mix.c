@@ -0,0 +1,98 @@
+/*
+ * iperf, Copyright (c) 2014, The Regents of the University of
+ * California, through Lawrence Berkeley National Laboratory (subject
+ * to receipt of any required approvals from the U.S. Dept. of
+ * Energy).  All rights reserved.
+ *
+ * If you have questions about your rights to use or distribute this
+ * software, please contact Berkeley Lab's Technology Transfer
+ * Department at TTD@lbl.gov.
+ *
+ * NOTICE.  This software is owned by the U.S. Department of Energy.
+ * As such, the U.S. Government has been granted for itself and others
+ * acting on its behalf a paid-up, nonexclusive, irrevocable,
+ * worldwide license in the Software to reproduce, prepare derivative
+ * works, and perform publicly and display publicly.  Beginning five
+ * (5) years after the date permission to assert copyright is obtained
+ * from the U.S. Department of Energy, and subject to any subsequent
+ * five (5) year renewals, the U.S. Government is granted for itself
+ * and others acting on its behalf a paid-up, nonexclusive,
+ * irrevocable, worldwide license in the Software to reproduce,
+ * prepare derivative works, distribute copies to the public, perform
+ * publicly and display publicly, and to permit others to do so.
+ *
+ * This code is distributed under a BSD style license, see the LICENSE
+ * file for complete information.
+ */
+#include "iperf_config.h"
+
+#include <assert.h>
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+
+#include "iperf.h"
+#include "iperf_api.h"
+#include "iperf_size_mix.h"
+
+static struct {
+    const char *spec;
+    int nclasses;		/* 0 if it must be refused */
+    int max;
+} specs[] = {
+    { "imix", 3, 1500 },
+    { "64:7,576:4,1500:1", 3, 1500 },
+    { "1000", 1, 1000 },
+    { "100,200:3", 2, 200 },
+    { "16", 1, 16 },
+    { "", 0, 0 },
+    { "15", 0, 0 },
+    { "100:0", 0, 0 },
+    { "100:", 0, 0 },
+    { "100,", 0, 0 },
+    { "100;200", 0, 0 },
+    { "100:65536,200", 0, 0 },
+    { "1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17", 0, 0 },
+};
+
+int
+main(int argc, char **argv)
+{
+    struct iperf_size_mix *mix, *mix2;
+    int count[MAX_SIZE_MIX];
+    int i, k, total;
+
+    for (k = 0; k < (int) (sizeof(specs) / sizeof(specs[0])); ++k) {
+	mix = iperf_size_mix_new(specs[k].spec);
+	if (specs[k].nclasses == 0) {
+	    assert(mix == NULL && i_errno == IESIZEMIX);
+	    continue;
+	}
+	assert(mix != NULL);
+	assert(mix->nclasses == specs[k].nclasses);
+	assert(iperf_size_mix_max(mix) == specs[k].max);
+
+	/* The table holds the weights in exact proportion... */
+	total = 0;
+	for (i = 0; i < mix->nclasses; ++i)
+	    total += mix->weight[i];
+	assert(mix->cycle % total == 0);
+	memset(count, 0, sizeof(count));
+	for (i = 0; i < mix->cycle; ++i) {
+	    assert(mix->table[i] == mix->size[mix->class_of[i]]);
+	    ++count[mix->class_of[i]];
+	}
+	for (i = 0; i < mix->nclasses; ++i)
+	    assert(count[i] == mix->weight[i] * (mix->cycle / total));
+
+	/* ... in the same order on both sides. */
+	mix2 = iperf_size_mix_new(specs[k].spec);
+	assert(mix2 != NULL && mix2->cycle == mix->cycle);
+	assert(memcmp(mix->table, mix2->table, mix->cycle * sizeof(int)) == 0);
+	iperf_size_mix_free(mix2);
+	iperf_size_mix_free(mix);
+    }
+    return 0;
+}